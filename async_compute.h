@@ -0,0 +1,625 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+#include "gpu_arena.h"
+#include "frame_loop.h"
+#include "queues.h"
+#include "cull.h"
+#include "descriptors.h"
+#include "shader_reflect.h"
+#include "shaders.h" //async_physics.comp, generated by the build (see CMakeLists.txt)
+
+/*
+async compute
+
+a physics step runs on the compute queue every frame and moves the objects: each one falls and
+bounces off the y = 0 floor (y grows downwards in this scene, see the camera's up vector). the
+step writes the spheres and models the gpu cull reads (gpu_cull.h), one pair per frame in flight,
+so the compute queue can work on frame N's objects while the graphics queue still draws N-1's:
+
+	compute:	step N-1 | step N   | step N+1
+	graphics:	         | frame N-1 (waits on step N-1) | frame N ...
+
+step N signals the timeline semaphore to N + 1 and frame N's submit waits for that value
+(frameWait). before the cpu re-records a slot it waits on the cpu side for the step that last
+used it, with vkWaitSemaphoresKHR. without timeline semaphores every slot gets a binary
+semaphore (signaled by the step, waited once by its frame) and a fence instead.
+
+on a dedicated compute family the EXCLUSIVE outputs change family twice a frame:
+
+	compute queue:	acquire from graphics | dispatch | release to graphics
+	graphics queue:	acquire from compute | cull, draw | release to compute
+
+the release/acquire pairs are the same barrier recorded on both sides, ordered by the semaphore
+(compute -> graphics) and by the frame fence the cpu waited on before the next step (graphics ->
+compute). the bodies (position, velocity) never leave the compute queue, they only come over once
+from the transfer queue, which uploads them from a staging buffer at init. with compute on the
+graphics family none of that is needed, the semaphore alone orders the two submits.
+
+overlap is measured with timestamps: each step and each frame's graphics work write a begin and an
+end stamp, read back when the slot comes around again. step N can only overlap frame N-1 (frame N
+waits for it), the overlap is how much of the step's gpu time falls inside that frame's. it assumes
+both queues' timestamps count on the same clock, which holds on every driver we've tried but isn't
+promised by the spec.
+*/
+
+#define ASYNC_PHYSICS_LOCAL_SIZE 64
+#define ASYNC_PHYSICS_DT (1.0f / 60.0f) //fixed step, whatever the frame rate
+
+typedef struct {
+	float dt;
+	uint32_t count;
+} async_physics_push;
+static_assert(async_physics_comp.reflection.push_size == sizeof(async_physics_push), "async_physics.comp's push constants aren't async_physics_push");
+
+typedef struct {
+	float pos[4]; //xyz, w radius
+	float vel[4];
+} async_body;
+
+typedef struct {
+	uint64_t begin, end; //gpu ticks, both 0 = none
+} async_interval;
+
+typedef struct {
+	VkDevice device;
+	const device_queues* queues;
+	uint32_t count;
+	bool exclusive; //compute and graphics are different families, the outputs change hands every frame
+
+	VkBuffer bodies;
+	gpu_allocation bodies_mem;
+	bool bodies_acquire; //still owned by the transfer family after the upload
+	VkBuffer spheres[FRAMES_IN_FLIGHT], models[FRAMES_IN_FLIGHT];
+	gpu_allocation spheres_mem[FRAMES_IN_FLIGHT], models_mem[FRAMES_IN_FLIGHT];
+	bool with_graphics[FRAMES_IN_FLIGHT]; //released to graphics, the next step has to acquire them back
+
+	VkCommandPool pool;
+	VkCommandBuffer cmds[FRAMES_IN_FLIGHT];
+	VkSemaphore timeline; //step n signals n + 1
+	VkSemaphore done[FRAMES_IN_FLIGHT]; //no timeline: one binary semaphore and fence per slot
+	VkFence fences[FRAMES_IN_FLIGHT];
+	uint64_t steps; //submitted so far
+
+	VkDescriptorPool desc_pool;
+	VkDescriptorSet sets[FRAMES_IN_FLIGHT];
+	shader_layout layout; //from async_physics.comp's reflection, the set layout from the layout cache
+	VkShaderModule module;
+	VkPipeline pipeline;
+
+	//begin/end stamps, 2 per slot on each queue
+	bool timestamps;
+	VkQueryPool compute_queries, graphics_queries;
+	uint64_t compute_mask, graphics_mask;
+	double tick_ms;
+	uint64_t stamped[FRAMES_IN_FLIGHT]; //step + 1 whose stamps are in the slot, 0 = none
+	async_interval last_graphics; //the previous frame's, step N overlaps frame N-1
+
+	uint64_t measured;
+	double compute_ms, graphics_ms, overlap_ms;
+	double wait_ms; //cpu blocked on a slot's previous step
+} async_compute;
+
+
+static VkBuffer asyncComputeBuffer(async_compute* ac, gpu_arena* arena, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags, gpu_allocation* mem)
+{
+	VkBufferCreateInfo buf_info = {};
+	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buf_info.pNext = nullptr;
+	buf_info.usage = usage;
+	buf_info.size = size;
+	buf_info.queueFamilyIndexCount = 0;
+	buf_info.pQueueFamilyIndices = nullptr;
+	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	buf_info.flags = 0;
+
+	VkBuffer buf;
+	VkResult res = vkCreateBuffer(ac->device, &buf_info, nullptr, &buf);
+	assert(res == VK_SUCCESS);
+	bool ok = arenaAllocBuffer(arena, buf, flags, mem);
+	assert(ok);
+	return buf;
+}
+
+static VkBufferMemoryBarrier asyncComputeBarrier(VkBuffer buffer, VkAccessFlags src_access, VkAccessFlags dst_access, uint32_t src_family, uint32_t dst_family)
+{
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = src_access;
+	barrier.dstAccessMask = dst_access;
+	barrier.srcQueueFamilyIndex = src_family;
+	barrier.dstQueueFamilyIndex = dst_family;
+	barrier.buffer = buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	return barrier;
+}
+
+//one shot on the transfer queue: staging -> bodies, released to the compute family if that's a different one
+static void asyncComputeUploadBodies(async_compute* ac, gpu_arena* arena, const void* data, VkDeviceSize size)
+{
+	const device_queues* q = ac->queues;
+	gpu_allocation staging_mem;
+	VkBuffer staging = asyncComputeBuffer(ac, arena, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+										  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging_mem);
+	memcpy(staging_mem.mapped, data, size);
+
+	VkCommandPoolCreateInfo cmd_pool_info = {};
+	cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cmd_pool_info.pNext = nullptr;
+	cmd_pool_info.queueFamilyIndex = q->transfer;
+	cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	VkCommandPool pool;
+	VkResult res = vkCreateCommandPool(ac->device, &cmd_pool_info, nullptr, &pool);
+	assert(res == VK_SUCCESS);
+
+	VkCommandBufferAllocateInfo cmd_info = {};
+	cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cmd_info.pNext = nullptr;
+	cmd_info.commandPool = pool;
+	cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmd_info.commandBufferCount = 1;
+	VkCommandBuffer cmd;
+	res = vkAllocateCommandBuffers(ac->device, &cmd_info, &cmd);
+	assert(res == VK_SUCCESS);
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.pNext = nullptr;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	begin_info.pInheritanceInfo = nullptr;
+	res = vkBeginCommandBuffer(cmd, &begin_info);
+	assert(res == VK_SUCCESS);
+
+	VkBufferCopy copy = {0, 0, size};
+	vkCmdCopyBuffer(cmd, staging, ac->bodies, 1, &copy);
+
+	ac->bodies_acquire = q->transfer != q->compute;
+	if(ac->bodies_acquire)
+	{
+		VkBufferMemoryBarrier release = asyncComputeBarrier(ac->bodies, VK_ACCESS_TRANSFER_WRITE_BIT, 0, q->transfer, q->compute);
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &release, 0, nullptr);
+	}
+	res = vkEndCommandBuffer(cmd);
+	assert(res == VK_SUCCESS);
+
+	VkFenceCreateInfo fence_info = {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_info.pNext = nullptr;
+	fence_info.flags = 0;
+	VkFence fence;
+	res = vkCreateFence(ac->device, &fence_info, nullptr, &fence);
+	assert(res == VK_SUCCESS);
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = nullptr;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &cmd;
+	res = vkQueueSubmit(q->transfer_queue, 1, &submit_info, fence);
+	assert(res == VK_SUCCESS);
+
+	//the first step is submitted after this returns, which orders its acquire after the release
+	res = vkWaitForFences(ac->device, 1, &fence, VK_TRUE, UINT64_MAX);
+	assert(res == VK_SUCCESS);
+
+	vkDestroyFence(ac->device, fence, nullptr);
+	vkFreeCommandBuffers(ac->device, pool, 1, &cmd);
+	vkDestroyCommandPool(ac->device, pool, nullptr);
+	vkDestroyBuffer(ac->device, staging, nullptr);
+	arenaFree(arena, &staging_mem);
+}
+
+static VkQueryPool asyncComputeQueries(VkDevice device)
+{
+	VkQueryPoolCreateInfo query_info = {};
+	query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	query_info.pNext = nullptr;
+	query_info.flags = 0;
+	query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	query_info.queryCount = 2 * FRAMES_IN_FLIGHT;
+	query_info.pipelineStatistics = 0;
+	VkQueryPool pool;
+	VkResult res = vkCreateQueryPool(device, &query_info, nullptr, &pool);
+	assert(res == VK_SUCCESS);
+	return pool;
+}
+
+static uint64_t asyncComputeMask(uint32_t bits)
+{
+	return bits >= 64 ? ~0ull : (1ull << bits) - 1;
+}
+
+//starting state from the bounds (at rest on the floor, thrown up at different speeds), uploaded through the transfer queue.
+//the outputs are per frame in flight, hand them to the gpu cull with gpuCullSetObjects
+void asyncComputeInit(async_compute* ac, gpu_arena* arena, const device_queues* queues, VkPhysicalDevice gpu, VkDevice device,
+					  VkPipelineCache cache, descriptor_layout_cache* layouts, const object_bounds* bounds)
+{
+	ac->device = device;
+	ac->queues = queues;
+	ac->count = bounds->count;
+	ac->exclusive = queues->compute != queues->graphics;
+	ac->steps = 0;
+	uint32_t n = ac->count ? ac->count : 1; //no zero sized buffers
+
+	std::vector<async_body> bodies(n, async_body{});
+	for(uint32_t i = 0; i < ac->count; i++)
+	{
+		for(uint32_t c = 0; c < 4; c++)
+			bodies[i].pos[c] = boundsArray(bounds, c)[i];
+		bodies[i].pos[1] = 0.0f;
+		bodies[i].vel[1] = -(2.0f + (float)(i % 7) * 0.5f);
+	}
+	ac->bodies = asyncComputeBuffer(ac, arena, n * sizeof(async_body), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+									VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &ac->bodies_mem);
+	asyncComputeUploadBodies(ac, arena, bodies.data(), n * sizeof(async_body));
+
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		ac->spheres[i] = asyncComputeBuffer(ac, arena, (VkDeviceSize)n * 4 * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+											VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &ac->spheres_mem[i]);
+		ac->models[i] = asyncComputeBuffer(ac, arena, (VkDeviceSize)n * 16 * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+										   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &ac->models_mem[i]);
+		ac->with_graphics[i] = false;
+	}
+
+	//bodies, spheres, models
+	const shader_reflection* stages[] = {&async_physics_comp.reflection};
+	shaderLayoutCreate(&ac->layout, device, layouts, stages, 1, nullptr);
+	assert(ac->layout.set_count == 1);
+
+	VkDescriptorPoolSize pool_size = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * FRAMES_IN_FLIGHT};
+	VkDescriptorPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.pNext = nullptr;
+	pool_info.maxSets = FRAMES_IN_FLIGHT;
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes = &pool_size;
+	VkResult res = vkCreateDescriptorPool(device, &pool_info, nullptr, &ac->desc_pool);
+	assert(res == VK_SUCCESS);
+
+	VkDescriptorSetLayout set_layouts[FRAMES_IN_FLIGHT];
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+		set_layouts[i] = ac->layout.sets[0];
+	VkDescriptorSetAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.pNext = nullptr;
+	alloc_info.descriptorPool = ac->desc_pool;
+	alloc_info.descriptorSetCount = FRAMES_IN_FLIGHT;
+	alloc_info.pSetLayouts = set_layouts;
+	res = vkAllocateDescriptorSets(device, &alloc_info, ac->sets);
+	assert(res == VK_SUCCESS);
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		VkDescriptorBufferInfo infos[3] = {{ac->bodies, 0, VK_WHOLE_SIZE}, {ac->spheres[i], 0, VK_WHOLE_SIZE}, {ac->models[i], 0, VK_WHOLE_SIZE}};
+		VkWriteDescriptorSet writes[3] = {};
+		for(uint32_t b = 0; b < 3; b++)
+		{
+			writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[b].pNext = nullptr;
+			writes[b].dstSet = ac->sets[i];
+			writes[b].dstBinding = b;
+			writes[b].dstArrayElement = 0;
+			writes[b].descriptorCount = 1;
+			writes[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[b].pBufferInfo = &infos[b];
+		}
+		vkUpdateDescriptorSets(device, 3, writes, 0, nullptr);
+	}
+
+	ac->module = shaderModuleCreate(device, async_physics_comp.code, async_physics_comp.size);
+
+	VkComputePipelineCreateInfo comp_info = {};
+	comp_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	comp_info.pNext = nullptr;
+	comp_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	comp_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	comp_info.stage.module = ac->module;
+	comp_info.stage.pName = "main";
+	comp_info.layout = ac->layout.layout;
+	comp_info.basePipelineIndex = -1;
+	res = vkCreateComputePipelines(device, cache, 1, &comp_info, nullptr, &ac->pipeline);
+	assert(res == VK_SUCCESS);
+
+	//one buffer per slot, re-recorded each time around (begin resets it)
+	VkCommandPoolCreateInfo cmd_pool_info = {};
+	cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cmd_pool_info.pNext = nullptr;
+	cmd_pool_info.queueFamilyIndex = queues->compute;
+	cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	res = vkCreateCommandPool(device, &cmd_pool_info, nullptr, &ac->pool);
+	assert(res == VK_SUCCESS);
+
+	VkCommandBufferAllocateInfo cmd_info = {};
+	cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cmd_info.pNext = nullptr;
+	cmd_info.commandPool = ac->pool;
+	cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmd_info.commandBufferCount = FRAMES_IN_FLIGHT;
+	res = vkAllocateCommandBuffers(device, &cmd_info, ac->cmds);
+	assert(res == VK_SUCCESS);
+
+	ac->timeline = VK_NULL_HANDLE;
+	if(queues->timeline)
+		ac->timeline = timelineCreate(device, 0);
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		ac->done[i] = VK_NULL_HANDLE;
+		ac->fences[i] = VK_NULL_HANDLE;
+		if(queues->timeline)
+			continue;
+
+		VkSemaphoreCreateInfo sem_info = {};
+		sem_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		sem_info.pNext = nullptr;
+		sem_info.flags = 0;
+		res = vkCreateSemaphore(device, &sem_info, nullptr, &ac->done[i]);
+		assert(res == VK_SUCCESS);
+
+		VkFenceCreateInfo fence_info = {};
+		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fence_info.pNext = nullptr;
+		fence_info.flags = 0;
+		res = vkCreateFence(device, &fence_info, nullptr, &ac->fences[i]);
+		assert(res == VK_SUCCESS);
+	}
+
+	//timestamps need both queues to have them
+	uint32_t compute_bits = queues->props[queues->compute].timestampValidBits;
+	uint32_t graphics_bits = queues->props[queues->graphics].timestampValidBits;
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(gpu, &props);
+	ac->timestamps = compute_bits && graphics_bits;
+	ac->compute_mask = asyncComputeMask(compute_bits);
+	ac->graphics_mask = asyncComputeMask(graphics_bits);
+	ac->tick_ms = props.limits.timestampPeriod / 1e6;
+	ac->compute_queries = ac->timestamps ? asyncComputeQueries(device) : VK_NULL_HANDLE;
+	ac->graphics_queries = ac->timestamps ? asyncComputeQueries(device) : VK_NULL_HANDLE;
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+		ac->stamped[i] = 0;
+	ac->last_graphics = async_interval{0, 0};
+
+	ac->measured = 0;
+	ac->compute_ms = 0.0;
+	ac->graphics_ms = 0.0;
+	ac->overlap_ms = 0.0;
+	ac->wait_ms = 0.0;
+}
+
+static double asyncComputeOverlap(async_compute* ac, async_interval a, async_interval b)
+{
+	uint64_t begin = a.begin > b.begin ? a.begin : b.begin;
+	uint64_t end = a.end < b.end ? a.end : b.end;
+	return end > begin ? (end - begin) * ac->tick_ms : 0.0;
+}
+
+//the slot's stamps from FRAMES_IN_FLIGHT steps ago, both its step and its frame are done
+static void asyncComputeCollect(async_compute* ac, uint32_t slot)
+{
+	if(!ac->timestamps || !ac->stamped[slot])
+		return;
+	ac->stamped[slot] = 0;
+
+	uint64_t c[2], g[2];
+	if(vkGetQueryPoolResults(ac->device, ac->compute_queries, slot * 2, 2, sizeof(c), c, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS
+	   || vkGetQueryPoolResults(ac->device, ac->graphics_queries, slot * 2, 2, sizeof(g), g, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+	{
+		ac->last_graphics = async_interval{0, 0};
+		return;
+	}
+	async_interval compute = {c[0] & ac->compute_mask, c[1] & ac->compute_mask};
+	async_interval graphics = {g[0] & ac->graphics_mask, g[1] & ac->graphics_mask};
+	if(compute.end < compute.begin || graphics.end < graphics.begin) //wrapped
+	{
+		ac->last_graphics = async_interval{0, 0};
+		return;
+	}
+
+	ac->compute_ms += (compute.end - compute.begin) * ac->tick_ms;
+	ac->graphics_ms += (graphics.end - graphics.begin) * ac->tick_ms;
+	ac->overlap_ms += asyncComputeOverlap(ac, compute, ac->last_graphics) + asyncComputeOverlap(ac, compute, graphics);
+	ac->measured++;
+	ac->last_graphics = graphics;
+}
+
+//records and submits the next step into slot (the frame's, after frameBegin: the slot's previous frame is done)
+void asyncComputeStep(async_compute* ac, uint32_t slot)
+{
+	const device_queues* q = ac->queues;
+	uint64_t step = ac->steps;
+	VkCommandBuffer cmd = ac->cmds[slot];
+
+	//the slot's last step has to be done before its command buffer and stamps are reused
+	auto start = std::chrono::high_resolution_clock::now();
+	if(step >= FRAMES_IN_FLIGHT)
+	{
+		if(q->timeline)
+			timelineWait(q, ac->device, ac->timeline, step - FRAMES_IN_FLIGHT + 1);
+		else
+		{
+			VkResult res = vkWaitForFences(ac->device, 1, &ac->fences[slot], VK_TRUE, UINT64_MAX);
+			assert(res == VK_SUCCESS);
+			res = vkResetFences(ac->device, 1, &ac->fences[slot]);
+			assert(res == VK_SUCCESS);
+		}
+	}
+	ac->wait_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	asyncComputeCollect(ac, slot);
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.pNext = nullptr;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	begin_info.pInheritanceInfo = nullptr;
+	VkResult res = vkBeginCommandBuffer(cmd, &begin_info);
+	assert(res == VK_SUCCESS);
+	if(ac->timestamps)
+		vkCmdResetQueryPool(cmd, ac->compute_queries, slot * 2, 2);
+
+	//the last step's bodies writes, plus taking over whatever another family still owns
+	VkMemoryBarrier bodies = {};
+	bodies.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	bodies.pNext = nullptr;
+	bodies.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	bodies.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	VkBufferMemoryBarrier acquires[3];
+	uint32_t acquire_count = 0;
+	if(ac->bodies_acquire)
+		acquires[acquire_count++] = asyncComputeBarrier(ac->bodies, 0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, q->transfer, q->compute);
+	if(ac->exclusive && ac->with_graphics[slot])
+	{
+		acquires[acquire_count++] = asyncComputeBarrier(ac->spheres[slot], 0, VK_ACCESS_SHADER_WRITE_BIT, q->graphics, q->compute);
+		acquires[acquire_count++] = asyncComputeBarrier(ac->models[slot], 0, VK_ACCESS_SHADER_WRITE_BIT, q->graphics, q->compute);
+	}
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &bodies, acquire_count, acquires, 0, nullptr);
+	ac->bodies_acquire = false;
+	ac->with_graphics[slot] = false;
+
+	if(ac->timestamps)
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, ac->compute_queries, slot * 2);
+	if(ac->count)
+	{
+		async_physics_push push = {ASYNC_PHYSICS_DT, ac->count};
+		uint32_t groups = (ac->count + ASYNC_PHYSICS_LOCAL_SIZE - 1) / ASYNC_PHYSICS_LOCAL_SIZE; //within the limit, it's the gpu cull's objects (gpuCullMaxObjects)
+
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, ac->pipeline);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, ac->layout.layout, 0, 1, &ac->sets[slot], 0, nullptr);
+		vkCmdPushConstants(cmd, ac->layout.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+		vkCmdDispatch(cmd, groups, 1, 1);
+	}
+	if(ac->timestamps)
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, ac->compute_queries, slot * 2 + 1);
+
+	if(ac->exclusive)
+	{
+		VkBufferMemoryBarrier releases[2] = {
+			asyncComputeBarrier(ac->spheres[slot], VK_ACCESS_SHADER_WRITE_BIT, 0, q->compute, q->graphics),
+			asyncComputeBarrier(ac->models[slot], VK_ACCESS_SHADER_WRITE_BIT, 0, q->compute, q->graphics),
+		};
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 2, releases, 0, nullptr);
+	}
+	res = vkEndCommandBuffer(cmd);
+	assert(res == VK_SUCCESS);
+
+	uint64_t signal_value = step + 1;
+	VkTimelineSemaphoreSubmitInfoKHR timeline_info = {};
+	timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	timeline_info.pNext = nullptr;
+	timeline_info.waitSemaphoreValueCount = 0;
+	timeline_info.pWaitSemaphoreValues = nullptr;
+	timeline_info.signalSemaphoreValueCount = 1;
+	timeline_info.pSignalSemaphoreValues = &signal_value;
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = q->timeline ? &timeline_info : nullptr;
+	submit_info.waitSemaphoreCount = 0;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &cmd;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores = q->timeline ? &ac->timeline : &ac->done[slot];
+	res = vkQueueSubmit(q->compute_queue, 1, &submit_info, q->timeline ? VK_NULL_HANDLE : ac->fences[slot]);
+	assert(res == VK_SUCCESS);
+	ac->steps++;
+}
+
+//first thing in the frame's command buffer, after asyncComputeStep: makes the submit wait for the step and takes its outputs over
+void asyncComputeBeginGraphics(async_compute* ac, frame_data* f, uint32_t slot)
+{
+	const device_queues* q = ac->queues;
+	VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT; //the cull reads spheres, the draws models
+	if(q->timeline)
+		frameWait(f, ac->timeline, ac->steps, stages);
+	else
+		frameWait(f, ac->done[slot], 0, stages);
+
+	if(ac->timestamps)
+		vkCmdResetQueryPool(f->cmd, ac->graphics_queries, slot * 2, 2);
+	if(ac->exclusive)
+	{
+		VkBufferMemoryBarrier acquires[2] = {
+			asyncComputeBarrier(ac->spheres[slot], 0, VK_ACCESS_SHADER_READ_BIT, q->compute, q->graphics),
+			asyncComputeBarrier(ac->models[slot], 0, VK_ACCESS_SHADER_READ_BIT, q->compute, q->graphics),
+		};
+		vkCmdPipelineBarrier(f->cmd, stages, stages, 0, 0, nullptr, 2, acquires, 0, nullptr);
+	}
+	if(ac->timestamps)
+		vkCmdWriteTimestamp(f->cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, ac->graphics_queries, slot * 2);
+}
+
+//after the render pass: hands the outputs back to the compute family
+void asyncComputeEndGraphics(async_compute* ac, VkCommandBuffer cmd, uint32_t slot)
+{
+	const device_queues* q = ac->queues;
+	if(ac->exclusive)
+	{
+		VkBufferMemoryBarrier releases[2] = {
+			asyncComputeBarrier(ac->spheres[slot], 0, 0, q->graphics, q->compute),
+			asyncComputeBarrier(ac->models[slot], 0, 0, q->graphics, q->compute),
+		};
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+							 0, 0, nullptr, 2, releases, 0, nullptr);
+		ac->with_graphics[slot] = true;
+	}
+	if(ac->timestamps)
+	{
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, ac->graphics_queries, slot * 2 + 1);
+		ac->stamped[slot] = ac->steps;
+	}
+}
+
+void asyncComputePrintStats(async_compute* ac)
+{
+	if(!ac->steps)
+		return;
+	const device_queues* q = ac->queues;
+	printf("async compute: %llu steps on family %u (%s), cpu wait %.3f ms/step\n", (unsigned long long)ac->steps, q->compute,
+		ac->exclusive ? "dedicated" : "shared with graphics", ac->wait_ms / ac->steps);
+	if(ac->measured)
+		printf("async compute: %.3f ms/step gpu, graphics %.3f ms/frame, %.3f ms/step overlapped (%.1f%%)\n",
+			ac->compute_ms / ac->measured, ac->graphics_ms / ac->measured, ac->overlap_ms / ac->measured,
+			ac->compute_ms > 0.0 ? 100.0 * ac->overlap_ms / ac->compute_ms : 0.0);
+}
+
+void asyncComputeDestroy(async_compute* ac, gpu_arena* arena)
+{
+	if(ac->timestamps)
+	{
+		vkDestroyQueryPool(ac->device, ac->compute_queries, nullptr);
+		vkDestroyQueryPool(ac->device, ac->graphics_queries, nullptr);
+	}
+	if(ac->timeline != VK_NULL_HANDLE)
+		vkDestroySemaphore(ac->device, ac->timeline, nullptr);
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		if(ac->done[i] != VK_NULL_HANDLE)
+			vkDestroySemaphore(ac->device, ac->done[i], nullptr);
+		if(ac->fences[i] != VK_NULL_HANDLE)
+			vkDestroyFence(ac->device, ac->fences[i], nullptr);
+	}
+	vkFreeCommandBuffers(ac->device, ac->pool, FRAMES_IN_FLIGHT, ac->cmds);
+	vkDestroyCommandPool(ac->device, ac->pool, nullptr);
+
+	vkDestroyPipeline(ac->device, ac->pipeline, nullptr);
+	vkDestroyShaderModule(ac->device, ac->module, nullptr);
+	shaderLayoutDestroy(&ac->layout, ac->device);
+	vkDestroyDescriptorPool(ac->device, ac->desc_pool, nullptr);
+
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		vkDestroyBuffer(ac->device, ac->models[i], nullptr);
+		arenaFree(arena, &ac->models_mem[i]);
+		vkDestroyBuffer(ac->device, ac->spheres[i], nullptr);
+		arenaFree(arena, &ac->spheres_mem[i]);
+	}
+	vkDestroyBuffer(ac->device, ac->bodies, nullptr);
+	arenaFree(arena, &ac->bodies_mem);
+}
@@ -0,0 +1,430 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+
+#include "device_profile.h"
+#include "descriptors.h"
+#include "uniform_ring.h"
+
+/*
+bindless descriptors
+
+one descriptor set for everything, bound once per command buffer: an array of storage buffers
+(binding 0) and an array of sampled images (binding 1), as big as the device allows up to
+BINDLESS_MAX_BUFFERS / BINDLESS_MAX_IMAGES, and together within the per stage resource limit.
+a resource is written into a free element when it's added and keeps that index until it's
+removed. draws don't bind anything, they push which buffer and which element of it
+(bindless_draw, 8 bytes of push constants) and the shader indexes the arrays with that.
+
+needs VK_EXT_descriptor_indexing (and VK_KHR_maintenance3, which it depends on) with
+runtimeDescriptorArray and descriptorBindingPartiallyBound, so most of the array can stay
+unwritten, plus dynamic indexing of storage buffer and sampled image arrays (core features).
+the features are read from the device profile, which only has them when the instance could
+ask (VK_KHR_get_physical_device_properties2).
+
+update after bind: when the device has it for both bindings, the set is created from an
+UPDATE_AFTER_BIND pool and resources can be added while command buffers that use the set
+are pending, so loading doesn't have to wait for frames. without it, resources have to be
+added before the set is first used (all of ours are added at startup). either way, an index
+that's removed can't be handed out again while frames that used it are in flight: removals
+go through the deletion queue's frame numbers like everything else (bindlessRemove* takes
+the frame it's safe from).
+
+without descriptor indexing (or with --descriptors classic) draws bind a set per draw
+instead (descriptors.h).
+*/
+
+#define BINDLESS_MAX_BUFFERS 1024
+#define BINDLESS_MAX_IMAGES 4096
+#define BINDLESS_OTHER_RESOURCES 8 //per stage, left out of the table's budget for attachments and other bindings
+#define BINDLESS_BUFFER_BINDING 0
+#define BINDLESS_IMAGE_BINDING 1
+
+//push constants of a draw
+typedef struct {
+	uint32_t buffer; //in the storage buffer array
+	uint32_t element; //in that buffer, in units of its stride
+} bindless_draw;
+
+typedef struct {
+	uint32_t index;
+	uint64_t frame; //reusable once this frame is done
+} bindless_free;
+
+typedef struct {
+	VkDevice device;
+	bool update_after_bind;
+	uint32_t max_buffers, max_images;
+
+	VkDescriptorSetLayout layout;
+	VkDescriptorPool pool;
+	VkDescriptorSet set;
+
+	uint32_t buffers, images; //elements ever used, the next new index
+	std::vector<bindless_free> free_buffers, free_images;
+
+	uint32_t writes; //vkUpdateDescriptorSets
+	uint32_t live_buffers, live_images;
+} bindless_table;
+
+
+//whether the device can, and if it can update after bind
+bool bindlessSupported(const device_profile* p, bool* update_after_bind)
+{
+	const VkPhysicalDeviceDescriptorIndexingFeaturesEXT& f = p->indexing;
+	*update_after_bind = false;
+	if(!profileHasExtension(p, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) || !profileHasExtension(p, VK_KHR_MAINTENANCE3_EXTENSION_NAME))
+		return false;
+	if(!f.runtimeDescriptorArray || !f.descriptorBindingPartiallyBound || !p->features.shaderStorageBufferArrayDynamicIndexing
+	   || !p->features.shaderSampledImageArrayDynamicIndexing)
+		return false;
+	*update_after_bind = f.descriptorBindingStorageBufferUpdateAfterBind && f.descriptorBindingSampledImageUpdateAfterBind;
+	return true;
+}
+
+//what device creation has to turn on. indexing goes in the device create info's pNext chain
+void bindlessEnable(bool update_after_bind, VkPhysicalDeviceDescriptorIndexingFeaturesEXT* indexing, VkPhysicalDeviceFeatures* features,
+					std::vector<const char*>& extensions)
+{
+	*indexing = {};
+	indexing->sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	indexing->pNext = nullptr;
+	indexing->runtimeDescriptorArray = VK_TRUE;
+	indexing->descriptorBindingPartiallyBound = VK_TRUE;
+	indexing->descriptorBindingStorageBufferUpdateAfterBind = update_after_bind;
+	indexing->descriptorBindingSampledImageUpdateAfterBind = update_after_bind;
+	features->shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+	features->shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+	extensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+	extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+}
+
+void bindlessInit(bindless_table* t, VkDevice device, const device_profile* p, bool update_after_bind)
+{
+	t->device = device;
+	t->update_after_bind = update_after_bind;
+	t->buffers = 0;
+	t->images = 0;
+	t->free_buffers.clear();
+	t->free_images.clear();
+	t->writes = 0;
+	t->live_buffers = 0;
+	t->live_images = 0;
+
+	//the whole array counts against the limits, written or not
+	const VkPhysicalDeviceLimits& limits = p->props.limits;
+	if(update_after_bind)
+	{
+		t->max_buffers = std::min(p->indexing_limits.maxDescriptorSetUpdateAfterBindStorageBuffers, p->indexing_limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers);
+		t->max_images = std::min(p->indexing_limits.maxDescriptorSetUpdateAfterBindSampledImages, p->indexing_limits.maxPerStageDescriptorUpdateAfterBindSampledImages);
+	}
+	else
+	{
+		t->max_buffers = std::min(limits.maxDescriptorSetStorageBuffers, limits.maxPerStageDescriptorStorageBuffers);
+		t->max_images = std::min(limits.maxDescriptorSetSampledImages, limits.maxPerStageDescriptorSampledImages);
+	}
+	t->max_buffers = std::min(t->max_buffers, (uint32_t)BINDLESS_MAX_BUFFERS);
+	t->max_images = std::min(t->max_images, (uint32_t)BINDLESS_MAX_IMAGES);
+
+	//both arrays are visible to every stage, so together they count against each stage's resource
+	//limit, next to the color attachments and whatever else a pipeline layout binds
+	uint32_t per_stage = update_after_bind ? p->indexing_limits.maxPerStageUpdateAfterBindResources : limits.maxPerStageResources;
+	uint32_t budget = per_stage > BINDLESS_OTHER_RESOURCES ? per_stage - BINDLESS_OTHER_RESOURCES : per_stage / 2;
+	if(t->max_buffers + t->max_images > budget)
+	{
+		t->max_buffers = std::min(t->max_buffers, budget / 2);
+		t->max_images = std::min(t->max_images, budget - t->max_buffers);
+	}
+	assert(t->max_buffers && t->max_images);
+
+	VkDescriptorSetLayoutBinding bindings[2] = {};
+	bindings[0].binding = BINDLESS_BUFFER_BINDING;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[0].descriptorCount = t->max_buffers;
+	bindings[0].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[0].pImmutableSamplers = nullptr;
+	bindings[1].binding = BINDLESS_IMAGE_BINDING;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	bindings[1].descriptorCount = t->max_images;
+	bindings[1].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].pImmutableSamplers = nullptr;
+
+	VkDescriptorBindingFlagsEXT flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | (update_after_bind ? VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT : 0);
+	VkDescriptorBindingFlagsEXT binding_flags[2] = {flags, flags};
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flags_info = {};
+	flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	flags_info.pNext = nullptr;
+	flags_info.bindingCount = 2;
+	flags_info.pBindingFlags = binding_flags;
+
+	//not through the layout cache, it doesn't know about binding flags and there's only ever one of these
+	VkDescriptorSetLayoutCreateInfo layout_info = {};
+	layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_info.pNext = &flags_info;
+	layout_info.flags = update_after_bind ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT : 0;
+	layout_info.bindingCount = 2;
+	layout_info.pBindings = bindings;
+	VkResult res = vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &t->layout);
+	assert(res == VK_SUCCESS);
+
+	VkDescriptorPoolSize pool_sizes[2] = {{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, t->max_buffers}, {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, t->max_images}};
+	VkDescriptorPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.pNext = nullptr;
+	pool_info.flags = update_after_bind ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT : 0;
+	pool_info.maxSets = 1;
+	pool_info.poolSizeCount = 2;
+	pool_info.pPoolSizes = pool_sizes;
+	res = vkCreateDescriptorPool(device, &pool_info, nullptr, &t->pool);
+	assert(res == VK_SUCCESS);
+
+	VkDescriptorSetAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.pNext = nullptr;
+	alloc_info.descriptorPool = t->pool;
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts = &t->layout;
+	res = vkAllocateDescriptorSets(device, &alloc_info, &t->set);
+	assert(res == VK_SUCCESS);
+
+	printf("bindless: %u buffers, %u images, %s\n", t->max_buffers, t->max_images,
+		update_after_bind ? "update after bind" : "no update after bind, resources are added before first use");
+}
+
+//completed = the newest frame the gpu is done with, UINT32_MAX if the array is full
+static uint32_t bindlessIndex(std::vector<bindless_free>& free, uint32_t* used, uint32_t max, uint64_t completed)
+{
+	for(size_t i = 0; i < free.size(); i++)
+	{
+		if(free[i].frame <= completed)
+		{
+			uint32_t index = free[i].index;
+			free.erase(free.begin() + i);
+			return index;
+		}
+	}
+	if(*used == max)
+		return UINT32_MAX;
+	return (*used)++;
+}
+
+static void bindlessWrite(bindless_table* t, uint32_t binding, uint32_t index, VkDescriptorType type, const VkDescriptorBufferInfo* buffer,
+						  const VkDescriptorImageInfo* image)
+{
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.pNext = nullptr;
+	write.dstSet = t->set;
+	write.dstBinding = binding;
+	write.dstArrayElement = index;
+	write.descriptorCount = 1;
+	write.descriptorType = type;
+	write.pBufferInfo = buffer;
+	write.pImageInfo = image;
+	vkUpdateDescriptorSets(t->device, 1, &write, 0, nullptr);
+	t->writes++;
+}
+
+//the buffer's index for bindless_draw, UINT32_MAX if the array is full
+uint32_t bindlessAddBuffer(bindless_table* t, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range, uint64_t completed_frame)
+{
+	uint32_t index = bindlessIndex(t->free_buffers, &t->buffers, t->max_buffers, completed_frame);
+	if(index == UINT32_MAX)
+		return index;
+	VkDescriptorBufferInfo info = {buffer, offset, range};
+	bindlessWrite(t, BINDLESS_BUFFER_BINDING, index, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &info, nullptr);
+	t->live_buffers++;
+	return index;
+}
+
+uint32_t bindlessAddImage(bindless_table* t, VkImageView view, VkImageLayout layout, uint64_t completed_frame)
+{
+	uint32_t index = bindlessIndex(t->free_images, &t->images, t->max_images, completed_frame);
+	if(index == UINT32_MAX)
+		return index;
+	VkDescriptorImageInfo info = {VK_NULL_HANDLE, view, layout};
+	bindlessWrite(t, BINDLESS_IMAGE_BINDING, index, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, nullptr, &info);
+	t->live_images++;
+	return index;
+}
+
+//frame = the last frame that may use it, the index comes back once that one's done
+void bindlessRemoveBuffer(bindless_table* t, uint32_t index, uint64_t frame)
+{
+	t->free_buffers.push_back({index, frame});
+	t->live_buffers--;
+}
+
+void bindlessRemoveImage(bindless_table* t, uint32_t index, uint64_t frame)
+{
+	t->free_images.push_back({index, frame});
+	t->live_images--;
+}
+
+//the push constants every pipeline layout that uses the table needs
+VkPushConstantRange bindlessPushRange()
+{
+	VkPushConstantRange range = {};
+	range.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT;
+	range.offset = 0;
+	range.size = sizeof(bindless_draw);
+	return range;
+}
+
+void bindlessBind(bindless_table* t, VkCommandBuffer cmd, VkPipelineBindPoint bind_point, VkPipelineLayout layout)
+{
+	vkCmdBindDescriptorSets(cmd, bind_point, layout, 0, 1, &t->set, 0, nullptr);
+}
+
+void bindlessDraw(VkCommandBuffer cmd, VkPipelineLayout layout, uint32_t buffer, uint32_t element)
+{
+	bindless_draw draw = {buffer, element};
+	vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(draw), &draw);
+}
+
+void bindlessPrintStats(bindless_table* t)
+{
+	printf("bindless: %u/%u buffers, %u/%u images, %u descriptor writes\n", t->live_buffers, t->max_buffers, t->live_images, t->max_images, t->writes);
+}
+
+void bindlessDestroy(bindless_table* t)
+{
+	vkDestroyDescriptorPool(t->device, t->pool, nullptr);
+	vkDestroyDescriptorSetLayout(t->device, t->layout, nullptr);
+}
+
+
+//--bench-bindless: cpu cost per draw of recording and submitting draws that each use their own
+//uniform slot, once binding a set per draw (classic, one set with a dynamic offset) and once
+//binding the table once and pushing the index (bindless). ring_index is frame 0's region of the
+//ring in the table. t = null: classic only
+void bindlessBenchmark(bindless_table* t, uniform_ring* ring, uint32_t ring_index, VkDevice device, VkQueue queue,
+					   uint32_t queue_family, uint32_t draws)
+{
+	const uint32_t iterations = 20;
+	draws = std::min(draws, ring->capacity);
+	descriptor_allocator descriptors;
+	descriptorsInit(&descriptors, device);
+
+	VkPipelineLayoutCreateInfo layout_info = {};
+	layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_info.pNext = nullptr;
+	layout_info.setLayoutCount = 1;
+	layout_info.pSetLayouts = &ring->set_layout;
+	layout_info.pushConstantRangeCount = 0;
+	layout_info.pPushConstantRanges = nullptr;
+	VkPipelineLayout classic_layout;
+	VkResult res = vkCreatePipelineLayout(device, &layout_info, nullptr, &classic_layout);
+	assert(res == VK_SUCCESS);
+
+	VkPipelineLayout bindless_layout = VK_NULL_HANDLE;
+	VkPushConstantRange push = bindlessPushRange();
+	if(t)
+	{
+		layout_info.pSetLayouts = &t->layout;
+		layout_info.pushConstantRangeCount = 1;
+		layout_info.pPushConstantRanges = &push;
+		res = vkCreatePipelineLayout(device, &layout_info, nullptr, &bindless_layout);
+		assert(res == VK_SUCCESS);
+	}
+
+	VkCommandPoolCreateInfo cmd_pool_info = {};
+	cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cmd_pool_info.pNext = nullptr;
+	cmd_pool_info.queueFamilyIndex = queue_family;
+	cmd_pool_info.flags = 0;
+	VkCommandPool pool;
+	res = vkCreateCommandPool(device, &cmd_pool_info, nullptr, &pool);
+	assert(res == VK_SUCCESS);
+
+	VkCommandBufferAllocateInfo cmd_info = {};
+	cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cmd_info.pNext = nullptr;
+	cmd_info.commandPool = pool;
+	cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmd_info.commandBufferCount = 1;
+	VkCommandBuffer cmd;
+	res = vkAllocateCommandBuffers(device, &cmd_info, &cmd);
+	assert(res == VK_SUCCESS);
+
+	VkFenceCreateInfo fence_info = {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_info.pNext = nullptr;
+	fence_info.flags = 0;
+	VkFence fence;
+	res = vkCreateFence(device, &fence_info, nullptr, &fence);
+	assert(res == VK_SUCCESS);
+
+	double record_ms[2] = {}, submit_ms[2] = {};
+	for(uint32_t mode = 0; mode < (t ? 2u : 1u); mode++)
+	{
+		for(uint32_t it = 0; it < iterations; it++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			vkResetCommandPool(device, pool, 0);
+			VkCommandBufferBeginInfo begin_info = {};
+			begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			begin_info.pNext = nullptr;
+			begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			res = vkBeginCommandBuffer(cmd, &begin_info);
+			assert(res == VK_SUCCESS);
+			if(mode == 0)
+			{
+				//what the frame loop does without bindless: one set for the frame from the per frame pools
+				descriptorsBeginFrame(&descriptors, it % FRAMES_IN_FLIGHT);
+				descriptor_write w = uniformRingDescriptor(ring);
+				VkDescriptorSet set = descriptorsGet(&descriptors, ring->set_layout, &w, 1);
+				assert(set != VK_NULL_HANDLE);
+				for(uint32_t i = 0; i < draws; i++)
+				{
+					uint32_t offset = uniformRingOffset(ring, 0, i);
+					vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, classic_layout, 0, 1, &set, 1, &offset);
+				}
+			}
+			else
+			{
+				bindlessBind(t, cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, bindless_layout);
+				for(uint32_t i = 0; i < draws; i++)
+					bindlessDraw(cmd, bindless_layout, ring_index, uniformRingElement(ring, i));
+			}
+			res = vkEndCommandBuffer(cmd);
+			assert(res == VK_SUCCESS);
+			auto recorded = std::chrono::high_resolution_clock::now();
+
+			VkSubmitInfo submit_info = {};
+			submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submit_info.pNext = nullptr;
+			submit_info.commandBufferCount = 1;
+			submit_info.pCommandBuffers = &cmd;
+			res = vkQueueSubmit(queue, 1, &submit_info, fence);
+			assert(res == VK_SUCCESS);
+			res = vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+			assert(res == VK_SUCCESS);
+			vkResetFences(device, 1, &fence);
+
+			record_ms[mode] += std::chrono::duration<double, std::milli>(recorded - start).count();
+			submit_ms[mode] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - recorded).count();
+		}
+	}
+
+	double n = (double)iterations * draws;
+	printf("descriptor modes, %u draws x %u: classic record %.1f ns/draw, submit %.3f ms", draws, iterations, record_ms[0] * 1e6 / n, submit_ms[0] / iterations);
+	if(t)
+		printf(", bindless record %.1f ns/draw, submit %.3f ms", record_ms[1] * 1e6 / n, submit_ms[1] / iterations);
+	else
+		printf(", no bindless on this device");
+	printf("\n");
+
+	vkDestroyFence(device, fence, nullptr);
+	vkDestroyCommandPool(device, pool, nullptr);
+	if(bindless_layout != VK_NULL_HANDLE)
+		vkDestroyPipelineLayout(device, bindless_layout, nullptr);
+	vkDestroyPipelineLayout(device, classic_layout, nullptr);
+	descriptorsDestroy(&descriptors);
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+
+#include "frame_loop.h"
+
+/*
+multithreaded command recording
+
+command pools aren't thread safe, so every worker thread owns one pool per frame in flight.
+a frame's work (a list of items, eg draws) gets split into one contiguous chunk per worker,
+each worker records its chunk into a SECONDARY command buffer from its own pool, and the
+main thread stitches them into the primary with vkCmdExecuteCommands (in worker order, so
+the draw order is the same as recording on one thread).
+
+pools get reset as a whole once the frame's fence has signaled (recorderBeginFrame), and
+the secondaries allocated out of them are reused instead of reallocated.
+*/
+
+//records items [first, first + count) into cmd
+typedef void (*record_fn)(VkCommandBuffer cmd, uint32_t first, uint32_t count, void* user);
+
+typedef struct {
+	std::thread thread;
+	uint32_t index;
+	VkCommandPool pools[FRAMES_IN_FLIGHT];
+	std::vector<VkCommandBuffer> cmds[FRAMES_IN_FLIGHT]; //everything allocated from pools[i]
+	uint32_t used[FRAMES_IN_FLIGHT]; //how many of cmds[i] were handed out since the last reset
+	VkCommandBuffer out; //this worker's result for the current job, null if it had nothing to do
+} record_worker;
+
+typedef struct {
+	VkDevice device;
+	std::vector<record_worker*> workers;
+
+	std::mutex lock;
+	std::condition_variable wake, done;
+	uint64_t generation; //bumped for every job, workers wait for it to change
+	uint32_t pending;
+	bool quit;
+
+	//the current job
+	uint32_t frame;
+	uint32_t count;
+	VkCommandBufferInheritanceInfo inherit;
+	record_fn fn;
+	void* user;
+} cmd_recorder;
+
+
+static VkCommandBuffer recorderGetSecondary(cmd_recorder* rec, record_worker* w, uint32_t frame)
+{
+	if(w->used[frame] == w->cmds[frame].size())
+	{
+		VkCommandBufferAllocateInfo cmd_info = {};
+		cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		cmd_info.pNext = nullptr;
+		cmd_info.commandPool = w->pools[frame];
+		cmd_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		cmd_info.commandBufferCount = 1;
+
+		VkCommandBuffer cmd;
+		VkResult res = vkAllocateCommandBuffers(rec->device, &cmd_info, &cmd);
+		assert(res == VK_SUCCESS);
+		w->cmds[frame].push_back(cmd);
+	}
+	return w->cmds[frame][w->used[frame]++];
+}
+
+static void recorderWorker(cmd_recorder* rec, record_worker* w)
+{
+	uint64_t seen = 0;
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> guard(rec->lock);
+			rec->wake.wait(guard, [&]{ return rec->quit || rec->generation != seen; });
+			if(rec->quit)
+				return;
+			seen = rec->generation;
+		}
+
+		//static split, worker i gets the i-th slice
+		uint32_t n = (uint32_t)rec->workers.size();
+		uint32_t first = (uint32_t)((uint64_t)rec->count * w->index / n);
+		uint32_t last = (uint32_t)((uint64_t)rec->count * (w->index + 1) / n);
+		w->out = VK_NULL_HANDLE;
+		if(last > first)
+		{
+			VkCommandBuffer cmd = recorderGetSecondary(rec, w, rec->frame);
+
+			VkCommandBufferBeginInfo begin_info = {};
+			begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			begin_info.pNext = nullptr;
+			begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			if(rec->inherit.renderPass != VK_NULL_HANDLE)
+				begin_info.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			begin_info.pInheritanceInfo = &rec->inherit;
+			VkResult res = vkBeginCommandBuffer(cmd, &begin_info);
+			assert(res == VK_SUCCESS);
+
+			rec->fn(cmd, first, last - first, rec->user);
+
+			res = vkEndCommandBuffer(cmd);
+			assert(res == VK_SUCCESS);
+			w->out = cmd;
+		}
+
+		std::lock_guard<std::mutex> guard(rec->lock);
+		if(--rec->pending == 0)
+			rec->done.notify_one();
+	}
+}
+
+void recorderInit(cmd_recorder* rec, VkDevice device, uint32_t queue_family, uint32_t thread_count)
+{
+	rec->device = device;
+	rec->generation = 0;
+	rec->pending = 0;
+	rec->quit = false;
+	if(thread_count == 0)
+		thread_count = 1;
+
+	for(uint32_t t = 0; t < thread_count; t++)
+	{
+		record_worker* w = new record_worker();
+		w->index = t;
+		for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+		{
+			VkCommandPoolCreateInfo cmd_pool_info = {};
+			cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			cmd_pool_info.pNext = nullptr;
+			cmd_pool_info.queueFamilyIndex = queue_family;
+			cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			VkResult res = vkCreateCommandPool(device, &cmd_pool_info, nullptr, &w->pools[i]);
+			assert(res == VK_SUCCESS);
+			w->used[i] = 0;
+		}
+		rec->workers.push_back(w);
+	}
+
+	//start them after the worker list is complete, they read its size
+	for(record_worker* w : rec->workers)
+		w->thread = std::thread(recorderWorker, rec, w);
+}
+
+//the frame's fence must have signaled (ie call after frameBegin)
+void recorderBeginFrame(cmd_recorder* rec, uint32_t frame)
+{
+	for(record_worker* w : rec->workers)
+	{
+		VkResult res = vkResetCommandPool(rec->device, w->pools[frame], 0);
+		assert(res == VK_SUCCESS);
+		w->used[frame] = 0;
+	}
+}
+
+//records count items across the workers, out gets the secondaries in order (ready for vkCmdExecuteCommands)
+void recorderRecord(cmd_recorder* rec, uint32_t frame, VkRenderPass render_pass, uint32_t subpass, VkFramebuffer framebuffer,
+					uint32_t count, record_fn fn, void* user, std::vector<VkCommandBuffer>& out)
+{
+	out.clear();
+	if(count == 0)
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(rec->lock);
+		rec->frame = frame;
+		rec->count = count;
+		rec->fn = fn;
+		rec->user = user;
+		rec->inherit = VkCommandBufferInheritanceInfo{};
+		rec->inherit.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		rec->inherit.pNext = nullptr;
+		rec->inherit.renderPass = render_pass;
+		rec->inherit.subpass = subpass;
+		rec->inherit.framebuffer = framebuffer;
+		rec->pending = (uint32_t)rec->workers.size();
+		rec->generation++;
+	}
+	rec->wake.notify_all();
+
+	std::unique_lock<std::mutex> guard(rec->lock);
+	rec->done.wait(guard, [&]{ return rec->pending == 0; });
+	for(record_worker* w : rec->workers)
+		if(w->out != VK_NULL_HANDLE)
+			out.push_back(w->out);
+}
+
+void recorderDestroy(cmd_recorder* rec)
+{
+	{
+		std::lock_guard<std::mutex> guard(rec->lock);
+		rec->quit = true;
+	}
+	rec->wake.notify_all();
+	for(record_worker* w : rec->workers)
+	{
+		w->thread.join();
+		for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+			vkDestroyCommandPool(rec->device, w->pools[i], nullptr); //frees its buffers too
+		delete w;
+	}
+	rec->workers.clear();
+}
+
+
+//--bench-record: same item count recorded with 1, 2, 4... threads
+void recorderBenchmark(VkDevice device, uint32_t queue_family, VkRenderPass render_pass, VkFramebuffer framebuffer,
+					   uint32_t count, record_fn fn, void* user)
+{
+	uint32_t max_threads = std::thread::hardware_concurrency();
+	if(max_threads == 0)
+		max_threads = 1;
+
+	const uint32_t iterations = 20;
+	double single_ms = 0.0;
+	std::vector<VkCommandBuffer> secondaries;
+	for(uint32_t threads = 1; ; threads *= 2)
+	{
+		if(threads > max_threads)
+			threads = max_threads;
+
+		cmd_recorder rec;
+		recorderInit(&rec, device, queue_family, threads);
+
+		//first pass allocates the secondaries, don't count it
+		recorderRecord(&rec, 0, render_pass, 0, framebuffer, count, fn, user, secondaries);
+
+		double total = 0.0;
+		for(uint32_t i = 0; i < iterations; i++)
+		{
+			uint32_t frame = i % FRAMES_IN_FLIGHT;
+			recorderBeginFrame(&rec, frame);
+			auto start = std::chrono::high_resolution_clock::now();
+			recorderRecord(&rec, frame, render_pass, 0, framebuffer, count, fn, user, secondaries);
+			total += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+		recorderDestroy(&rec);
+
+		double ms = total / iterations;
+		if(threads == 1)
+			single_ms = ms;
+		printf("record %u items on %u thread(s): %.3f ms (%.2fx)\n", count, threads, ms, single_ms / ms);
+
+		if(threads == max_threads)
+			break;
+	}
+}
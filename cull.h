@@ -0,0 +1,450 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CULL_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+frustum culling
+
+every object has a world space bounding sphere, stored structure of arrays (x, y, z, radius)
+so the simd kernels test 4 (SSE) or 8 (AVX2) spheres against a plane at once. the planes come
+straight out of the view projection matrix (Gribb/Hartmann), with vulkan's 0..w depth range:
+
+	left   = row3 + row0		right = row3 - row0
+	bottom = row3 + row1		top   = row3 - row1
+	near   = row2			far   = row3 - row2
+
+a sphere is visible unless it's entirely behind one of them. the output is a compact list of
+the visible object indices, in object order, which is what recording (and the MVP writes)
+iterate over.
+
+the objects get split across a pool of worker threads, one contiguous range each. every worker
+writes its survivors at the start of its own range of the output, then the ranges get slid
+together. small counts aren't worth waking anyone up for and run on the calling thread.
+*/
+
+#define CULL_MIN_CHUNK 16384 //objects per worker before it's worth using another one
+
+typedef struct {
+	uint32_t count;
+	uint32_t pitch; //floats between arrays, count rounded up to 8
+	std::vector<float> data; //x, y, z, radius
+} object_bounds;
+
+typedef struct {
+	float planes[6][4]; //xyz normal (unit length), w distance
+} frustum;
+
+//writes the indices of the visible objects in [first, first + count) to out, returns how many
+typedef uint32_t (*cull_kernel_fn)(const frustum& f, const object_bounds* b, uint32_t first, uint32_t count, uint32_t* out);
+
+typedef struct {
+	const char* name;
+	cull_kernel_fn fn;
+} cull_kernel;
+
+typedef struct {
+	std::thread thread;
+	uint32_t index;
+	uint32_t visible;
+} cull_worker;
+
+typedef struct {
+	std::vector<cull_worker*> workers;
+	cull_kernel_fn fn;
+
+	std::mutex lock;
+	std::condition_variable wake, done;
+	uint64_t generation;
+	uint32_t pending;
+	bool quit;
+
+	//the current job
+	frustum f;
+	const object_bounds* bounds;
+	uint32_t count;
+	uint32_t active; //workers taking part, the rest sit this one out
+	uint32_t* out;
+
+	//the last cullRun
+	uint32_t visible;
+	double ms;
+} cull_pool;
+
+
+void boundsInit(object_bounds* b, uint32_t count)
+{
+	b->count = count;
+	b->pitch = (count + 7) & ~7u;
+	b->data.assign((size_t)b->pitch * 4, 0.0f);
+}
+
+float* boundsArray(object_bounds* b, uint32_t k)
+{
+	return b->data.data() + (size_t)b->pitch * k;
+}
+
+const float* boundsArray(const object_bounds* b, uint32_t k)
+{
+	return b->data.data() + (size_t)b->pitch * k;
+}
+
+void boundsSet(object_bounds* b, uint32_t i, const glm::vec3& center, float radius)
+{
+	boundsArray(b, 0)[i] = center.x;
+	boundsArray(b, 1)[i] = center.y;
+	boundsArray(b, 2)[i] = center.z;
+	boundsArray(b, 3)[i] = radius;
+}
+
+frustum frustumFromMatrix(const glm::mat4& m)
+{
+	//glm is column major, row r is m[0][r] m[1][r] m[2][r] m[3][r]
+	frustum f;
+	for(uint32_t c = 0; c < 4; c++)
+	{
+		f.planes[0][c] = m[c][3] + m[c][0];
+		f.planes[1][c] = m[c][3] - m[c][0];
+		f.planes[2][c] = m[c][3] + m[c][1];
+		f.planes[3][c] = m[c][3] - m[c][1];
+		f.planes[4][c] = m[c][2];
+		f.planes[5][c] = m[c][3] - m[c][2];
+	}
+	//normalized so the plane equation gives a distance to compare the radius against
+	for(uint32_t p = 0; p < 6; p++)
+	{
+		float len = sqrtf(f.planes[p][0] * f.planes[p][0] + f.planes[p][1] * f.planes[p][1] + f.planes[p][2] * f.planes[p][2]);
+		for(uint32_t c = 0; c < 4; c++)
+			f.planes[p][c] /= len;
+	}
+	return f;
+}
+
+
+static uint32_t cullKernelScalar(const frustum& f, const object_bounds* b, uint32_t first, uint32_t count, uint32_t* out)
+{
+	const float* x = boundsArray(b, 0);
+	const float* y = boundsArray(b, 1);
+	const float* z = boundsArray(b, 2);
+	const float* r = boundsArray(b, 3);
+
+	uint32_t n = 0;
+	for(uint32_t i = first; i < first + count; i++)
+	{
+		bool visible = true;
+		for(uint32_t p = 0; p < 6; p++)
+			visible &= f.planes[p][0] * x[i] + f.planes[p][1] * y[i] + f.planes[p][2] * z[i] + f.planes[p][3] > -r[i];
+		out[n] = i;
+		n += visible; //no branch, the store is harmless if it gets overwritten
+	}
+	return n;
+}
+
+#ifdef CULL_X86
+
+__attribute__((target("sse2")))
+static uint32_t cullKernelSSE(const frustum& f, const object_bounds* b, uint32_t first, uint32_t count, uint32_t* out)
+{
+	const float* x = boundsArray(b, 0);
+	const float* y = boundsArray(b, 1);
+	const float* z = boundsArray(b, 2);
+	const float* r = boundsArray(b, 3);
+
+	__m128 pl[6][4];
+	for(uint32_t p = 0; p < 6; p++)
+		for(uint32_t c = 0; c < 4; c++)
+			pl[p][c] = _mm_set1_ps(f.planes[p][c]);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+
+	uint32_t n = 0;
+	uint32_t i = first, last = first + count;
+	for(; i + 4 <= last; i += 4)
+	{
+		__m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i), vz = _mm_loadu_ps(z + i);
+		__m128 neg_r = _mm_xor_ps(_mm_loadu_ps(r + i), sign);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for(uint32_t p = 0; p < 6; p++)
+		{
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pl[p][0], vx), _mm_mul_ps(pl[p][1], vy)),
+								  _mm_add_ps(_mm_mul_ps(pl[p][2], vz), pl[p][3]));
+			inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, neg_r));
+		}
+
+		uint32_t mask = (uint32_t)_mm_movemask_ps(inside);
+		while(mask)
+		{
+			out[n++] = i + (uint32_t)__builtin_ctz(mask);
+			mask &= mask - 1;
+		}
+	}
+	if(i < last)
+		n += cullKernelScalar(f, b, i, last - i, out + n);
+	return n;
+}
+
+__attribute__((target("avx2,fma")))
+static uint32_t cullKernelAVX2(const frustum& f, const object_bounds* b, uint32_t first, uint32_t count, uint32_t* out)
+{
+	const float* x = boundsArray(b, 0);
+	const float* y = boundsArray(b, 1);
+	const float* z = boundsArray(b, 2);
+	const float* r = boundsArray(b, 3);
+
+	__m256 pl[6][4];
+	for(uint32_t p = 0; p < 6; p++)
+		for(uint32_t c = 0; c < 4; c++)
+			pl[p][c] = _mm256_set1_ps(f.planes[p][c]);
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+
+	uint32_t n = 0;
+	uint32_t i = first, last = first + count;
+	for(; i + 8 <= last; i += 8)
+	{
+		__m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i), vz = _mm256_loadu_ps(z + i);
+		__m256 neg_r = _mm256_xor_ps(_mm256_loadu_ps(r + i), sign);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for(uint32_t p = 0; p < 6; p++)
+		{
+			__m256 d = _mm256_fmadd_ps(pl[p][0], vx, pl[p][3]);
+			d = _mm256_fmadd_ps(pl[p][1], vy, d);
+			d = _mm256_fmadd_ps(pl[p][2], vz, d);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, neg_r, _CMP_GT_OQ));
+		}
+
+		uint32_t mask = (uint32_t)_mm256_movemask_ps(inside);
+		while(mask)
+		{
+			out[n++] = i + (uint32_t)__builtin_ctz(mask);
+			mask &= mask - 1;
+		}
+	}
+	if(i < last)
+		n += cullKernelScalar(f, b, i, last - i, out + n);
+	return n;
+}
+
+#endif
+
+//every kernel this cpu can run, slowest first
+std::vector<cull_kernel> cullKernels()
+{
+	std::vector<cull_kernel> kernels;
+	kernels.push_back({"scalar", cullKernelScalar});
+#ifdef CULL_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse2"))
+		kernels.push_back({"sse2", cullKernelSSE});
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		kernels.push_back({"avx2", cullKernelAVX2});
+#endif
+	return kernels;
+}
+
+
+static void cullWorker(cull_pool* pool, cull_worker* w)
+{
+	uint64_t seen = 0;
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> guard(pool->lock);
+			pool->wake.wait(guard, [&]{ return pool->quit || pool->generation != seen; });
+			if(pool->quit)
+				return;
+			seen = pool->generation;
+		}
+
+		//static split like cmd_recorder, worker i gets the i-th range
+		w->visible = 0;
+		if(w->index < pool->active)
+		{
+			uint32_t first = (uint32_t)((uint64_t)pool->count * w->index / pool->active);
+			uint32_t last = (uint32_t)((uint64_t)pool->count * (w->index + 1) / pool->active);
+			w->visible = pool->fn(pool->f, pool->bounds, first, last - first, pool->out + first);
+		}
+
+		std::lock_guard<std::mutex> guard(pool->lock);
+		if(--pool->pending == 0)
+			pool->done.notify_one();
+	}
+}
+
+//kernel == nullptr picks the fastest one
+void cullInit(cull_pool* pool, uint32_t thread_count, cull_kernel_fn kernel = nullptr)
+{
+	pool->fn = kernel ? kernel : cullKernels().back().fn;
+	pool->generation = 0;
+	pool->pending = 0;
+	pool->quit = false;
+	pool->visible = 0;
+	pool->ms = 0.0;
+	if(thread_count == 0)
+		thread_count = 1;
+
+	for(uint32_t t = 0; t < thread_count; t++)
+	{
+		cull_worker* w = new cull_worker();
+		w->index = t;
+		w->visible = 0;
+		pool->workers.push_back(w);
+	}
+	for(cull_worker* w : pool->workers)
+		w->thread = std::thread(cullWorker, pool, w);
+}
+
+//fills visible with the indices of the objects inside the frustum of view_proj, in order
+uint32_t cullRun(cull_pool* pool, const glm::mat4& view_proj, const object_bounds* bounds, std::vector<uint32_t>& visible)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	visible.resize(bounds->count);
+
+	uint32_t workers = (uint32_t)pool->workers.size();
+	uint32_t active = (bounds->count + CULL_MIN_CHUNK - 1) / CULL_MIN_CHUNK;
+	if(active > workers)
+		active = workers;
+
+	pool->f = frustumFromMatrix(view_proj);
+	pool->bounds = bounds;
+	pool->count = bounds->count;
+	pool->out = visible.data();
+
+	uint32_t n = 0;
+	if(active <= 1)
+	{
+		pool->active = 1;
+		n = bounds->count ? pool->fn(pool->f, bounds, 0, bounds->count, pool->out) : 0;
+	}
+	else
+	{
+		{
+			std::lock_guard<std::mutex> guard(pool->lock);
+			pool->active = active;
+			pool->pending = workers;
+			pool->generation++;
+		}
+		pool->wake.notify_all();
+
+		std::unique_lock<std::mutex> guard(pool->lock);
+		pool->done.wait(guard, [&]{ return pool->pending == 0; });
+
+		//slide every worker's survivors down against the previous worker's
+		for(uint32_t i = 0; i < active; i++)
+		{
+			uint32_t first = (uint32_t)((uint64_t)pool->count * i / active);
+			uint32_t v = pool->workers[i]->visible;
+			if(first != n)
+				memmove(pool->out + n, pool->out + first, v * sizeof(uint32_t));
+			n += v;
+		}
+	}
+
+	visible.resize(n);
+	pool->visible = n;
+	pool->ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return n;
+}
+
+void cullDestroy(cull_pool* pool)
+{
+	{
+		std::lock_guard<std::mutex> guard(pool->lock);
+		pool->quit = true;
+	}
+	pool->wake.notify_all();
+	for(cull_worker* w : pool->workers)
+	{
+		w->thread.join();
+		delete w;
+	}
+	pool->workers.clear();
+}
+
+
+//--bench-cull: every kernel on 1, 2, 4... threads, 10k to max_count spheres scattered around the camera
+void cullBenchmark(uint32_t max_count)
+{
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(-5, 3, -10), glm::vec3(0, 0, 0), glm::vec3(0, -1, 0));
+	glm::mat4 clip = glm::mat4(1.0f, 0.0f, 0.0f, 0.0f,
+							   0.0f,-1.0f, 0.0f, 0.0f,
+							   0.0f, 0.0f, 0.5f, 0.0f,
+							   0.0f, 0.0f, 0.5f, 1.0f);
+	glm::mat4 view_proj = clip * projection * view;
+
+	uint32_t max_threads = std::thread::hardware_concurrency();
+	if(max_threads == 0)
+		max_threads = 1;
+	std::vector<cull_kernel> kernels = cullKernels();
+
+	for(uint32_t count = 10000; count <= max_count; count *= 10)
+	{
+		object_bounds bounds;
+		boundsInit(&bounds, count);
+		uint32_t seed = 1;
+		for(uint32_t i = 0; i < count; i++)
+		{
+			float p[3];
+			for(uint32_t c = 0; c < 3; c++)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				p[c] = (float)(seed >> 8) / (float)(1 << 24) * 200.0f - 100.0f;
+			}
+			boundsSet(&bounds, i, glm::vec3(p[0], p[1], p[2]), 1.0f);
+		}
+
+		std::vector<uint32_t> reference, visible;
+		cull_pool ref;
+		cullInit(&ref, 1, kernels[0].fn);
+		cullRun(&ref, view_proj, &bounds, reference);
+		cullDestroy(&ref);
+		printf("cull %u objects, %zu visible:\n", count, reference.size());
+
+		uint32_t iterations = count >= 1000000 ? 10 : 50;
+		for(const cull_kernel& k : kernels)
+		{
+			double single_ms = 0.0;
+			for(uint32_t threads = 1; ; threads *= 2)
+			{
+				if(threads > max_threads)
+					threads = max_threads;
+
+				cull_pool pool;
+				cullInit(&pool, threads, k.fn);
+				double ms = 0.0;
+				for(uint32_t it = 0; it < iterations; it++)
+				{
+					cullRun(&pool, view_proj, &bounds, visible);
+					ms += pool.ms;
+				}
+				cullDestroy(&pool);
+				ms /= iterations;
+				if(threads == 1)
+					single_ms = ms;
+
+				printf("    %-6s %2u thread(s): %.3f ms (%.2f ns/object, %.2fx)%s\n", k.name, threads, ms, ms * 1e6 / count,
+					single_ms / ms, visible == reference ? "" : " MISMATCH");
+
+				if(threads == max_threads)
+					break;
+			}
+		}
+	}
+}
@@ -0,0 +1,440 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+/*
+validation and debug messages
+
+the messenger callback runs inside whatever api call the layer is complaining about, on
+whatever thread made it, so anything slow in there (a flushed write to the console) stalls
+that call. modes:
+
+	async	(default) the callback copies the message into a slot of a fixed ring and returns.
+			a background thread drains the ring, deduplicates and prints
+	sync	the callback prints and flushes itself, the way it used to. every message costs
+			a write to the console inside the api call, but nothing is lost or late on a crash
+	off		release: no validation layers, no VK_EXT_debug_utils, no messenger at all
+
+the ring is a bounded lock-free queue with many producers (the layer calls us from any thread)
+and one consumer. producers claim a slot with a compare and swap on the write position, fill it
+and publish it through the slot's sequence number; the drain thread only ever looks at the
+slot after the last one it took. when it's full the message is dropped and counted, the
+callback never waits. there's no wakeup on push (that'd be a syscall in the callback), the
+drain thread sleeps DEBUG_IDLE_US when it finds the ring empty.
+
+the drain thread keeps a record per message id (messageIdNumber, or a hash of the text for
+messages without one) and prints the first DEBUG_BURST messages of an id per DEBUG_WINDOW_MS,
+the rest are counted and summed up once the window is over ("N more like this"). the severity
+filter is applied twice: the messenger only asks for severities at or above the minimum, and
+the callback checks again (one compare) so the benchmark and a future runtime switch see it
+too. at shutdown the ids are listed with their counts, most frequent first.
+*/
+
+#define DEBUG_RING 1024 //slots, power of two
+#define DEBUG_MESSAGE_TEXT 1024 //longer messages get cut
+#define DEBUG_ID_NAME 64
+#define DEBUG_BURST 3 //messages of one id printed per window
+#define DEBUG_WINDOW_MS 1000
+#define DEBUG_IDLE_US 1000 //drain thread's sleep on an empty ring
+
+typedef enum {
+	DEBUG_MESSAGES_OFF,
+	DEBUG_MESSAGES_SYNC,
+	DEBUG_MESSAGES_ASYNC,
+} debug_mode;
+
+static const char* debug_mode_names[] = {"off", "sync", "async"};
+
+typedef struct {
+	std::atomic<uint64_t> sequence; //== position: free for the producer claiming it, position + 1: ready to drain
+	VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+	VkDebugUtilsMessageTypeFlagsEXT type;
+	int32_t id;
+	char id_name[DEBUG_ID_NAME];
+	char text[DEBUG_MESSAGE_TEXT];
+} debug_slot;
+
+//drain thread only
+typedef struct {
+	char id_name[DEBUG_ID_NAME];
+	VkDebugUtilsMessageSeverityFlagBitsEXT severity; //the worst seen
+	uint64_t count;
+	uint64_t window_start_ms;
+	uint32_t window_count; //messages seen in the current window
+} debug_id;
+
+typedef struct {
+	debug_mode mode;
+	VkDebugUtilsMessageSeverityFlagBitsEXT min_severity;
+	FILE* out;
+	std::chrono::steady_clock::time_point start;
+
+	debug_slot* slots; //DEBUG_RING
+	std::atomic<uint64_t> write; //next position a producer claims
+	uint64_t read; //drain thread only
+
+	std::atomic<bool> running;
+	std::thread thread;
+
+	//callback side
+	std::atomic<uint64_t> received, filtered, dropped, truncated;
+	//drain side, sync mode counts in here too (from the callback, so they'd be racy with several threads)
+	std::atomic<uint64_t> printed, suppressed, errors, warnings;
+	std::unordered_map<uint64_t, debug_id> ids;
+} debug_messages;
+
+
+static uint64_t debugMessageKey(int32_t id, const char* text)
+{
+	if(id != 0)
+		return (uint64_t)(uint32_t)id;
+	//no id (loader and driver messages): fnv-1a of the text, high bit set so it can't collide with an id
+	uint64_t h = 1469598103934665603ull;
+	for(const char* c = text; *c; c++)
+		h = (h ^ (uint8_t)*c) * 1099511628211ull;
+	return h | (1ull << 63);
+}
+
+static const char* debugSeverityName(VkDebugUtilsMessageSeverityFlagBitsEXT severity)
+{
+	if(severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+		return "error";
+	if(severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+		return "warning";
+	if(severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT)
+		return "info";
+	return "verbose";
+}
+
+static uint64_t debugNowMs(debug_messages* d)
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - d->start).count();
+}
+
+static void debugCount(debug_messages* d, VkDebugUtilsMessageSeverityFlagBitsEXT severity)
+{
+	if(severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+		d->errors.fetch_add(1, std::memory_order_relaxed);
+	else if(severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+		d->warnings.fetch_add(1, std::memory_order_relaxed);
+}
+
+//dedup and rate limit one message, prints it (and what its id had suppressed) if it's let through
+static void debugHandle(debug_messages* d, const debug_slot* m)
+{
+	debugCount(d, m->severity);
+	uint64_t now = debugNowMs(d);
+	auto found = d->ids.find(debugMessageKey(m->id, m->text));
+	if(found == d->ids.end())
+	{
+		debug_id fresh = {};
+		memcpy(fresh.id_name, m->id_name, sizeof(fresh.id_name));
+		fresh.severity = m->severity;
+		fresh.window_start_ms = now;
+		found = d->ids.emplace(debugMessageKey(m->id, m->text), fresh).first;
+	}
+	debug_id& id = found->second;
+	id.count++;
+	if(m->severity > id.severity)
+		id.severity = m->severity;
+
+	if(now - id.window_start_ms >= DEBUG_WINDOW_MS)
+	{
+		if(id.window_count > DEBUG_BURST)
+			fprintf(d->out, "validation layer: %u more %s in the last %.1f s\n", id.window_count - DEBUG_BURST,
+				id.id_name[0] ? id.id_name : "like the one above", (now - id.window_start_ms) / 1000.0);
+		id.window_start_ms = now;
+		id.window_count = 0;
+	}
+	id.window_count++;
+	if(id.window_count > DEBUG_BURST)
+	{
+		d->suppressed.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	fprintf(d->out, "validation layer (%s): %s\n", debugSeverityName(m->severity), m->text);
+	d->printed.fetch_add(1, std::memory_order_relaxed);
+}
+
+static bool debugPop(debug_messages* d, debug_slot** m)
+{
+	debug_slot* slot = &d->slots[d->read & (DEBUG_RING - 1)];
+	if(slot->sequence.load(std::memory_order_acquire) != d->read + 1)
+		return false;
+	*m = slot;
+	return true;
+}
+
+static void debugRelease(debug_messages* d, debug_slot* slot)
+{
+	//free for the producer that comes around the ring next time
+	slot->sequence.store(d->read + DEBUG_RING, std::memory_order_release);
+	d->read++;
+}
+
+static void debugDrain(debug_messages* d)
+{
+	for(;;)
+	{
+		bool running = d->running.load(std::memory_order_acquire);
+		uint32_t drained = 0;
+		debug_slot* m;
+		while(debugPop(d, &m))
+		{
+			debugHandle(d, m);
+			debugRelease(d, m);
+			drained++;
+		}
+		if(drained)
+			fflush(d->out);
+		else if(!running)
+			break; //stopped, and everything pushed before that has been drained
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(DEBUG_IDLE_US));
+	}
+}
+
+//false if the ring is full
+static bool debugPush(debug_messages* d, VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type,
+					  const VkDebugUtilsMessengerCallbackDataEXT* data)
+{
+	uint64_t pos = d->write.load(std::memory_order_relaxed);
+	debug_slot* slot;
+	for(;;)
+	{
+		slot = &d->slots[pos & (DEBUG_RING - 1)];
+		int64_t diff = (int64_t)(slot->sequence.load(std::memory_order_acquire) - pos);
+		if(diff == 0)
+		{
+			if(d->write.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if(diff < 0)
+			return false; //the drain thread hasn't taken this slot's last message yet
+		else
+			pos = d->write.load(std::memory_order_relaxed); //someone else claimed it
+	}
+
+	slot->severity = severity;
+	slot->type = type;
+	slot->id = data->messageIdNumber;
+	const char* name = data->pMessageIdName ? data->pMessageIdName : "";
+	size_t name_len = std::min(strlen(name), (size_t)DEBUG_ID_NAME - 1);
+	memcpy(slot->id_name, name, name_len);
+	slot->id_name[name_len] = '\0';
+	size_t len = strlen(data->pMessage);
+	if(len >= DEBUG_MESSAGE_TEXT)
+	{
+		len = DEBUG_MESSAGE_TEXT - 1;
+		d->truncated.fetch_add(1, std::memory_order_relaxed);
+	}
+	memcpy(slot->text, data->pMessage, len);
+	slot->text[len] = '\0';
+	slot->sequence.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+static VKAPI_ATTR VkBool32 VKAPI_CALL debugMessagesCallback(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type,
+															const VkDebugUtilsMessengerCallbackDataEXT* data, void* user)
+{
+	debug_messages* d = (debug_messages*)user;
+	d->received.fetch_add(1, std::memory_order_relaxed);
+	if(severity < d->min_severity)
+	{
+		d->filtered.fetch_add(1, std::memory_order_relaxed);
+		return VK_FALSE;
+	}
+
+	if(d->mode == DEBUG_MESSAGES_SYNC)
+	{
+		debugCount(d, severity);
+		fprintf(d->out, "validation layer (%s): %s\n", debugSeverityName(severity), data->pMessage);
+		fflush(d->out);
+		d->printed.fetch_add(1, std::memory_order_relaxed);
+	}
+	else if(!debugPush(d, severity, type, data))
+		d->dropped.fetch_add(1, std::memory_order_relaxed);
+	return VK_FALSE; //never abort the call
+}
+
+//returns false (and picks async) for an unknown mode name. out is where messages go (stderr)
+bool debugMessagesInit(debug_messages* d, const char* mode, VkDebugUtilsMessageSeverityFlagBitsEXT min_severity, FILE* out)
+{
+	bool known = false;
+	d->mode = DEBUG_MESSAGES_ASYNC;
+	for(uint32_t i = 0; i < sizeof(debug_mode_names) / sizeof(debug_mode_names[0]); i++)
+	{
+		if(strcmp(mode, debug_mode_names[i]) == 0)
+		{
+			d->mode = (debug_mode)i;
+			known = true;
+		}
+	}
+	d->min_severity = min_severity;
+	d->out = out;
+	d->start = std::chrono::steady_clock::now();
+	d->slots = nullptr;
+	d->write = 0;
+	d->read = 0;
+	d->received = 0;
+	d->filtered = 0;
+	d->dropped = 0;
+	d->truncated = 0;
+	d->printed = 0;
+	d->suppressed = 0;
+	d->errors = 0;
+	d->warnings = 0;
+	d->ids.clear();
+
+	d->running = d->mode == DEBUG_MESSAGES_ASYNC;
+	if(d->mode == DEBUG_MESSAGES_ASYNC)
+	{
+		d->slots = new debug_slot[DEBUG_RING];
+		for(uint64_t i = 0; i < DEBUG_RING; i++)
+			d->slots[i].sequence.store(i, std::memory_order_relaxed);
+		d->thread = std::thread(debugDrain, d);
+	}
+	return known;
+}
+
+//for vkCreateInstance's pNext (messages from instance creation itself) and the messenger after it
+void debugMessagesCreateInfo(debug_messages* d, VkDebugUtilsMessengerCreateInfoEXT* info)
+{
+	info->sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+	info->pNext = nullptr;
+	info->flags = 0;
+	//the severity bits go up in value with severity, everything from the minimum up
+	info->messageSeverity = 0;
+	VkDebugUtilsMessageSeverityFlagBitsEXT severities[4] = {VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT, VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT,
+															VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT, VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT};
+	for(VkDebugUtilsMessageSeverityFlagBitsEXT s : severities)
+	{
+		if(s >= d->min_severity)
+			info->messageSeverity |= s;
+	}
+	info->messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+	info->pfnUserCallback = debugMessagesCallback;
+	info->pUserData = d;
+}
+
+void debugMessagesPrintStats(debug_messages* d)
+{
+	if(d->mode == DEBUG_MESSAGES_OFF)
+		return;
+	printf("debug messages (%s): %llu received, %llu below %s, %llu printed, %llu suppressed, %llu dropped (ring full), %llu cut; %llu errors, %llu warnings\n",
+		debug_mode_names[d->mode], (unsigned long long)d->received.load(), (unsigned long long)d->filtered.load(), debugSeverityName(d->min_severity),
+		(unsigned long long)d->printed.load(), (unsigned long long)d->suppressed.load(), (unsigned long long)d->dropped.load(),
+		(unsigned long long)d->truncated.load(), (unsigned long long)d->errors.load(), (unsigned long long)d->warnings.load());
+}
+
+//the drain thread empties the ring before it exits
+static void debugStop(debug_messages* d)
+{
+	if(d->mode != DEBUG_MESSAGES_ASYNC)
+		return;
+	d->running.store(false, std::memory_order_release);
+	d->thread.join();
+	delete[] d->slots;
+	d->slots = nullptr;
+}
+
+//after the messenger is gone (nothing pushes any more): drains what's left and lists the ids, print the stats after
+void debugMessagesDestroy(debug_messages* d)
+{
+	debugStop(d);
+	if(d->mode == DEBUG_MESSAGES_ASYNC)
+	{
+		std::vector<const debug_id*> ids;
+		for(const auto& it : d->ids)
+			ids.push_back(&it.second);
+		std::sort(ids.begin(), ids.end(), [](const debug_id* a, const debug_id* b) { return a->count > b->count; });
+		for(const debug_id* id : ids)
+			printf("    %8llu  %-7s %s\n", (unsigned long long)id->count, debugSeverityName(id->severity), id->id_name[0] ? id->id_name : "(no id)");
+	}
+}
+
+//--bench-debug: cost of a message inside the api call that caused it, per mode. the callback is called
+//directly with made up validation errors (16 ids), output goes to /dev/null so the console isn't measured.
+//off runs the same loop with nothing to call, what's left is the loop and the clock reads
+void debugMessagesBenchmark(uint32_t count)
+{
+	FILE* sink = fopen("/dev/null", "w");
+	if(!sink)
+	{
+		printf("bench debug: no /dev/null\n");
+		return;
+	}
+
+	char texts[16][256];
+	char names[16][32];
+	for(uint32_t i = 0; i < 16; i++)
+	{
+		snprintf(names[i], sizeof(names[i]), "VUID-vkCmdDraw-bench-%02u", i);
+		snprintf(texts[i], sizeof(texts[i]), "Validation Error: [ %s ] Object 0: handle = 0x%llx, type = VK_OBJECT_TYPE_COMMAND_BUFFER; | "
+			"MessageID = 0x%08x | made up message for the benchmark, about as long as a real one", names[i], 0x55d0c0000000ull + i, 0x1000u + i);
+	}
+
+	uint32_t max_threads = std::thread::hardware_concurrency();
+	if(max_threads == 0)
+		max_threads = 1;
+	printf("debug messages, %u per thread:\n", count);
+
+	//mode, severity of the messages (the minimum is warning), producer threads
+	struct { const char* label; const char* mode; VkDebugUtilsMessageSeverityFlagBitsEXT severity; uint32_t threads; } runs[] = {
+		{"off", "off", VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, 1},
+		{"sync", "sync", VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, 1},
+		{"async", "async", VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, 1},
+		{"async, 4 threads", "async", VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, std::min(4u, max_threads)},
+		{"async, filtered", "async", VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT, 1},
+	};
+	for(const auto& run : runs)
+	{
+		debug_messages d;
+		debugMessagesInit(&d, run.mode, VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT, sink);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> producers;
+		std::vector<double> worst(run.threads, 0.0);
+		for(uint32_t t = 0; t < run.threads; t++)
+		{
+			producers.emplace_back([&, t]() {
+				for(uint32_t i = 0; i < count; i++)
+				{
+					VkDebugUtilsMessengerCallbackDataEXT data = {};
+					data.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CALLBACK_DATA_EXT;
+					data.pMessageIdName = names[i % 16];
+					data.messageIdNumber = (int32_t)(0x1000 + i % 16);
+					data.pMessage = texts[i % 16];
+					auto call = std::chrono::high_resolution_clock::now();
+					if(d.mode != DEBUG_MESSAGES_OFF) //no messenger, the layer never calls us
+						debugMessagesCallback(run.severity, VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT, &data, &d);
+					worst[t] = std::max(worst[t], std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - call).count());
+				}
+			});
+		}
+		for(std::thread& t : producers)
+			t.join();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		//what's still in the ring once the producers are done
+		auto drain_start = std::chrono::high_resolution_clock::now();
+		debugStop(&d);
+		double drain_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - drain_start).count();
+
+		//per thread: every thread made count calls in that time
+		printf("    %-17s %8.1f ns/message in the call (worst %.1f us), %llu printed, %llu suppressed, %llu dropped, %.3f ms to drain after\n",
+			run.label, ms * 1e6 / count, *std::max_element(worst.begin(), worst.end()), (unsigned long long)d.printed.load(),
+			(unsigned long long)d.suppressed.load(), (unsigned long long)d.dropped.load(), drain_ms);
+	}
+	fclose(sink);
+}
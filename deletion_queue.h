@@ -0,0 +1,249 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+
+#include "gpu_arena.h"
+
+/*
+deferred destruction
+
+a buffer/image/pipeline can't be destroyed while a submission that uses it is still in
+flight, and vkDeviceWaitIdle just to free something stalls the cpu and drains the gpu.
+instead the object goes in here, tagged with a value that says when its last use is done,
+and gets destroyed once that value is known to be reached:
+
+	frames:		tag = frame number of the frame being recorded (loop.frame_number)
+				completed = framesCompleted(loop), right after frameBegin
+	timeline:	tag = the value the last submission using it signals
+				completed = vkGetSemaphoreCounterValue() + 1
+
+anything with tag < completed is destroyed. tags only ever go up, so the queue is in
+order and collecting stops at the first entry that isn't done yet. destroys happen in
+one batch per collect, in the order they were queued (a view before its image, etc).
+
+the pending counters are what's being held past its lifetime: memory the arena can't hand
+out again yet. if they keep growing, something retires faster than frames complete.
+*/
+
+typedef enum {
+	DELETE_BUFFER,
+	DELETE_IMAGE,
+	DELETE_IMAGE_VIEW,
+	DELETE_FRAMEBUFFER,
+	DELETE_PIPELINE,
+	DELETE_PIPELINE_LAYOUT,
+	DELETE_DESCRIPTOR_POOL,
+	DELETE_SHADER_MODULE,
+	DELETE_SWAPCHAIN,
+	DELETE_ALLOCATION, //memory only, the resource is already gone
+} deletion_type;
+
+typedef struct {
+	uint64_t value;
+	deletion_type type;
+	union {
+		VkBuffer buffer;
+		VkImage image;
+		VkImageView view;
+		VkFramebuffer framebuffer;
+		VkPipeline pipeline;
+		VkPipelineLayout pipeline_layout;
+		VkDescriptorPool descriptor_pool;
+		VkShaderModule shader_module;
+		VkSwapchainKHR swapchain;
+	};
+	bool has_mem;
+	gpu_allocation mem; //freed back to the arena with the object
+} deletion_entry;
+
+typedef struct {
+	VkDevice device;
+	gpu_arena* arena;
+	std::deque<deletion_entry> entries;
+
+	uint64_t pending_objects, pending_bytes, peak_bytes;
+	uint64_t destroyed_objects, destroyed_bytes;
+	double collect_ms;
+} deletion_queue;
+
+
+void deletionQueueInit(deletion_queue* q, VkDevice device, gpu_arena* arena)
+{
+	q->device = device;
+	q->arena = arena;
+	q->entries.clear();
+	q->pending_objects = 0;
+	q->pending_bytes = 0;
+	q->peak_bytes = 0;
+	q->destroyed_objects = 0;
+	q->destroyed_bytes = 0;
+	q->collect_ms = 0.0;
+}
+
+static void deletionQueuePush(deletion_queue* q, deletion_entry& e, gpu_allocation* mem)
+{
+	assert(q->entries.empty() || q->entries.back().value <= e.value);
+	e.has_mem = mem != nullptr;
+	if(mem)
+	{
+		e.mem = *mem;
+		q->pending_bytes += mem->size;
+		if(q->pending_bytes > q->peak_bytes)
+			q->peak_bytes = q->pending_bytes;
+	}
+	q->pending_objects++;
+	q->entries.push_back(e);
+}
+
+//mem (optional) is freed to the arena along with the object
+void deleteBuffer(deletion_queue* q, uint64_t value, VkBuffer buffer, gpu_allocation* mem)
+{
+	deletion_entry e;
+	e.value = value;
+	e.type = DELETE_BUFFER;
+	e.buffer = buffer;
+	deletionQueuePush(q, e, mem);
+}
+
+void deleteImage(deletion_queue* q, uint64_t value, VkImage image, gpu_allocation* mem)
+{
+	deletion_entry e;
+	e.value = value;
+	e.type = DELETE_IMAGE;
+	e.image = image;
+	deletionQueuePush(q, e, mem);
+}
+
+void deleteImageView(deletion_queue* q, uint64_t value, VkImageView view)
+{
+	deletion_entry e;
+	e.value = value;
+	e.type = DELETE_IMAGE_VIEW;
+	e.view = view;
+	deletionQueuePush(q, e, nullptr);
+}
+
+void deleteFramebuffer(deletion_queue* q, uint64_t value, VkFramebuffer framebuffer)
+{
+	deletion_entry e;
+	e.value = value;
+	e.type = DELETE_FRAMEBUFFER;
+	e.framebuffer = framebuffer;
+	deletionQueuePush(q, e, nullptr);
+}
+
+void deletePipeline(deletion_queue* q, uint64_t value, VkPipeline pipeline)
+{
+	deletion_entry e;
+	e.value = value;
+	e.type = DELETE_PIPELINE;
+	e.pipeline = pipeline;
+	deletionQueuePush(q, e, nullptr);
+}
+
+void deletePipelineLayout(deletion_queue* q, uint64_t value, VkPipelineLayout layout)
+{
+	deletion_entry e;
+	e.value = value;
+	e.type = DELETE_PIPELINE_LAYOUT;
+	e.pipeline_layout = layout;
+	deletionQueuePush(q, e, nullptr);
+}
+
+void deleteDescriptorPool(deletion_queue* q, uint64_t value, VkDescriptorPool pool)
+{
+	deletion_entry e;
+	e.value = value;
+	e.type = DELETE_DESCRIPTOR_POOL;
+	e.descriptor_pool = pool;
+	deletionQueuePush(q, e, nullptr);
+}
+
+void deleteShaderModule(deletion_queue* q, uint64_t value, VkShaderModule module)
+{
+	deletion_entry e;
+	e.value = value;
+	e.type = DELETE_SHADER_MODULE;
+	e.shader_module = module;
+	deletionQueuePush(q, e, nullptr);
+}
+
+void deleteSwapchain(deletion_queue* q, uint64_t value, VkSwapchainKHR swapchain)
+{
+	deletion_entry e;
+	e.value = value;
+	e.type = DELETE_SWAPCHAIN;
+	e.swapchain = swapchain;
+	deletionQueuePush(q, e, nullptr);
+}
+
+void deleteAllocation(deletion_queue* q, uint64_t value, gpu_allocation* mem)
+{
+	deletion_entry e;
+	e.value = value;
+	e.type = DELETE_ALLOCATION;
+	e.buffer = VK_NULL_HANDLE;
+	deletionQueuePush(q, e, mem);
+}
+
+static void deletionQueueDestroy(deletion_queue* q, deletion_entry& e)
+{
+	switch(e.type)
+	{
+	case DELETE_BUFFER: vkDestroyBuffer(q->device, e.buffer, nullptr); break;
+	case DELETE_IMAGE: vkDestroyImage(q->device, e.image, nullptr); break;
+	case DELETE_IMAGE_VIEW: vkDestroyImageView(q->device, e.view, nullptr); break;
+	case DELETE_FRAMEBUFFER: vkDestroyFramebuffer(q->device, e.framebuffer, nullptr); break;
+	case DELETE_PIPELINE: vkDestroyPipeline(q->device, e.pipeline, nullptr); break;
+	case DELETE_PIPELINE_LAYOUT: vkDestroyPipelineLayout(q->device, e.pipeline_layout, nullptr); break;
+	case DELETE_DESCRIPTOR_POOL: vkDestroyDescriptorPool(q->device, e.descriptor_pool, nullptr); break;
+	case DELETE_SHADER_MODULE: vkDestroyShaderModule(q->device, e.shader_module, nullptr); break;
+	case DELETE_SWAPCHAIN: vkDestroySwapchainKHR(q->device, e.swapchain, nullptr); break;
+	case DELETE_ALLOCATION: break;
+	}
+
+	if(e.has_mem)
+	{
+		q->pending_bytes -= e.mem.size;
+		q->destroyed_bytes += e.mem.size;
+		arenaFree(q->arena, &e.mem);
+	}
+	q->pending_objects--;
+	q->destroyed_objects++;
+}
+
+//destroys everything tagged below completed, returns how many objects went
+uint32_t deletionQueueCollect(deletion_queue* q, uint64_t completed)
+{
+	if(q->entries.empty() || q->entries.front().value >= completed)
+		return 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	uint32_t count = 0;
+	while(!q->entries.empty() && q->entries.front().value < completed)
+	{
+		deletionQueueDestroy(q, q->entries.front());
+		q->entries.pop_front();
+		count++;
+	}
+	q->collect_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return count;
+}
+
+//everything, regardless of tag. the device has to be idle
+void deletionQueueFlush(deletion_queue* q)
+{
+	deletionQueueCollect(q, UINT64_MAX);
+}
+
+void deletionQueuePrintStats(deletion_queue* q)
+{
+	printf("deletions: %llu pending (%.1f KB), peak %.1f KB, %llu destroyed (%.1f KB), collect %.3f ms total\n",
+		(unsigned long long)q->pending_objects, q->pending_bytes / 1024.0, q->peak_bytes / 1024.0,
+		(unsigned long long)q->destroyed_objects, q->destroyed_bytes / 1024.0, q->collect_ms);
+}
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+#include "gpu_arena.h"
+#include "device_profile.h"
+#include "render_pass.h"
+
+/*
+depth format and tiling
+
+depth buffers are only ever OPTIMAL: that's the tiled (and usually compressed) layout the depth
+hardware wants, LINEAR depth is the slow path on every gpu that has it at all. LINEAR is only
+tried when nothing has OPTIMAL, which no real driver does.
+
+the format is the cheapest one that's precise enough. cost is bytes per pixel, every depth
+test reads them and every passing fragment writes them:
+	D16_UNORM			2	16 bits
+	D32_SFLOAT			4	a float near 1.0 only has 24 bits of mantissa, so with our depth (near
+						at 0, far at 1) it's about as precise as D24. reversed z would make it much
+						better, we don't do that
+	D24_UNORM_S8_UINT	4	24 bits, plus stencil (AMD doesn't have it as an attachment)
+	D32_SFLOAT_S8_UINT	5	stencil fallback, often stored as two planes
+precision need: with a perspective projection, one step of depth at view distance z is
+	dz = step * (far - near) * z^2 / (far * near)
+so the error is worst at the far plane. a format is precise enough if that's within the
+tolerance (world units) the caller gives. nothing precise enough = the most precise one there is.
+
+a depth buffer that nothing reads after the render pass (ATTACHMENT_TRANSIENT in render_pass.h) only has to
+exist inside the pass. it's created TRANSIENT_ATTACHMENT, and given LAZILY_ALLOCATED memory where
+the device has it: tile based gpus keep such an attachment in tile memory and never back it with
+real memory. desktop gpus don't have lazy memory and ignore the hint, it costs nothing there.
+*/
+
+typedef struct {
+	bool stencil;
+	attachment_lifetime lifetime; //in the render pass, TRANSIENT gets transient usage and lazy memory
+	float near_plane, far_plane; //of the projection
+	float tolerance; //largest depth step acceptable at the far plane, world units
+} depth_need;
+
+typedef struct {
+	VkFormat format;
+	VkImageTiling tiling;
+	VkImageUsageFlags usage;
+	VkMemoryPropertyFlags memory; //DEVICE_LOCAL, | LAZILY_ALLOCATED if the device has it
+	VkImageAspectFlags aspect; //for the view
+	uint32_t bytes; //per pixel
+	float error; //depth step at the far plane, world units
+} depth_config;
+
+typedef struct {
+	VkFormat format;
+	const char* name;
+	uint32_t bytes;
+	uint32_t bits; //effective, for precision
+	bool stencil;
+} depth_candidate;
+
+//cheapest first, so the first one that is precise enough wins
+static const depth_candidate depth_candidates[] = {
+	{VK_FORMAT_D16_UNORM, "D16", 2, 16, false},
+	{VK_FORMAT_D32_SFLOAT, "D32", 4, 24, false},
+	{VK_FORMAT_D24_UNORM_S8_UINT, "D24S8", 4, 24, true},
+	{VK_FORMAT_D32_SFLOAT_S8_UINT, "D32S8", 5, 24, true},
+};
+
+const char* depthFormatName(VkFormat format)
+{
+	for(const depth_candidate& c : depth_candidates)
+	{
+		if(c.format == format)
+			return c.name;
+	}
+	return "other";
+}
+
+float depthError(uint32_t bits, float near_plane, float far_plane)
+{
+	double step = 1.0 / (double)(1ull << bits);
+	return (float)(step * (far_plane - near_plane) * far_plane * far_plane / (far_plane * near_plane));
+}
+
+//false if the device has no depth attachment format at all
+bool depthSelect(const device_profile* p, VkPhysicalDevice gpu, const depth_need* need, depth_config* out)
+{
+	const depth_candidate* best = nullptr; //precise enough and cheapest
+	const depth_candidate* fallback = nullptr; //most precise
+	VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL;
+	for(VkImageTiling t : {VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_TILING_LINEAR})
+	{
+		for(const depth_candidate& c : depth_candidates)
+		{
+			if(need->stencil && !c.stencil)
+				continue;
+			VkFormatProperties props = profileFormat(p, gpu, c.format);
+			VkFormatFeatureFlags features = t == VK_IMAGE_TILING_OPTIMAL ? props.optimalTilingFeatures : props.linearTilingFeatures;
+			if(!(features & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT))
+				continue;
+			if(!best && depthError(c.bits, need->near_plane, need->far_plane) <= need->tolerance)
+				best = &c;
+			if(!fallback || c.bits > fallback->bits)
+				fallback = &c;
+		}
+		if(fallback)
+		{
+			tiling = t;
+			break;
+		}
+	}
+	if(!fallback)
+		return false;
+	if(!best)
+		best = fallback;
+
+	out->format = best->format;
+	out->tiling = tiling;
+	out->usage = attachmentUsage(need->lifetime, true);
+	out->memory = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	if(attachmentTransient(need->lifetime))
+	{
+		for(uint32_t i = 0; i < p->memory.memoryTypeCount; i++)
+		{
+			if(p->memory.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+				out->memory |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+		}
+	}
+	out->aspect = VK_IMAGE_ASPECT_DEPTH_BIT | (best->stencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+	out->bytes = best->bytes;
+	out->error = depthError(best->bits, need->near_plane, need->far_plane);
+
+	printf("depth: %s %s, %u bytes/pixel, %.4f units at the far plane (%.4f wanted)%s%s\n", best->name,
+		tiling == VK_IMAGE_TILING_OPTIMAL ? "optimal" : "LINEAR (no optimal depth format)", out->bytes, out->error, need->tolerance,
+		attachmentTransient(need->lifetime) ? ", transient" : "", out->memory & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT ? ", lazily allocated" : "");
+	return true;
+}
+
+//memory for an image made from config, lazily allocated if it's asked for and the image can have it
+bool depthAlloc(gpu_arena* arena, VkImage image, const depth_config* config, gpu_allocation* out)
+{
+	if(config->memory & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT && arenaAllocImage(arena, image, config->tiling, config->memory, out))
+		return true;
+	return arenaAllocImage(arena, image, config->tiling, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, out);
+}
+
+
+//--bench-depth: every depth format the device has, cleared and stored over and over in a 1920x1080
+//render pass and timed on the gpu, next to the same pass with DONT_CARE store. that's the write
+//bandwidth each format costs per pass, reads (the depth test) scale the same way
+void depthBenchmark(gpu_arena* arena, const device_profile* p, VkPhysicalDevice gpu, VkDevice device, VkQueue queue, uint32_t queue_family,
+					uint32_t passes)
+{
+	VkExtent2D extent = {1920, 1080};
+	if(p->families[queue_family].timestampValidBits == 0)
+	{
+		printf("bench depth: no timestamps on the graphics queue\n");
+		return;
+	}
+
+	VkCommandPoolCreateInfo cmd_pool_info = {};
+	cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cmd_pool_info.pNext = nullptr;
+	cmd_pool_info.queueFamilyIndex = queue_family;
+	cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	VkCommandPool pool;
+	VkResult res = vkCreateCommandPool(device, &cmd_pool_info, nullptr, &pool);
+	assert(res == VK_SUCCESS);
+
+	VkCommandBufferAllocateInfo cmd_info = {};
+	cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cmd_info.pNext = nullptr;
+	cmd_info.commandPool = pool;
+	cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmd_info.commandBufferCount = 1;
+	VkCommandBuffer cmd;
+	res = vkAllocateCommandBuffers(device, &cmd_info, &cmd);
+	assert(res == VK_SUCCESS);
+
+	VkQueryPoolCreateInfo query_info = {};
+	query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	query_info.pNext = nullptr;
+	query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	query_info.queryCount = 2;
+	VkQueryPool queries;
+	res = vkCreateQueryPool(device, &query_info, nullptr, &queries);
+	assert(res == VK_SUCCESS);
+
+	VkFenceCreateInfo fence_info = {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_info.pNext = nullptr;
+	fence_info.flags = 0;
+	VkFence fence;
+	res = vkCreateFence(device, &fence_info, nullptr, &fence);
+	assert(res == VK_SUCCESS);
+
+	uint64_t mask = p->families[queue_family].timestampValidBits >= 64 ? ~0ull : (1ull << p->families[queue_family].timestampValidBits) - 1;
+	printf("depth bandwidth, %ux%u, %u passes:\n", extent.width, extent.height, passes);
+	for(const depth_candidate& c : depth_candidates)
+	{
+		if(!(profileFormat(p, gpu, c.format).optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT))
+		{
+			printf("    %-6s not supported\n", c.name);
+			continue;
+		}
+
+		VkImageCreateInfo image_info = {};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.pNext = nullptr;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.format = c.format;
+		image_info.extent = {extent.width, extent.height, 1};
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = 1;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		image_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		VkImage image;
+		res = vkCreateImage(device, &image_info, nullptr, &image);
+		assert(res == VK_SUCCESS);
+		gpu_allocation mem;
+		bool ok = arenaAllocImage(arena, image, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mem);
+		assert(ok);
+
+		VkImageViewCreateInfo view_info = {};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.pNext = nullptr;
+		view_info.image = image;
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = c.format;
+		view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | (c.stencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+		view_info.subresourceRange.levelCount = 1;
+		view_info.subresourceRange.layerCount = 1;
+		VkImageView view;
+		res = vkCreateImageView(device, &view_info, nullptr, &view);
+		assert(res == VK_SUCCESS);
+
+		double ms[2];
+		for(uint32_t store = 0; store < 2; store++)
+		{
+			VkAttachmentDescription attachment = {};
+			attachment.format = c.format;
+			attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachment.storeOp = store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.stencilLoadOp = c.stencil ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachment.stencilStoreOp = attachment.storeOp;
+			attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+			VkAttachmentReference depth_ref = {0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+			VkSubpassDescription subpass = {};
+			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+			subpass.pDepthStencilAttachment = &depth_ref;
+
+			//one pass after the other writes the same image
+			VkSubpassDependency dependency = {};
+			dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+			dependency.dstSubpass = 0;
+			dependency.srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+			dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+
+			VkRenderPassCreateInfo rp_info = {};
+			rp_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+			rp_info.pNext = nullptr;
+			rp_info.attachmentCount = 1;
+			rp_info.pAttachments = &attachment;
+			rp_info.subpassCount = 1;
+			rp_info.pSubpasses = &subpass;
+			rp_info.dependencyCount = 1;
+			rp_info.pDependencies = &dependency;
+			VkRenderPass render_pass;
+			res = vkCreateRenderPass(device, &rp_info, nullptr, &render_pass);
+			assert(res == VK_SUCCESS);
+
+			VkFramebufferCreateInfo fb_info = {};
+			fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			fb_info.pNext = nullptr;
+			fb_info.renderPass = render_pass;
+			fb_info.attachmentCount = 1;
+			fb_info.pAttachments = &view;
+			fb_info.width = extent.width;
+			fb_info.height = extent.height;
+			fb_info.layers = 1;
+			VkFramebuffer framebuffer;
+			res = vkCreateFramebuffer(device, &fb_info, nullptr, &framebuffer);
+			assert(res == VK_SUCCESS);
+
+			VkCommandBufferBeginInfo begin_info = {};
+			begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			begin_info.pNext = nullptr;
+			begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			res = vkBeginCommandBuffer(cmd, &begin_info);
+			assert(res == VK_SUCCESS);
+			vkCmdResetQueryPool(cmd, queries, 0, 2);
+			vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries, 0);
+			for(uint32_t i = 0; i < passes; i++)
+			{
+				VkClearValue clear;
+				clear.depthStencil = {(i & 1) ? 1.0f : 0.5f, 0};
+				VkRenderPassBeginInfo rp_begin = {};
+				rp_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+				rp_begin.pNext = nullptr;
+				rp_begin.renderPass = render_pass;
+				rp_begin.framebuffer = framebuffer;
+				rp_begin.renderArea.extent = extent;
+				rp_begin.clearValueCount = 1;
+				rp_begin.pClearValues = &clear;
+				vkCmdBeginRenderPass(cmd, &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
+				vkCmdEndRenderPass(cmd);
+			}
+			vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries, 1);
+			res = vkEndCommandBuffer(cmd);
+			assert(res == VK_SUCCESS);
+
+			VkSubmitInfo submit_info = {};
+			submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submit_info.pNext = nullptr;
+			submit_info.commandBufferCount = 1;
+			submit_info.pCommandBuffers = &cmd;
+			res = vkQueueSubmit(queue, 1, &submit_info, fence);
+			assert(res == VK_SUCCESS);
+			res = vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+			assert(res == VK_SUCCESS);
+			vkResetFences(device, 1, &fence);
+
+			uint64_t ticks[2] = {};
+			res = vkGetQueryPoolResults(device, queries, 0, 2, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+			assert(res == VK_SUCCESS);
+			ms[store] = (double)((ticks[1] - ticks[0]) & mask) * p->props.limits.timestampPeriod / 1e6;
+
+			vkDestroyFramebuffer(device, framebuffer, nullptr);
+			vkDestroyRenderPass(device, render_pass, nullptr);
+		}
+
+		double bytes = (double)extent.width * extent.height * c.bytes * passes;
+		printf("    %-6s %u bytes/pixel: store %.3f ms/pass (%.1f GB/s), dont care %.3f ms/pass, %.4f units at 100 (near 0.1)\n", c.name, c.bytes,
+			ms[1] / passes, ms[1] > 0.0 ? bytes / (ms[1] * 1e6) : 0.0, ms[0] / passes, depthError(c.bits, 0.1f, 100.0f));
+
+		vkDestroyImageView(device, view, nullptr);
+		vkDestroyImage(device, image, nullptr);
+		arenaFree(arena, &mem);
+	}
+
+	vkDestroyFence(device, fence, nullptr);
+	vkDestroyQueryPool(device, queries, nullptr);
+	vkDestroyCommandPool(device, pool, nullptr);
+}
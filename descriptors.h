@@ -0,0 +1,515 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+
+#include "gpu_arena.h"
+#include "frame_loop.h"
+
+/*
+descriptor sets
+
+three parts, for three different costs:
+
+layouts: identical layouts are created once. a layout is keyed by an fnv-1a hash of its flags
+and bindings (sorted by binding, immutable samplers aren't supported), every entry keeps the
+bindings to compare against so a collision can't hand out the wrong layout. the cache owns
+them, they live until shutdown.
+
+per frame pools: every frame in flight has its own list of pools. sets are never freed one by
+one, the frame's pools are reset wholesale (vkResetDescriptorPool) once its fence has signaled
+(descriptorsBeginFrame), which is one call per pool instead of one per set and no
+FREE_DESCRIPTOR_SET bookkeeping in the driver. the sets taken from a pool are counted and once
+it's handed out all it was made for the next one is used (running a pool dry isn't a defined
+error on 1.0 without maintenance1, the driver may do anything), and if there is none a new one is created with twice the sets of the last (up to
+DESCRIPTOR_POOL_MAX_SETS). pools are kept across frames, so after the first few frames
+there are no more vkCreateDescriptorPool calls.
+
+written sets: most draws ask for a set with the same resources as some draw before them. a
+set is keyed by its layout and what's written to it (buffer, offset, range, image view,
+sampler, layout per binding), the same key in the same frame gets the same set back without
+allocating or vkUpdateDescriptorSets. the cache is per frame, it goes when the pools are reset.
+
+counters: allocations, cache hits, vkUpdateDescriptorSets calls and new pools, per frame and
+in total, printed with the other stats.
+
+none of it is thread safe: sets are gotten on the thread that begins the frame, before the
+secondaries are recorded.
+*/
+
+#define DESCRIPTOR_POOL_SETS 64 //sets in a frame's first pool
+#define DESCRIPTOR_POOL_MAX_SETS 4096
+
+//descriptors per set a pool has room for, by type
+typedef struct {
+	VkDescriptorType type;
+	float per_set;
+} descriptor_pool_ratio;
+
+static const descriptor_pool_ratio descriptor_pool_ratios[] = {
+	{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f},
+	{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f},
+	{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f},
+	{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.0f},
+	{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f},
+	{VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 2.0f},
+	{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f},
+	{VK_DESCRIPTOR_TYPE_SAMPLER, 1.0f},
+};
+
+typedef struct {
+	VkDescriptorSetLayoutCreateFlags flags;
+	std::vector<VkDescriptorSetLayoutBinding> bindings; //sorted by binding
+	VkDescriptorSetLayout layout;
+} descriptor_layout_entry;
+
+typedef struct {
+	VkDevice device;
+	std::unordered_map<uint64_t, std::vector<descriptor_layout_entry>> layouts;
+	uint32_t created, hits;
+} descriptor_layout_cache;
+
+//one binding of a set, buffer for the buffer types, image for the rest
+typedef struct {
+	uint32_t binding;
+	VkDescriptorType type;
+	VkDescriptorBufferInfo buffer;
+	VkDescriptorImageInfo image;
+} descriptor_write;
+
+typedef struct {
+	VkDescriptorSetLayout layout;
+	std::vector<descriptor_write> writes;
+	VkDescriptorSet set;
+} descriptor_cached_set;
+
+typedef struct {
+	std::vector<VkDescriptorPool> pools;
+	std::vector<uint32_t> pool_sets; //sets each pool was made for
+	uint32_t current; //pools before this one are full
+	uint32_t used; //sets allocated from pools[current]
+	std::unordered_map<uint64_t, std::vector<descriptor_cached_set>> sets;
+} descriptor_frame;
+
+typedef struct {
+	uint32_t allocations; //vkAllocateDescriptorSets
+	uint32_t hits; //handed out from the written set cache
+	uint32_t updates; //vkUpdateDescriptorSets
+	uint32_t pools_created;
+} descriptor_counters;
+
+typedef struct {
+	VkDevice device;
+	descriptor_layout_cache layouts;
+	descriptor_frame frames[FRAMES_IN_FLIGHT];
+	uint32_t slot; //frame being recorded
+
+	descriptor_counters frame; //since the last descriptorsBeginFrame
+	descriptor_counters total;
+	uint32_t max_allocations; //in one frame
+	uint64_t frames_counted;
+	uint32_t pool_resets;
+} descriptor_allocator;
+
+
+static uint64_t descriptorHash(uint64_t hash, uint64_t value)
+{
+	return (hash ^ value) * 1099511628211ull;
+}
+
+void descriptorLayoutCacheInit(descriptor_layout_cache* c, VkDevice device)
+{
+	c->device = device;
+	c->layouts.clear();
+	c->created = 0;
+	c->hits = 0;
+}
+
+//the layout for these bindings, created the first time. owned by the cache
+VkDescriptorSetLayout descriptorLayoutGet(descriptor_layout_cache* c, const VkDescriptorSetLayoutBinding* bindings, uint32_t count,
+										  VkDescriptorSetLayoutCreateFlags flags = 0)
+{
+	std::vector<VkDescriptorSetLayoutBinding> sorted(bindings, bindings + count);
+	std::sort(sorted.begin(), sorted.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+
+	uint64_t hash = descriptorHash(14695981039346656037ull, flags);
+	for(const VkDescriptorSetLayoutBinding& b : sorted)
+	{
+		assert(b.pImmutableSamplers == nullptr);
+		hash = descriptorHash(hash, b.binding);
+		hash = descriptorHash(hash, b.descriptorType);
+		hash = descriptorHash(hash, b.descriptorCount);
+		hash = descriptorHash(hash, b.stageFlags);
+	}
+
+	std::vector<descriptor_layout_entry>& entries = c->layouts[hash];
+	for(const descriptor_layout_entry& e : entries)
+	{
+		if(e.flags != flags || e.bindings.size() != sorted.size())
+			continue;
+		bool same = true;
+		for(uint32_t i = 0; i < sorted.size() && same; i++)
+		{
+			same = e.bindings[i].binding == sorted[i].binding && e.bindings[i].descriptorType == sorted[i].descriptorType
+				&& e.bindings[i].descriptorCount == sorted[i].descriptorCount && e.bindings[i].stageFlags == sorted[i].stageFlags;
+		}
+		if(same)
+		{
+			c->hits++;
+			return e.layout;
+		}
+	}
+
+	VkDescriptorSetLayoutCreateInfo layout_info = {};
+	layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_info.pNext = nullptr;
+	layout_info.flags = flags;
+	layout_info.bindingCount = count;
+	layout_info.pBindings = sorted.data();
+
+	descriptor_layout_entry e;
+	e.flags = flags;
+	e.bindings = sorted;
+	VkResult res = vkCreateDescriptorSetLayout(c->device, &layout_info, nullptr, &e.layout);
+	assert(res == VK_SUCCESS);
+	entries.push_back(e);
+	c->created++;
+	return e.layout;
+}
+
+void descriptorLayoutCacheDestroy(descriptor_layout_cache* c)
+{
+	for(auto& it : c->layouts)
+	{
+		for(descriptor_layout_entry& e : it.second)
+			vkDestroyDescriptorSetLayout(c->device, e.layout, nullptr);
+	}
+	c->layouts.clear();
+}
+
+
+void descriptorsInit(descriptor_allocator* d, VkDevice device)
+{
+	d->device = device;
+	descriptorLayoutCacheInit(&d->layouts, device);
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		d->frames[i].pools.clear();
+		d->frames[i].pool_sets.clear();
+		d->frames[i].current = 0;
+		d->frames[i].used = 0;
+		d->frames[i].sets.clear();
+	}
+	d->slot = 0;
+	d->frame = {};
+	d->total = {};
+	d->max_allocations = 0;
+	d->frames_counted = 0;
+	d->pool_resets = 0;
+}
+
+static VkDescriptorPool descriptorsNewPool(descriptor_allocator* d, uint32_t sets)
+{
+	VkDescriptorPoolSize sizes[sizeof(descriptor_pool_ratios) / sizeof(descriptor_pool_ratios[0])];
+	uint32_t count = 0;
+	for(const descriptor_pool_ratio& r : descriptor_pool_ratios)
+		sizes[count++] = {r.type, (uint32_t)(r.per_set * sets)};
+
+	VkDescriptorPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.pNext = nullptr;
+	pool_info.flags = 0; //no FREE_DESCRIPTOR_SET, sets only go when the whole pool is reset
+	pool_info.maxSets = sets;
+	pool_info.poolSizeCount = count;
+	pool_info.pPoolSizes = sizes;
+	VkDescriptorPool pool;
+	VkResult res = vkCreateDescriptorPool(d->device, &pool_info, nullptr, &pool);
+	assert(res == VK_SUCCESS);
+	d->frame.pools_created++;
+	d->total.pools_created++;
+	return pool;
+}
+
+//the frame's fence has signaled: everything it allocated goes back at once
+void descriptorsBeginFrame(descriptor_allocator* d, uint32_t slot)
+{
+	if(d->frames_counted)
+		d->max_allocations = std::max(d->max_allocations, d->frame.allocations);
+	d->frames_counted++;
+	d->frame = {};
+	d->slot = slot;
+
+	descriptor_frame* f = &d->frames[slot];
+	for(uint32_t i = 0; i < f->pools.size() && i <= f->current; i++)
+	{
+		vkResetDescriptorPool(d->device, f->pools[i], 0);
+		d->pool_resets++;
+	}
+	f->current = 0;
+	f->used = 0;
+	f->sets.clear();
+}
+
+//a new set from this frame's pools, valid until the frame slot comes around again. the layout
+//can't have more descriptors of a type than descriptor_pool_ratios gives a set, then counting
+//sets is enough to never overflow a pool. VK_NULL_HANDLE if the driver is out of memory
+VkDescriptorSet descriptorsAllocate(descriptor_allocator* d, VkDescriptorSetLayout layout)
+{
+	descriptor_frame* f = &d->frames[d->slot];
+	if(f->current < f->pools.size() && f->used == f->pool_sets[f->current])
+	{
+		f->current++;
+		f->used = 0;
+	}
+	if(f->current == f->pools.size())
+	{
+		uint32_t sets = f->pool_sets.empty() ? DESCRIPTOR_POOL_SETS : std::min(f->pool_sets.back() * 2, (uint32_t)DESCRIPTOR_POOL_MAX_SETS);
+		f->pools.push_back(descriptorsNewPool(d, sets));
+		f->pool_sets.push_back(sets);
+	}
+
+	VkDescriptorSetAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.pNext = nullptr;
+	alloc_info.descriptorPool = f->pools[f->current];
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts = &layout;
+	VkDescriptorSet set;
+	if(vkAllocateDescriptorSets(d->device, &alloc_info, &set) != VK_SUCCESS)
+		return VK_NULL_HANDLE;
+	f->used++;
+	d->frame.allocations++;
+	d->total.allocations++;
+	return set;
+}
+
+static bool descriptorSameWrite(const descriptor_write& a, const descriptor_write& b)
+{
+	return a.binding == b.binding && a.type == b.type && a.buffer.buffer == b.buffer.buffer && a.buffer.offset == b.buffer.offset && a.buffer.range == b.buffer.range
+		&& a.image.sampler == b.image.sampler && a.image.imageView == b.image.imageView && a.image.imageLayout == b.image.imageLayout;
+}
+
+static bool descriptorIsBuffer(VkDescriptorType type)
+{
+	return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+		|| type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+}
+
+//a set of layout with writes in it: the one from earlier this frame if the same was asked for, a new one otherwise.
+//VK_NULL_HANDLE if a new one couldn't be allocated
+VkDescriptorSet descriptorsGet(descriptor_allocator* d, VkDescriptorSetLayout layout, const descriptor_write* writes, uint32_t count)
+{
+	uint64_t hash = descriptorHash(14695981039346656037ull, (uint64_t)(uintptr_t)layout);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		hash = descriptorHash(hash, writes[i].binding);
+		hash = descriptorHash(hash, writes[i].type);
+		hash = descriptorHash(hash, (uint64_t)(uintptr_t)writes[i].buffer.buffer);
+		hash = descriptorHash(hash, writes[i].buffer.offset);
+		hash = descriptorHash(hash, writes[i].buffer.range);
+		hash = descriptorHash(hash, (uint64_t)(uintptr_t)writes[i].image.sampler);
+		hash = descriptorHash(hash, (uint64_t)(uintptr_t)writes[i].image.imageView);
+		hash = descriptorHash(hash, writes[i].image.imageLayout);
+	}
+
+	std::vector<descriptor_cached_set>& cached = d->frames[d->slot].sets[hash];
+	for(const descriptor_cached_set& c : cached)
+	{
+		if(c.layout != layout || c.writes.size() != count)
+			continue;
+		bool same = true;
+		for(uint32_t i = 0; i < count && same; i++)
+			same = descriptorSameWrite(c.writes[i], writes[i]);
+		if(same)
+		{
+			d->frame.hits++;
+			d->total.hits++;
+			return c.set;
+		}
+	}
+
+	VkDescriptorSet set = descriptorsAllocate(d, layout);
+	if(set == VK_NULL_HANDLE)
+		return VK_NULL_HANDLE;
+	std::vector<VkWriteDescriptorSet> vk_writes(count);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		vk_writes[i] = {};
+		vk_writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		vk_writes[i].pNext = nullptr;
+		vk_writes[i].dstSet = set;
+		vk_writes[i].dstBinding = writes[i].binding;
+		vk_writes[i].dstArrayElement = 0;
+		vk_writes[i].descriptorCount = 1;
+		vk_writes[i].descriptorType = writes[i].type;
+		if(descriptorIsBuffer(writes[i].type))
+			vk_writes[i].pBufferInfo = &writes[i].buffer;
+		else
+			vk_writes[i].pImageInfo = &writes[i].image;
+	}
+	vkUpdateDescriptorSets(d->device, count, vk_writes.data(), 0, nullptr);
+	d->frame.updates++;
+	d->total.updates++;
+
+	descriptor_cached_set c;
+	c.layout = layout;
+	c.writes.assign(writes, writes + count);
+	c.set = set;
+	cached.push_back(c);
+	return set;
+}
+
+//a buffer binding for descriptorsGet
+descriptor_write descriptorBuffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	descriptor_write w = {};
+	w.binding = binding;
+	w.type = type;
+	w.buffer = {buffer, offset, range};
+	return w;
+}
+
+void descriptorsPrintStats(descriptor_allocator* d)
+{
+	uint32_t pools = 0;
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+		pools += (uint32_t)d->frames[i].pools.size();
+	uint64_t asked = d->total.allocations + d->total.hits;
+	printf("descriptors: %.2f allocations/frame (max %u), %.1f%% of %llu sets from the cache, %.2f updates/frame, %u pools (%u created), %u resets, %u layouts (%u cache hits)\n",
+		d->frames_counted ? (double)d->total.allocations / d->frames_counted : 0.0, std::max(d->max_allocations, d->frame.allocations),
+		asked ? 100.0 * d->total.hits / asked : 0.0, (unsigned long long)asked, d->frames_counted ? (double)d->total.updates / d->frames_counted : 0.0, pools,
+		d->total.pools_created, d->pool_resets, d->layouts.created, d->layouts.hits);
+}
+
+void descriptorsDestroy(descriptor_allocator* d)
+{
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		for(VkDescriptorPool pool : d->frames[i].pools)
+			vkDestroyDescriptorPool(d->device, pool, nullptr);
+		d->frames[i].pools.clear();
+		d->frames[i].sets.clear();
+	}
+	descriptorLayoutCacheDestroy(&d->layouts);
+}
+
+
+//--bench-descriptors: cpu cost per draw of getting a set with one uniform buffer in it, three ways:
+//allocate + write + free per draw from a FREE_DESCRIPTOR_SET pool (the naive way), allocate + write
+//from the per frame pools, and descriptorsGet with the draws spread over 16 different buffer ranges
+void descriptorsBenchmark(gpu_arena* arena, VkDevice device, uint32_t draws)
+{
+	const uint32_t frames = 16, ranges = 16;
+	VkBufferCreateInfo buf_info = {};
+	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buf_info.pNext = nullptr;
+	buf_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	buf_info.size = 256 * ranges;
+	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	VkBuffer buffer;
+	VkResult res = vkCreateBuffer(device, &buf_info, nullptr, &buffer);
+	assert(res == VK_SUCCESS);
+	gpu_allocation mem;
+	bool ok = arenaAllocBuffer(arena, buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mem);
+	assert(ok);
+
+	descriptor_allocator d;
+	descriptorsInit(&d, device);
+	VkDescriptorSetLayoutBinding binding = {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr};
+	VkDescriptorSetLayout layout = descriptorLayoutGet(&d.layouts, &binding, 1);
+
+	//naive
+	VkDescriptorPoolSize pool_size = {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1};
+	VkDescriptorPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.pNext = nullptr;
+	pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	pool_info.maxSets = 1;
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes = &pool_size;
+	VkDescriptorPool pool;
+	res = vkCreateDescriptorPool(device, &pool_info, nullptr, &pool);
+	assert(res == VK_SUCCESS);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for(uint32_t f = 0; f < frames; f++)
+	{
+		for(uint32_t i = 0; i < draws; i++)
+		{
+			VkDescriptorSetAllocateInfo alloc_info = {};
+			alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			alloc_info.pNext = nullptr;
+			alloc_info.descriptorPool = pool;
+			alloc_info.descriptorSetCount = 1;
+			alloc_info.pSetLayouts = &layout;
+			VkDescriptorSet set;
+			res = vkAllocateDescriptorSets(device, &alloc_info, &set);
+			assert(res == VK_SUCCESS);
+
+			VkDescriptorBufferInfo info = {buffer, 256 * (i % ranges), 256};
+			VkWriteDescriptorSet write = {};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.pNext = nullptr;
+			write.dstSet = set;
+			write.dstBinding = 0;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			write.pBufferInfo = &info;
+			vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+			vkFreeDescriptorSets(device, pool, 1, &set);
+		}
+	}
+	double naive_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	vkDestroyDescriptorPool(device, pool, nullptr);
+
+	//per frame pools, a set per draw
+	start = std::chrono::high_resolution_clock::now();
+	for(uint32_t f = 0; f < frames; f++)
+	{
+		descriptorsBeginFrame(&d, f % FRAMES_IN_FLIGHT);
+		for(uint32_t i = 0; i < draws; i++)
+		{
+			VkDescriptorSet set = descriptorsAllocate(&d, layout);
+			assert(set != VK_NULL_HANDLE);
+			VkDescriptorBufferInfo info = {buffer, 256 * (i % ranges), 256};
+			VkWriteDescriptorSet write = {};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.pNext = nullptr;
+			write.dstSet = set;
+			write.dstBinding = 0;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			write.pBufferInfo = &info;
+			vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+		}
+	}
+	double pooled_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	//and with the written set cache
+	start = std::chrono::high_resolution_clock::now();
+	for(uint32_t f = 0; f < frames; f++)
+	{
+		descriptorsBeginFrame(&d, f % FRAMES_IN_FLIGHT);
+		for(uint32_t i = 0; i < draws; i++)
+		{
+			descriptor_write w = descriptorBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, buffer, 256 * (i % ranges), 256);
+			descriptorsGet(&d, layout, &w, 1);
+		}
+	}
+	double cached_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	double n = (double)frames * draws;
+	printf("descriptors, %u draws x %u frames: free per draw %.1f ns/draw, per frame pools %.1f ns/draw, cached %.1f ns/draw\n", draws, frames,
+		naive_ms * 1e6 / n, pooled_ms * 1e6 / n, cached_ms * 1e6 / n);
+	descriptorsPrintStats(&d);
+
+	descriptorsDestroy(&d);
+	vkDestroyBuffer(device, buffer, nullptr);
+	arenaFree(arena, &mem);
+}
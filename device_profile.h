@@ -0,0 +1,255 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+#include "pipeline_cache.h"
+
+/*
+device capability profiles
+
+everything startup asks a physical device about that can't change while the driver stays
+the same: properties, features, memory types and heaps, queue families, extensions, the
+format support of every format we might use and descriptor indexing (features and limits,
+only when the instance has VK_KHR_get_physical_device_properties2 to ask with, zero otherwise). queried once, written to disk, and read back on
+the next start instead of asking the driver again, one profile per device.
+
+a profile is keyed by what's in VkPhysicalDeviceProperties: vendorID, deviceID, driverVersion,
+apiVersion and pipelineCacheUUID (which changes with driver builds that keep the version). the
+properties themselves are always asked for (one cheap call, and it's how we find the device in
+the file), everything else comes from the file when the key matches. surface capabilities are
+not in here, they depend on the window.
+
+the file is the structs as they are in memory, so it's only good for the build that wrote it:
+the header has the struct sizes, anything that doesn't match is thrown away. it's written the
+same way the pipeline cache is (tmp file, fsync, rename), --cold ignores it.
+*/
+
+#define DEVICE_PROFILE_DEFAULT_PATH "device_profiles.bin"
+#define DEVICE_PROFILE_MAGIC 0x50444b56 //"VKDP"
+#define DEVICE_PROFILE_VERSION 2
+
+//every format anything in the tree picks from, the rest get asked for when they're needed
+static const VkFormat profile_formats[] = {
+	VK_FORMAT_B8G8R8A8_UNORM,
+	VK_FORMAT_B8G8R8A8_SRGB,
+	VK_FORMAT_R8G8B8A8_UNORM,
+	VK_FORMAT_R8G8B8A8_SRGB,
+	VK_FORMAT_A2B10G10R10_UNORM_PACK32,
+	VK_FORMAT_R16G16B16A16_SFLOAT,
+	VK_FORMAT_R32_UINT,
+	VK_FORMAT_D16_UNORM,
+	VK_FORMAT_X8_D24_UNORM_PACK32,
+	VK_FORMAT_D32_SFLOAT,
+	VK_FORMAT_D16_UNORM_S8_UINT,
+	VK_FORMAT_D24_UNORM_S8_UINT,
+	VK_FORMAT_D32_SFLOAT_S8_UINT,
+};
+#define PROFILE_FORMAT_COUNT (sizeof(profile_formats) / sizeof(profile_formats[0]))
+
+typedef struct {
+	VkPhysicalDeviceProperties props;
+	VkPhysicalDeviceFeatures features;
+	VkPhysicalDeviceMemoryProperties memory;
+	std::vector<VkQueueFamilyProperties> families;
+	std::vector<VkExtensionProperties> extensions;
+	VkFormatProperties formats[PROFILE_FORMAT_COUNT]; //in profile_formats order
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing; //pNext is always null
+	VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexing_limits;
+	bool cached; //read from disk, not from the driver
+} device_profile;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t sizes; //of the structs in the file, changes with the headers
+	uint32_t count;
+} device_profile_header;
+
+static uint32_t profileStructSizes()
+{
+	return (uint32_t)(sizeof(VkPhysicalDeviceProperties) ^ (sizeof(VkPhysicalDeviceFeatures) << 8) ^ (sizeof(VkPhysicalDeviceMemoryProperties) << 16)
+		^ (sizeof(VkQueueFamilyProperties) << 4) ^ (sizeof(VkExtensionProperties) << 12) ^ (PROFILE_FORMAT_COUNT << 24)
+		^ (sizeof(VkPhysicalDeviceDescriptorIndexingFeaturesEXT) << 20) ^ (sizeof(VkPhysicalDeviceDescriptorIndexingPropertiesEXT) << 10));
+}
+
+static bool profileSameDriver(const VkPhysicalDeviceProperties& a, const VkPhysicalDeviceProperties& b)
+{
+	return a.vendorID == b.vendorID && a.deviceID == b.deviceID && a.driverVersion == b.driverVersion && a.apiVersion == b.apiVersion
+		&& memcmp(a.pipelineCacheUUID, b.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+bool profileHasExtension(const device_profile* p, const char* name)
+{
+	for(const VkExtensionProperties& ext : p->extensions)
+	{
+		if(strcmp(ext.extensionName, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+//everything from the driver. features2/properties2 from VK_KHR_get_physical_device_properties2, null if the instance doesn't have it
+void profileQuery(device_profile* p, VkPhysicalDevice gpu, PFN_vkGetPhysicalDeviceFeatures2KHR features2 = nullptr,
+				  PFN_vkGetPhysicalDeviceProperties2KHR properties2 = nullptr)
+{
+	vkGetPhysicalDeviceProperties(gpu, &p->props);
+	vkGetPhysicalDeviceFeatures(gpu, &p->features);
+	vkGetPhysicalDeviceMemoryProperties(gpu, &p->memory);
+
+	uint32_t count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(gpu, &count, nullptr);
+	p->families.resize(count);
+	vkGetPhysicalDeviceQueueFamilyProperties(gpu, &count, p->families.data());
+
+	count = 0;
+	VkResult res = vkEnumerateDeviceExtensionProperties(gpu, nullptr, &count, nullptr);
+	assert(res == VK_SUCCESS);
+	p->extensions.resize(count);
+	res = vkEnumerateDeviceExtensionProperties(gpu, nullptr, &count, p->extensions.data());
+	assert(res == VK_SUCCESS);
+
+	for(uint32_t i = 0; i < PROFILE_FORMAT_COUNT; i++)
+		vkGetPhysicalDeviceFormatProperties(gpu, profile_formats[i], &p->formats[i]);
+
+	p->indexing = {};
+	p->indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	p->indexing_limits = {};
+	p->indexing_limits.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+	if(features2 && properties2 && profileHasExtension(p, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME))
+	{
+		VkPhysicalDeviceFeatures2KHR features = {};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+		features.pNext = &p->indexing;
+		features2(gpu, &features);
+		VkPhysicalDeviceProperties2KHR props = {};
+		props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+		props.pNext = &p->indexing_limits;
+		properties2(gpu, &props);
+		p->indexing.pNext = nullptr;
+		p->indexing_limits.pNext = nullptr;
+	}
+	p->cached = false;
+}
+
+template<typename T>
+static bool profileTake(const std::vector<uint8_t>& data, size_t* at, T* out, size_t count)
+{
+	if(*at + sizeof(T) * count > data.size())
+		return false;
+	memcpy(out, data.data() + *at, sizeof(T) * count);
+	*at += sizeof(T) * count;
+	return true;
+}
+
+//whatever profiles the file has, for any device. false (and nothing) if it's missing or from another build
+bool profilesRead(const char* path, std::vector<device_profile>& profiles)
+{
+	profiles.clear();
+	std::vector<uint8_t> data;
+	if(!readFile(path, data))
+		return false;
+
+	size_t at = 0;
+	device_profile_header header;
+	if(!profileTake(data, &at, &header, 1) || header.magic != DEVICE_PROFILE_MAGIC || header.version != DEVICE_PROFILE_VERSION
+	   || header.sizes != profileStructSizes())
+		return false;
+
+	for(uint32_t i = 0; i < header.count; i++)
+	{
+		device_profile p;
+		uint32_t families = 0, extensions = 0;
+		bool ok = profileTake(data, &at, &p.props, 1) && profileTake(data, &at, &p.features, 1) && profileTake(data, &at, &p.memory, 1)
+			&& profileTake(data, &at, p.formats, PROFILE_FORMAT_COUNT) && profileTake(data, &at, &p.indexing, 1) && profileTake(data, &at, &p.indexing_limits, 1)
+			&& profileTake(data, &at, &families, 1) && profileTake(data, &at, &extensions, 1);
+		if(ok)
+		{
+			p.families.resize(families);
+			p.extensions.resize(extensions);
+			ok = profileTake(data, &at, p.families.data(), families) && profileTake(data, &at, p.extensions.data(), extensions);
+		}
+		if(!ok)
+		{
+			profiles.clear(); //truncated
+			return false;
+		}
+		p.cached = true;
+		profiles.push_back(p);
+	}
+	return true;
+}
+
+bool profilesSave(const char* path, const std::vector<device_profile>& profiles)
+{
+	std::vector<uint8_t> data;
+	auto put = [&data](const void* src, size_t size) {
+		data.insert(data.end(), (const uint8_t*)src, (const uint8_t*)src + size);
+	};
+
+	device_profile_header header = {DEVICE_PROFILE_MAGIC, DEVICE_PROFILE_VERSION, profileStructSizes(), (uint32_t)profiles.size()};
+	put(&header, sizeof(header));
+	for(const device_profile& p : profiles)
+	{
+		uint32_t families = (uint32_t)p.families.size(), extensions = (uint32_t)p.extensions.size();
+		put(&p.props, sizeof(p.props));
+		put(&p.features, sizeof(p.features));
+		put(&p.memory, sizeof(p.memory));
+		put(p.formats, sizeof(p.formats));
+		put(&p.indexing, sizeof(p.indexing));
+		put(&p.indexing_limits, sizeof(p.indexing_limits));
+		put(&families, sizeof(families));
+		put(&extensions, sizeof(extensions));
+		put(p.families.data(), families * sizeof(VkQueueFamilyProperties));
+		put(p.extensions.data(), extensions * sizeof(VkExtensionProperties));
+	}
+	return writeFileAtomic(path, data.data(), data.size());
+}
+
+//a profile per gpu, from cached where the driver is still the same. returns how many had to be queried
+uint32_t profilesGet(const std::vector<VkPhysicalDevice>& gpus, const std::vector<device_profile>& cached, std::vector<device_profile>& profiles,
+					 PFN_vkGetPhysicalDeviceFeatures2KHR features2 = nullptr, PFN_vkGetPhysicalDeviceProperties2KHR properties2 = nullptr)
+{
+	uint32_t queried = 0;
+	profiles.resize(gpus.size());
+	for(uint32_t i = 0; i < gpus.size(); i++)
+	{
+		VkPhysicalDeviceProperties props;
+		vkGetPhysicalDeviceProperties(gpus[i], &props);
+
+		bool found = false;
+		for(const device_profile& c : cached)
+		{
+			//two identical cards have the same key and the same answers, either one will do
+			if(profileSameDriver(c.props, props))
+			{
+				profiles[i] = c;
+				found = true;
+				break;
+			}
+		}
+		if(!found)
+		{
+			profileQuery(&profiles[i], gpus[i], features2, properties2);
+			queried++;
+		}
+	}
+	return queried;
+}
+
+//formats outside profile_formats get asked for
+VkFormatProperties profileFormat(const device_profile* p, VkPhysicalDevice gpu, VkFormat format)
+{
+	for(uint32_t i = 0; i < PROFILE_FORMAT_COUNT; i++)
+	{
+		if(profile_formats[i] == format)
+			return p->formats[i];
+	}
+	VkFormatProperties props;
+	vkGetPhysicalDeviceFormatProperties(gpu, format, &props);
+	return props;
+}
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstdio>
+#include <cstdarg>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+
+#include "device_profile.h"
+#include "queues.h"
+
+/*
+physical device selection
+
+every device gets a score from its profile (see device_profile.h) plus whether it can present
+to the surface, and the highest one wins. a device that lacks something we can't run without
+is out, whatever its score:
+	- a required extension (the swapchain, unless headless)
+	- a graphics queue family, and one that presents to the surface
+	- a depth format usable as an attachment with optimal tiling (D32, D24S8 or D16)
+
+the rest adds up, biggest first:
+	type				discrete 1000, integrated 500, virtual 200, cpu 50
+	device local memory	10 per GiB of the largest DEVICE_LOCAL heap, up to 320. integrated parts
+						report shared system memory here, the type already keeps them behind
+	queue families		50 for a compute family without graphics, 25 for a transfer only one
+						(async compute and copies, see queues.h), 10 for timestamps on graphics
+	extensions			20 per optional extension we'd use (timeline semaphores)
+ties go to the one enumerated first. every line of the score is kept as text, the ranking
+is printed with it so it's clear why a device won.
+
+--gpu picks one explicitly, by index or by a case insensitive piece of its name. an override
+that can't run the app is reported and ignored.
+*/
+
+#define DEVICE_MAX_HEAP_SCORE 320
+
+typedef struct {
+	std::vector<const char*> extensions; //required
+	std::vector<const char*> optional_extensions; //each one that's there scores
+	VkSurfaceKHR surface; //VK_NULL_HANDLE = headless
+} device_requirements;
+
+typedef struct {
+	uint32_t index; //in the enumeration
+	int64_t score; //-1 = can't be used
+	std::vector<std::string> reasons; //"+1000 discrete gpu", "missing VK_KHR_swapchain", ...
+} device_rank;
+
+static const VkFormat device_depth_formats[] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM};
+
+static void deviceReason(device_rank* r, int64_t score, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+static void deviceReason(device_rank* r, int64_t score, const char* fmt, ...)
+{
+	char text[256];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(text, sizeof(text), fmt, args);
+	va_end(args);
+	if(score > 0)
+	{
+		char line[280];
+		snprintf(line, sizeof(line), "+%lld %s", (long long)score, text);
+		r->reasons.push_back(line);
+		r->score += score;
+	}
+	else
+		r->reasons.push_back(text);
+}
+
+//one device, from its profile. gpu is only used to ask about the surface
+device_rank deviceScore(uint32_t index, VkPhysicalDevice gpu, const device_profile* p, const device_requirements* req)
+{
+	device_rank r;
+	r.index = index;
+	r.score = 0;
+	bool usable = true;
+
+	for(const char* ext : req->extensions)
+	{
+		if(!profileHasExtension(p, ext))
+		{
+			deviceReason(&r, 0, "missing %s", ext);
+			usable = false;
+		}
+	}
+
+	device_queues queues;
+	if(!queuesFind(&queues, gpu, req->surface, p->families))
+	{
+		deviceReason(&r, 0, req->surface != VK_NULL_HANDLE ? "no graphics queue that can present" : "no graphics queue");
+		usable = false;
+	}
+
+	const char* depth = nullptr;
+	for(VkFormat format : device_depth_formats)
+	{
+		if(!depth && profileFormat(p, gpu, format).optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+			depth = format == VK_FORMAT_D32_SFLOAT ? "D32" : format == VK_FORMAT_D24_UNORM_S8_UINT ? "D24S8" : "D16";
+	}
+	if(!depth)
+	{
+		deviceReason(&r, 0, "no depth attachment format");
+		usable = false;
+	}
+
+	if(!usable)
+	{
+		r.score = -1;
+		return r;
+	}
+
+	switch(p->props.deviceType)
+	{
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: deviceReason(&r, 1000, "discrete gpu"); break;
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: deviceReason(&r, 500, "integrated gpu"); break;
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: deviceReason(&r, 200, "virtual gpu"); break;
+	case VK_PHYSICAL_DEVICE_TYPE_CPU: deviceReason(&r, 50, "cpu"); break;
+	default: deviceReason(&r, 0, "unknown device type"); break;
+	}
+
+	VkDeviceSize heap = 0;
+	for(uint32_t i = 0; i < p->memory.memoryHeapCount; i++)
+	{
+		if(p->memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT && p->memory.memoryHeaps[i].size > heap)
+			heap = p->memory.memoryHeaps[i].size;
+	}
+	int64_t heap_score = (int64_t)(heap >> 30) * 10;
+	if(heap_score > DEVICE_MAX_HEAP_SCORE)
+		heap_score = DEVICE_MAX_HEAP_SCORE;
+	deviceReason(&r, heap_score, "%.1f GiB device local", heap / (1024.0 * 1024.0 * 1024.0));
+
+	if(queues.compute != queues.graphics)
+		deviceReason(&r, 50, "compute family %u without graphics", queues.compute);
+	if(queues.transfer != queues.compute)
+		deviceReason(&r, 25, "transfer only family %u", queues.transfer);
+	if(p->families[queues.graphics].timestampValidBits)
+		deviceReason(&r, 10, "timestamps on graphics");
+
+	for(const char* ext : req->optional_extensions)
+	{
+		if(profileHasExtension(p, ext))
+			deviceReason(&r, 20, "%s", ext);
+	}
+	deviceReason(&r, 0, "depth %s", depth);
+	return r;
+}
+
+//best first (stable, ties keep the enumeration order)
+std::vector<device_rank> deviceRank(const std::vector<VkPhysicalDevice>& gpus, const std::vector<device_profile>& profiles, const device_requirements* req)
+{
+	std::vector<device_rank> ranks;
+	for(uint32_t i = 0; i < gpus.size(); i++)
+		ranks.push_back(deviceScore(i, gpus[i], &profiles[i], req));
+	std::stable_sort(ranks.begin(), ranks.end(), [](const device_rank& a, const device_rank& b) { return a.score > b.score; });
+	return ranks;
+}
+
+static bool deviceNameMatches(const char* name, const char* pattern)
+{
+	size_t n = strlen(pattern);
+	for(const char* c = name; *c; c++)
+	{
+		size_t i = 0;
+		while(i < n && c[i] && tolower((unsigned char)c[i]) == tolower((unsigned char)pattern[i]))
+			i++;
+		if(i == n)
+			return true;
+	}
+	return n == 0;
+}
+
+//the index into gpus to use, UINT32_MAX if none will do. override = --gpu (index or part of the name), nullptr = none
+uint32_t deviceSelect(const std::vector<VkPhysicalDevice>& gpus, const std::vector<device_profile>& profiles, const device_requirements* req,
+					  const char* override_device)
+{
+	std::vector<device_rank> ranks = deviceRank(gpus, profiles, req);
+
+	printf("devices, best first:\n");
+	for(const device_rank& r : ranks)
+	{
+		const VkPhysicalDeviceProperties& props = profiles[r.index].props;
+		printf("    %u: %s (driver %u.%u.%u, vulkan %u.%u): ", r.index, props.deviceName, VK_VERSION_MAJOR(props.driverVersion),
+			VK_VERSION_MINOR(props.driverVersion), VK_VERSION_PATCH(props.driverVersion), VK_VERSION_MAJOR(props.apiVersion), VK_VERSION_MINOR(props.apiVersion));
+		if(r.score < 0)
+			printf("unusable");
+		else
+			printf("%lld", (long long)r.score);
+		for(const std::string& reason : r.reasons)
+			printf(", %s", reason.c_str());
+		printf("\n");
+	}
+
+	if(override_device)
+	{
+		char* end = nullptr;
+		unsigned long index = strtoul(override_device, &end, 10);
+		bool by_index = end != override_device && *end == '\0';
+		bool matched = false;
+		//best first, so a name that matches several devices gets the best of them
+		for(const device_rank& r : ranks)
+		{
+			if(by_index ? r.index != index : !deviceNameMatches(profiles[r.index].props.deviceName, override_device))
+				continue;
+			matched = true;
+			if(r.score < 0)
+				continue;
+			printf("using %u: %s (--gpu %s)\n", r.index, profiles[r.index].props.deviceName, override_device);
+			return r.index;
+		}
+		printf("--gpu %s: %s, picking the best one instead\n", override_device, matched ? "can't run on that" : "no such device");
+	}
+
+	if(ranks.empty() || ranks[0].score < 0)
+		return UINT32_MAX;
+	printf("using %u: %s\n", ranks[0].index, profiles[ranks[0].index].props.deviceName);
+	return ranks[0].index;
+}
+
+
+//--test-select: scoring and selection against made up devices, no driver involved (surface is
+//VK_NULL_HANDLE and every depth format asked about is in the profile). true if every pick is the expected one
+static device_profile deviceTestProfile(const char* name, VkPhysicalDeviceType type, uint32_t heap_gib, bool swapchain, bool depth,
+										std::vector<VkQueueFlags> families)
+{
+	device_profile p = {};
+	snprintf(p.props.deviceName, sizeof(p.props.deviceName), "%s", name);
+	p.props.deviceType = type;
+	p.memory.memoryHeapCount = 1;
+	p.memory.memoryHeaps[0].size = (VkDeviceSize)heap_gib << 30;
+	p.memory.memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+	for(VkQueueFlags flags : families)
+	{
+		VkQueueFamilyProperties family = {};
+		family.queueFlags = flags;
+		family.queueCount = 1;
+		family.timestampValidBits = 64;
+		p.families.push_back(family);
+	}
+	if(swapchain)
+	{
+		VkExtensionProperties ext = {};
+		snprintf(ext.extensionName, sizeof(ext.extensionName), "%s", VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+		p.extensions.push_back(ext);
+	}
+	for(uint32_t i = 0; i < PROFILE_FORMAT_COUNT; i++)
+	{
+		if(depth && profile_formats[i] == VK_FORMAT_D16_UNORM)
+			p.formats[i].optimalTilingFeatures = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	}
+	return p;
+}
+
+static bool deviceTestPick(const char* what, const std::vector<device_profile>& profiles, const device_requirements* req, const char* override_device,
+						   uint32_t expected)
+{
+	std::vector<VkPhysicalDevice> gpus(profiles.size(), VK_NULL_HANDLE);
+	uint32_t picked = deviceSelect(gpus, profiles, req, override_device);
+	bool ok = picked == expected;
+	printf("test-select %s: %s (picked %d, expected %d)\n", what, ok ? "ok" : "FAILED", (int)picked, (int)expected);
+	return ok;
+}
+
+bool deviceSelectTest()
+{
+	const VkQueueFlags gfx = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+	const VkQueueFlags compute = VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+	device_requirements windowed;
+	windowed.extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	windowed.surface = VK_NULL_HANDLE;
+	device_requirements headless;
+	headless.surface = VK_NULL_HANDLE;
+	bool ok = true;
+
+	//the type outweighs memory and enumeration order
+	std::vector<device_profile> profiles = {
+		deviceTestProfile("integrated", VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU, 16, true, true, {gfx}),
+		deviceTestProfile("discrete", VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 8, true, true, {gfx}),
+	};
+	ok &= deviceTestPick("discrete over integrated", profiles, &windowed, nullptr, 1);
+
+	//equal scores: the first one enumerated
+	profiles = {
+		deviceTestProfile("cpu", VK_PHYSICAL_DEVICE_TYPE_CPU, 0, true, true, {gfx}),
+		deviceTestProfile("discrete a", VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 8, true, true, {gfx}),
+		deviceTestProfile("discrete b", VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 8, true, true, {gfx}),
+	};
+	ok &= deviceTestPick("tie", profiles, &windowed, nullptr, 1);
+
+	//a dedicated compute family breaks it, the heap score stops at DEVICE_MAX_HEAP_SCORE
+	profiles = {
+		deviceTestProfile("discrete 64 GiB", VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 64, true, true, {gfx}),
+		deviceTestProfile("discrete 32 GiB + compute", VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 32, true, true, {gfx, compute}),
+	};
+	ok &= deviceTestPick("async compute family, capped heap", profiles, &windowed, nullptr, 1);
+
+	//what it can't run without rules a device out whatever its score
+	profiles = {
+		deviceTestProfile("discrete, no swapchain", VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 8, false, true, {gfx}),
+		deviceTestProfile("discrete, no depth", VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 8, true, false, {gfx}),
+		deviceTestProfile("discrete, compute only", VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 8, true, true, {compute}),
+		deviceTestProfile("cpu", VK_PHYSICAL_DEVICE_TYPE_CPU, 0, true, true, {gfx}),
+	};
+	ok &= deviceTestPick("requirements", profiles, &windowed, nullptr, 3);
+	//headless doesn't need the swapchain
+	ok &= deviceTestPick("headless", profiles, &headless, nullptr, 0);
+
+	//--gpu: by name over a better device, by index, and ignored when it can't run this
+	ok &= deviceTestPick("override by name", profiles, &headless, "CPU", 3);
+	ok &= deviceTestPick("override by index", profiles, &headless, "3", 3);
+	ok &= deviceTestPick("override unusable", profiles, &windowed, "no depth", 3);
+	ok &= deviceTestPick("override missing", profiles, &windowed, "7", 3);
+
+	//nothing suitable
+	profiles.pop_back();
+	ok &= deviceTestPick("no suitable device", profiles, &windowed, nullptr, UINT32_MAX);
+	profiles.clear();
+	ok &= deviceTestPick("no devices", profiles, &windowed, nullptr, UINT32_MAX);
+	return ok;
+}
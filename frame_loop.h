@@ -0,0 +1,285 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+
+/*
+frames in flight
+
+each frame in flight owns everything the cpu touches while recording:
+	- a command pool (TRANSIENT) that gets reset as a whole with vkResetCommandPool,
+	  way cheaper than resetting/freeing individual command buffers
+	- a semaphore the swapchain signals when the image is acquired
+	- a semaphore we signal when rendering is done (present waits on it)
+	- a fence the queue signals when the frame's work is done
+
+so while the gpu chews on frame N the cpu is already recording N+1 into the other
+frame's pool. we only block when we come back around to a frame whose fence hasn't
+signaled yet.
+
+work from other queues that the frame consumes (async compute) adds its semaphore with
+frameWait before the submit, binary or timeline (with the value to wait for).
+
+the cpu frame times (fence signaled to submit) of the last FRAME_WINDOW frames are kept for the
+p99, and frames over FRAME_HITCH_MS are counted as hitches: that's where pipeline compiles on the render thread
+show up (see pipeline_compiler.h).
+*/
+
+#define FRAMES_IN_FLIGHT 2
+#define FRAME_MAX_WAITS 4 //semaphores a submit waits on, the acquire included
+#define FRAME_HITCH_MS (1000.0 / 60.0) //a cpu frame longer than this misses a 60 Hz vblank on its own
+#define FRAME_WINDOW 1024 //cpu frame times kept for the percentiles
+
+typedef struct {
+	VkCommandPool pool;
+	VkCommandBuffer cmd;
+	VkSemaphore acquired;
+	VkSemaphore rendered;
+	VkFence fence;
+
+	//extra waits for the next submit, cleared by frameBegin
+	uint32_t wait_count;
+	VkSemaphore waits[FRAME_MAX_WAITS - 1];
+	uint64_t wait_values[FRAME_MAX_WAITS - 1]; //0 for binary semaphores
+	VkPipelineStageFlags wait_stages[FRAME_MAX_WAITS - 1];
+} frame_data;
+
+typedef struct {
+	uint64_t frames;
+	double cpu_ms;		//fence signaled to submit, summed (the cpu's own work)
+	double cpu_min_ms, cpu_max_ms;
+	double wait_ms;		//time blocked on the frame fence (cpu ahead of the gpu)
+	double gpu_idle_ms;	//time the queue was known to be empty before a submit (gpu ahead of the cpu)
+	uint64_t hitches;	//cpu frames over FRAME_HITCH_MS
+	float cpu_window[FRAME_WINDOW]; //the last FRAME_WINDOW cpu frames, ring
+} frame_stats;
+
+typedef struct {
+	VkDevice device;
+	VkQueue queue;
+	frame_data frames[FRAMES_IN_FLIGHT];
+	uint32_t current;
+	uint64_t frame_number;
+	VkFence last_submitted; //fence of the most recent submit, to spot an idle queue
+	bool headless; //no swapchain: nothing signals acquired and nobody waits on rendered
+
+	frame_stats stats;
+	std::chrono::high_resolution_clock::time_point frame_start;
+	std::chrono::high_resolution_clock::time_point idle_since;
+	bool idle;
+} frame_loop;
+
+
+void framesInit(frame_loop* loop, VkDevice device, VkQueue queue, uint32_t queue_family, bool headless = false)
+{
+	loop->headless = headless;
+	loop->device = device;
+	loop->queue = queue;
+	loop->current = 0;
+	loop->frame_number = 0;
+	loop->last_submitted = VK_NULL_HANDLE;
+	loop->stats = frame_stats{};
+	loop->stats.cpu_min_ms = 1e30;
+	loop->idle = false;
+
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		frame_data& f = loop->frames[i];
+		f.wait_count = 0;
+
+		VkCommandPoolCreateInfo cmd_pool_info = {};
+		cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		cmd_pool_info.pNext = nullptr;
+		cmd_pool_info.queueFamilyIndex = queue_family;
+		cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; //buffers only live for a frame
+		VkResult res = vkCreateCommandPool(device, &cmd_pool_info, nullptr, &f.pool);
+		assert(res == VK_SUCCESS);
+
+		VkCommandBufferAllocateInfo cmd_info = {};
+		cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		cmd_info.pNext = nullptr;
+		cmd_info.commandPool = f.pool;
+		cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		cmd_info.commandBufferCount = 1;
+		res = vkAllocateCommandBuffers(device, &cmd_info, &f.cmd);
+		assert(res == VK_SUCCESS);
+
+		VkSemaphoreCreateInfo sem_info = {};
+		sem_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		sem_info.pNext = nullptr;
+		sem_info.flags = 0;
+		res = vkCreateSemaphore(device, &sem_info, nullptr, &f.acquired);
+		assert(res == VK_SUCCESS);
+		res = vkCreateSemaphore(device, &sem_info, nullptr, &f.rendered);
+		assert(res == VK_SUCCESS);
+
+		//start signaled so the first wait on each frame doesn't hang
+		VkFenceCreateInfo fence_info = {};
+		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fence_info.pNext = nullptr;
+		fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+		res = vkCreateFence(device, &fence_info, nullptr, &f.fence);
+		assert(res == VK_SUCCESS);
+	}
+}
+
+//waits until this frame's previous submission is done, resets its pool and begins its command buffer
+frame_data* frameBegin(frame_loop* loop)
+{
+	frame_data* f = &loop->frames[loop->current];
+	auto now = std::chrono::high_resolution_clock::now();
+
+	VkResult res = vkWaitForFences(loop->device, 1, &f->fence, VK_TRUE, UINT64_MAX);
+	assert(res == VK_SUCCESS);
+	auto waited = std::chrono::high_resolution_clock::now();
+	loop->stats.wait_ms += std::chrono::duration<double, std::milli>(waited - now).count();
+	loop->frame_start = waited;
+
+	//if the newest submit is also done the queue is empty and the gpu is waiting on us
+	if(!loop->idle && loop->last_submitted != VK_NULL_HANDLE && vkGetFenceStatus(loop->device, loop->last_submitted) == VK_SUCCESS)
+	{
+		loop->idle = true;
+		loop->idle_since = waited;
+	}
+
+	res = vkResetFences(loop->device, 1, &f->fence);
+	assert(res == VK_SUCCESS);
+	f->wait_count = 0;
+	res = vkResetCommandPool(loop->device, f->pool, 0);
+	assert(res == VK_SUCCESS);
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.pNext = nullptr;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	begin_info.pInheritanceInfo = nullptr;
+	res = vkBeginCommandBuffer(f->cmd, &begin_info);
+	assert(res == VK_SUCCESS);
+	return f;
+}
+
+//makes the frame's submit also wait for sem (at least value, if it's a timeline semaphore) before stage
+void frameWait(frame_data* f, VkSemaphore sem, uint64_t value, VkPipelineStageFlags stage)
+{
+	assert(f->wait_count < FRAME_MAX_WAITS - 1);
+	f->waits[f->wait_count] = sem;
+	f->wait_values[f->wait_count] = value;
+	f->wait_stages[f->wait_count] = stage;
+	f->wait_count++;
+}
+
+//ends the command buffer and submits it: waits on acquired (and frameWait's), signals rendered and the fence (headless: just the fence)
+void frameSubmit(frame_loop* loop, frame_data* f, VkPipelineStageFlags wait_stage)
+{
+	VkResult res = vkEndCommandBuffer(f->cmd);
+	assert(res == VK_SUCCESS);
+
+	VkSemaphore waits[FRAME_MAX_WAITS];
+	uint64_t wait_values[FRAME_MAX_WAITS];
+	VkPipelineStageFlags wait_stages[FRAME_MAX_WAITS];
+	uint32_t wait_count = 0;
+	bool timeline = false;
+	if(!loop->headless)
+	{
+		waits[0] = f->acquired;
+		wait_values[0] = 0;
+		wait_stages[0] = wait_stage;
+		wait_count = 1;
+	}
+	for(uint32_t i = 0; i < f->wait_count; i++, wait_count++)
+	{
+		waits[wait_count] = f->waits[i];
+		wait_values[wait_count] = f->wait_values[i];
+		wait_stages[wait_count] = f->wait_stages[i];
+		timeline = timeline || f->wait_values[i] != 0;
+	}
+
+	//binary semaphores ignore their value, but once one wait is a timeline every wait needs one
+	uint64_t signal_value = 0;
+	VkTimelineSemaphoreSubmitInfoKHR timeline_info = {};
+	timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	timeline_info.pNext = nullptr;
+	timeline_info.waitSemaphoreValueCount = wait_count;
+	timeline_info.pWaitSemaphoreValues = wait_values;
+	timeline_info.signalSemaphoreValueCount = loop->headless ? 0 : 1;
+	timeline_info.pSignalSemaphoreValues = &signal_value;
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = timeline ? &timeline_info : nullptr;
+	submit_info.waitSemaphoreCount = wait_count;
+	submit_info.pWaitSemaphores = waits;
+	submit_info.pWaitDstStageMask = wait_stages;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &f->cmd;
+	submit_info.signalSemaphoreCount = loop->headless ? 0 : 1;
+	submit_info.pSignalSemaphores = &f->rendered;
+
+	//the queue might have drained while we were recording
+	auto now = std::chrono::high_resolution_clock::now();
+	if(!loop->idle && loop->last_submitted != VK_NULL_HANDLE && vkGetFenceStatus(loop->device, loop->last_submitted) == VK_SUCCESS)
+	{
+		loop->idle = true;
+		loop->idle_since = now;
+	}
+	if(loop->idle)
+		loop->stats.gpu_idle_ms += std::chrono::duration<double, std::milli>(now - loop->idle_since).count();
+	loop->idle = false;
+
+	res = vkQueueSubmit(loop->queue, 1, &submit_info, f->fence);
+	assert(res == VK_SUCCESS);
+	loop->last_submitted = f->fence;
+
+	double cpu = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loop->frame_start).count();
+	loop->stats.frames++;
+	loop->stats.cpu_ms += cpu;
+	if(cpu < loop->stats.cpu_min_ms)
+		loop->stats.cpu_min_ms = cpu;
+	if(cpu > loop->stats.cpu_max_ms)
+		loop->stats.cpu_max_ms = cpu;
+	if(cpu > FRAME_HITCH_MS)
+		loop->stats.hitches++;
+	loop->stats.cpu_window[(loop->stats.frames - 1) % FRAME_WINDOW] = (float)cpu;
+
+	loop->current = (loop->current + 1) % FRAMES_IN_FLIGHT;
+	loop->frame_number++;
+}
+
+//frames below this are known to be done: frameBegin has waited on frame (frame_number - FRAMES_IN_FLIGHT)'s fence
+uint64_t framesCompleted(const frame_loop* loop)
+{
+	return loop->frame_number >= FRAMES_IN_FLIGHT ? loop->frame_number - FRAMES_IN_FLIGHT + 1 : 0;
+}
+
+void framesPrintStats(frame_loop* loop)
+{
+	frame_stats& s = loop->stats;
+	if(!s.frames)
+		return;
+	float sorted[FRAME_WINDOW];
+	uint32_t n = s.frames < FRAME_WINDOW ? (uint32_t)s.frames : FRAME_WINDOW;
+	std::copy(s.cpu_window, s.cpu_window + n, sorted);
+	std::sort(sorted, sorted + n);
+	printf("frames: %llu, cpu frame %.3f ms avg (%.3f min, %.3f p99 of the last %u, %.3f max), %llu hitches over %.1f ms, fence wait %.3f ms/frame, gpu idle %.3f ms/frame\n",
+		(unsigned long long)s.frames, s.cpu_ms / s.frames, s.cpu_min_ms, sorted[n * 99 / 100], n, s.cpu_max_ms,
+		(unsigned long long)s.hitches, FRAME_HITCH_MS, s.wait_ms / s.frames, s.gpu_idle_ms / s.frames);
+}
+
+void framesDestroy(frame_loop* loop)
+{
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		frame_data& f = loop->frames[i];
+		vkWaitForFences(loop->device, 1, &f.fence, VK_TRUE, UINT64_MAX);
+		vkDestroyFence(loop->device, f.fence, nullptr);
+		vkDestroySemaphore(loop->device, f.acquired, nullptr);
+		vkDestroySemaphore(loop->device, f.rendered, nullptr);
+		vkFreeCommandBuffers(loop->device, f.pool, 1, &f.cmd);
+		vkDestroyCommandPool(loop->device, f.pool, nullptr);
+	}
+}
@@ -0,0 +1,615 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cassert>
+
+/*
+gpu memory arena
+
+vkAllocateMemory is slow (kernel round trip) and the driver caps the number of live
+allocations (maxMemoryAllocationCount, 4096 on a lot of hardware), so instead of one
+VkDeviceMemory per resource we grab big blocks per memory type and hand out pieces.
+
+each block is managed by a TLSF (two level segregated fit) allocator:
+	- first level = power of two size class, second level = 32 linear subdivisions of it
+	- a bitmap per level means finding a free range is a couple of bit scans, O(1)
+	- free ranges get merged with their physical neighbours on free
+
+the allocator never touches the memory itself (it might not be host visible),
+so range bookkeeping lives in a node array on the cpu side.
+
+bufferImageGranularity: linear resources (buffers, linear images) and optimal images
+must not share a "page" of that size. we just pad optimal images out to whole pages
+(offset and size), then no page can ever contain both kinds.
+*/
+
+bool memType(VkPhysicalDeviceMemoryProperties& props, uint32_t typeBits, VkFlags requirements, uint32_t* typeIndex)
+{
+	for(uint32_t i = 0; i < props.memoryTypeCount; i++)
+	{
+		if((typeBits & 1) == 1)
+		{
+			if((props.memoryTypes[i].propertyFlags & requirements) == requirements)
+			{
+				*typeIndex = i;
+				return true;
+			}
+		}
+		typeBits >>= 1;
+	}
+	return false;
+}
+
+
+#define TLSF_SL_BITS 5
+#define TLSF_SL_COUNT (1u << TLSF_SL_BITS)
+#define TLSF_SMALL_SHIFT 8 //everything under 256 bytes goes in first level 0
+#define TLSF_SMALL (1ull << TLSF_SMALL_SHIFT)
+#define TLSF_FL_COUNT (64 - TLSF_SMALL_SHIFT + 1)
+#define TLSF_NONE UINT32_MAX
+
+#define ARENA_DEFAULT_BLOCK_SIZE (64ull * 1024 * 1024)
+
+
+typedef struct {
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	uint32_t prev_phys, next_phys;
+	uint32_t prev_free, next_free;
+	bool free;
+	bool optimal; //optimal tiling image, only used for stats/debugging
+} tlsf_node;
+
+typedef struct {
+	VkDeviceMemory mem;
+	VkDeviceSize size;
+	uint32_t memory_type;
+	void* mapped; //persistently mapped if the memory type is host visible
+
+	std::vector<tlsf_node> nodes;
+	std::vector<uint32_t> spare_nodes; //recycled indices into nodes
+	uint64_t fl_bitmap;
+	uint32_t sl_bitmap[TLSF_FL_COUNT];
+	uint32_t heads[TLSF_FL_COUNT][TLSF_SL_COUNT];
+	uint32_t live; //number of allocations in this block
+} gpu_arena_block;
+
+typedef struct {
+	VkDeviceMemory mem;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	void* mapped; //nullptr unless host visible
+	uint32_t block; //index into gpu_arena::blocks
+	uint32_t node;
+} gpu_allocation;
+
+typedef struct {
+	uint32_t block_count;
+	uint32_t allocation_count;
+	uint32_t free_range_count;
+	VkDeviceSize reserved_bytes; //sum of all block sizes
+	VkDeviceSize used_bytes;
+	VkDeviceSize free_bytes;
+	VkDeviceSize largest_free;
+	float fragmentation; //1 - largest_free / free_bytes, 0 means all free space is one range
+} gpu_arena_stats;
+
+typedef struct {
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties mem_props;
+	VkDeviceSize granularity; //bufferImageGranularity
+	VkDeviceSize block_size;
+	std::vector<gpu_arena_block*> blocks; //nullptr slots are released blocks
+
+	//how often we actually went to the driver
+	uint64_t driver_allocs;
+	uint64_t driver_frees;
+	double driver_alloc_ms;
+} gpu_arena;
+
+
+static uint32_t tlsfBitScanForward(uint64_t v){ return (uint32_t)__builtin_ctzll(v); }
+static uint32_t tlsfBitScanReverse(uint64_t v){ return 63u - (uint32_t)__builtin_clzll(v); }
+
+static void tlsfMapping(VkDeviceSize size, uint32_t* fl, uint32_t* sl)
+{
+	if(size < TLSF_SMALL)
+	{
+		*fl = 0;
+		*sl = (uint32_t)(size / (TLSF_SMALL / TLSF_SL_COUNT));
+		return;
+	}
+	uint32_t f = tlsfBitScanReverse(size);
+	*sl = (uint32_t)((size >> (f - TLSF_SL_BITS)) ^ TLSF_SL_COUNT);
+	*fl = f - TLSF_SMALL_SHIFT + 1;
+}
+
+//rounds the request up to the start of the next list so whatever we find is big enough
+static void tlsfMappingSearch(VkDeviceSize size, uint32_t* fl, uint32_t* sl)
+{
+	if(size >= TLSF_SMALL)
+		size += (1ull << (tlsfBitScanReverse(size) - TLSF_SL_BITS)) - 1;
+	else
+		size += (TLSF_SMALL / TLSF_SL_COUNT) - 1;
+	tlsfMapping(size, fl, sl);
+}
+
+//smallest block a fresh tlsfAlloc(size, align) is sure to fit in: the alignment slack plus the
+//search's round up to the start of the next list
+static VkDeviceSize tlsfBlockSizeFor(VkDeviceSize size, VkDeviceSize align)
+{
+	VkDeviceSize need = size + (align > 1 ? align - 1 : 0);
+	VkDeviceSize step = need >= TLSF_SMALL ? 1ull << (tlsfBitScanReverse(need) - TLSF_SL_BITS) : TLSF_SMALL / TLSF_SL_COUNT;
+	return (need + step - 1) / step * step;
+}
+
+static uint32_t tlsfNewNode(gpu_arena_block* b)
+{
+	if(!b->spare_nodes.empty())
+	{
+		uint32_t n = b->spare_nodes.back();
+		b->spare_nodes.pop_back();
+		return n;
+	}
+	b->nodes.push_back(tlsf_node{});
+	return (uint32_t)b->nodes.size() - 1;
+}
+
+static void tlsfInsertFree(gpu_arena_block* b, uint32_t n)
+{
+	uint32_t fl, sl;
+	tlsfMapping(b->nodes[n].size, &fl, &sl);
+	uint32_t head = b->heads[fl][sl];
+	b->nodes[n].free = true;
+	b->nodes[n].prev_free = TLSF_NONE;
+	b->nodes[n].next_free = head;
+	if(head != TLSF_NONE)
+		b->nodes[head].prev_free = n;
+	b->heads[fl][sl] = n;
+	b->fl_bitmap |= 1ull << fl;
+	b->sl_bitmap[fl] |= 1u << sl;
+}
+
+static void tlsfRemoveFree(gpu_arena_block* b, uint32_t n)
+{
+	tlsf_node& node = b->nodes[n];
+	uint32_t fl, sl;
+	tlsfMapping(node.size, &fl, &sl);
+	if(node.prev_free != TLSF_NONE)
+		b->nodes[node.prev_free].next_free = node.next_free;
+	else
+		b->heads[fl][sl] = node.next_free;
+	if(node.next_free != TLSF_NONE)
+		b->nodes[node.next_free].prev_free = node.prev_free;
+
+	if(b->heads[fl][sl] == TLSF_NONE)
+	{
+		b->sl_bitmap[fl] &= ~(1u << sl);
+		if(!b->sl_bitmap[fl])
+			b->fl_bitmap &= ~(1ull << fl);
+	}
+	node.free = false;
+}
+
+static uint32_t tlsfFindFree(gpu_arena_block* b, VkDeviceSize size)
+{
+	uint32_t fl, sl;
+	tlsfMappingSearch(size, &fl, &sl);
+	if(fl >= TLSF_FL_COUNT)
+		return TLSF_NONE;
+
+	uint32_t sl_map = sl < TLSF_SL_COUNT ? b->sl_bitmap[fl] & (~0u << sl) : 0;
+	if(!sl_map)
+	{
+		uint64_t fl_map = fl + 1 < 64 ? b->fl_bitmap & (~0ull << (fl + 1)) : 0;
+		if(!fl_map)
+			return TLSF_NONE;
+		fl = tlsfBitScanForward(fl_map);
+		sl_map = b->sl_bitmap[fl];
+	}
+	sl = tlsfBitScanForward(sl_map);
+	return b->heads[fl][sl];
+}
+
+//splits [node.offset + at, end) off into a new free node after it
+static void tlsfSplit(gpu_arena_block* b, uint32_t n, VkDeviceSize at)
+{
+	uint32_t r = tlsfNewNode(b); //may reallocate nodes, don't hold references across this
+	b->nodes[r].offset = b->nodes[n].offset + at;
+	b->nodes[r].size = b->nodes[n].size - at;
+	b->nodes[r].optimal = false;
+	b->nodes[r].prev_phys = n;
+	b->nodes[r].next_phys = b->nodes[n].next_phys;
+	if(b->nodes[n].next_phys != TLSF_NONE)
+		b->nodes[b->nodes[n].next_phys].prev_phys = r;
+	b->nodes[n].next_phys = r;
+	b->nodes[n].size = at;
+	tlsfInsertFree(b, r);
+}
+
+static void tlsfInit(gpu_arena_block* b)
+{
+	b->fl_bitmap = 0;
+	for(uint32_t i = 0; i < TLSF_FL_COUNT; i++)
+	{
+		b->sl_bitmap[i] = 0;
+		for(uint32_t j = 0; j < TLSF_SL_COUNT; j++)
+			b->heads[i][j] = TLSF_NONE;
+	}
+	b->live = 0;
+	uint32_t n = tlsfNewNode(b);
+	b->nodes[n].offset = 0;
+	b->nodes[n].size = b->size;
+	b->nodes[n].prev_phys = TLSF_NONE;
+	b->nodes[n].next_phys = TLSF_NONE;
+	b->nodes[n].optimal = false;
+	tlsfInsertFree(b, n);
+}
+
+static uint32_t tlsfAlloc(gpu_arena_block* b, VkDeviceSize size, VkDeviceSize align)
+{
+	VkDeviceSize need = size + (align > 1 ? align - 1 : 0);
+	uint32_t n = tlsfFindFree(b, need);
+	if(n == TLSF_NONE)
+		return TLSF_NONE;
+	tlsfRemoveFree(b, n);
+
+	//front padding becomes its own free range
+	VkDeviceSize offset = b->nodes[n].offset;
+	VkDeviceSize pad = (align - offset % align) % align;
+	if(pad)
+	{
+		tlsfSplit(b, n, pad);
+		uint32_t front = n;
+		n = b->nodes[front].next_phys;
+		tlsfRemoveFree(b, n);
+		tlsfInsertFree(b, front);
+	}
+
+	//don't bother splitting off slivers nobody will ever fit in
+	if(b->nodes[n].size - size >= TLSF_SMALL)
+		tlsfSplit(b, n, size);
+
+	b->live++;
+	return n;
+}
+
+static void tlsfFree(gpu_arena_block* b, uint32_t n)
+{
+	b->live--;
+	uint32_t prev = b->nodes[n].prev_phys;
+	if(prev != TLSF_NONE && b->nodes[prev].free)
+	{
+		tlsfRemoveFree(b, prev);
+		b->nodes[prev].size += b->nodes[n].size;
+		b->nodes[prev].next_phys = b->nodes[n].next_phys;
+		if(b->nodes[n].next_phys != TLSF_NONE)
+			b->nodes[b->nodes[n].next_phys].prev_phys = prev;
+		b->spare_nodes.push_back(n);
+		n = prev;
+	}
+
+	uint32_t next = b->nodes[n].next_phys;
+	if(next != TLSF_NONE && b->nodes[next].free)
+	{
+		tlsfRemoveFree(b, next);
+		b->nodes[n].size += b->nodes[next].size;
+		b->nodes[n].next_phys = b->nodes[next].next_phys;
+		if(b->nodes[next].next_phys != TLSF_NONE)
+			b->nodes[b->nodes[next].next_phys].prev_phys = n;
+		b->spare_nodes.push_back(next);
+	}
+
+	b->nodes[n].optimal = false;
+	tlsfInsertFree(b, n);
+}
+
+
+void arenaInit(gpu_arena* arena, VkPhysicalDevice gpu, VkDevice device, VkDeviceSize block_size = ARENA_DEFAULT_BLOCK_SIZE)
+{
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(gpu, &props);
+	vkGetPhysicalDeviceMemoryProperties(gpu, &arena->mem_props);
+	arena->device = device;
+	arena->granularity = props.limits.bufferImageGranularity;
+	arena->block_size = block_size;
+	arena->driver_allocs = 0;
+	arena->driver_frees = 0;
+	arena->driver_alloc_ms = 0.0;
+}
+
+static gpu_arena_block* arenaNewBlock(gpu_arena* arena, uint32_t memory_type, VkDeviceSize size, VkDeviceSize align, uint32_t* index)
+{
+	//don't eat a whole small heap (some BAR heaps are 256MB)
+	VkDeviceSize heap = arena->mem_props.memoryHeaps[arena->mem_props.memoryTypes[memory_type].heapIndex].size;
+	VkDeviceSize block_size = arena->block_size;
+	if(block_size > heap / 8)
+		block_size = heap / 8;
+	//requests that don't fit get a block of their own, big enough for TLSF to hand them out
+	VkDeviceSize fit = tlsfBlockSizeFor(size, align);
+	if(fit > block_size)
+		block_size = fit;
+
+	VkMemoryAllocateInfo mem_alloc = {};
+	mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	mem_alloc.pNext = nullptr;
+	mem_alloc.allocationSize = block_size;
+	mem_alloc.memoryTypeIndex = memory_type;
+
+	VkDeviceMemory mem;
+	auto start = std::chrono::high_resolution_clock::now();
+	VkResult res = vkAllocateMemory(arena->device, &mem_alloc, nullptr, &mem);
+	arena->driver_alloc_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	if(res != VK_SUCCESS)
+		return nullptr;
+	arena->driver_allocs++;
+
+	gpu_arena_block* b = new gpu_arena_block();
+	b->mem = mem;
+	b->size = block_size;
+	b->memory_type = memory_type;
+	b->mapped = nullptr;
+	if(arena->mem_props.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		res = vkMapMemory(arena->device, mem, 0, VK_WHOLE_SIZE, 0, &b->mapped);
+		assert(res == VK_SUCCESS);
+	}
+	tlsfInit(b);
+
+	for(uint32_t i = 0; i < arena->blocks.size(); i++)
+	{
+		if(arena->blocks[i] == nullptr)
+		{
+			arena->blocks[i] = b;
+			*index = i;
+			return b;
+		}
+	}
+	arena->blocks.push_back(b);
+	*index = (uint32_t)arena->blocks.size() - 1;
+	return b;
+}
+
+static void arenaReleaseBlock(gpu_arena* arena, uint32_t index)
+{
+	gpu_arena_block* b = arena->blocks[index];
+	if(b->mapped)
+		vkUnmapMemory(arena->device, b->mem);
+	vkFreeMemory(arena->device, b->mem, nullptr);
+	arena->driver_frees++;
+	delete b;
+	arena->blocks[index] = nullptr;
+}
+
+//optimal = the resource is an optimal tiling image (see granularity note at the top)
+bool arenaAlloc(gpu_arena* arena, const VkMemoryRequirements& reqs, VkMemoryPropertyFlags flags, bool optimal, gpu_allocation* out)
+{
+	uint32_t memory_type;
+	if(!memType(arena->mem_props, reqs.memoryTypeBits, flags, &memory_type))
+		return false;
+
+	VkDeviceSize size = reqs.size, align = reqs.alignment ? reqs.alignment : 1;
+	if(optimal && arena->granularity > 1)
+	{
+		if(align < arena->granularity)
+			align = arena->granularity;
+		size = (size + arena->granularity - 1) / arena->granularity * arena->granularity;
+	}
+
+	uint32_t index = TLSF_NONE, node = TLSF_NONE;
+	gpu_arena_block* b = nullptr;
+	for(uint32_t i = 0; i < arena->blocks.size(); i++)
+	{
+		if(arena->blocks[i] == nullptr || arena->blocks[i]->memory_type != memory_type)
+			continue;
+		node = tlsfAlloc(arena->blocks[i], size, align);
+		if(node != TLSF_NONE)
+		{
+			index = i;
+			b = arena->blocks[i];
+			break;
+		}
+	}
+
+	if(b == nullptr)
+	{
+		b = arenaNewBlock(arena, memory_type, size, align, &index);
+		if(b == nullptr)
+			return false;
+		node = tlsfAlloc(b, size, align);
+		if(node == TLSF_NONE)
+		{
+			arenaReleaseBlock(arena, index);
+			return false;
+		}
+	}
+
+	b->nodes[node].optimal = optimal;
+	out->mem = b->mem;
+	out->offset = b->nodes[node].offset;
+	out->size = reqs.size;
+	out->mapped = b->mapped ? (char*)b->mapped + out->offset : nullptr;
+	out->block = index;
+	out->node = node;
+	return true;
+}
+
+void arenaFree(gpu_arena* arena, gpu_allocation* alloc)
+{
+	gpu_arena_block* b = arena->blocks[alloc->block];
+	tlsfFree(b, alloc->node);
+
+	//give empty blocks back, but keep one per memory type around so we don't thrash
+	if(b->live == 0)
+	{
+		for(uint32_t i = 0; i < arena->blocks.size(); i++)
+		{
+			if(i != alloc->block && arena->blocks[i] && arena->blocks[i]->memory_type == b->memory_type)
+			{
+				arenaReleaseBlock(arena, alloc->block);
+				break;
+			}
+		}
+	}
+	alloc->mem = VK_NULL_HANDLE;
+}
+
+bool arenaAllocBuffer(gpu_arena* arena, VkBuffer buf, VkMemoryPropertyFlags flags, gpu_allocation* out)
+{
+	VkMemoryRequirements reqs;
+	vkGetBufferMemoryRequirements(arena->device, buf, &reqs);
+	if(!arenaAlloc(arena, reqs, flags, false, out))
+		return false;
+	return vkBindBufferMemory(arena->device, buf, out->mem, out->offset) == VK_SUCCESS;
+}
+
+bool arenaAllocImage(gpu_arena* arena, VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags flags, gpu_allocation* out)
+{
+	VkMemoryRequirements reqs;
+	vkGetImageMemoryRequirements(arena->device, image, &reqs);
+	if(!arenaAlloc(arena, reqs, flags, tiling == VK_IMAGE_TILING_OPTIMAL, out))
+		return false;
+	return vkBindImageMemory(arena->device, image, out->mem, out->offset) == VK_SUCCESS;
+}
+
+gpu_arena_stats arenaStats(gpu_arena* arena)
+{
+	gpu_arena_stats s = {};
+	for(gpu_arena_block* b : arena->blocks)
+	{
+		if(b == nullptr)
+			continue;
+		s.block_count++;
+		s.reserved_bytes += b->size;
+		s.allocation_count += b->live;
+		for(uint32_t n = 0; n != TLSF_NONE; n = b->nodes[n].next_phys)
+		{
+			if(b->nodes[n].free)
+			{
+				s.free_range_count++;
+				s.free_bytes += b->nodes[n].size;
+				if(b->nodes[n].size > s.largest_free)
+					s.largest_free = b->nodes[n].size;
+			}
+			else
+				s.used_bytes += b->nodes[n].size;
+		}
+	}
+	s.fragmentation = s.free_bytes ? 1.0f - (float)s.largest_free / (float)s.free_bytes : 0.0f;
+	return s;
+}
+
+void arenaPrintStats(gpu_arena* arena)
+{
+	gpu_arena_stats s = arenaStats(arena);
+	printf("arena: %u blocks, %u allocations, %llu/%llu KB used, %u free ranges (largest %llu KB), fragmentation %.1f%%\n",
+		s.block_count, s.allocation_count,
+		(unsigned long long)(s.used_bytes / 1024), (unsigned long long)(s.reserved_bytes / 1024),
+		s.free_range_count, (unsigned long long)(s.largest_free / 1024), s.fragmentation * 100.0f);
+	printf("arena: %llu vkAllocateMemory calls (%.3f ms), %llu vkFreeMemory calls\n",
+		(unsigned long long)arena->driver_allocs, arena->driver_alloc_ms, (unsigned long long)arena->driver_frees);
+}
+
+void arenaDestroy(gpu_arena* arena)
+{
+	for(uint32_t i = 0; i < arena->blocks.size(); i++)
+		if(arena->blocks[i])
+			arenaReleaseBlock(arena, i);
+	arena->blocks.clear();
+}
+
+
+//--bench-arena: one vkAllocateMemory per buffer (what main.cpp used to do) vs the arena
+void arenaBenchmark(VkPhysicalDevice gpu, VkDevice device, uint32_t count)
+{
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(gpu, &props);
+	VkPhysicalDeviceMemoryProperties memProps;
+	vkGetPhysicalDeviceMemoryProperties(gpu, &memProps);
+
+	VkBufferCreateInfo buf_info = {};
+	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buf_info.pNext = nullptr;
+	buf_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	buf_info.size = 256;
+	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	std::vector<VkBuffer> bufs(count);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		VkResult res = vkCreateBuffer(device, &buf_info, nullptr, &bufs[i]);
+		assert(res == VK_SUCCESS);
+	}
+
+	//the naive path can't go past the driver's allocation limit, leave some room for everyone else
+	uint32_t limit = props.limits.maxMemoryAllocationCount;
+	uint32_t headroom = limit > 64 ? limit - 64 : limit / 2;
+	uint32_t naive_count = count;
+	if(naive_count > headroom)
+	{
+		naive_count = headroom;
+		printf("naive path capped at %u buffers (maxMemoryAllocationCount = %u)\n", naive_count, props.limits.maxMemoryAllocationCount);
+	}
+
+	std::vector<VkDeviceMemory> mems(naive_count);
+	auto start = std::chrono::high_resolution_clock::now();
+	for(uint32_t i = 0; i < naive_count; i++)
+	{
+		VkMemoryRequirements reqs;
+		vkGetBufferMemoryRequirements(device, bufs[i], &reqs);
+		VkMemoryAllocateInfo mem_alloc = {};
+		mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		mem_alloc.allocationSize = reqs.size;
+		bool found = memType(memProps, reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mem_alloc.memoryTypeIndex);
+		assert(found);
+		VkResult res = vkAllocateMemory(device, &mem_alloc, nullptr, &mems[i]);
+		assert(res == VK_SUCCESS);
+		vkBindBufferMemory(device, bufs[i], mems[i], 0);
+	}
+	double naive_alloc = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	start = std::chrono::high_resolution_clock::now();
+	for(uint32_t i = 0; i < naive_count; i++)
+		vkFreeMemory(device, mems[i], nullptr);
+	double naive_free = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	//memory can't be rebound, so new buffers for the arena pass
+	for(uint32_t i = 0; i < count; i++)
+	{
+		vkDestroyBuffer(device, bufs[i], nullptr);
+		VkResult res = vkCreateBuffer(device, &buf_info, nullptr, &bufs[i]);
+		assert(res == VK_SUCCESS);
+	}
+
+	gpu_arena arena;
+	arenaInit(&arena, gpu, device);
+	std::vector<gpu_allocation> allocs(count);
+	start = std::chrono::high_resolution_clock::now();
+	for(uint32_t i = 0; i < count; i++)
+	{
+		bool ok = arenaAllocBuffer(&arena, bufs[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocs[i]);
+		assert(ok);
+	}
+	double arena_alloc = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	//free every other one to show what fragmentation looks like
+	for(uint32_t i = 0; i < count; i += 2)
+		arenaFree(&arena, &allocs[i]);
+	arenaPrintStats(&arena);
+
+	start = std::chrono::high_resolution_clock::now();
+	for(uint32_t i = 1; i < count; i += 2)
+		arenaFree(&arena, &allocs[i]);
+	double arena_free = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	printf("naive: %u vkAllocateMemory calls, alloc %.3f ms (%.2f us/buffer), free %.3f ms\n",
+		naive_count, naive_alloc, naive_alloc * 1000.0 / naive_count, naive_free);
+	printf("arena: %llu vkAllocateMemory calls, alloc %.3f ms (%.2f us/buffer), free (second half) %.3f ms\n",
+		(unsigned long long)arena.driver_allocs, arena_alloc, arena_alloc * 1000.0 / count, arena_free);
+
+	arenaDestroy(&arena);
+	for(uint32_t i = 0; i < count; i++)
+		vkDestroyBuffer(device, bufs[i], nullptr);
+}
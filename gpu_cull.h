@@ -0,0 +1,537 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+#include <glm/mat4x4.hpp>
+
+#include "gpu_arena.h"
+#include "frame_loop.h"
+#include "upload_ring.h"
+#include "mvp_batch.h"
+#include "cull.h"
+#include "descriptors.h"
+#include "shader_reflect.h"
+#include "shaders.h" //gpu_cull.comp/.vert/.frag, generated by the build (see CMakeLists.txt)
+
+/*
+gpu driven culling
+
+the cpu path (cull.h -> uniform ring -> one draw per object) still costs a bind and a draw per
+visible object. here a compute shader does the frustum test instead and builds the draws itself:
+
+	draws buffer, one per frame in flight
+	offset 0	VkDrawIndexedIndirectCommand cmds[GPU_CULL_BATCHES], 32 byte stride
+	offset 128	uint ids[]			visible object ids, batch b's start at cmds[b].firstInstance
+
+objects are split into GPU_CULL_BATCHES contiguous ranges (standing in for per mesh/material
+batches). every visible object bumps its batch's instanceCount with an atomic (that's the count)
+and writes its id into the slot it got. then it's one vkCmdDrawIndexedIndirect per batch, each an
+instanced cube, and the vertex shader looks up ids[gl_InstanceIndex] for the model matrix.
+
+vulkan 1.0 has no draw indirect count, so the command count is fixed and culled objects just
+don't show up as instances, which is also why this doesn't need the multiDrawIndirect feature.
+it does need drawIndirectFirstInstance though (main turns it on, and refuses --gpu-cull without
+it): every batch after the first starts at a non-zero firstInstance.
+
+the shaders are shaders/gpu_cull.*, both pipeline layouts come from their reflection (see
+shader_reflect.h), the set layouts from the layout cache.
+*/
+
+#define GPU_CULL_BATCHES 4 //baked into both shaders, cmds[4]
+#define GPU_CULL_CMD_STRIDE 32
+#define GPU_CULL_IDS_OFFSET (GPU_CULL_BATCHES * GPU_CULL_CMD_STRIDE)
+#define GPU_CULL_LOCAL_SIZE 64
+
+typedef struct {
+	float planes[6][4];
+	uint32_t count;
+} gpu_cull_push;
+static_assert(gpu_cull_comp.reflection.push_size == sizeof(gpu_cull_push), "gpu_cull.comp's push constants aren't gpu_cull_push");
+static_assert(gpu_cull_vert.reflection.push_size == sizeof(glm::mat4), "gpu_cull.vert's push constants aren't the view projection");
+
+typedef struct {
+	VkDevice device;
+	uint32_t count;
+
+	VkBuffer spheres, models, indices;
+	gpu_allocation spheres_mem, models_mem, indices_mem;
+	VkBuffer draws[FRAMES_IN_FLIGHT];
+	gpu_allocation draws_mem[FRAMES_IN_FLIGHT];
+	VkDeviceSize draws_size;
+	uint32_t reset[GPU_CULL_IDS_OFFSET / 4]; //the cmds with instanceCount 0, copied over the draws buffer every frame
+
+	VkDescriptorPool pool;
+	VkDescriptorSet cull_sets[FRAMES_IN_FLIGHT]; //spheres, draws[i]
+	VkDescriptorSet draw_sets[FRAMES_IN_FLIGHT]; //models, draws[i]
+	shader_layout cull_layout, draw_layout;
+	VkShaderModule cull_module, vert_module, frag_module;
+	VkPipeline cull_pipeline, draw_pipeline;
+} gpu_cull;
+
+
+//first object of a batch: the shader puts object i in batch i * GPU_CULL_BATCHES / count,
+//so batch b starts at the smallest i with i * GPU_CULL_BATCHES >= b * count
+static uint32_t gpuCullBatchFirst(uint32_t count, uint32_t batch)
+{
+	return (uint32_t)(((uint64_t)count * batch + GPU_CULL_BATCHES - 1) / GPU_CULL_BATCHES);
+}
+
+
+static VkBuffer gpuCullBuffer(gpu_cull* gc, gpu_arena* arena, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags, gpu_allocation* mem)
+{
+	VkBufferCreateInfo buf_info = {};
+	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buf_info.pNext = nullptr;
+	buf_info.usage = usage;
+	buf_info.size = size;
+	buf_info.queueFamilyIndexCount = 0;
+	buf_info.pQueueFamilyIndices = nullptr;
+	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	buf_info.flags = 0;
+
+	VkBuffer buf;
+	VkResult res = vkCreateBuffer(gc->device, &buf_info, nullptr, &buf);
+	assert(res == VK_SUCCESS);
+	bool ok = arenaAllocBuffer(arena, buf, flags, mem);
+	assert(ok);
+	return buf;
+}
+
+//the ring only takes up to its own size per copy
+static void gpuCullUpload(upload_ring* uploads, VkBuffer dst, const void* data, VkDeviceSize size)
+{
+	VkDeviceSize chunk = uploads->size / 2;
+	for(VkDeviceSize offset = 0; offset < size; offset += chunk)
+		uploadBuffer(uploads, dst, offset, (const uint8_t*)data + offset, size - offset < chunk ? size - offset : chunk);
+}
+
+static void gpuCullWriteSet(gpu_cull* gc, VkDescriptorSet set, VkBuffer objects, VkBuffer draws)
+{
+	VkDescriptorBufferInfo infos[2] = {{objects, 0, VK_WHOLE_SIZE}, {draws, 0, VK_WHOLE_SIZE}};
+	VkWriteDescriptorSet writes[2] = {};
+	for(uint32_t i = 0; i < 2; i++)
+	{
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].pNext = nullptr;
+		writes[i].dstSet = set;
+		writes[i].dstBinding = i;
+		writes[i].dstArrayElement = 0;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].pBufferInfo = &infos[i];
+	}
+	vkUpdateDescriptorSets(gc->device, 2, writes, 0, nullptr);
+}
+
+//the most objects one 1D dispatch of the cull covers on gpu, at least 65535 groups' worth
+uint32_t gpuCullMaxObjects(VkPhysicalDevice gpu)
+{
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(gpu, &props);
+	uint64_t max = (uint64_t)props.limits.maxComputeWorkGroupCount[0] * GPU_CULL_LOCAL_SIZE;
+	return max < UINT32_MAX ? (uint32_t)max : UINT32_MAX;
+}
+
+//uploads the objects (through uploads, flushed before returning) and builds both pipelines against render_pass.
+//the set layouts are layouts' (see descriptors.h)
+void gpuCullInit(gpu_cull* gc, gpu_arena* arena, upload_ring* uploads, VkDevice device, VkPipelineCache cache, VkRenderPass render_pass,
+				 descriptor_layout_cache* layouts, const object_transforms* transforms, const object_bounds* bounds)
+{
+	assert(transforms->count == bounds->count);
+	gc->device = device;
+	gc->count = bounds->count;
+	uint32_t n = gc->count ? gc->count : 1; //no zero sized buffers
+
+	//the shaders want AoS: one vec4 per sphere, one mat4 per model
+	std::vector<float> spheres((size_t)n * 4, 0.0f);
+	std::vector<glm::mat4> models(n, glm::mat4(1.0f));
+	for(uint32_t i = 0; i < gc->count; i++)
+	{
+		for(uint32_t c = 0; c < 4; c++)
+			spheres[(size_t)i * 4 + c] = boundsArray(bounds, c)[i];
+		models[i] = transformsGet(transforms, i);
+	}
+
+	//cube corner i is at (i & 1, (i >> 1) & 1, (i >> 2) & 1), see the vertex shader
+	static const uint16_t cube[36] = {
+		0, 2, 6, 0, 6, 4,	1, 5, 7, 1, 7, 3,	//-x +x
+		0, 4, 5, 0, 5, 1,	2, 3, 7, 2, 7, 6,	//-y +y
+		0, 1, 3, 0, 3, 2,	4, 6, 7, 4, 7, 5,	//-z +z
+	};
+
+	gc->spheres = gpuCullBuffer(gc, arena, spheres.size() * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+								VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &gc->spheres_mem);
+	gc->models = gpuCullBuffer(gc, arena, models.size() * sizeof(glm::mat4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+							   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &gc->models_mem);
+	gc->indices = gpuCullBuffer(gc, arena, sizeof(cube), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+								VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &gc->indices_mem);
+	gpuCullUpload(uploads, gc->spheres, spheres.data(), spheres.size() * sizeof(float));
+	gpuCullUpload(uploads, gc->models, models.data(), models.size() * sizeof(glm::mat4));
+	gpuCullUpload(uploads, gc->indices, cube, sizeof(cube));
+	uploadFlush(uploads);
+
+	gc->draws_size = GPU_CULL_IDS_OFFSET + (VkDeviceSize)n * sizeof(uint32_t);
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+		gc->draws[i] = gpuCullBuffer(gc, arena, gc->draws_size,
+									 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+									 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &gc->draws_mem[i]);
+
+	memset(gc->reset, 0, sizeof(gc->reset));
+	for(uint32_t b = 0; b < GPU_CULL_BATCHES; b++)
+	{
+		VkDrawIndexedIndirectCommand draw = {};
+		draw.indexCount = 36;
+		draw.instanceCount = 0;
+		draw.firstIndex = 0;
+		draw.vertexOffset = 0;
+		draw.firstInstance = gpuCullBatchFirst(gc->count, b);
+		memcpy((uint8_t*)gc->reset + b * GPU_CULL_CMD_STRIDE, &draw, sizeof(draw));
+	}
+
+	//cull: spheres and draws for the compute stage. draw: models and draws for the vertex stage
+	const shader_reflection* cull_stages[] = {&gpu_cull_comp.reflection};
+	const shader_reflection* draw_stages[] = {&gpu_cull_vert.reflection, &gpu_cull_frag.reflection};
+	shaderLayoutCreate(&gc->cull_layout, device, layouts, cull_stages, 1, nullptr);
+	shaderLayoutCreate(&gc->draw_layout, device, layouts, draw_stages, 2, nullptr);
+	assert(gc->cull_layout.set_count == 1 && gc->draw_layout.set_count == 1);
+
+	VkDescriptorPoolSize pool_size = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * FRAMES_IN_FLIGHT};
+	VkDescriptorPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.pNext = nullptr;
+	pool_info.maxSets = 2 * FRAMES_IN_FLIGHT;
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes = &pool_size;
+	VkResult res = vkCreateDescriptorPool(device, &pool_info, nullptr, &gc->pool);
+	assert(res == VK_SUCCESS);
+
+	VkDescriptorSetLayout set_layouts[2 * FRAMES_IN_FLIGHT];
+	VkDescriptorSet sets[2 * FRAMES_IN_FLIGHT];
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		set_layouts[i * 2] = gc->cull_layout.sets[0];
+		set_layouts[i * 2 + 1] = gc->draw_layout.sets[0];
+	}
+	VkDescriptorSetAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.pNext = nullptr;
+	alloc_info.descriptorPool = gc->pool;
+	alloc_info.descriptorSetCount = 2 * FRAMES_IN_FLIGHT;
+	alloc_info.pSetLayouts = set_layouts;
+	res = vkAllocateDescriptorSets(device, &alloc_info, sets);
+	assert(res == VK_SUCCESS);
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		gc->cull_sets[i] = sets[i * 2];
+		gc->draw_sets[i] = sets[i * 2 + 1];
+		gpuCullWriteSet(gc, gc->cull_sets[i], gc->spheres, gc->draws[i]);
+		gpuCullWriteSet(gc, gc->draw_sets[i], gc->models, gc->draws[i]);
+	}
+
+	gc->cull_module = shaderModuleCreate(device, gpu_cull_comp.code, gpu_cull_comp.size);
+	gc->vert_module = shaderModuleCreate(device, gpu_cull_vert.code, gpu_cull_vert.size);
+	gc->frag_module = shaderModuleCreate(device, gpu_cull_frag.code, gpu_cull_frag.size);
+
+	VkComputePipelineCreateInfo comp_info = {};
+	comp_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	comp_info.pNext = nullptr;
+	comp_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	comp_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	comp_info.stage.module = gc->cull_module;
+	comp_info.stage.pName = "main";
+	comp_info.layout = gc->cull_layout.layout;
+	comp_info.basePipelineIndex = -1;
+	res = vkCreateComputePipelines(device, cache, 1, &comp_info, nullptr, &gc->cull_pipeline);
+	assert(res == VK_SUCCESS);
+
+	VkPipelineShaderStageCreateInfo stages[2] = {};
+	stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stages[0].module = gc->vert_module;
+	stages[0].pName = "main";
+	stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stages[1].module = gc->frag_module;
+	stages[1].pName = "main";
+
+	//no vertex buffers, the corners come from the index
+	VkPipelineVertexInputStateCreateInfo vertex_input = {};
+	vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+	input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPipelineViewportStateCreateInfo viewport = {};
+	viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewport.viewportCount = 1;
+	viewport.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo raster = {};
+	raster.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	raster.polygonMode = VK_POLYGON_MODE_FILL;
+	raster.cullMode = VK_CULL_MODE_NONE;
+	raster.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	raster.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisample = {};
+	multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineDepthStencilStateCreateInfo depth = {};
+	depth.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depth.depthTestEnable = VK_TRUE;
+	depth.depthWriteEnable = VK_TRUE;
+	depth.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+	VkPipelineColorBlendAttachmentState blend_attachment = {};
+	blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	VkPipelineColorBlendStateCreateInfo blend = {};
+	blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	blend.attachmentCount = 1;
+	blend.pAttachments = &blend_attachment;
+
+	VkDynamicState dynamic_states[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+	VkPipelineDynamicStateCreateInfo dynamic = {};
+	dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic.dynamicStateCount = 2;
+	dynamic.pDynamicStates = dynamic_states;
+
+	VkGraphicsPipelineCreateInfo pipe_info = {};
+	pipe_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipe_info.pNext = nullptr;
+	pipe_info.stageCount = 2;
+	pipe_info.pStages = stages;
+	pipe_info.pVertexInputState = &vertex_input;
+	pipe_info.pInputAssemblyState = &input_assembly;
+	pipe_info.pViewportState = &viewport;
+	pipe_info.pRasterizationState = &raster;
+	pipe_info.pMultisampleState = &multisample;
+	pipe_info.pDepthStencilState = &depth;
+	pipe_info.pColorBlendState = &blend;
+	pipe_info.pDynamicState = &dynamic;
+	pipe_info.layout = gc->draw_layout.layout;
+	pipe_info.renderPass = render_pass;
+	pipe_info.subpass = 0;
+	pipe_info.basePipelineIndex = -1;
+	res = vkCreateGraphicsPipelines(device, cache, 1, &pipe_info, nullptr, &gc->draw_pipeline);
+	assert(res == VK_SUCCESS);
+}
+
+//points frame's sets at spheres/models that something else writes (async_compute.h) instead of the static ones.
+//same layout and count, and the frame must not be in flight
+void gpuCullSetObjects(gpu_cull* gc, uint32_t frame, VkBuffer spheres, VkBuffer models)
+{
+	gpuCullWriteSet(gc, gc->cull_sets[frame], spheres, gc->draws[frame]);
+	gpuCullWriteSet(gc, gc->draw_sets[frame], models, gc->draws[frame]);
+}
+
+//outside the render pass: resets this frame's draws and runs the cull over them
+void gpuCullRecord(gpu_cull* gc, VkCommandBuffer cmd, uint32_t frame, const glm::mat4& view_proj)
+{
+	//the frame fence has signaled, nothing still reads this frame's draws
+	vkCmdUpdateBuffer(cmd, gc->draws[frame], 0, sizeof(gc->reset), gc->reset);
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	if(gc->count)
+	{
+		gpu_cull_push push;
+		frustum f = frustumFromMatrix(view_proj);
+		memcpy(push.planes, f.planes, sizeof(push.planes));
+		push.count = gc->count;
+
+		uint32_t groups = (gc->count + GPU_CULL_LOCAL_SIZE - 1) / GPU_CULL_LOCAL_SIZE; //within the limit, the caller checked gpuCullMaxObjects
+
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, gc->cull_pipeline);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, gc->cull_layout.layout, 0, 1, &gc->cull_sets[frame], 0, nullptr);
+		vkCmdPushConstants(cmd, gc->cull_layout.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+		vkCmdDispatch(cmd, groups, 1, 1);
+	}
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+						 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+//inside the render pass (inline contents): the batches' indirect draws
+void gpuCullDraw(gpu_cull* gc, VkCommandBuffer cmd, uint32_t frame, const glm::mat4& view_proj, VkExtent2D extent)
+{
+	VkViewport viewport = {0.0f, 0.0f, (float)extent.width, (float)extent.height, 0.0f, 1.0f};
+	VkRect2D scissor = {{0, 0}, extent};
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, gc->draw_pipeline);
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, gc->draw_layout.layout, 0, 1, &gc->draw_sets[frame], 0, nullptr);
+	vkCmdPushConstants(cmd, gc->draw_layout.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &view_proj);
+	vkCmdBindIndexBuffer(cmd, gc->indices, 0, VK_INDEX_TYPE_UINT16);
+	for(uint32_t b = 0; b < GPU_CULL_BATCHES; b++)
+		vkCmdDrawIndexedIndirect(cmd, gc->draws[frame], b * GPU_CULL_CMD_STRIDE, 1, GPU_CULL_CMD_STRIDE);
+}
+
+//runs the gpu cull once on its own, reads the draws back and compares them with the cpu cull.
+//float rounding can differ between the two, so disagreements on spheres that touch a plane
+//are counted separately and don't fail the check
+bool gpuCullVerify(gpu_cull* gc, gpu_arena* arena, VkQueue queue, uint32_t queue_family, const glm::mat4& view_proj, const object_bounds* bounds)
+{
+	gpu_allocation readback_mem;
+	VkBuffer readback = gpuCullBuffer(gc, arena, gc->draws_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+									  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readback_mem);
+
+	VkCommandPoolCreateInfo cmd_pool_info = {};
+	cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cmd_pool_info.pNext = nullptr;
+	cmd_pool_info.queueFamilyIndex = queue_family;
+	cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	VkCommandPool pool;
+	VkResult res = vkCreateCommandPool(gc->device, &cmd_pool_info, nullptr, &pool);
+	assert(res == VK_SUCCESS);
+
+	VkCommandBufferAllocateInfo cmd_info = {};
+	cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cmd_info.pNext = nullptr;
+	cmd_info.commandPool = pool;
+	cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmd_info.commandBufferCount = 1;
+	VkCommandBuffer cmd;
+	res = vkAllocateCommandBuffers(gc->device, &cmd_info, &cmd);
+	assert(res == VK_SUCCESS);
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.pNext = nullptr;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	res = vkBeginCommandBuffer(cmd, &begin_info);
+	assert(res == VK_SUCCESS);
+
+	gpuCullRecord(gc, cmd, 0, view_proj);
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	VkBufferCopy copy = {0, 0, gc->draws_size};
+	vkCmdCopyBuffer(cmd, gc->draws[0], readback, 1, &copy);
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	res = vkEndCommandBuffer(cmd);
+	assert(res == VK_SUCCESS);
+
+	VkFenceCreateInfo fence_info = {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_info.pNext = nullptr;
+	fence_info.flags = 0;
+	VkFence fence;
+	res = vkCreateFence(gc->device, &fence_info, nullptr, &fence);
+	assert(res == VK_SUCCESS);
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = nullptr;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &cmd;
+	res = vkQueueSubmit(queue, 1, &submit_info, fence);
+	assert(res == VK_SUCCESS);
+	res = vkWaitForFences(gc->device, 1, &fence, VK_TRUE, UINT64_MAX);
+	assert(res == VK_SUCCESS);
+
+	//every batch's ids have to stay inside the batch's own range
+	const uint8_t* data = (const uint8_t*)readback_mem.mapped;
+	const uint32_t* ids = (const uint32_t*)(data + GPU_CULL_IDS_OFFSET);
+	std::vector<uint32_t> gpu_visible;
+	bool ranges_ok = true;
+	for(uint32_t b = 0; b < GPU_CULL_BATCHES; b++)
+	{
+		VkDrawIndexedIndirectCommand draw;
+		memcpy(&draw, data + b * GPU_CULL_CMD_STRIDE, sizeof(draw));
+		uint32_t first = gpuCullBatchFirst(gc->count, b);
+		uint32_t last = gpuCullBatchFirst(gc->count, b + 1);
+		if(draw.firstInstance != first || draw.instanceCount > last - first)
+		{
+			ranges_ok = false;
+			continue;
+		}
+		for(uint32_t i = 0; i < draw.instanceCount; i++)
+		{
+			uint32_t id = ids[first + i];
+			ranges_ok = ranges_ok && id >= first && id < last;
+			gpu_visible.push_back(id);
+		}
+	}
+	std::sort(gpu_visible.begin(), gpu_visible.end()); //the atomics hand out slots in any order
+
+	//reference: the scalar cpu kernel
+	std::vector<uint32_t> cpu_visible;
+	cull_pool reference;
+	cullInit(&reference, 1, cullKernels()[0].fn);
+	cullRun(&reference, view_proj, bounds, cpu_visible);
+	cullDestroy(&reference);
+
+	std::vector<uint32_t> diff;
+	std::set_symmetric_difference(gpu_visible.begin(), gpu_visible.end(), cpu_visible.begin(), cpu_visible.end(), std::back_inserter(diff));
+	frustum f = frustumFromMatrix(view_proj);
+	uint32_t boundary = 0;
+	for(uint32_t id : diff)
+	{
+		float closest = 1e30f;
+		for(uint32_t p = 0; p < 6; p++)
+		{
+			float d = f.planes[p][0] * boundsArray(bounds, 0)[id] + f.planes[p][1] * boundsArray(bounds, 1)[id]
+					+ f.planes[p][2] * boundsArray(bounds, 2)[id] + f.planes[p][3] + boundsArray(bounds, 3)[id];
+			closest = fminf(closest, fabsf(d));
+		}
+		boundary += closest < 1e-3f;
+	}
+	bool ok = ranges_ok && diff.size() == boundary;
+	printf("gpu cull: %zu/%u visible, cpu %zu, %zu differ (%u on a plane), %s\n", gpu_visible.size(), gc->count, cpu_visible.size(),
+		diff.size(), boundary, ok ? "ok" : "MISMATCH");
+
+	vkDestroyFence(gc->device, fence, nullptr);
+	vkDestroyCommandPool(gc->device, pool, nullptr);
+	vkDestroyBuffer(gc->device, readback, nullptr);
+	arenaFree(arena, &readback_mem);
+	return ok;
+}
+
+void gpuCullDestroy(gpu_cull* gc, gpu_arena* arena)
+{
+	vkDestroyPipeline(gc->device, gc->draw_pipeline, nullptr);
+	vkDestroyPipeline(gc->device, gc->cull_pipeline, nullptr);
+	vkDestroyShaderModule(gc->device, gc->frag_module, nullptr);
+	vkDestroyShaderModule(gc->device, gc->vert_module, nullptr);
+	vkDestroyShaderModule(gc->device, gc->cull_module, nullptr);
+	shaderLayoutDestroy(&gc->draw_layout, gc->device);
+	shaderLayoutDestroy(&gc->cull_layout, gc->device);
+	vkDestroyDescriptorPool(gc->device, gc->pool, nullptr);
+
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		vkDestroyBuffer(gc->device, gc->draws[i], nullptr);
+		arenaFree(arena, &gc->draws_mem[i]);
+	}
+	vkDestroyBuffer(gc->device, gc->indices, nullptr);
+	arenaFree(arena, &gc->indices_mem);
+	vkDestroyBuffer(gc->device, gc->models, nullptr);
+	arenaFree(arena, &gc->models_mem);
+	vkDestroyBuffer(gc->device, gc->spheres, nullptr);
+	arenaFree(arena, &gc->spheres_mem);
+}
@@ -7,12 +7,42 @@
 #include <cstdio>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
+#include <cctype>
 #include <iostream>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "gpu_arena.h"
+#include "frame_loop.h"
+#include "cmd_recorder.h"
+#include "pipeline_cache.h"
+#include "upload_ring.h"
+#include "uniform_ring.h"
+#include "mvp_batch.h"
+#include "cull.h"
+#include "gpu_cull.h"
+#include "offscreen.h"
+#include "present.h"
+#include "swapchain.h"
+#include "deletion_queue.h"
+#include "queues.h"
+#include "async_compute.h"
+#include "profiler.h"
+#include "debug_messages.h"
+#include "device_profile.h"
+#include "startup.h"
+#include "device_select.h"
+#include "depth_format.h"
+#include "render_pass.h"
+#include "descriptors.h"
+#include "bindless.h"
+#include "shader_reflect.h"
+#include "pipeline_compiler.h"
+#include "shaders.h" //generated by the build from shaders/ (see CMakeLists.txt)
+
 
 /*
 Steps
@@ -34,12 +64,6 @@ Steps
 
 */
 
-static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) {
-        std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
-
-        return VK_FALSE;
-    }
-
     VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
     auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
     if (func != nullptr) {
@@ -56,15 +80,6 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
     }
 }
 
-bool memType(VkPhysicalDeviceMemoryProperties& props, uint32_t typeBits, VkFlags requirements, uint32_t* typeIndex)
-{
-	for(uint32_t i = 0; i < props.memoryTypeCount; i++)
-	{
-		if((typeBits & 1) == 1)
-	}
-}
-
-
 std::vector<const char*> validationLayers;
 
 bool checkValidationLayerSupport() {
@@ -95,10 +110,77 @@ bool checkValidationLayerSupport() {
 	return true;
 }
 
+//every item binds its MVP slot and draws a cube with its material's pipeline, or without pipelines
+//(--bench-record, before they exist) clears its own little square
 typedef struct {
-	VkImage image;
-	VkImageView view;
-} swap_chain_buffer;
+	VkExtent2D extent;
+	uniform_ring* uniforms; //null until the ring exists (eg --bench-record)
+	VkDescriptorSet set; //this frame's, for the ring
+	bindless_table* bindless; //non-null: push the slot instead of binding the set per draw
+	uint32_t ring_indices[FRAMES_IN_FLIGHT]; //each frame's region of the ring in the bindless table
+	VkPipelineLayout layout;
+	uint32_t frame;
+	const uint32_t* objects; //item i draws objects[i] (the visible list), null = object i
+	const VkPipeline* pipelines; //per material, object o is material o % materials. null: clear squares
+	uint32_t materials;
+} draw_items;
+
+void recordDrawItems(VkCommandBuffer cmd, uint32_t first, uint32_t count, void* user)
+{
+	draw_items* items = (draw_items*)user;
+	uint32_t cols = items->extent.width / 8 ? items->extent.width / 8 : 1;
+	uint32_t rows = items->extent.height / 8 ? items->extent.height / 8 : 1;
+	if(items->uniforms && items->bindless)
+		bindlessBind(items->bindless, cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, items->layout);
+	VkPipeline bound = VK_NULL_HANDLE;
+	if(items->pipelines)
+	{
+		//dynamic state isn't inherited by secondaries
+		VkViewport viewport = {0.0f, 0.0f, (float)items->extent.width, (float)items->extent.height, 0.0f, 1.0f};
+		VkRect2D scissor = {{0, 0}, items->extent};
+		vkCmdSetViewport(cmd, 0, 1, &viewport);
+		vkCmdSetScissor(cmd, 0, 1, &scissor);
+	}
+	for(uint32_t i = first; i < first + count; i++)
+	{
+		if(items->uniforms && items->bindless)
+			bindlessDraw(cmd, items->layout, items->ring_indices[items->frame], uniformRingElement(items->uniforms, i));
+		else if(items->uniforms)
+		{
+			uint32_t offset = uniformRingOffset(items->uniforms, items->frame, i);
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, items->layout, 0, 1, &items->set, 1, &offset);
+		}
+
+		//the MVP slots are packed in item order, the square stays where its object is
+		uint32_t object = items->objects ? items->objects[i] : i;
+		if(items->pipelines)
+		{
+			VkPipeline pipeline = items->pipelines[object % items->materials];
+			if(pipeline != bound)
+				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			bound = pipeline;
+			vkCmdDraw(cmd, 14, 1, 0, 0); //the cube strip, see shaders/mvp.vert
+			continue;
+		}
+
+		VkClearAttachment clear = {};
+		clear.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		clear.colorAttachment = 0;
+		clear.clearValue.color.float32[0] = (float)(object % 7) / 7.0f;
+		clear.clearValue.color.float32[1] = (float)(object % 13) / 13.0f;
+		clear.clearValue.color.float32[2] = 0.5f;
+		clear.clearValue.color.float32[3] = 1.0f;
+
+		VkClearRect rect = {};
+		rect.rect.offset.x = (int32_t)((object % cols) * 8);
+		rect.rect.offset.y = (int32_t)((object / cols % rows) * 8);
+		rect.rect.extent.width = 6;
+		rect.rect.extent.height = 6;
+		rect.baseArrayLayer = 0;
+		rect.layerCount = 1;
+		vkCmdClearAttachments(cmd, 1, &clear, 1, &rect);
+	}
+}
 
 void derror(const char* err)
 {
@@ -114,31 +196,283 @@ void derror(std::string str)
 }
 
 
-int main(/*int argc, char const *argv[]*/)
+int main(int argc, char const *argv[])
 {
 	
 	uint32_t wWidth = 1280, wHeight = 720;
 
-	if(!checkValidationLayerSupport()){
-		derror("No validationLayers!");
+	//command line options
+	bool benchArena = false;
+	uint32_t benchArenaCount = 4096;
+	uint64_t frameCount = 0; //0 = run until the window is closed
+	uint32_t drawCount = 1024;
+	uint32_t threadCount = std::thread::hardware_concurrency();
+	bool benchRecord = false;
+	const char* pipelineCachePath = PIPELINE_CACHE_DEFAULT_PATH;
+	const char* profilePath = DEVICE_PROFILE_DEFAULT_PATH;
+	bool coldStart = false; //ignore the caches on disk
+	const char* gpuOverride = nullptr; //index or part of the name, see device_select.h
+	uint32_t benchPipelineCacheCount = 0;
+	uint32_t benchUploadCount = 0, benchUploadSize = 256;
+	uint32_t benchUniformCount = 0;
+	uint32_t benchMvpCount = 0;
+	uint32_t benchCullCount = 0;
+	const char* mvpKernel = nullptr; //nullptr = fastest the cpu supports
+	bool gpuCull = false; //cull and build the draws in a compute shader instead
+	bool asyncCompute = false; //move the objects in a physics step on the compute queue
+	bool headless = false; //no window, render offscreen and read the frames back
+	const char* headlessDump = nullptr; //ppm of the last headless frame
+	const char* presentStrategy = "fifo"; //see present.h
+	double paceHz = 0.0; //frame rate cap, 0 = none
+	bool profile = false; //gpu timestamps and cpu times per scope, see profiler.h
+	const char* tracePath = nullptr; //chrome trace of the whole run
+	const char* debugMode = "async"; //validation messages, see debug_messages.h
+	VkDebugUtilsMessageSeverityFlagBitsEXT debugSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+	uint32_t benchDebugCount = 0;
+	bool testSelect = false; //device scoring and selection against made up devices (see device_select.h)
+	float depthTolerance = 0.05f; //world units at the far plane, picks the depth format (see depth_format.h)
+	uint32_t benchDepthCount = 0;
+	uint32_t benchDescriptorCount = 0;
+	const char* descriptorMode = "bindless"; //or classic, bindless falls back to classic where there's no descriptor indexing (see bindless.h)
+	uint32_t benchBindlessCount = 0;
+	uint32_t benchShaderCount = 0;
+	const char* pipelineMode = "async"; //or sync: compile new materials' pipelines on the render thread (see pipeline_compiler.h)
+	uint32_t materialCount = PIPELINE_KEY_COUNT;
+	uint32_t pipelineBudget = PIPELINE_MAX_VARIANTS;
+	double prewarmMs = 50.0; //startup waits this long at most for the manifest's pipelines
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--bench-arena") == 0)
+		{
+			benchArena = true;
+			if(i + 1 < argc && isdigit(argv[i + 1][0]))
+				benchArenaCount = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frameCount = strtoull(argv[++i], nullptr, 10);
+		else if(strcmp(argv[i], "--draws") == 0 && i + 1 < argc)
+			drawCount = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threadCount = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--bench-record") == 0)
+			benchRecord = true;
+		else if(strcmp(argv[i], "--pipeline-cache") == 0 && i + 1 < argc)
+			pipelineCachePath = argv[++i];
+		else if(strcmp(argv[i], "--device-profiles") == 0 && i + 1 < argc)
+			profilePath = argv[++i];
+		else if(strcmp(argv[i], "--cold") == 0)
+			coldStart = true;
+		else if(strcmp(argv[i], "--bench-upload") == 0)
+		{
+			benchUploadCount = 65536;
+			if(i + 1 < argc && isdigit(argv[i + 1][0]))
+				benchUploadCount = atoi(argv[++i]);
+			if(i + 1 < argc && isdigit(argv[i + 1][0]))
+				benchUploadSize = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--bench-uniform") == 0)
+		{
+			benchUniformCount = 100000;
+			if(i + 1 < argc && isdigit(argv[i + 1][0]))
+				benchUniformCount = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--bench-mvp") == 0)
+		{
+			benchMvpCount = 1000000;
+			if(i + 1 < argc && isdigit(argv[i + 1][0]))
+				benchMvpCount = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--bench-cull") == 0)
+		{
+			benchCullCount = 1000000;
+			if(i + 1 < argc && isdigit(argv[i + 1][0]))
+				benchCullCount = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--mvp-kernel") == 0 && i + 1 < argc)
+			mvpKernel = argv[++i];
+		else if(strcmp(argv[i], "--gpu") == 0 && i + 1 < argc)
+			gpuOverride = argv[++i];
+		else if(strcmp(argv[i], "--gpu-cull") == 0)
+			gpuCull = true;
+		else if(strcmp(argv[i], "--async-compute") == 0)
+			asyncCompute = true;
+		else if(strcmp(argv[i], "--headless") == 0)
+			headless = true;
+		else if(strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+			headlessDump = argv[++i];
+		else if(strcmp(argv[i], "--present") == 0 && i + 1 < argc)
+			presentStrategy = argv[++i];
+		else if(strcmp(argv[i], "--pace-hz") == 0 && i + 1 < argc)
+			paceHz = atof(argv[++i]);
+		else if(strcmp(argv[i], "--bench-pipeline-cache") == 0)
+		{
+			benchPipelineCacheCount = 64;
+			if(i + 1 < argc && isdigit(argv[i + 1][0]))
+				benchPipelineCacheCount = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--profile") == 0)
+			profile = true;
+		else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+		{
+			profile = true;
+			tracePath = argv[++i];
+		}
+		else if(strcmp(argv[i], "--debug-messages") == 0 && i + 1 < argc)
+			debugMode = argv[++i];
+		else if(strcmp(argv[i], "--debug-verbose") == 0)
+			debugSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+		else if(strcmp(argv[i], "--depth-tolerance") == 0 && i + 1 < argc)
+			depthTolerance = (float)atof(argv[++i]);
+		else if(strcmp(argv[i], "--bench-depth") == 0)
+		{
+			benchDepthCount = 100;
+			if(i + 1 < argc && isdigit(argv[i + 1][0]))
+				benchDepthCount = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--bench-descriptors") == 0)
+		{
+			benchDescriptorCount = 10000;
+			if(i + 1 < argc && isdigit(argv[i + 1][0]))
+				benchDescriptorCount = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--descriptors") == 0 && i + 1 < argc)
+			descriptorMode = argv[++i];
+		else if(strcmp(argv[i], "--bench-bindless") == 0)
+		{
+			benchBindlessCount = 1024;
+			if(i + 1 < argc && isdigit(argv[i + 1][0]))
+				benchBindlessCount = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--pipelines") == 0 && i + 1 < argc)
+			pipelineMode = argv[++i];
+		else if(strcmp(argv[i], "--materials") == 0 && i + 1 < argc)
+			materialCount = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--pipeline-budget") == 0 && i + 1 < argc)
+			pipelineBudget = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--prewarm-ms") == 0 && i + 1 < argc)
+			prewarmMs = atof(argv[++i]);
+		else if(strcmp(argv[i], "--bench-shaders") == 0)
+		{
+			benchShaderCount = 100;
+			if(i + 1 < argc && isdigit(argv[i + 1][0]))
+				benchShaderCount = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--bench-debug") == 0)
+		{
+			benchDebugCount = 100000;
+			if(i + 1 < argc && isdigit(argv[i + 1][0]))
+				benchDebugCount = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--test-select") == 0)
+			testSelect = true;
+		else
+			printf("unknown option %s\n", argv[i]);
 	}
 
-	//create an sdl window
-	SDL_Window* window;
-	VkSurfaceKHR surface;
-	SDL_Init(SDL_INIT_VIDEO);
-
+	//the physics step's output is what the gpu cull draws
+	if(asyncCompute && !gpuCull)
+	{
+		printf("--async-compute draws through the gpu cull, turning on --gpu-cull\n");
+		gpuCull = true;
+	}
 
-	window = SDL_CreateWindow("My App", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1280, 720, SDL_WINDOW_VULKAN);
-	if(window == NULL)
-		derror(std::string("Could not create window: ") + SDL_GetError());
+	//nothing to close without a window
+	if(headless && frameCount == 0)
+		frameCount = 1000;
+
+	if(!mvpSelectKernel(mvpKernel))
+		printf("no %s mvp kernel on this cpu, using %s\n", mvpKernel, mvpKernelName());
+
+	if(benchMvpCount)
+		mvpBenchmark(benchMvpCount);
+
+	if(benchCullCount)
+		cullBenchmark(benchCullCount);
+
+	if(benchDebugCount)
+		debugMessagesBenchmark(benchDebugCount);
+
+	if(testSelect && !deviceSelectTest())
+		derror("Device selection doesn't pick what it should!");
+
+	//from here to the render loop is startup, timed by phase (see startup.h)
+	startup_timer startup;
+	startupInit(&startup);
+
+	//started before the instance, messages from vkCreateInstance come through it too
+	debug_messages debugMessages;
+	if(!debugMessagesInit(&debugMessages, debugMode, debugSeverity, stderr))
+		printf("unknown debug message mode %s, using async\n", debugMode);
+	bool debugging = debugMessages.mode != DEBUG_MESSAGES_OFF;
+
+	//nothing in here needs the window, it runs while the main thread makes one
+	bool layersFound = false;
+	bool properties2 = false; //VK_KHR_get_physical_device_properties2, for the features behind extensions
+	std::vector<uint8_t> pipelineCacheData;
+	std::vector<device_profile> cachedProfiles;
+	std::thread startupWorker([&]() {
+		size_t phase = startupBegin(&startup, "layers");
+		layersFound = debugging && checkValidationLayerSupport();
+		startupEnd(&startup, phase);
+
+		phase = startupBegin(&startup, "instance extensions");
+		uint32_t count = 0;
+		vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+		std::vector<VkExtensionProperties> extensions(count);
+		vkEnumerateInstanceExtensionProperties(nullptr, &count, extensions.data());
+		for(const VkExtensionProperties& ext : extensions)
+		{
+			if(strcmp(ext.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0)
+				properties2 = true;
+		}
+		startupEnd(&startup, phase);
+
+		phase = startupBegin(&startup, "read pipeline cache");
+		if(!coldStart && !readFile(pipelineCachePath, pipelineCacheData))
+			pipelineCacheData.clear();
+		startupEnd(&startup, phase);
+
+		phase = startupBegin(&startup, "read device profiles");
+		if(!coldStart)
+			profilesRead(profilePath, cachedProfiles);
+		startupEnd(&startup, phase);
+	});
+
+	//create an sdl window (headless: no window, no surface, no surface extensions)
+	SDL_Window* window = nullptr;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+	std::vector<const char *> extensionNames;
+	if(!headless)
+	{
+		size_t phase = startupBegin(&startup, "window");
+		SDL_Init(SDL_INIT_VIDEO);
+
+		window = SDL_CreateWindow("My App", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, wWidth, wHeight, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+		if(window == NULL)
+			derror(std::string("Could not create window: ") + SDL_GetError());
+
+		//get the right extensions for SDL2
+		uint32_t extensionCount;
+		SDL_Vulkan_GetInstanceExtensions(window, &extensionCount, nullptr);
+		extensionNames.resize(extensionCount);
+		SDL_Vulkan_GetInstanceExtensions(window, &extensionCount, extensionNames.data());
+		startupEnd(&startup, phase);
+	}
 
-	//get the right extensions for SDL2
-	uint32_t extensionCount;
-	SDL_Vulkan_GetInstanceExtensions(window, &extensionCount, nullptr);
-	std::vector<const char *> extensionNames(extensionCount);
-	SDL_Vulkan_GetInstanceExtensions(window, &extensionCount, extensionNames.data());
-	extensionNames.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+	startupWorker.join();
+	if(!debugging)
+		printf("debug messages off: no validation layers\n");
+	else if(!layersFound){
+		//ci and render farm machines usually don't have the sdk installed
+		if(!headless)
+			derror("No validationLayers!");
+		printf("no validation layers, running without\n");
+		validationLayers.clear();
+	}
+	if(debugging)
+		extensionNames.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+	if(properties2)
+		extensionNames.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 
 	//creating instance--------------------------------------------------------
 	VkApplicationInfo app_info = {};
@@ -163,11 +497,9 @@ int main(/*int argc, char const *argv[]*/)
 
 
 	VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo = {};
-	debugCreateInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-	debugCreateInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-	debugCreateInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-	debugCreateInfo.pfnUserCallback = debugCallback;
-	inst_info.pNext = (VkDebugUtilsMessengerCreateInfoEXT*) &debugCreateInfo;
+	debugMessagesCreateInfo(&debugMessages, &debugCreateInfo);
+	if(debugging)
+		inst_info.pNext = (VkDebugUtilsMessengerCreateInfoEXT*) &debugCreateInfo;
 
 	
 	
@@ -183,469 +515,337 @@ int main(/*int argc, char const *argv[]*/)
 
 	VkInstance inst;
 	
+	size_t instancePhase = startupBegin(&startup, "instance");
 	VkResult res = vkCreateInstance(&inst_info, nullptr, &inst);
 	if(res == VK_ERROR_INCOMPATIBLE_DRIVER)
 		derror("Could not find a compatible Vulkan ICD!\n");
 	else if(res)
 		derror("Unknown error!\n");
-	
-	if(!SDL_Vulkan_CreateSurface(window, inst, &surface))
-		derror(std::string("Could not create window: ") + SDL_GetError());
-
-	VkDebugUtilsMessengerEXT debugMessenger;
-	CreateDebugUtilsMessengerEXT(inst, &debugCreateInfo, nullptr, &debugMessenger);
-
+	startupEnd(&startup, instancePhase);
 
 	//end create instance------------------------------------------------------
 
 	//device enumeration-------------------------------------------------------
 
-
-	uint32_t gpu_count = 1;
-	res = vkEnumeratePhysicalDevices(inst, &gpu_count, nullptr);
-	assert(gpu_count);
+	//the instance isn't externally synchronized for any of this, enumeration and the capability
+	//queries run while the main thread makes the surface and the messenger
 	std::vector<VkPhysicalDevice> gpus;
-	gpus.resize(gpu_count);
-	res = vkEnumeratePhysicalDevices(inst, &gpu_count, gpus.data());
+	std::vector<device_profile> profiles;
+	std::thread enumerateWorker([&]() {
+		size_t phase = startupBegin(&startup, "enumerate devices");
+		uint32_t gpu_count = 0;
+		VkResult res = vkEnumeratePhysicalDevices(inst, &gpu_count, nullptr);
+		assert(res == VK_SUCCESS);
+		gpus.resize(gpu_count);
+		res = vkEnumeratePhysicalDevices(inst, &gpu_count, gpus.data());
+		assert(res == VK_SUCCESS);
+		startupEnd(&startup, phase);
 
+		phase = startupBegin(&startup, "device profiles");
+		PFN_vkGetPhysicalDeviceFeatures2KHR features2 = nullptr;
+		PFN_vkGetPhysicalDeviceProperties2KHR getProperties2 = nullptr;
+		if(properties2)
+		{
+			features2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(inst, "vkGetPhysicalDeviceFeatures2KHR");
+			getProperties2 = (PFN_vkGetPhysicalDeviceProperties2KHR)vkGetInstanceProcAddr(inst, "vkGetPhysicalDeviceProperties2KHR");
+		}
+		uint32_t queried = profilesGet(gpus, cachedProfiles, profiles, features2, getProperties2);
+		startupEnd(&startup, phase);
+		printf("device profiles: %zu from %s, %u queried\n", gpus.size() - queried, profilePath, queried);
+		if(queried)
+		{
+			phase = startupBegin(&startup, "write device profiles");
+			if(!profilesSave(profilePath, profiles))
+				printf("couldn't save device profiles to %s\n", profilePath);
+			startupEnd(&startup, phase);
+		}
+	});
+
+	if(!headless)
+	{
+		size_t phase = startupBegin(&startup, "surface");
+		if(!SDL_Vulkan_CreateSurface(window, inst, &surface))
+			derror(std::string("Could not create window: ") + SDL_GetError());
+		startupEnd(&startup, phase);
+	}
+
+	//release mode registers nothing, the layers aren't loaded either
+	VkDebugUtilsMessengerEXT debugMessenger = VK_NULL_HANDLE;
+	if(debugging)
+	{
+		size_t phase = startupBegin(&startup, "debug messenger");
+		CreateDebugUtilsMessengerEXT(inst, &debugCreateInfo, nullptr, &debugMessenger);
+		startupEnd(&startup, phase);
+	}
+
+	enumerateWorker.join();
+	if(gpus.empty())
+		derror("No Vulkan devices!");
 
 	//https://www.khronos.org/registry/vulkan/specs/1.1-extensions/man/html/VkPhysicalDeviceProperties.html
 	VkPhysicalDeviceProperties gpuProps[gpus.size()];
-	printf("Compatible Physical GPUs:\n");
 	for(uint32_t i = 0; i < gpus.size(); i++)
-	{
-		vkGetPhysicalDeviceProperties(gpus[i], &(gpuProps[i]));
-		printf("%d: %s\n", i, gpuProps[i].deviceName);
-	}
+		gpuProps[i] = profiles[i].props;
+
+	//the best device that can run this, not just the first one (see device_select.h)
+	device_requirements requirements;
+	if(!headless)
+		requirements.extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	requirements.optional_extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+	requirements.surface = surface;
+	uint32_t gpuIndex = deviceSelect(gpus, profiles, &requirements, gpuOverride);
+	if(gpuIndex == UINT32_MAX)
+		derror("No Vulkan device can run this!");
+	VkPhysicalDevice gpu = gpus[gpuIndex];
+	const device_profile& gpuProfile = profiles[gpuIndex];
 
 
 	//end device enumeration---------------------------------------------------
 
 	//device initialization----------------------------------------------------
 
-	//first we need the right device queue w/ both the graphics and present
-	//present just means that it can 'present' to the window
+	//graphics needs a queue that can present to the window (or a separate present queue),
+	//compute and transfer get their own families where the device has them (see queues.h)
+	size_t devicePhase = startupBegin(&startup, "device");
+	device_queues queues;
+	if(!queuesFind(&queues, gpu, surface, gpuProfile.families))
+		derror("Couldn't find queues for both graphics and present!");
+	uint32_t graphics_queue_family_index = queues.graphics;
 
-	VkDeviceQueueCreateInfo queue_info = {};
-	uint32_t 	queue_family_count = 0, 
-				present_queue_family_index = UINT32_MAX, graphics_queue_family_index = UINT32_MAX;
-	std::vector<VkQueueFamilyProperties> queue_props;
+	float queue_priorities[1] = {0.0}; //one queue per family, nothing to prioritise
+	std::vector<VkDeviceQueueCreateInfo> queue_infos;
+	queuesCreateInfos(&queues, queue_priorities, queue_infos);
 
-	//get device queue props
-	vkGetPhysicalDeviceQueueFamilyProperties(gpus[0], &queue_family_count, nullptr);
-	assert(queue_family_count >= 1);
-	queue_props.resize(queue_family_count);
-	vkGetPhysicalDeviceQueueFamilyProperties(gpus[0], &queue_family_count, queue_props.data());
 
-	VkBool32 *pSupportsPresent = (VkBool32*)malloc(queue_family_count * sizeof(VkBool32));
-	for(uint32_t i = 0; i < queue_family_count; i++)
-		vkGetPhysicalDeviceSurfaceSupportKHR(gpus[0], i, surface, &pSupportsPresent[i]);
-	
+	//now we can create a logical device using the queues we found
 
-	//search for graphics and present queue in queue array
-	
-	for(uint32_t i = 0; i < queue_family_count; ++i)
+	std::vector<const char*> deviceExtensions;
+	if(!headless)
+		deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+	//cross queue sync is nicer with timeline semaphores, core in 1.2 but an extension for us
+	bool timeline = profileHasExtension(&gpuProfile, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_features = {};
+	timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	timeline_features.pNext = nullptr;
+	timeline_features.timelineSemaphore = VK_TRUE;
+	if(timeline)
+		deviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+
+	//the profiler's pipeline statistics queries are an optional feature
+	VkPhysicalDeviceFeatures features = {};
+	features.pipelineStatisticsQuery = profile ? gpuProfile.features.pipelineStatisticsQuery : VK_FALSE;
+
+	//the gpu cull's indirect draws start every batch but the first at a non-zero firstInstance
+	if(gpuCull)
 	{
-		if((queue_props[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0)
-		{
-			if(graphics_queue_family_index == UINT32_MAX)
-				graphics_queue_family_index = i;
-
-			if(pSupportsPresent[i] == VK_TRUE)
-			{
-				graphics_queue_family_index = i;
-				present_queue_family_index = i;
-				break;
-			}
-		}
+		if(!gpuProfile.features.drawIndirectFirstInstance)
+			derror("--gpu-cull needs drawIndirectFirstInstance, this device doesn't have it!");
+		features.drawIndirectFirstInstance = VK_TRUE;
 	}
 
-	if(present_queue_family_index == UINT32_MAX) //todo: this is a shitty way of checking if it's unset
+	//one big descriptor array that draws index into, if the device has descriptor indexing
+	bool updateAfterBind = false;
+	bool bindless = false;
+	if(strcmp(descriptorMode, "bindless") == 0)
 	{
-		//if we couldn't find a queue that supports both graphics and present,
-		//find a seperate present queue
-		for(uint32_t i = 0; i < queue_family_count; ++i)
-		{
-			if(pSupportsPresent[i] == VK_TRUE)
-			{
-				present_queue_family_index = i;
-				break;
-			}
-		}
+		bindless = bindlessSupported(&gpuProfile, &updateAfterBind);
+		if(!bindless)
+			printf("no descriptor indexing%s, classic descriptor sets\n", properties2 ? "" : " (can't ask without VK_KHR_get_physical_device_properties2)");
+	}
+	else if(strcmp(descriptorMode, "classic") != 0)
+		printf("unknown descriptor mode %s, using classic\n", descriptorMode);
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features = {};
+	if(bindless)
+		bindlessEnable(updateAfterBind, &indexing_features, &features, deviceExtensions);
+
+	void* deviceNext = nullptr;
+	if(timeline)
+	{
+		timeline_features.pNext = deviceNext;
+		deviceNext = &timeline_features;
+	}
+	if(bindless)
+	{
+		indexing_features.pNext = deviceNext;
+		deviceNext = &indexing_features;
 	}
-
-	free(pSupportsPresent);
-
-	if(graphics_queue_family_index == UINT32_MAX 
-		|| present_queue_family_index == UINT32_MAX)
-		derror("Couldn't find queues for both graphics and present!");
-
-
-	if(graphics_queue_family_index != present_queue_family_index)
-		derror("Graphics index != present index!");
-
-
-
-
-	float queue_priorities[1] = {0.0}; //this is only for dealing w/ multiple queues, so we don't care
-	queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	queue_info.pNext = nullptr;
-	queue_info.queueCount = 1; //like i said, you can use multiple queues
-	queue_info.pQueuePriorities = queue_priorities; 
-
-
-	//now we can create a logical device using the queue we found
-
-	std::vector<const char*> deviceExtensions;
-	deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
 	VkDeviceCreateInfo device_info = {};
 	device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	device_info.pNext = nullptr;
-	device_info.queueCreateInfoCount = 1;
-	device_info.pQueueCreateInfos = &queue_info;
+	device_info.pNext = deviceNext;
+	device_info.queueCreateInfoCount = queue_infos.size();
+	device_info.pQueueCreateInfos = queue_infos.data();
 	device_info.enabledExtensionCount = deviceExtensions.size();
 	device_info.ppEnabledExtensionNames = deviceExtensions.data();
 	device_info.enabledLayerCount = 0;
 	device_info.ppEnabledLayerNames = nullptr;
-	device_info.pEnabledFeatures = nullptr;
+	device_info.pEnabledFeatures = &features;
 
 	VkDevice device;
-	res = vkCreateDevice(gpus[0], &device_info, nullptr, &device);
+	res = vkCreateDevice(gpu, &device_info, nullptr, &device);
 	assert(res == VK_SUCCESS);
 
+	queuesInit(&queues, device, timeline);
+	startupEnd(&startup, devicePhase);
+	queuesPrint(&queues);
+	VkQueue queue = queues.graphics_queue;
 
-	//end device intialization-------------------------------------------------
-	
-	//create swap-chain/windowing related crap--------------------------------- 
+	gpu_profiler profiler;
+	profiler.enabled = false;
+	if(profile)
+		profilerInit(&profiler, device, gpuProps[gpuIndex], queues.props[queues.graphics].timestampValidBits, features.pipelineStatisticsQuery,
+					 queue, graphics_queue_family_index, tracePath != nullptr);
 
 
-	//get all of the supported VkFormats;
-	uint32_t formatCount;
-	res = vkGetPhysicalDeviceSurfaceFormatsKHR(gpus[0], surface, &formatCount, nullptr);
-	assert(res == VK_SUCCESS);
-	VkSurfaceFormatKHR *surfFormats = (VkSurfaceFormatKHR*)malloc(formatCount * sizeof(VkSurfaceFormatKHR));
-	res = vkGetPhysicalDeviceSurfaceFormatsKHR(gpus[0], surface, &formatCount, surfFormats);
-	assert(res == VK_SUCCESS);
-	VkFormat format;
-
-	{
-		bool found = false;
-		for(uint32_t i = 0; i < formatCount; i++)
-		{
-			if(surfFormats[i].format == VK_FORMAT_R8G8B8A8_UNORM)
-			{
-				found = true;
-				break;
-			}
-		}
-
-		if(found)
-			format = VK_FORMAT_R8G8B8A8_UNORM;
-		else
-			format = surfFormats[0].format;
-
-	}
-
-	delete[] surfFormats;
+	//end device intialization-------------------------------------------------
 
-	//determine the 'extent' of the swapchain (the resolution/width/h)
-	VkSurfaceCapabilitiesKHR surfCapabilities;
-	res = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(gpus[0], surface, &surfCapabilities);
-	assert(res == VK_SUCCESS);
+	//all buffers and images get their memory from here instead of their own vkAllocateMemory
+	gpu_arena arena;
+	arenaInit(&arena, gpu, device);
 
-	VkExtent2D swapchainExtent = surfCapabilities.currentExtent;
-	printf("w:%d h:%d\n", surfCapabilities.currentExtent.width, surfCapabilities.currentExtent.height);
-	//if sdl didn't set the extents (which it does...)
-	
-	//if (surfCapabilities.currentExtent.width == 0xFFFFFFFF) {
-		// If the surface size is undefined, the size is set to
-		// the size of the images requested.
-	//	swapchainExtent.width = myWidth;
-	//	swapchainExtent.height = myHeight;
-	//	if (swapchainExtent.width < surfCapabilities.minImageExtent.width) {
-	//		swapchainExtent.width = surfCapabilities.minImageExtent.width;
-	//	} else if (swapchainExtent.width > surfCapabilities.maxImageExtent.width) {
-	//		swapchainExtent.width = surfCapabilities.maxImageExtent.width;
-	//	}
-
-	//	if (swapchainExtent.height < surfCapabilities.minImageExtent.height) {
-	//		swapchainExtent.height = surfCapabilities.minImageExtent.height;
-	//	} else if (swapchainExtent.height > surfCapabilities.maxImageExtent.height) {
-	//		swapchainExtent.height = surfCapabilities.maxImageExtent.height;
-	//	}
-	//} 
-	
-	
-	
-		//get surface present modes
-		//uint32_t presentModeCount;
-		//res = vkGetDeviceSurfacePresentModesKHR(gpus[0], surface, &presentModeCount, nullptr);
-		//assert(res == VK_SUCCESS);
-		//VkPresentModeKHR* presentModes = (VkPresentModeKHR*)malloc(presentModeCount * sizeof(VkPresentModeKHR));
-		//res = vkGetDeviceSurfacePresentModesKHR(gpus[0], surface, &presentModeCount, presentModes);
-		//assert(res == VK_SUCCESS);
-
-		//free(presentModes)
-	
+	if(benchArena)
+		arenaBenchmark(gpu, device, benchArenaCount);
 
-	// The FIFO present mode is guaranteed by the spec to be supported
-	//this is why the previous code is commented out
-	VkPresentModeKHR swapchainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+	//layouts are shared, sets come from per frame pools that get reset wholesale (see descriptors.h)
+	descriptor_allocator descriptors;
+	descriptorsInit(&descriptors, device);
 
+	if(benchDescriptorCount)
+		descriptorsBenchmark(&arena, device, benchDescriptorCount);
 
-	// Determine the number of VkImage's to use in the swap chain.
-	// We need to acquire only 1 presentable image at at time.
-	// Asking for minImageCount images ensures that we can acquire
-	// 1 presentable image as long as we present it before attempting
-	// to acquire another.
-	uint32_t desiredNumberOfSwapChainImages = surfCapabilities.minImageCount;
+	//anything freed while frames are in flight waits in here until they're done (see deletion_queue.h)
+	deletion_queue deletions;
+	deletionQueueInit(&deletions, device, &arena);
 
-	VkSurfaceTransformFlagBitsKHR preTransform;
-	if(surfCapabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
-		preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-	else
-		preTransform = surfCapabilities.currentTransform;
-
-	//find supported composite alpha mode- one is guarenteed to be sets
-	VkCompositeAlphaFlagBitsKHR compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-	VkCompositeAlphaFlagBitsKHR compositeAlphaFlags[4] = {
-		VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-		VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR,
-		VK_COMPOSITE_ALPHA_POST_MULTIPLIED_BIT_KHR,
-		VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR,
-	};
-
-	for(uint32_t i = 0; i < sizeof(compositeAlphaFlags) / sizeof(compositeAlphaFlags[0]); i++)
+	//every pipeline gets created through this, it's saved back to disk at shutdown
+	VkPipelineCache pipelineCache;
 	{
-		if(surfCapabilities.supportedCompositeAlpha & compositeAlphaFlags[i])
-		{
-			compositeAlpha = compositeAlphaFlags[i];
-			break;
-		}
+		auto start = std::chrono::high_resolution_clock::now();
+		size_t phase = startupBegin(&startup, "pipeline cache");
+		pipelineCache = pipelineCacheCreate(device, gpuProps[gpuIndex], pipelineCacheData, pipelineCachePath);
+		startupEnd(&startup, phase);
+		size_t cacheSize = 0;
+		vkGetPipelineCacheData(device, pipelineCache, &cacheSize, nullptr);
+		printf("pipeline cache: %s start, %zu bytes, %.3f ms\n", coldStart ? "cold" : "warm", cacheSize,
+			std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
 	}
 
-	VkSwapchainCreateInfoKHR swapchain_ci = {};
-	swapchain_ci.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-	swapchain_ci.pNext = nullptr;
-	swapchain_ci.surface = surface;
-	swapchain_ci.minImageCount = desiredNumberOfSwapChainImages;
-	swapchain_ci.imageFormat = format;
-	swapchain_ci.imageExtent.width = swapchainExtent.width;
-	swapchain_ci.imageExtent.height = swapchainExtent.height;
-	swapchain_ci.preTransform = preTransform;
-	swapchain_ci.compositeAlpha = compositeAlpha;
-	swapchain_ci.imageArrayLayers = 1;
-	swapchain_ci.presentMode = swapchainPresentMode;
-	swapchain_ci.oldSwapchain = VK_NULL_HANDLE;
-	swapchain_ci.clipped = VK_TRUE;
-	swapchain_ci.imageColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
-	swapchain_ci.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-	swapchain_ci.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	swapchain_ci.queueFamilyIndexCount = 0;
-	swapchain_ci.pQueueFamilyIndices = nullptr;
-
-
-	//I'm not dealing with this complication
-	//todo: deal with this
-	//uint32_t queueFamilyIndices[2] = {(uint32_t)info.graphics_queue_family_index, (uint32_t)info.present_queue_family_index};
-	//if (info.graphics_queue_family_index != info.present_queue_family_index) {
-		// If the graphics and present queues are from different queue families,
-		// we either have to explicitly transfer ownership of images between
-		// the queues, or we have to create the swapchain with imageSharingMode
-		// as VK_SHARING_MODE_CONCURRENT
-	//	swapchain_ci.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-	//	swapchain_ci.queueFamilyIndexCount = 2;
-	//	swapchain_ci.pQueueFamilyIndices = queueFamilyIndices;
-	//}
-
-	VkSwapchainKHR swap_chain;
-	uint32_t swapchainImageCount;
-	
-	res = vkCreateSwapchainKHR(device, &swapchain_ci, NULL, &swap_chain);
-	assert(res == VK_SUCCESS);
-
-	res = vkGetSwapchainImagesKHR(device, swap_chain, &swapchainImageCount, nullptr);
-	assert(res == VK_SUCCESS);
-
-	VkImage *swapchainImages = (VkImage*)malloc(swapchainImageCount * sizeof(VkImage));
-	assert(swapchainImages);
-	res = vkGetSwapchainImagesKHR(device, swap_chain, &swapchainImageCount, swapchainImages);
-	assert(res == VK_SUCCESS);
-
-
-	std::vector<swap_chain_buffer> buffers(swapchainImageCount);
-	for(uint32_t i = 0; i < swapchainImageCount; i++)
-		buffers[i].image = swapchainImages[i];
-
-	free(swapchainImages);
-
-
-	for(uint32_t i = 0; i < swapchainImageCount; i++)
-	{
-		VkImageViewCreateInfo color_image_view = {};
-		color_image_view.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		color_image_view.pNext = nullptr;
-		color_image_view.flags = 0;
-		color_image_view.image = buffers[i].image;
-		color_image_view.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		color_image_view.format = format;
-		color_image_view.components.r = VK_COMPONENT_SWIZZLE_R;
-		color_image_view.components.g = VK_COMPONENT_SWIZZLE_G;
-		color_image_view.components.b = VK_COMPONENT_SWIZZLE_B;
-		color_image_view.components.a = VK_COMPONENT_SWIZZLE_A;
-		color_image_view.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		color_image_view.subresourceRange.baseMipLevel = 0;
-		color_image_view.subresourceRange.levelCount = 1;
-		color_image_view.subresourceRange.baseArrayLayer = 0;
-		color_image_view.subresourceRange.layerCount = 1;
-
-		res = vkCreateImageView(device, &color_image_view, nullptr, &buffers[i].view);
-		assert(res == VK_SUCCESS);
-	}
+	if(benchPipelineCacheCount)
+		pipelineCacheBenchmark(device, gpuProps[gpuIndex], pipelineCachePath, benchPipelineCacheCount);
 
-	
-	//end create swapchain-----------------------------------------------------
+	if(benchUploadCount)
+		uploadBenchmark(&arena, gpu, device, queue, graphics_queue_family_index, benchUploadCount, benchUploadSize);
 
-	//create depth buffer------------------------------------------------------
-
-	struct {
-        VkFormat format;
-
-        VkImage image;
-        VkDeviceMemory mem;
-        VkImageView view;
-    } depth;
-
-	VkImageCreateInfo image_info = {};
-	const VkFormat depth_format = VK_FORMAT_D16_UNORM;
-	VkFormatProperties fProps;
-	vkGetPhysicalDeviceFormatProperties(gpus[0], depth_format, &fProps);
-	if(fProps.linearTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
-		image_info.tiling = VK_IMAGE_TILING_LINEAR;
-	else if(fProps.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
-		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
-	else	//try other formats?
-		derror("VK_FORMAT_D16_UNORM unsupported!");
-
-
-	image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	image_info.pNext = nullptr;
-	image_info.imageType = VK_IMAGE_TYPE_2D;
-	image_info.format = depth_format;
-	image_info.extent.width = wWidth;
-	image_info.extent.height = wHeight;
-	image_info.extent.depth = 1;
-	image_info.mipLevels = 1;
-	image_info.arrayLayers = 1;
-	image_info.samples = VK_SAMPLE_COUNT_1_BIT;
-	image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	image_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-	image_info.queueFamilyIndexCount = 0;
-	image_info.pQueueFamilyIndices = nullptr;
-	image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	image_info.flags = 0;
-
-	VkMemoryAllocateInfo mem_alloc = {};
-	mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	mem_alloc.pNext = nullptr;
-	mem_alloc.allocationSize = 0; //we will set these
-	mem_alloc.memoryTypeIndex = 0;
+	if(benchUniformCount)
+		uniformRingBenchmark(&arena, gpu, device, benchUniformCount);
 
+	//everything headed for device local memory goes through here
+	upload_ring uploads;
+	uploadInit(&uploads, &arena, gpu, device, queue, graphics_queue_family_index, 8 * 1024 * 1024);
 	
+	//create swap-chain/windowing related crap--------------------------------- 
 
-	VkMemoryRequirements mem_reqs;
-	depth.format = depth_format;
-	res = vkCreateImage(device, &image_info, nullptr, &depth.image);
-	assert(res == VK_SUCCESS);
-	vkGetImageMemoryRequirements(device, depth.image, &mem_reqs);
-
-	mem_alloc.allocationSize = mem_reqs.size;
-	VkPhysicalDeviceMemoryProperties memProps;
-	//determine mem type
+	//nothing reads depth after the render pass, so it can stay transient (in tile memory where there's lazy memory)
+	attachment_lifetime depthLifetime = ATTACHMENT_TRANSIENT;
+	depth_need depthNeed = {};
+	depthNeed.stencil = false;
+	depthNeed.lifetime = depthLifetime;
+	depthNeed.near_plane = 0.1f;
+	depthNeed.far_plane = 100.0f;
+	depthNeed.tolerance = depthTolerance;
+	depth_config depthConfig;
+	if(!depthSelect(&gpuProfile, gpu, &depthNeed, &depthConfig))
+		derror("no depth attachment format");
+
+	if(benchDepthCount)
+		depthBenchmark(&arena, &gpuProfile, gpu, device, queue, graphics_queue_family_index, benchDepthCount);
+
+	//swapchain (or offscreen images headless), depth buffer and framebuffers, rebuilt on resize (see swapchain.h)
+	offscreen off;
+	swapchain chain;
+	size_t swapchainPhase = startupBegin(&startup, "swapchain");
+	if(headless)
 	{
-		bool success = false;
-		uint32_t typeBits = mem_reqs.memoryTypeBits;
-		vkGetPhysicalDeviceMemoryProperties(gpus[0], &memProps);
-		for(uint32_t i = 0; i < memProps.memoryTypeCount; i++)
-		{
-			if((typeBits & 1) == 1)
-			{
-				if((memProps.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
-				{
-					mem_alloc.memoryTypeIndex = i;
-					success = true;
-					break;
-				}
-			}
-			typeBits >>= 1;
-		}
-		assert(success);
+		offscreenInit(&off, &arena, device, {wWidth, wHeight});
+		swapchainInitHeadless(&chain, &arena, gpu, device, &off, &depthConfig);
 	}
+	else
+		swapchainInit(&chain, &arena, gpu, device, surface, window, presentStrategy, queues.graphics, queues.present, &depthConfig);
+	startupEnd(&startup, swapchainPhase);
 
-	res = vkAllocateMemory(device, &mem_alloc, nullptr, &depth.mem);
-	assert(res == VK_SUCCESS);
-
-	res = vkBindImageMemory(device, depth.image, depth.mem, 0);
-	assert(res == VK_SUCCESS);
-
-	VkImageViewCreateInfo view_info = {};
-	view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	view_info.pNext = nullptr;
-	view_info.image = depth.image;
-	view_info.format = depth_format;
-	view_info.components.r = VK_COMPONENT_SWIZZLE_R;
-	view_info.components.g = VK_COMPONENT_SWIZZLE_G;
-	view_info.components.b = VK_COMPONENT_SWIZZLE_B;
-	view_info.components.a = VK_COMPONENT_SWIZZLE_A;
-	view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-	view_info.subresourceRange.baseMipLevel = 0;
-	view_info.subresourceRange.levelCount = 1;
-	view_info.subresourceRange.baseArrayLayer = 0;
-	view_info.subresourceRange.layerCount = 1;
-	view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	view_info.flags = 0;
-
-	res = vkCreateImageView(device, &view_info, nullptr, &depth.view);
-	assert(res == VK_SUCCESS);
-
-
-	//end create depth buffer--------------------------------------------------
-
-
+	//end create swapchain-----------------------------------------------------
 
-	//create command buffer(the place where we put our commands)---------------
+	//create render pass and framebuffers--------------------------------------
+
+	//color gets cleared on load and handed to present (or the readback copy), depth is only needed during the pass.
+	//the load/store ops come from that (see render_pass.h)
+	render_pass_desc passDesc;
+	renderPassInit(&passDesc);
+	renderPassAddColor(&passDesc, chain.format, ATTACHMENT_OUTPUT, headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	uint32_t depthAttachment = renderPassAddDepth(&passDesc, chain.depth_info.format, depthLifetime);
+	passDesc.attachments[depthAttachment].lazy = chain.depth_lazy;
+
+	//the acquire semaphore is waited on at COLOR_ATTACHMENT_OUTPUT, so the layout transition has to wait too
+	VkSubpassDependency dependencies[2] = {};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependencies[0].srcAccessMask = 0;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dependencyFlags = 0;
+
+	//headless: the readback copy right after the pass has to see the color writes
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	dependencies[1].dependencyFlags = 0;
+
+	renderPassAddDependency(&passDesc, dependencies[0]);
+	if(headless)
+		renderPassAddDependency(&passDesc, dependencies[1]);
+	VkRenderPass render_pass = renderPassCreate(&passDesc, device);
+	renderPassPrintStats(&passDesc, chain.extent);
+
+	//the render pass only depends on the formats, so it outlives every resize
+	swapchainSetRenderPass(&chain, render_pass);
+
+	//end create render pass and framebuffers----------------------------------
+
+
+
+	//create command buffers(the place where we put our commands)--------------
 	//we make command calls to add commands to command buffer
 	//we use pools to manage command buffers(since some short lived buffers could waste memory)
-	//there is usually a pool per Queue Family, but we only made one.
-
-	//create command pool
-
-	
-	VkCommandPoolCreateInfo cmd_pool_info = {};
-	cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	cmd_pool_info.pNext = nullptr;
-	cmd_pool_info.queueFamilyIndex = queue_info.queueFamilyIndex;
-	cmd_pool_info.flags = 0;
-
-	//we allocate our command buffer from this pool
-	VkCommandPool cmd_pool;
-	res = vkCreateCommandPool(device, &cmd_pool_info, nullptr, &cmd_pool);
-	assert(res == VK_SUCCESS);
-
-	//create command buffer from command pool
-
-
-	VkCommandBufferAllocateInfo cmd_info = {};
-	cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	cmd_info.pNext = nullptr;
-	cmd_info.commandPool = cmd_pool;
-	cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	cmd_info.commandBufferCount = 1; //we can do more than one at once if we want
-
-	VkCommandBuffer cmd;
-	res = vkAllocateCommandBuffers(device, &cmd_info, &cmd);
-	assert(res == VK_SUCCESS);
+	//each frame in flight gets its own pool so we can reset it wholesale once its fence signals,
+	//and record the next frame while the gpu is still busy with the last one (see frame_loop.h)
+
+	frame_loop loop;
+	framesInit(&loop, device, queue, graphics_queue_family_index, headless);
+
+	//the draws themselves get recorded into secondaries on worker threads (see cmd_recorder.h)
+	draw_items drawItems;
+	drawItems.extent = chain.extent;
+	drawItems.uniforms = nullptr;
+	drawItems.set = VK_NULL_HANDLE;
+	drawItems.bindless = nullptr;
+	memset(drawItems.ring_indices, 0, sizeof(drawItems.ring_indices));
+	drawItems.layout = VK_NULL_HANDLE;
+	drawItems.frame = 0;
+	drawItems.objects = nullptr;
+	drawItems.pipelines = nullptr;
+	drawItems.materials = 1;
+
+	if(benchRecord)
+		recorderBenchmark(device, graphics_queue_family_index, render_pass, chain.framebuffers[0], drawCount, recordDrawItems, &drawItems);
+
+	cmd_recorder recorder;
+	recorderInit(&recorder, device, graphics_queue_family_index, threadCount);
+	std::vector<VkCommandBuffer> secondaries;
 
 	
 	//end create command buffer/pool-------------------------------------------
@@ -658,66 +858,473 @@ int main(/*int argc, char const *argv[]*/)
 								 glm::vec3(0,-1,0) //head is up
 								);
 
-	glm::mat4 Model = glm::mat4(1.0f);
-
 	//vulkan clip space inverts y and half z
 	glm::mat4 Clip = glm::mat4 (1.0f, 0.0f, 0.0f, 0.0f,
 								0.0f,-1.0f, 0.0f, 0.0f,
 								0.0f, 0.0f, 0.5f, 0.0f,
 								0.0f, 0.0f, 0.5f, 1.0f);
 
-	glm::mat4 MVP = Clip * Projection * View * Model; //Model View Projection
+	//everything but Model is the same for every object, so it's multiplied out once per frame
+	glm::mat4 ViewProj = Clip * Projection * View;
 
+	//one Model per object, laid out on a grid around the origin, stored SoA for the batch transform.
+	//they don't move, so their bounding spheres are set once too
+	object_transforms models;
+	transformsInit(&models, drawCount);
+	object_bounds bounds;
+	boundsInit(&bounds, drawCount);
+	{
+		uint32_t side = 1;
+		while(side * side < drawCount)
+			side++;
+		for(uint32_t i = 0; i < drawCount; i++)
+		{
+			glm::vec3 pos((float)(i % side) - side * 0.5f, 0.0f, (float)(i / side) - side * 0.5f);
+			transformsSet(&models, i, glm::translate(glm::mat4(1.0f), pos * 2.0f));
+			boundsSet(&bounds, i, pos * 2.0f, 0.87f); //unit cube
+		}
+	}
+	printf("mvp kernel: %s\n", mvpKernelName());
 
-	struct {
-        VkBuffer buf;
-        VkDeviceMemory mem;
-        VkDescriptorBufferInfo buffer_info;
-    } uniform_data;
+	//each object's MVP (Clip * Projection * View * Model) gets its own slot in here every frame,
+	//draws pick theirs with a dynamic offset, or bindless by pushing the slot's index (see uniform_ring.h)
+	uniform_ring uniforms;
+	uniformRingInit(&uniforms, &arena, gpu, device, drawCount ? drawCount : 1, sizeof(glm::mat4), &descriptors.layouts);
 
+	//bindless: one storage buffer per frame region, each has to fit the storage buffer range
+	if(bindless && uniforms.frame_size > gpuProfile.props.limits.maxStorageBufferRange)
+	{
+		printf("a frame of the uniform ring (%llu bytes) is over maxStorageBufferRange, classic descriptor sets\n", (unsigned long long)uniforms.frame_size);
+		bindless = false;
+	}
+	bindless_table bindlessTable;
+	uint32_t ringIndices[FRAMES_IN_FLIGHT];
+	if(bindless)
+	{
+		bindlessInit(&bindlessTable, device, &gpuProfile, updateAfterBind);
+		for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+		{
+			ringIndices[i] = bindlessAddBuffer(&bindlessTable, uniforms.buffer, uniformRingFrameOffset(&uniforms, i), uniforms.frame_size, 0);
+			assert(ringIndices[i] != UINT32_MAX);
+		}
+	}
 
-	
-	VkBufferCreateInfo buf_info = {};
-	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	buf_info.pNext = nullptr;
-	buf_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-	buf_info.size = sizeof(MVP);
-	buf_info.queueFamilyIndexCount = 0;
-	buf_info.pQueueFamilyIndices = nullptr;
-	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	buf_info.flags = 0;
-
-	res = vkCreateBuffer(device, &buf_info, nullptr, &uniform_data.buf);
-	
+	if(benchBindlessCount)
+		bindlessBenchmark(bindless ? &bindlessTable : nullptr, &uniforms, bindless ? ringIndices[0] : UINT32_MAX, device, queue, graphics_queue_family_index, benchBindlessCount);
+
+	//the pipeline layout comes from the shaders (see shader_reflect.h). classic: the MVP block in
+	//mvp.vert reflects to the ring's dynamic uniform binding, and the layout cache hands back the
+	//ring's own set layout for it. bindless: the table's set and push range, checked against what
+	//mvp_bindless.vert declares
+	VkPushConstantRange bindlessPush = bindlessPushRange();
+	const shader_blob* vertexShader = bindless ? &mvp_bindless_vert : &mvp_vert;
+	shader_layout shaderLayout;
+	VkShaderModule vertexModule, fragmentModule;
+	{
+		size_t phase = startupBegin(&startup, "shaders");
+		const shader_reflection* stages[] = {&vertexShader->reflection, &mvp_frag.reflection};
+		shader_layout_options options = {};
+		options.dynamic_uniforms = true;
+		if(bindless)
+		{
+			options.sets[0] = bindlessTable.layout;
+			options.push_stages = bindlessPush.stageFlags;
+		}
+		shaderLayoutCreate(&shaderLayout, device, &descriptors.layouts, stages, 2, &options);
+		if(bindless)
+		{
+			const shader_binding& buffers = vertexShader->reflection.bindings[0];
+			assert(buffers.binding == BINDLESS_BUFFER_BINDING && buffers.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER && buffers.count == 0);
+			assert(shaderLayout.push.offset == bindlessPush.offset && shaderLayout.push.size == bindlessPush.size);
+		}
+		else
+			assert(shaderLayout.set_count == 1 && shaderLayout.sets[0] == uniforms.set_layout && shaderLayout.push_count == 0);
 
-	
+		vertexModule = shaderModuleCreate(device, vertexShader->code, vertexShader->size);
+		fragmentModule = shaderModuleCreate(device, mvp_frag.code, mvp_frag.size);
+		startupEnd(&startup, phase);
+	}
+	VkPipelineLayout pipelineLayout = shaderLayout.layout;
+
+	if(benchShaderCount)
+		shaderBenchmark(device, embedded_shaders, sizeof(embedded_shaders) / sizeof(embedded_shaders[0]), benchShaderCount);
+
+	//every material has its own pipeline variant, material m is key m (see pipeline_variants.h),
+	//compiled in the background while the generic one stands in (see pipeline_compiler.h). they
+	//don't all show up at once: one more every materialFrames frames, like content streaming in,
+	//so each one is new to a running frame loop. the manifest's variants are prewarmed first
+	static_assert((mvp_frag.reflection.spec_ids & variantConstantIds(VK_SHADER_STAGE_FRAGMENT_BIT)) == variantConstantIds(VK_SHADER_STAGE_FRAGMENT_BIT),
+				  "mvp.frag doesn't declare every specialization constant the variants set");
+	const uint32_t materialFrames = 30;
+	if(materialCount == 0)
+		materialCount = 1;
+	pipeline_compiler pipelines;
+	{
+		size_t phase = startupBegin(&startup, "generic pipeline");
+		pipelineCompilerInit(&pipelines, device, pipelineCache, pipelineLayout, render_pass, vertexModule, fragmentModule,
+							 threadCount > 2 ? threadCount / 2 : 1, strcmp(pipelineMode, "sync") != 0, pipelineBudget);
+		startupEnd(&startup, phase);
+
+		phase = startupBegin(&startup, "prewarm pipelines");
+		pipelineCompilerPrewarm(&pipelines, pipeline_manifest, PIPELINE_MANIFEST_COUNT, prewarmMs);
+		startupEnd(&startup, phase);
+	}
+	std::vector<VkPipeline> materialPipelines(materialCount, pipelines.generic);
+
+	drawItems.uniforms = &uniforms;
+	drawItems.bindless = bindless ? &bindlessTable : nullptr;
+	if(bindless)
+		memcpy(drawItems.ring_indices, ringIndices, sizeof(ringIndices));
+	drawItems.layout = pipelineLayout;
+	drawItems.pipelines = materialPipelines.data();
+	drawItems.materials = materialCount;
+
+	//only what survives culling gets an MVP and a draw (see cull.h)
+	cull_pool culler;
+	cullInit(&culler, threadCount);
+	std::vector<uint32_t> visible;
+
+	//or the gpu does both and draws with indirect commands (see gpu_cull.h), checked once against the cpu cull
+	gpu_cull gpuCuller;
+	if(gpuCull)
+	{
+		if(bounds.count > gpuCullMaxObjects(gpu))
+			derror("--gpu-cull can dispatch at most " + std::to_string(gpuCullMaxObjects(gpu)) + " objects on this device!");
+		size_t phase = startupBegin(&startup, "gpu cull");
+		gpuCullInit(&gpuCuller, &arena, &uploads, device, pipelineCache, render_pass, &descriptors.layouts, &models, &bounds);
+		if(!gpuCullVerify(&gpuCuller, &arena, queue, graphics_queue_family_index, ViewProj, &bounds))
+			derror("The gpu cull doesn't match the cpu cull!");
+		startupEnd(&startup, phase);
+	}
 
+	//and the objects move, stepped on the compute queue alongside graphics (see async_compute.h)
+	async_compute physics;
+	if(asyncCompute)
+	{
+		size_t phase = startupBegin(&startup, "async compute");
+		asyncComputeInit(&physics, &arena, &queues, gpu, device, pipelineCache, &descriptors.layouts, &bounds);
+		for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+			gpuCullSetObjects(&gpuCuller, i, physics.spheres[i], physics.models[i]);
+		startupEnd(&startup, phase);
+	}
 
+	//the benchmarks on the way here are in the wall clock time, not in any phase
+	startupPrint(&startup);
+
+	//end create uniform buffer------------------------------------------------
+
+	//render loop--------------------------------------------------------------
+
+	//a swapchain image can come back around while a different frame in flight still uses it
+	std::vector<VkFence> imagesInFlight(chain.buffers.size(), VK_NULL_HANDLE);
+	double uniformWriteMs = 0.0;
+	uint64_t uniformWrites = 0;
+	double cullMs = 0.0;
+	if(headless)
+		off.start = std::chrono::high_resolution_clock::now(); //throughput from the first frame on
+	frame_pacer pacer;
+	pacerInit(&pacer, paceHz);
+	bool running = true;
+	bool resized = false;
+	while(running && (frameCount == 0 || loop.frame_number < frameCount))
+	{
+		//nothing to render into while minimized (the surface has no area), and no point spinning
+		while(!headless && running && (SDL_GetWindowFlags(window) & SDL_WINDOW_MINIMIZED))
+		{
+			SDL_Event event;
+			if(SDL_WaitEvent(&event) && event.type == SDL_QUIT)
+				running = false;
+			resized = true;
+		}
+		if(!running)
+			break;
 
-	
+		pacerWait(&pacer);
+		frame_data* frame = frameBegin(&loop);
+		uint32_t frameIndex = loop.current;
+		profilerBeginFrame(&profiler, frame->cmd, loop.current, loop.frame_number);
 
-	//cleanup
-	
+		//frameBegin just waited on a fence, whatever was waiting on it can go
+		deletionQueueCollect(&deletions, framesCompleted(&loop));
+		descriptorsBeginFrame(&descriptors, loop.current);
 
-	VkCommandBuffer cmd_bufs[1] = {cmd}; //we can free multiple
-	vkFreeCommandBuffers(device, cmd_pool, 1, cmd_bufs); 
-	vkDestroyCommandPool(device, cmd_pool, nullptr);
-	
-	//for(uint32_t i = 0; i < swapchainImageCount; i++)
-	//	vkDestroyImageView(device, buffers[i].view, nullptr);
+		//first, so the compute queue gets going while this frame is still being recorded
+		if(asyncCompute)
+			asyncComputeStep(&physics, loop.current);
+
+		uint32_t imageIndex;
+		uint32_t acquireScope = profilerCpuBegin(&profiler, "acquire");
+		if(headless)
+		{
+			//the frame fence has signaled, so the copy this slot made last time around is done
+			imageIndex = loop.current;
+			offscreenCollect(&off, imageIndex);
+		}
+		else
+		{
+			//the frame has begun (its fence is reset), so this has to end with an image to submit to
+			for(;;)
+			{
+				if(resized)
+				{
+					if(swapchainRecreate(&chain, &arena, &deletions, loop.frame_number))
+					{
+						imagesInFlight.assign(chain.buffers.size(), VK_NULL_HANDLE);
+						resized = false;
+					}
+					else
+					{
+						//minimized in between, wait for it to come back
+						SDL_PumpEvents();
+						SDL_Delay(10);
+						continue;
+					}
+				}
+				res = vkAcquireNextImageKHR(device, chain.swapchain, UINT64_MAX, frame->acquired, VK_NULL_HANDLE, &imageIndex);
+				if(res != VK_ERROR_OUT_OF_DATE_KHR)
+					break;
+				resized = true;
+			}
+			assert(res == VK_SUCCESS || res == VK_SUBOPTIMAL_KHR);
+			if(res == VK_SUBOPTIMAL_KHR)
+				resized = true; //still usable, rebuild next frame
+			if(imagesInFlight[imageIndex] != VK_NULL_HANDLE && imagesInFlight[imageIndex] != frame->fence)
+				vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+			imagesInFlight[imageIndex] = frame->fence;
+		}
+		profilerCpuEnd(&profiler, acquireScope);
+
+		//input goes in as late as possible, everything that blocks is behind us (see present.h)
+		pacerSampleInput(&pacer, frameIndex);
+		SDL_Event event;
+		while(!headless && SDL_PollEvent(&event))
+		{
+			if(event.type == SDL_QUIT)
+				running = false;
+			else if(event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+				resized = true;
+		}
+		drawItems.extent = chain.extent;
+
+		uint32_t recordScope = profilerCpuBegin(&profiler, "record");
+		if(gpuCull)
+		{
+			if(asyncCompute)
+				asyncComputeBeginGraphics(&physics, frame, loop.current);
+			uint32_t cullScope = profilerBegin(&profiler, frame->cmd, "cull");
+			gpuCullRecord(&gpuCuller, frame->cmd, loop.current, ViewProj);
+			profilerEnd(&profiler, frame->cmd, cullScope);
+		}
+		else
+		{
+			uint32_t cullScope = profilerCpuBegin(&profiler, "cull");
+			uint32_t visibleCount = cullRun(&culler, ViewProj, &bounds, visible);
+			cullMs += culler.ms;
+			profilerCpuEnd(&profiler, cullScope);
+
+			//the frame fence has signaled, so the gpu is done with this frame's region of the ring
+			uint32_t uniformScope = profilerCpuBegin(&profiler, "uniforms");
+			uniformRingWriteMVPs(&uniforms, loop.current, ViewProj, &models, visible.data(), visibleCount);
+			uniformWriteMs += uniforms.write_ms;
+			uniformWrites += uniforms.written;
+			profilerCpuEnd(&profiler, uniformScope);
+			drawItems.frame = loop.current;
+			drawItems.objects = visible.data();
+
+			uint32_t pipelineScope = profilerCpuBegin(&profiler, "pipelines");
+			uint64_t shown = loop.frame_number / materialFrames + 1;
+			for(uint32_t m = 1; m < materialCount && m < shown; m++)
+				materialPipelines[m] = pipelineCompilerGet(&pipelines, m % PIPELINE_KEY_COUNT);
+			profilerCpuEnd(&profiler, pipelineScope);
+			if(!bindless)
+			{
+				descriptor_write uniformWrite = uniformRingDescriptor(&uniforms);
+				drawItems.set = descriptorsGet(&descriptors, uniforms.set_layout, &uniformWrite, 1);
+				if(drawItems.set == VK_NULL_HANDLE)
+					derror("Out of memory for descriptor sets!");
+			}
 
-	//vkDestroySwapchainKHR(device, swap_chain, nullptr);
+			uint32_t secondaryScope = profilerCpuBegin(&profiler, "secondaries");
+			recorderBeginFrame(&recorder, loop.current);
+			recorderRecord(&recorder, loop.current, render_pass, 0, chain.framebuffers[imageIndex], visibleCount, recordDrawItems, &drawItems, secondaries);
+			profilerCpuEnd(&profiler, secondaryScope);
+		}
 
-	vkDestroyImageView(device, depth.view, nullptr);
-	vkDestroyImage(device, depth.image, nullptr);
-	vkFreeMemory(device, depth.mem, nullptr);
+		float pulse = (float)(loop.frame_number % 256) / 255.0f;
+		VkClearValue clear_values[2];
+		clear_values[0].color = {{0.1f, 0.1f, pulse, 1.0f}};
+		clear_values[1].depthStencil = {1.0f, 0};
+
+		VkRenderPassBeginInfo rp_begin = {};
+		rp_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		rp_begin.pNext = nullptr;
+		rp_begin.renderPass = render_pass;
+		rp_begin.framebuffer = chain.framebuffers[imageIndex];
+		rp_begin.renderArea.offset = {0, 0};
+		rp_begin.renderArea.extent = chain.extent;
+		rp_begin.clearValueCount = 2;
+		rp_begin.pClearValues = clear_values;
+
+		//around the whole pass: inside one that runs secondaries the primary can't write timestamps
+		uint32_t drawScope = profilerBegin(&profiler, frame->cmd, "draw", gpuCull);
+		if(gpuCull)
+		{
+			vkCmdBeginRenderPass(frame->cmd, &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
+			gpuCullDraw(&gpuCuller, frame->cmd, loop.current, ViewProj, chain.extent);
+		}
+		else
+		{
+			vkCmdBeginRenderPass(frame->cmd, &rp_begin, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			if(!secondaries.empty())
+				vkCmdExecuteCommands(frame->cmd, (uint32_t)secondaries.size(), secondaries.data());
+		}
+		vkCmdEndRenderPass(frame->cmd);
+		profilerEnd(&profiler, frame->cmd, drawScope);
+		if(asyncCompute)
+			asyncComputeEndGraphics(&physics, frame->cmd, loop.current);
+		if(headless)
+		{
+			uint32_t readbackScope = profilerBegin(&profiler, frame->cmd, "readback");
+			offscreenCopy(&off, frame->cmd, imageIndex);
+			profilerEnd(&profiler, frame->cmd, readbackScope);
+		}
+		profilerCpuEnd(&profiler, recordScope);
+
+		profilerEndFrame(&profiler, frame->cmd);
+		uint32_t submitScope = profilerCpuBegin(&profiler, "submit");
+		frameSubmit(&loop, frame, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+
+		if(!headless)
+		{
+			VkPresentInfoKHR present = {};
+			present.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+			present.pNext = nullptr;
+			present.waitSemaphoreCount = 1;
+			present.pWaitSemaphores = &frame->rendered;
+			present.swapchainCount = 1;
+			present.pSwapchains = &chain.swapchain;
+			present.pImageIndices = &imageIndex;
+			present.pResults = nullptr;
+			res = vkQueuePresentKHR(queues.present_queue, &present);
+			assert(res == VK_SUCCESS || res == VK_SUBOPTIMAL_KHR || res == VK_ERROR_OUT_OF_DATE_KHR);
+			if(res != VK_SUCCESS)
+				resized = true;
+		}
+		profilerCpuEnd(&profiler, submitScope);
+		pacerPresented(&pacer, frameIndex);
+
+		if(loop.frame_number % 500 == 0)
+		{
+			framesPrintStats(&loop);
+			if(!gpuCull)
+				printf("cull: %u/%u visible, %.3f ms/frame\n", culler.visible, drawCount, cullMs / loop.frame_number);
+			if(uniformWrites)
+				printf("uniforms: %.3f ms/frame, %.1f ns/object\n", uniformWriteMs / loop.frame_number, uniformWriteMs * 1e6 / uniformWrites);
+			if(headless)
+				offscreenPrintStats(&off);
+			pacerPrintStats(&pacer);
+			swapchainPrintStats(&chain);
+			deletionQueuePrintStats(&deletions);
+			descriptorsPrintStats(&descriptors);
+			if(bindless)
+				bindlessPrintStats(&bindlessTable);
+			if(!gpuCull)
+				pipelineCompilerPrintStats(&pipelines);
+			if(asyncCompute)
+				asyncComputePrintStats(&physics);
+			profilerPrintStats(&profiler);
+			debugMessagesPrintStats(&debugMessages);
+		}
+	}
+
+	framesPrintStats(&loop);
+	pacerPrintStats(&pacer);
+	swapchainPrintStats(&chain);
+	deletionQueuePrintStats(&deletions);
+	descriptorsPrintStats(&descriptors);
+	if(bindless)
+		bindlessPrintStats(&bindlessTable);
+	if(!gpuCull)
+		pipelineCompilerPrintStats(&pipelines);
+	if(asyncCompute)
+		asyncComputePrintStats(&physics);
+	if(loop.frame_number && !gpuCull)
+		printf("cull: %u/%u visible, %.3f ms/frame\n", culler.visible, drawCount, cullMs / loop.frame_number);
+	if(uniformWrites)
+		printf("uniforms: %.3f ms/frame, %.1f ns/object\n", uniformWriteMs / loop.frame_number, uniformWriteMs * 1e6 / uniformWrites);
+
+	//end render loop----------------------------------------------------------
+
+	//cleanup
+	
+	vkDeviceWaitIdle(device);
+	if(headless)
+	{
+		//the last FRAMES_IN_FLIGHT copies haven't been collected yet, oldest first
+		for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+			offscreenCollect(&off, (loop.current + i) % FRAMES_IN_FLIGHT);
+		offscreenPrintStats(&off);
+		if(headlessDump && loop.frame_number && !offscreenWritePPM(&off, (loop.current + FRAMES_IN_FLIGHT - 1) % FRAMES_IN_FLIGHT, headlessDump))
+			printf("couldn't write %s\n", headlessDump);
+	}
+	//the last frames in flight are done now too
+	profilerFlush(&profiler);
+	profilerPrintStats(&profiler);
+	if(tracePath)
+	{
+		if(profilerWriteTrace(&profiler, tracePath))
+			printf("trace: %zu events written to %s\n", profiler.events.size(), tracePath);
+		else
+			printf("couldn't write %s\n", tracePath);
+	}
+	profilerDestroy(&profiler);
+	if(!pipelineCacheSave(device, pipelineCache, pipelineCachePath))
+		printf("couldn't save pipeline cache to %s\n", pipelineCachePath);
+	vkDestroyPipelineCache(device, pipelineCache, nullptr);
+
+	recorderDestroy(&recorder);
+	cullDestroy(&culler);
+	if(asyncCompute)
+		asyncComputeDestroy(&physics, &arena);
+	if(gpuCull)
+		gpuCullDestroy(&gpuCuller, &arena);
+	framesDestroy(&loop);
+	uploadDestroy(&uploads, &arena);
+
+	deletionQueueFlush(&deletions);
+	swapchainDestroy(&chain, &arena);
+	vkDestroyRenderPass(device, render_pass, nullptr);
+
+	pipelineCompilerDestroy(&pipelines);
+	vkDestroyShaderModule(device, vertexModule, nullptr);
+	vkDestroyShaderModule(device, fragmentModule, nullptr);
+	shaderLayoutDestroy(&shaderLayout, device);
+	if(bindless)
+		bindlessDestroy(&bindlessTable);
+	uniformRingDestroy(&uniforms, &arena);
+	descriptorsDestroy(&descriptors);
+
+	if(headless)
+		offscreenDestroy(&off, &arena);
+
+	arenaPrintStats(&arena);
+	arenaDestroy(&arena);
 
 	vkDestroyDevice(device, nullptr);
-	DestroyDebugUtilsMessengerEXT(inst, debugMessenger, nullptr);
-	vkDestroySurfaceKHR(inst, surface, nullptr);
+	if(debugMessenger != VK_NULL_HANDLE)
+		DestroyDebugUtilsMessengerEXT(inst, debugMessenger, nullptr);
+	if(!headless)
+		vkDestroySurfaceKHR(inst, surface, nullptr);
 	vkDestroyInstance(inst, nullptr);
 
-	SDL_DestroyWindow(window);
-	SDL_Quit();
+	//vkDestroyInstance reports through the create info's messenger, so only now
+	debugMessagesDestroy(&debugMessages);
+	debugMessagesPrintStats(&debugMessages);
+
+	if(!headless)
+	{
+		SDL_DestroyWindow(window);
+		SDL_Quit();
+	}
 	return 0;
 }
@@ -0,0 +1,380 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MVP_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+batch MVP transform
+
+Clip * Projection * View is the same for every object, so it's multiplied out once (view_proj)
+and the per object work is just view_proj * Model. models are affine, so only their top three
+rows are stored, structure of arrays: array k holds element k of every object's model, which
+lets the simd kernels load 4 (SSE) or 8 (AVX2) objects' worth of one element at once:
+
+	m[col * 3 + row][object]		row 3 is always 0 0 0 1
+
+each lane computes one object's MVP, the results get transposed back to one column major
+mat4 per object and stored at dst + i * stride (eg straight into uniform_ring slots).
+given a list of object indices (eg what survived culling) the lanes gather instead, and the
+output is packed in list order.
+
+the kernel is picked once at runtime from what the cpu supports: AVX2+FMA, SSE2, or scalar.
+*/
+
+typedef struct {
+	uint32_t count;
+	uint32_t pitch; //floats between arrays, count rounded up to 8
+	std::vector<float> data;
+} object_transforms;
+
+//output i (dst + (i - first) * stride) is for object indices[i], or object i if indices is null
+typedef void (*mvp_kernel_fn)(const glm::mat4& view_proj, const object_transforms* t, const uint32_t* indices,
+							  uint32_t first, uint32_t count, uint8_t* dst, size_t stride);
+
+typedef struct {
+	const char* name;
+	mvp_kernel_fn fn;
+} mvp_kernel;
+
+
+void transformsInit(object_transforms* t, uint32_t count)
+{
+	t->count = count;
+	t->pitch = (count + 7) & ~7u;
+	t->data.assign((size_t)t->pitch * 12, 0.0f);
+}
+
+float* transformsArray(object_transforms* t, uint32_t k)
+{
+	return t->data.data() + (size_t)t->pitch * k;
+}
+
+const float* transformsArray(const object_transforms* t, uint32_t k)
+{
+	return t->data.data() + (size_t)t->pitch * k;
+}
+
+//model must be affine, its bottom row is dropped
+void transformsSet(object_transforms* t, uint32_t i, const glm::mat4& model)
+{
+	for(uint32_t col = 0; col < 4; col++)
+		for(uint32_t row = 0; row < 3; row++)
+			transformsArray(t, col * 3 + row)[i] = model[col][row];
+}
+
+glm::mat4 transformsGet(const object_transforms* t, uint32_t i)
+{
+	glm::mat4 model(0.0f);
+	for(uint32_t col = 0; col < 4; col++)
+		for(uint32_t row = 0; row < 3; row++)
+			model[col][row] = transformsArray(t, col * 3 + row)[i];
+	model[3][3] = 1.0f;
+	return model;
+}
+
+
+static void mvpKernelScalar(const glm::mat4& vp, const object_transforms* t, const uint32_t* indices,
+							uint32_t first, uint32_t count, uint8_t* dst, size_t stride)
+{
+	const float* m[12];
+	for(uint32_t k = 0; k < 12; k++)
+		m[k] = transformsArray(t, k);
+
+	for(uint32_t i = first; i < first + count; i++)
+	{
+		uint32_t o = indices ? indices[i] : i;
+		float out[16];
+		for(uint32_t col = 0; col < 4; col++)
+		{
+			float x = m[col * 3 + 0][o], y = m[col * 3 + 1][o], z = m[col * 3 + 2][o];
+			float w = col == 3 ? 1.0f : 0.0f;
+			for(uint32_t row = 0; row < 4; row++)
+				out[col * 4 + row] = vp[0][row] * x + vp[1][row] * y + vp[2][row] * z + vp[3][row] * w;
+		}
+		memcpy(dst + (size_t)(i - first) * stride, out, sizeof(out));
+	}
+}
+
+#ifdef MVP_X86
+
+__attribute__((target("sse2")))
+static __m128 mvpLoad4(const float* a, const uint32_t* indices, uint32_t i)
+{
+	if(indices)
+		return _mm_setr_ps(a[indices[i]], a[indices[i + 1]], a[indices[i + 2]], a[indices[i + 3]]);
+	return _mm_loadu_ps(a + i);
+}
+
+__attribute__((target("avx2,fma")))
+static __m256 mvpLoad8(const float* a, const uint32_t* indices, uint32_t i)
+{
+	if(indices)
+		return _mm256_i32gather_ps(a, _mm256_loadu_si256((const __m256i*)(indices + i)), 4);
+	return _mm256_loadu_ps(a + i);
+}
+
+__attribute__((target("sse2")))
+static void mvpKernelSSE(const glm::mat4& vp, const object_transforms* t, const uint32_t* indices,
+						 uint32_t first, uint32_t count, uint8_t* dst, size_t stride)
+{
+	const float* m[12];
+	for(uint32_t k = 0; k < 12; k++)
+		m[k] = transformsArray(t, k);
+
+	__m128 v[4][4]; //v[col][row] broadcast
+	for(uint32_t c = 0; c < 4; c++)
+		for(uint32_t r = 0; r < 4; r++)
+			v[c][r] = _mm_set1_ps(vp[c][r]);
+
+	uint32_t i = first, last = first + count;
+	for(; i + 4 <= last; i += 4)
+	{
+		uint8_t* out = dst + (size_t)(i - first) * stride;
+		for(uint32_t col = 0; col < 4; col++)
+		{
+			__m128 x = mvpLoad4(m[col * 3 + 0], indices, i);
+			__m128 y = mvpLoad4(m[col * 3 + 1], indices, i);
+			__m128 z = mvpLoad4(m[col * 3 + 2], indices, i);
+
+			//one row of this column for 4 objects each
+			__m128 r[4];
+			for(uint32_t row = 0; row < 4; row++)
+			{
+				r[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v[0][row], x), _mm_mul_ps(v[1][row], y)), _mm_mul_ps(v[2][row], z));
+				if(col == 3)
+					r[row] = _mm_add_ps(r[row], v[3][row]);
+			}
+
+			//4 rows x 4 objects -> 4 objects' columns
+			__m128 t0 = _mm_unpacklo_ps(r[0], r[1]);
+			__m128 t1 = _mm_unpackhi_ps(r[0], r[1]);
+			__m128 t2 = _mm_unpacklo_ps(r[2], r[3]);
+			__m128 t3 = _mm_unpackhi_ps(r[2], r[3]);
+			_mm_storeu_ps((float*)(out + 0 * stride + col * 16), _mm_movelh_ps(t0, t2));
+			_mm_storeu_ps((float*)(out + 1 * stride + col * 16), _mm_movehl_ps(t2, t0));
+			_mm_storeu_ps((float*)(out + 2 * stride + col * 16), _mm_movelh_ps(t1, t3));
+			_mm_storeu_ps((float*)(out + 3 * stride + col * 16), _mm_movehl_ps(t3, t1));
+		}
+	}
+	if(i < last)
+		mvpKernelScalar(vp, t, indices, i, last - i, dst + (size_t)(i - first) * stride, stride);
+}
+
+__attribute__((target("avx2,fma")))
+static void mvpKernelAVX2(const glm::mat4& vp, const object_transforms* t, const uint32_t* indices,
+						  uint32_t first, uint32_t count, uint8_t* dst, size_t stride)
+{
+	const float* m[12];
+	for(uint32_t k = 0; k < 12; k++)
+		m[k] = transformsArray(t, k);
+
+	__m256 v[4][4];
+	for(uint32_t c = 0; c < 4; c++)
+		for(uint32_t r = 0; r < 4; r++)
+			v[c][r] = _mm256_set1_ps(vp[c][r]);
+
+	uint32_t i = first, last = first + count;
+	for(; i + 8 <= last; i += 8)
+	{
+		uint8_t* out = dst + (size_t)(i - first) * stride;
+
+		//two columns at a time so every object gets whole 32 byte stores
+		for(uint32_t col = 0; col < 4; col += 2)
+		{
+			__m256 lanes[2][4]; //[column][object pair], each 128 bit half is one object's column
+			for(uint32_t c = 0; c < 2; c++)
+			{
+				uint32_t mc = col + c;
+				__m256 x = mvpLoad8(m[mc * 3 + 0], indices, i);
+				__m256 y = mvpLoad8(m[mc * 3 + 1], indices, i);
+				__m256 z = mvpLoad8(m[mc * 3 + 2], indices, i);
+
+				__m256 r[4];
+				for(uint32_t row = 0; row < 4; row++)
+				{
+					r[row] = mc == 3 ? v[3][row] : _mm256_setzero_ps();
+					r[row] = _mm256_fmadd_ps(v[0][row], x, r[row]);
+					r[row] = _mm256_fmadd_ps(v[1][row], y, r[row]);
+					r[row] = _mm256_fmadd_ps(v[2][row], z, r[row]);
+				}
+
+				//same transpose as SSE, per 128 bit half: objects 0-3 low, 4-7 high
+				__m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+				__m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+				__m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+				__m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+				lanes[c][0] = _mm256_shuffle_ps(t0, t2, 0x44); //objects 0 | 4
+				lanes[c][1] = _mm256_shuffle_ps(t0, t2, 0xEE); //1 | 5
+				lanes[c][2] = _mm256_shuffle_ps(t1, t3, 0x44); //2 | 6
+				lanes[c][3] = _mm256_shuffle_ps(t1, t3, 0xEE); //3 | 7
+			}
+
+			for(uint32_t o = 0; o < 4; o++)
+			{
+				_mm256_storeu_ps((float*)(out + o * stride + col * 16), _mm256_permute2f128_ps(lanes[0][o], lanes[1][o], 0x20));
+				_mm256_storeu_ps((float*)(out + (o + 4) * stride + col * 16), _mm256_permute2f128_ps(lanes[0][o], lanes[1][o], 0x31));
+			}
+		}
+	}
+	if(i < last)
+		mvpKernelScalar(vp, t, indices, i, last - i, dst + (size_t)(i - first) * stride, stride);
+}
+
+#endif
+
+//every kernel this cpu can run, slowest first
+std::vector<mvp_kernel> mvpKernels()
+{
+	std::vector<mvp_kernel> kernels;
+	kernels.push_back({"scalar", mvpKernelScalar});
+#ifdef MVP_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse2"))
+		kernels.push_back({"sse2", mvpKernelSSE});
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		kernels.push_back({"avx2", mvpKernelAVX2});
+#endif
+	return kernels;
+}
+
+static mvp_kernel mvp_selected = {nullptr, nullptr};
+
+//name == nullptr picks the fastest, returns false if there's no such kernel on this cpu
+bool mvpSelectKernel(const char* name)
+{
+	std::vector<mvp_kernel> kernels = mvpKernels();
+	if(name == nullptr)
+	{
+		mvp_selected = kernels.back();
+		return true;
+	}
+	for(const mvp_kernel& k : kernels)
+	{
+		if(strcmp(k.name, name) == 0)
+		{
+			mvp_selected = k;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* mvpKernelName()
+{
+	if(mvp_selected.fn == nullptr)
+		mvpSelectKernel(nullptr);
+	return mvp_selected.name;
+}
+
+//dst + (i - first) * stride = view_proj * model[i], for i in [first, first + count)
+void mvpBatch(const glm::mat4& view_proj, const object_transforms* t, uint32_t first, uint32_t count, uint8_t* dst, size_t stride)
+{
+	assert(first + count <= t->count);
+	assert(stride >= sizeof(glm::mat4));
+	if(mvp_selected.fn == nullptr)
+		mvpSelectKernel(nullptr);
+	mvp_selected.fn(view_proj, t, nullptr, first, count, dst, stride);
+}
+
+//dst + i * stride = view_proj * model[indices[i]], for i in [0, count)
+void mvpBatchIndexed(const glm::mat4& view_proj, const object_transforms* t, const uint32_t* indices, uint32_t count, uint8_t* dst, size_t stride)
+{
+	assert(stride >= sizeof(glm::mat4));
+	if(mvp_selected.fn == nullptr)
+		mvpSelectKernel(nullptr);
+	mvp_selected.fn(view_proj, t, indices, 0, count, dst, stride);
+}
+
+
+//--bench-mvp: per object glm (the whole chain per object, and with view_proj hoisted) against
+//each kernel, 10k to 1M objects
+void mvpBenchmark(uint32_t max_count)
+{
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(-5, 3, -10), glm::vec3(0, 0, 0), glm::vec3(0, -1, 0));
+	glm::mat4 clip = glm::mat4(1.0f, 0.0f, 0.0f, 0.0f,
+							   0.0f,-1.0f, 0.0f, 0.0f,
+							   0.0f, 0.0f, 0.5f, 0.0f,
+							   0.0f, 0.0f, 0.5f, 1.0f);
+	glm::mat4 view_proj = clip * projection * view;
+
+	std::vector<mvp_kernel> kernels = mvpKernels();
+	const size_t stride = sizeof(glm::mat4);
+
+	for(uint32_t count = 10000; count <= max_count; count *= 10)
+	{
+		object_transforms t;
+		transformsInit(&t, count);
+		std::vector<glm::mat4> models(count);
+		for(uint32_t i = 0; i < count; i++)
+		{
+			models[i] = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(i % 100, i / 100 % 100, i / 10000)),
+									(float)i * 0.01f, glm::vec3(0, 1, 0));
+			transformsSet(&t, i, models[i]);
+		}
+		std::vector<uint8_t> out(count * stride), ref(count * stride);
+		uint32_t iterations = count >= 1000000 ? 5 : 20;
+
+		//baselines, glm::mat4 output written through the same byte stride
+		double chain_ms = 0.0, hoisted_ms = 0.0;
+		for(uint32_t it = 0; it < iterations; it++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			for(uint32_t i = 0; i < count; i++)
+			{
+				glm::mat4 mvp = clip * projection * view * models[i];
+				memcpy(ref.data() + i * stride, &mvp, sizeof(mvp));
+			}
+			auto mid = std::chrono::high_resolution_clock::now();
+			for(uint32_t i = 0; i < count; i++)
+			{
+				glm::mat4 mvp = view_proj * models[i];
+				memcpy(ref.data() + i * stride, &mvp, sizeof(mvp));
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+			chain_ms += std::chrono::duration<double, std::milli>(mid - start).count();
+			hoisted_ms += std::chrono::duration<double, std::milli>(end - mid).count();
+		}
+		chain_ms /= iterations;
+		hoisted_ms /= iterations;
+		printf("mvp %u objects: glm chain %.3f ms (%.2f ns/object), glm hoisted %.3f ms (%.2fx)\n",
+			count, chain_ms, chain_ms * 1e6 / count, hoisted_ms, chain_ms / hoisted_ms);
+
+		for(const mvp_kernel& k : kernels)
+		{
+			double ms = 0.0;
+			for(uint32_t it = 0; it < iterations; it++)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				k.fn(view_proj, &t, nullptr, 0, count, out.data(), stride);
+				ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			}
+			ms /= iterations;
+
+			//fma rounds differently, compare relative to the size of the numbers involved
+			float max_err = 0.0f;
+			const float* a = (const float*)out.data();
+			const float* b = (const float*)ref.data();
+			for(size_t e = 0; e < (size_t)count * 16; e++)
+			{
+				float err = fabsf(a[e] - b[e]) / (1.0f + fabsf(b[e]));
+				if(err > max_err)
+					max_err = err;
+			}
+			printf("    %-6s %.3f ms (%.2f ns/object, %.2fx glm chain)%s\n", k.name, ms, ms * 1e6 / count, chain_ms / ms,
+				max_err > 1e-5f ? " MISMATCH" : "");
+		}
+	}
+}
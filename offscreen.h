@@ -0,0 +1,248 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+#include "gpu_arena.h"
+#include "frame_loop.h"
+
+/*
+headless rendering
+
+no window, no surface, no swapchain: the render pass draws into plain VkImages we own,
+one per frame in flight, and each frame ends with a copy of its image into a host visible
+readback buffer. nothing is presented, so there's no vsync and the loop runs as fast as
+the device (or lavapipe on a machine without a gpu) allows.
+
+the readback is asynchronous. the copy for frame N is recorded into frame N's command
+buffer and only looked at when frame N's slot comes back around, after frameBegin has
+waited on its fence for other reasons anyway:
+
+	frame N:	collect slot's previous copy (N - FRAMES_IN_FLIGHT) | record | copy -> readback
+	frame N+1:	collect ... (the gpu is still busy with N)
+
+so the cpu never stalls on a copy it just asked for. collecting here means checksumming
+the pixels (which also pulls them through the cache like a real consumer would) and, at
+the end, optionally writing the last one out as a PPM.
+
+readback memory is HOST_CACHED where there is such a type: reads from write-combined
+memory are painfully slow.
+*/
+
+#define OFFSCREEN_FORMAT VK_FORMAT_R8G8B8A8_UNORM
+
+typedef struct {
+	VkImage image;
+	gpu_allocation mem;
+	VkImageView view;
+
+	VkBuffer readback;
+	gpu_allocation readback_mem;
+	bool pending; //a copy was submitted and hasn't been collected
+} offscreen_target;
+
+typedef struct {
+	VkDevice device;
+	VkExtent2D extent;
+	VkDeviceSize frame_bytes;
+	bool coherent;
+	offscreen_target targets[FRAMES_IN_FLIGHT];
+
+	//collected readbacks
+	uint64_t frames;
+	uint64_t checksum; //of the last one
+	double collect_ms;
+	std::chrono::high_resolution_clock::time_point start;
+} offscreen;
+
+
+void offscreenInit(offscreen* off, gpu_arena* arena, VkDevice device, VkExtent2D extent)
+{
+	off->device = device;
+	off->extent = extent;
+	off->frame_bytes = (VkDeviceSize)extent.width * extent.height * 4;
+	off->frames = 0;
+	off->checksum = 0;
+	off->collect_ms = 0.0;
+	off->coherent = true;
+
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		offscreen_target& t = off->targets[i];
+		t.pending = false;
+
+		VkImageCreateInfo image_info = {};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.pNext = nullptr;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.format = OFFSCREEN_FORMAT;
+		image_info.extent.width = extent.width;
+		image_info.extent.height = extent.height;
+		image_info.extent.depth = 1;
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = 1;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		image_info.queueFamilyIndexCount = 0;
+		image_info.pQueueFamilyIndices = nullptr;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		image_info.flags = 0;
+		VkResult res = vkCreateImage(device, &image_info, nullptr, &t.image);
+		assert(res == VK_SUCCESS);
+		bool ok = arenaAllocImage(arena, t.image, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &t.mem);
+		assert(ok);
+
+		VkImageViewCreateInfo view_info = {};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.pNext = nullptr;
+		view_info.flags = 0;
+		view_info.image = t.image;
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = OFFSCREEN_FORMAT;
+		view_info.components.r = VK_COMPONENT_SWIZZLE_R;
+		view_info.components.g = VK_COMPONENT_SWIZZLE_G;
+		view_info.components.b = VK_COMPONENT_SWIZZLE_B;
+		view_info.components.a = VK_COMPONENT_SWIZZLE_A;
+		view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		view_info.subresourceRange.baseMipLevel = 0;
+		view_info.subresourceRange.levelCount = 1;
+		view_info.subresourceRange.baseArrayLayer = 0;
+		view_info.subresourceRange.layerCount = 1;
+		res = vkCreateImageView(device, &view_info, nullptr, &t.view);
+		assert(res == VK_SUCCESS);
+
+		VkBufferCreateInfo buf_info = {};
+		buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buf_info.pNext = nullptr;
+		buf_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		buf_info.size = off->frame_bytes;
+		buf_info.queueFamilyIndexCount = 0;
+		buf_info.pQueueFamilyIndices = nullptr;
+		buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		buf_info.flags = 0;
+		res = vkCreateBuffer(device, &buf_info, nullptr, &t.readback);
+		assert(res == VK_SUCCESS);
+
+		//cached first, cached memory that isn't coherent needs an invalidate before reading
+		if(arenaAllocBuffer(arena, t.readback, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &t.readback_mem))
+			continue;
+		if(arenaAllocBuffer(arena, t.readback, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &t.readback_mem))
+		{
+			off->coherent = false;
+			continue;
+		}
+		ok = arenaAllocBuffer(arena, t.readback, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &t.readback_mem);
+		assert(ok);
+	}
+
+	off->start = std::chrono::high_resolution_clock::now();
+}
+
+//records the copy of this frame's image (TRANSFER_SRC_OPTIMAL after the render pass) into its readback buffer
+void offscreenCopy(offscreen* off, VkCommandBuffer cmd, uint32_t frame)
+{
+	offscreen_target& t = off->targets[frame];
+
+	VkBufferImageCopy copy = {};
+	copy.bufferOffset = 0;
+	copy.bufferRowLength = 0;
+	copy.bufferImageHeight = 0;
+	copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	copy.imageSubresource.mipLevel = 0;
+	copy.imageSubresource.baseArrayLayer = 0;
+	copy.imageSubresource.layerCount = 1;
+	copy.imageOffset = {0, 0, 0};
+	copy.imageExtent = {off->extent.width, off->extent.height, 1};
+	vkCmdCopyImageToBuffer(cmd, t.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, t.readback, 1, &copy);
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	t.pending = true;
+}
+
+//reads back the frame's previous copy. only call once its fence has signaled (after frameBegin, or after the device is idle)
+void offscreenCollect(offscreen* off, uint32_t frame)
+{
+	offscreen_target& t = off->targets[frame];
+	if(!t.pending)
+		return;
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if(!off->coherent)
+	{
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.pNext = nullptr;
+		range.memory = t.readback_mem.mem;
+		range.offset = 0;
+		range.size = VK_WHOLE_SIZE;
+		vkInvalidateMappedMemoryRanges(off->device, 1, &range);
+	}
+
+	//FNV-1a over 64 bit words (an odd trailing pixel is left out)
+	const uint64_t* words = (const uint64_t*)t.readback_mem.mapped;
+	uint64_t hash = 14695981039346656037ull;
+	for(VkDeviceSize i = 0; i < off->frame_bytes / 8; i++)
+		hash = (hash ^ words[i]) * 1099511628211ull;
+
+	off->checksum = hash;
+	off->frames++;
+	t.pending = false;
+	off->collect_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+//binary PPM of the frame's readback buffer, collect it first
+bool offscreenWritePPM(offscreen* off, uint32_t frame, const char* path)
+{
+	FILE* f = fopen(path, "wb");
+	if(!f)
+		return false;
+	fprintf(f, "P6\n%u %u\n255\n", off->extent.width, off->extent.height);
+
+	const uint8_t* pixels = (const uint8_t*)off->targets[frame].readback_mem.mapped;
+	std::vector<uint8_t> row((size_t)off->extent.width * 3);
+	for(uint32_t y = 0; y < off->extent.height; y++)
+	{
+		const uint8_t* src = pixels + (size_t)y * off->extent.width * 4;
+		for(uint32_t x = 0; x < off->extent.width; x++)
+			memcpy(&row[x * 3], &src[x * 4], 3);
+		fwrite(row.data(), 1, row.size(), f);
+	}
+	return fclose(f) == 0;
+}
+
+//throughput since offscreenInit, counting only frames that made it back to the cpu
+void offscreenPrintStats(offscreen* off)
+{
+	double s = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - off->start).count();
+	if(!off->frames || s <= 0.0)
+		return;
+	printf("headless: %llu frames %ux%u in %.3f s, %.1f fps, readback %.1f MB/s, collect %.3f ms/frame, checksum %016llx\n",
+		(unsigned long long)off->frames, off->extent.width, off->extent.height, s, off->frames / s,
+		off->frames * off->frame_bytes / s / (1024.0 * 1024.0), off->collect_ms / off->frames, (unsigned long long)off->checksum);
+}
+
+void offscreenDestroy(offscreen* off, gpu_arena* arena)
+{
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		offscreen_target& t = off->targets[i];
+		vkDestroyBuffer(off->device, t.readback, nullptr);
+		arenaFree(arena, &t.readback_mem);
+		vkDestroyImageView(off->device, t.view, nullptr);
+		vkDestroyImage(off->device, t.image, nullptr);
+		arenaFree(arena, &t.mem);
+	}
+}
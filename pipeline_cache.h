@@ -0,0 +1,253 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <unistd.h>
+
+/*
+persistent pipeline cache
+
+compiling pipelines is most of our cold start, so the VkPipelineCache gets written to
+disk on shutdown and fed back in on the next run.
+
+the driver is allowed to reject (or worse, misbehave on) data from another device or
+driver, so we check the header ourselves before handing it over:
+	uint32_t length			header length, >= 32
+	uint32_t version		VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+	uint32_t vendorID		must match VkPhysicalDeviceProperties
+	uint32_t deviceID		ditto
+	uint8_t  uuid[16]		pipelineCacheUUID, changes with driver builds
+anything that doesn't match gets thrown away and we start with an empty cache.
+
+saving writes to <path>.tmp, fsyncs and renames over <path>, so a crash halfway through
+a write never leaves a truncated cache behind.
+*/
+
+#define PIPELINE_CACHE_DEFAULT_PATH "pipeline_cache.bin"
+
+typedef struct {
+	uint32_t length;
+	uint32_t version;
+	uint32_t vendor_id;
+	uint32_t device_id;
+	uint8_t uuid[VK_UUID_SIZE];
+} pipeline_cache_header;
+
+static bool readFile(const char* path, std::vector<uint8_t>& data)
+{
+	FILE* f = fopen(path, "rb");
+	if(f == nullptr)
+		return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if(size < 0)
+	{
+		fclose(f);
+		return false;
+	}
+	data.resize(size);
+	bool ok = size == 0 || fread(data.data(), 1, size, f) == (size_t)size;
+	fclose(f);
+	return ok;
+}
+
+static bool writeFileAtomic(const char* path, const void* data, size_t size)
+{
+	std::string tmp = std::string(path) + ".tmp";
+	FILE* f = fopen(tmp.c_str(), "wb");
+	if(f == nullptr)
+		return false;
+	bool ok = fwrite(data, 1, size, f) == size;
+	ok = ok && fflush(f) == 0;
+	ok = ok && fsync(fileno(f)) == 0;
+	ok = fclose(f) == 0 && ok;
+	if(ok)
+		ok = rename(tmp.c_str(), path) == 0;
+	if(!ok)
+		remove(tmp.c_str());
+	return ok;
+}
+
+//true if data looks like a cache this device/driver produced
+bool pipelineCacheValid(const VkPhysicalDeviceProperties& props, const std::vector<uint8_t>& data)
+{
+	if(data.size() < sizeof(pipeline_cache_header))
+		return false;
+	pipeline_cache_header header;
+	memcpy(&header, data.data(), sizeof(header));
+	return header.length >= sizeof(pipeline_cache_header)
+		&& header.length <= data.size()
+		&& header.version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& header.vendor_id == props.vendorID
+		&& header.device_id == props.deviceID
+		&& memcmp(header.uuid, props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+//data is what was read from path (empty = cold start), read ahead of the device being there
+VkPipelineCache pipelineCacheCreate(VkDevice device, const VkPhysicalDeviceProperties& props, std::vector<uint8_t>& data, const char* path)
+{
+	if(!data.empty() && !pipelineCacheValid(props, data))
+	{
+		printf("pipeline cache %s is from another device or driver, ignoring it\n", path);
+		data.clear();
+	}
+
+	VkPipelineCacheCreateInfo cache_info = {};
+	cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cache_info.pNext = nullptr;
+	cache_info.flags = 0;
+	cache_info.initialDataSize = data.size();
+	cache_info.pInitialData = data.empty() ? nullptr : data.data();
+
+	VkPipelineCache cache;
+	VkResult res = vkCreatePipelineCache(device, &cache_info, nullptr, &cache);
+	if(res != VK_SUCCESS && !data.empty())
+	{
+		//valid header but the driver still didn't like it
+		cache_info.initialDataSize = 0;
+		cache_info.pInitialData = nullptr;
+		res = vkCreatePipelineCache(device, &cache_info, nullptr, &cache);
+	}
+	assert(res == VK_SUCCESS);
+	return cache;
+}
+
+//path == nullptr gives an empty cache (cold start)
+VkPipelineCache pipelineCacheLoad(VkDevice device, const VkPhysicalDeviceProperties& props, const char* path)
+{
+	std::vector<uint8_t> data;
+	if(path && !readFile(path, data))
+		data.clear();
+	return pipelineCacheCreate(device, props, data, path);
+}
+
+bool pipelineCacheSave(VkDevice device, VkPipelineCache cache, const char* path)
+{
+	size_t size = 0;
+	VkResult res = vkGetPipelineCacheData(device, cache, &size, nullptr);
+	if(res != VK_SUCCESS)
+		return false;
+	std::vector<uint8_t> data(size);
+	res = vkGetPipelineCacheData(device, cache, &size, data.data());
+	if(res != VK_SUCCESS)
+		return false;
+	return writeFileAtomic(path, data.data(), size);
+}
+
+
+//--bench-pipeline-cache: builds a bunch of pipelines with an empty cache, saves it, reloads
+//it from disk and builds them again.
+//the pipelines are a do-nothing compute shader, hand assembled rather than from shaders/: every
+//pipeline has to be distinct, so LocalSize is patched per variant in the words here, and the
+//benchmark stays independent of the shader build:
+//	OpCapability Shader
+//	OpMemoryModel Logical GLSL450
+//	OpEntryPoint GLCompute %1 "main"
+//	OpExecutionMode %1 LocalSize X 1 1
+//	%2 = OpTypeVoid
+//	%3 = OpTypeFunction %2
+//	%1 = OpFunction %2 None %3
+//	%4 = OpLabel
+//	OpReturn
+//	OpFunctionEnd
+static const uint32_t bench_comp_spv[] = {
+	0x07230203, 0x00010000, 0x00000000, 0x00000005, 0x00000000,
+	0x00020011, 0x00000001,
+	0x0003000E, 0x00000000, 0x00000001,
+	0x0005000F, 0x00000005, 0x00000001, 0x6E69616D, 0x00000000,
+	0x00060010, 0x00000001, 0x00000011, 0x00000001, 0x00000001, 0x00000001,
+	0x00020013, 0x00000002,
+	0x00030021, 0x00000003, 0x00000002,
+	0x00050036, 0x00000002, 0x00000001, 0x00000000, 0x00000003,
+	0x000200F8, 0x00000004,
+	0x000100FD,
+	0x00010038,
+};
+#define BENCH_COMP_LOCAL_SIZE_X_WORD 18
+
+static double pipelineCacheBuild(VkDevice device, VkPipelineCache cache, uint32_t count)
+{
+	VkPipelineLayoutCreateInfo layout_info = {};
+	layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_info.pNext = nullptr;
+	VkPipelineLayout layout;
+	VkResult res = vkCreatePipelineLayout(device, &layout_info, nullptr, &layout);
+	assert(res == VK_SUCCESS);
+
+	uint32_t code[sizeof(bench_comp_spv) / sizeof(uint32_t)];
+	memcpy(code, bench_comp_spv, sizeof(code));
+
+	double ms = 0.0;
+	for(uint32_t i = 0; i < count; i++)
+	{
+		code[BENCH_COMP_LOCAL_SIZE_X_WORD] = i + 1;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		VkShaderModuleCreateInfo module_info = {};
+		module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		module_info.pNext = nullptr;
+		module_info.codeSize = sizeof(code);
+		module_info.pCode = code;
+		VkShaderModule module;
+		res = vkCreateShaderModule(device, &module_info, nullptr, &module);
+		assert(res == VK_SUCCESS);
+
+		VkComputePipelineCreateInfo pipe_info = {};
+		pipe_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipe_info.pNext = nullptr;
+		pipe_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipe_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipe_info.stage.module = module;
+		pipe_info.stage.pName = "main";
+		pipe_info.layout = layout;
+		pipe_info.basePipelineIndex = -1;
+		VkPipeline pipeline;
+		res = vkCreateComputePipelines(device, cache, 1, &pipe_info, nullptr, &pipeline);
+		assert(res == VK_SUCCESS);
+		ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		vkDestroyPipeline(device, pipeline, nullptr);
+		vkDestroyShaderModule(device, module, nullptr);
+	}
+
+	vkDestroyPipelineLayout(device, layout, nullptr);
+	return ms;
+}
+
+//--bench-pipeline-cache: the warm run goes through a scratch file next to path, the real cache isn't touched
+void pipelineCacheBenchmark(VkDevice device, const VkPhysicalDeviceProperties& props, const char* path, uint32_t count)
+{
+	std::string bench_path = std::string(path) + ".bench";
+
+	auto start = std::chrono::high_resolution_clock::now();
+	VkPipelineCache cold = pipelineCacheLoad(device, props, nullptr);
+	double cold_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	cold_ms += pipelineCacheBuild(device, cold, count);
+
+	start = std::chrono::high_resolution_clock::now();
+	bool saved = pipelineCacheSave(device, cold, bench_path.c_str());
+	double save_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	vkDestroyPipelineCache(device, cold, nullptr);
+	if(!saved)
+	{
+		printf("couldn't write %s\n", bench_path.c_str());
+		return;
+	}
+
+	start = std::chrono::high_resolution_clock::now();
+	VkPipelineCache warm = pipelineCacheLoad(device, props, bench_path.c_str());
+	double load_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	remove(bench_path.c_str());
+	double warm_ms = load_ms + pipelineCacheBuild(device, warm, count);
+	vkDestroyPipelineCache(device, warm, nullptr);
+
+	printf("pipeline cache, %u pipelines: cold %.3f ms, warm %.3f ms (load %.3f ms), save %.3f ms\n",
+		count, cold_ms, warm_ms, load_ms, save_ms);
+}
@@ -0,0 +1,386 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+
+#include "pipeline_variants.h"
+
+/*
+background pipeline compilation
+
+the first time a material shows up its pipeline doesn't exist yet, and compiling it right there
+on the render thread is a hitch: tens of ms with a cold cache, for every new material. instead
+a material's first lookup puts its pipeline in a queue that a pool of workers compiles from,
+and until it's done its draws use the generic pipeline compiled at startup. the lookup the
+frame after the worker finishes swaps the real one in. lookups are once per material per frame
+on the render thread, the recording threads only see the resulting table.
+
+every compile goes through the one VkPipelineCache the app loads and saves (see
+pipeline_cache.h). it's internally synchronized, so the workers share it as is, and whatever
+one of them compiled is a cache hit for the rest of this run and the next.
+
+a material's pipeline is a variant of the generic one: some fixed function state and some
+specialization constants (the key, see pipeline_variants.h). so the generic pipeline is created
+with ALLOW_DERIVATIVES and every variant as its DERIVATIVE. that's a hint, drivers can share
+work with the parent or ignore it (most desktop ones do). variants are stored by variantHash,
+keys that make the same pipeline get the same one, and there are at most budget of them.
+
+the startup manifest is prewarmed on the workers before the frame loop, for as long as the
+prewarm time budget allows, and whatever isn't done by then keeps compiling in the background.
+
+compiler off (--pipelines sync) a missing pipeline is compiled on the render thread in the frame
+that first needs it, the baseline for the hitch count and the p99 in framesPrintStats.
+*/
+
+typedef struct {
+	VkPipeline pipeline; //VK_NULL_HANDLE while it's queued
+	uint32_t key; //canonical, the first one that asked for it
+	double ms; //to compile
+} pipeline_entry;
+
+typedef struct {
+	VkDevice device;
+	VkPipelineCache cache;
+	VkPipelineLayout layout;
+	VkRenderPass render_pass;
+	VkShaderModule vert, frag;
+	VkPipeline generic;
+	bool async;
+
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done; //a worker stored a pipeline
+	std::deque<uint32_t> queue;
+	bool quit;
+	std::unordered_map<uint64_t, pipeline_entry> entries; //by variantHash, under lock
+	uint32_t budget; //entries, the generic one included
+
+	//stats, under lock
+	uint32_t compiled;
+	uint32_t compiled_sync; //on the render thread
+	double compile_ms, compile_max_ms;
+	double generic_ms;
+	uint32_t prewarmed; //manifest entries ready when prewarming stopped waiting
+	double prewarm_ms;
+	//render thread only
+	bool requested[PIPELINE_KEY_COUNT];
+	uint64_t lookups, fallbacks; //fallbacks: lookups that got the generic pipeline while theirs compiles
+	uint64_t over_budget; //lookups that got a variant with fewer features
+} pipeline_compiler;
+
+
+static VkPipeline pipelineCompile(pipeline_compiler* c, uint32_t key, VkPipeline base, double* ms)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	VkPipelineShaderStageCreateInfo stages[2] = {};
+	stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stages[0].module = c->vert;
+	stages[0].pName = "main";
+	stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stages[1].module = c->frag;
+	stages[1].pName = "main";
+	variant_specialization specialization;
+	stages[1].pSpecializationInfo = variantSpecialization(key, VK_SHADER_STAGE_FRAGMENT_BIT, &specialization);
+
+	//no vertex buffers, the cube's corners come from the vertex index
+	VkPipelineVertexInputStateCreateInfo vertex_input = {};
+	vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+	input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+
+	VkPipelineViewportStateCreateInfo viewport = {};
+	viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewport.viewportCount = 1;
+	viewport.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo raster = {};
+	raster.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	raster.polygonMode = VK_POLYGON_MODE_FILL;
+	raster.cullMode = key & PIPELINE_KEY_CULL_BACK ? VK_CULL_MODE_BACK_BIT : VK_CULL_MODE_NONE;
+	raster.frontFace = key & PIPELINE_KEY_FRONT_CW ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	raster.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisample = {};
+	multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineDepthStencilStateCreateInfo depth = {};
+	depth.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depth.depthTestEnable = VK_TRUE;
+	depth.depthWriteEnable = key & PIPELINE_KEY_NO_DEPTH_WRITE ? VK_FALSE : VK_TRUE;
+	depth.depthCompareOp = key & PIPELINE_KEY_DEPTH_LESS ? VK_COMPARE_OP_LESS : VK_COMPARE_OP_LESS_OR_EQUAL;
+
+	VkPipelineColorBlendAttachmentState blend_attachment = {};
+	blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	if(key & PIPELINE_KEY_BLEND)
+	{
+		blend_attachment.blendEnable = VK_TRUE;
+		blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+		blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	}
+	VkPipelineColorBlendStateCreateInfo blend = {};
+	blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	blend.attachmentCount = 1;
+	blend.pAttachments = &blend_attachment;
+
+	VkDynamicState dynamic_states[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+	VkPipelineDynamicStateCreateInfo dynamic = {};
+	dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic.dynamicStateCount = 2;
+	dynamic.pDynamicStates = dynamic_states;
+
+	VkGraphicsPipelineCreateInfo pipe_info = {};
+	pipe_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipe_info.pNext = nullptr;
+	pipe_info.flags = base != VK_NULL_HANDLE ? VK_PIPELINE_CREATE_DERIVATIVE_BIT : VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT;
+	pipe_info.stageCount = 2;
+	pipe_info.pStages = stages;
+	pipe_info.pVertexInputState = &vertex_input;
+	pipe_info.pInputAssemblyState = &input_assembly;
+	pipe_info.pViewportState = &viewport;
+	pipe_info.pRasterizationState = &raster;
+	pipe_info.pMultisampleState = &multisample;
+	pipe_info.pDepthStencilState = &depth;
+	pipe_info.pColorBlendState = &blend;
+	pipe_info.pDynamicState = &dynamic;
+	pipe_info.layout = c->layout;
+	pipe_info.renderPass = c->render_pass;
+	pipe_info.subpass = 0;
+	pipe_info.basePipelineHandle = base;
+	pipe_info.basePipelineIndex = -1;
+
+	VkPipeline pipeline;
+	VkResult res = vkCreateGraphicsPipelines(c->device, c->cache, 1, &pipe_info, nullptr, &pipeline);
+	assert(res == VK_SUCCESS);
+	*ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return pipeline;
+}
+
+//under lock, the entry was added when the key was queued
+static void pipelineCompilerStore(pipeline_compiler* c, uint32_t key, VkPipeline pipeline, double ms, bool sync)
+{
+	pipeline_entry& e = c->entries.at(variantHash(key));
+	e.pipeline = pipeline;
+	e.ms = ms;
+	c->compiled++;
+	c->compiled_sync += sync ? 1 : 0;
+	c->compile_ms += ms;
+	if(ms > c->compile_max_ms)
+		c->compile_max_ms = ms;
+}
+
+static void pipelineCompilerWorker(pipeline_compiler* c)
+{
+	for(;;)
+	{
+		uint32_t key;
+		{
+			std::unique_lock<std::mutex> guard(c->lock);
+			c->wake.wait(guard, [&]{ return c->quit || !c->queue.empty(); });
+			if(c->quit)
+				return;
+			key = c->queue.front();
+			c->queue.pop_front();
+		}
+
+		double ms;
+		VkPipeline pipeline = pipelineCompile(c, key, c->generic, &ms);
+
+		std::lock_guard<std::mutex> guard(c->lock);
+		pipelineCompilerStore(c, key, pipeline, ms, false);
+		c->done.notify_all();
+	}
+}
+
+//under lock: the entry for a new key, false if it's there already or there's no room
+static bool pipelineCompilerReserve(pipeline_compiler* c, uint32_t key)
+{
+	uint64_t hash = variantHash(key);
+	if(c->entries.count(hash) || c->entries.size() >= c->budget)
+		return false;
+	c->entries[hash] = {VK_NULL_HANDLE, key, 0.0};
+	return true;
+}
+
+//compiles the generic pipeline now, thread_count workers if async, at most budget pipelines
+void pipelineCompilerInit(pipeline_compiler* c, VkDevice device, VkPipelineCache cache, VkPipelineLayout layout, VkRenderPass render_pass,
+						  VkShaderModule vert, VkShaderModule frag, uint32_t thread_count, bool async, uint32_t budget = PIPELINE_MAX_VARIANTS)
+{
+	c->device = device;
+	c->cache = cache;
+	c->layout = layout;
+	c->render_pass = render_pass;
+	c->vert = vert;
+	c->frag = frag;
+	c->async = async;
+	c->quit = false;
+	c->compiled = 0;
+	c->compiled_sync = 0;
+	c->compile_ms = 0.0;
+	c->compile_max_ms = 0.0;
+	c->prewarmed = 0;
+	c->prewarm_ms = 0.0;
+	c->lookups = 0;
+	c->fallbacks = 0;
+	c->over_budget = 0;
+	c->budget = budget ? budget : 1;
+	for(uint32_t i = 0; i < PIPELINE_KEY_COUNT; i++)
+		c->requested[i] = false;
+
+	//key 0 is the generic state, so it's its own variant
+	c->generic = pipelineCompile(c, 0, VK_NULL_HANDLE, &c->generic_ms);
+	c->entries[variantHash(0)] = {c->generic, 0, c->generic_ms};
+
+	if(thread_count == 0)
+		thread_count = 1;
+	for(uint32_t t = 0; async && t < thread_count; t++)
+		c->workers.push_back(std::thread(pipelineCompilerWorker, c));
+}
+
+//compiles keys (the manifest) before the frame loop: queues them all for the workers and waits
+//for them up to budget_ms (sync: compiles them here until budget_ms is up, the rest on demand)
+void pipelineCompilerPrewarm(pipeline_compiler* c, const uint32_t* keys, uint32_t count, double budget_ms)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	auto elapsed = [&]{ return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count(); };
+	auto ready = [&]{
+		uint32_t n = 0;
+		for(uint32_t i = 0; i < count; i++)
+		{
+			auto e = c->entries.find(variantHash(variantCanonical(keys[i])));
+			n += e != c->entries.end() && e->second.pipeline != VK_NULL_HANDLE ? 1 : 0;
+		}
+		return n;
+	};
+
+	std::unique_lock<std::mutex> guard(c->lock);
+	if(c->async)
+	{
+		for(uint32_t i = 0; i < count; i++)
+		{
+			uint32_t key = variantCanonical(keys[i]);
+			if(pipelineCompilerReserve(c, key))
+				c->queue.push_back(key);
+		}
+		c->wake.notify_all();
+		c->done.wait_for(guard, std::chrono::duration<double, std::milli>(budget_ms), [&]{ return ready() == count; });
+	}
+	else
+	{
+		for(uint32_t i = 0; i < count && elapsed() < budget_ms; i++)
+		{
+			uint32_t key = variantCanonical(keys[i]);
+			if(!pipelineCompilerReserve(c, key))
+				continue;
+			guard.unlock();
+			double ms;
+			VkPipeline pipeline = pipelineCompile(c, key, c->generic, &ms);
+			guard.lock();
+			pipelineCompilerStore(c, key, pipeline, ms, false);
+		}
+	}
+	c->prewarmed = ready();
+	c->prewarm_ms = elapsed();
+}
+
+//render thread, once per frame for every key it draws with: the key's pipeline if it's ready,
+//otherwise the generic one (async) or the key's, compiled right now (sync). past the budget a
+//new key gets the nearest variant there is with fewer features instead
+VkPipeline pipelineCompilerGet(pipeline_compiler* c, uint32_t key)
+{
+	assert(key < PIPELINE_KEY_COUNT);
+	c->lookups++;
+	c->requested[key] = true;
+	key = variantCanonical(key);
+	{
+		std::lock_guard<std::mutex> guard(c->lock);
+		bool over = false;
+		for(;;)
+		{
+			auto e = c->entries.find(variantHash(key));
+			if(e != c->entries.end())
+			{
+				c->over_budget += over ? 1 : 0;
+				if(e->second.pipeline != VK_NULL_HANDLE)
+					return e->second.pipeline;
+				c->fallbacks++;
+				return c->generic;
+			}
+			if(pipelineCompilerReserve(c, key))
+				break;
+			over = true;
+			key = variantFallback(key); //ends at 0, the generic one, which is always there
+		}
+		if(c->async)
+		{
+			c->queue.push_back(key);
+			c->wake.notify_one();
+			c->fallbacks++;
+			return c->generic;
+		}
+	}
+
+	//only the render thread compiles when it's sync, and the entry is reserved, so nobody else compiles it meanwhile
+	double ms;
+	VkPipeline pipeline = pipelineCompile(c, key, c->generic, &ms);
+	std::lock_guard<std::mutex> guard(c->lock);
+	pipelineCompilerStore(c, key, pipeline, ms, true);
+	return pipeline;
+}
+
+void pipelineCompilerPrintStats(pipeline_compiler* c)
+{
+	uint32_t requested = 0;
+	for(uint32_t i = 0; i < PIPELINE_KEY_COUNT; i++)
+		requested += c->requested[i] ? 1 : 0;
+
+	std::lock_guard<std::mutex> guard(c->lock);
+	printf("pipelines (%s, %zu workers): generic %.3f ms, manifest %u/%zu prewarmed in %.3f ms\n", c->async ? "async" : "sync", c->workers.size(),
+		c->generic_ms, c->prewarmed, PIPELINE_MANIFEST_COUNT, c->prewarm_ms);
+	printf("    %zu/%u variants for %u keys drawn with, %u compiled (%u on the render thread), %.3f ms avg, %.3f ms max, %zu queued\n",
+		c->entries.size(), c->budget, requested, c->compiled, c->compiled_sync, c->compiled ? c->compile_ms / c->compiled : 0.0,
+		c->compile_max_ms, c->queue.size());
+	printf("    %llu/%llu lookups fell back to the generic one while compiling, %llu to fewer features over the budget\n",
+		(unsigned long long)c->fallbacks, (unsigned long long)c->lookups, (unsigned long long)c->over_budget);
+}
+
+//the device must be idle
+void pipelineCompilerDestroy(pipeline_compiler* c)
+{
+	{
+		std::lock_guard<std::mutex> guard(c->lock);
+		c->quit = true;
+	}
+	c->wake.notify_all();
+	for(std::thread& t : c->workers)
+		t.join();
+	c->workers.clear();
+	c->queue.clear();
+
+	//the generic one is in there too
+	for(auto& e : c->entries)
+	{
+		if(e.second.pipeline != VK_NULL_HANDLE)
+			vkDestroyPipeline(c->device, e.second.pipeline, nullptr);
+	}
+	c->entries.clear();
+}
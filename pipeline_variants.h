@@ -0,0 +1,181 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+/*
+pipeline variants
+
+a pipeline variant is a key, a bitset of features. the low bits are fixed function state the
+pipeline is created with, the high ones are specialization constants: instead of the fragment
+shader branching on a uniform for every pixel, the branch is on a constant_id and the driver
+compiles the variant with the other side gone.
+	bit		what					where
+	0x01	cull back faces			rasterization state
+	0x02	clockwise front faces	rasterization state
+	0x04	no depth writes			depth state
+	0x08	depth LESS				depth state (LESS_OR_EQUAL without)
+	0x10	alpha blending			blend state
+	0x20	checker pattern			shaders/mvp.frag constant_id 0
+	0x40	fog						shaders/mvp.frag constant_id 1
+
+everything about a key is constexpr: canonicalization (bits that can't change the result are
+dropped, so two keys that make the same pipeline are the same key), the map from bits to
+constant ids, and the startup manifest, which is checked at compile time to hold only canonical,
+distinct keys within the budget. variantKey<bits>() does the same checks for a single key.
+
+at runtime the compiler (see pipeline_compiler.h) still dedups by variantHash, a hash of what
+actually goes into vkCreateGraphicsPipelines, so keys that end up identical some other way share
+one pipeline too. the count is bounded by PIPELINE_MAX_VARIANTS: past it a new key falls back to
+the nearest one with fewer features (variantFallback) instead of compiling, and the manifest's
+prewarm at startup stops after a time budget and leaves the rest to the workers.
+*/
+
+#define PIPELINE_KEY_CULL_BACK 0x1
+#define PIPELINE_KEY_FRONT_CW 0x2
+#define PIPELINE_KEY_NO_DEPTH_WRITE 0x4
+#define PIPELINE_KEY_DEPTH_LESS 0x8
+#define PIPELINE_KEY_BLEND 0x10
+#define PIPELINE_KEY_CHECKER 0x20
+#define PIPELINE_KEY_FOG 0x40
+#define PIPELINE_KEY_COUNT 0x80 //keys are below this
+
+#define PIPELINE_MAX_VARIANTS 64 //distinct pipelines, the generic one included
+
+typedef struct {
+	uint32_t bit; //in the key
+	uint32_t constant_id;
+	VkShaderStageFlagBits stage;
+} variant_constant;
+
+//one VkBool32 constant per bit, constant_id order
+static constexpr variant_constant variant_constants[] = {
+	{PIPELINE_KEY_CHECKER, 0, VK_SHADER_STAGE_FRAGMENT_BIT},
+	{PIPELINE_KEY_FOG, 1, VK_SHADER_STAGE_FRAGMENT_BIT},
+};
+#define VARIANT_CONSTANT_COUNT (sizeof(variant_constants) / sizeof(variant_constants[0]))
+
+typedef struct {
+	VkSpecializationMapEntry entries[VARIANT_CONSTANT_COUNT];
+	VkBool32 data[VARIANT_CONSTANT_COUNT];
+	VkSpecializationInfo info; //points into the above, don't copy
+} variant_specialization;
+
+
+//the key that makes the same pipeline with no bits that don't matter
+constexpr uint32_t variantCanonical(uint32_t key)
+{
+	//winding only matters to culling
+	if(!(key & PIPELINE_KEY_CULL_BACK))
+		key &= ~(uint32_t)PIPELINE_KEY_FRONT_CW;
+	return key;
+}
+
+//the constant ids a stage's module has to declare
+constexpr uint32_t variantConstantIds(VkShaderStageFlagBits stage)
+{
+	uint32_t ids = 0;
+	for(const variant_constant& c : variant_constants)
+	{
+		if(c.stage == stage)
+			ids |= 1u << c.constant_id;
+	}
+	return ids;
+}
+
+//a key written in code, checked when it's compiled
+template<uint32_t Bits>
+constexpr uint32_t variantKey()
+{
+	static_assert(Bits < PIPELINE_KEY_COUNT, "not a pipeline key bit");
+	static_assert(variantCanonical(Bits) == Bits, "not canonical, it's the same pipeline as variantCanonical(bits)");
+	return Bits;
+}
+
+constexpr bool variantsDistinct(const uint32_t* keys, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		for(size_t j = i + 1; j < count; j++)
+		{
+			if(keys[i] == keys[j])
+				return false;
+		}
+	}
+	return true;
+}
+
+//prewarmed at startup, most used first so a short time budget gets the ones that matter
+static constexpr uint32_t pipeline_manifest[] = {
+	variantKey<PIPELINE_KEY_CULL_BACK>(),
+	variantKey<PIPELINE_KEY_CULL_BACK | PIPELINE_KEY_CHECKER>(),
+	variantKey<PIPELINE_KEY_CULL_BACK | PIPELINE_KEY_FOG>(),
+	variantKey<PIPELINE_KEY_CULL_BACK | PIPELINE_KEY_CHECKER | PIPELINE_KEY_FOG>(),
+	variantKey<PIPELINE_KEY_CHECKER>(),
+	variantKey<PIPELINE_KEY_FOG>(),
+	variantKey<PIPELINE_KEY_CHECKER | PIPELINE_KEY_FOG>(),
+	variantKey<PIPELINE_KEY_NO_DEPTH_WRITE | PIPELINE_KEY_BLEND>(),
+	variantKey<PIPELINE_KEY_NO_DEPTH_WRITE | PIPELINE_KEY_BLEND | PIPELINE_KEY_FOG>(),
+	variantKey<PIPELINE_KEY_CULL_BACK | PIPELINE_KEY_DEPTH_LESS>(),
+};
+#define PIPELINE_MANIFEST_COUNT (sizeof(pipeline_manifest) / sizeof(pipeline_manifest[0]))
+static_assert(variantsDistinct(pipeline_manifest, PIPELINE_MANIFEST_COUNT), "the manifest has a variant twice");
+static_assert(PIPELINE_MANIFEST_COUNT < PIPELINE_MAX_VARIANTS, "the manifest doesn't fit the budget next to the generic pipeline");
+
+//one feature less: the highest bit goes first, the specialization constants before the fixed function state
+constexpr uint32_t variantFallback(uint32_t key)
+{
+	for(uint32_t bit = PIPELINE_KEY_COUNT >> 1; bit; bit >>= 1)
+	{
+		if(key & bit)
+			return variantCanonical(key & ~bit);
+	}
+	return 0;
+}
+
+//fills s with the stage's constants for key, returns its VkSpecializationInfo (null if the stage has none)
+const VkSpecializationInfo* variantSpecialization(uint32_t key, VkShaderStageFlagBits stage, variant_specialization* s)
+{
+	uint32_t n = 0;
+	for(const variant_constant& c : variant_constants)
+	{
+		if(c.stage != stage)
+			continue;
+		s->entries[n].constantID = c.constant_id;
+		s->entries[n].offset = n * sizeof(VkBool32);
+		s->entries[n].size = sizeof(VkBool32);
+		s->data[n] = key & c.bit ? VK_TRUE : VK_FALSE;
+		n++;
+	}
+	s->info.mapEntryCount = n;
+	s->info.pMapEntries = s->entries;
+	s->info.dataSize = n * sizeof(VkBool32);
+	s->info.pData = s->data;
+	return n ? &s->info : nullptr;
+}
+
+static uint64_t variantHashValue(uint64_t hash, uint32_t value)
+{
+	for(uint32_t i = 0; i < 4; i++)
+		hash = (hash ^ ((value >> (i * 8)) & 0xFF)) * 1099511628211ull;
+	return hash;
+}
+
+//FNV-1a over the state and the constants the key turns into, what the pipeline is made of
+uint64_t variantHash(uint32_t key)
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = variantHashValue(hash, key & PIPELINE_KEY_CULL_BACK ? VK_CULL_MODE_BACK_BIT : VK_CULL_MODE_NONE);
+	hash = variantHashValue(hash, key & PIPELINE_KEY_CULL_BACK && key & PIPELINE_KEY_FRONT_CW ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE);
+	hash = variantHashValue(hash, key & PIPELINE_KEY_NO_DEPTH_WRITE ? VK_FALSE : VK_TRUE);
+	hash = variantHashValue(hash, key & PIPELINE_KEY_DEPTH_LESS ? VK_COMPARE_OP_LESS : VK_COMPARE_OP_LESS_OR_EQUAL);
+	hash = variantHashValue(hash, key & PIPELINE_KEY_BLEND ? VK_TRUE : VK_FALSE);
+	for(const variant_constant& c : variant_constants)
+	{
+		hash = variantHashValue(hash, c.constant_id);
+		hash = variantHashValue(hash, key & c.bit ? VK_TRUE : VK_FALSE);
+	}
+	return hash;
+}
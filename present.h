@@ -0,0 +1,183 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+#include "frame_loop.h"
+
+/*
+present modes and frame pacing
+
+present mode is picked from what the surface actually supports, by strategy:
+	fifo		vsync, always there (the spec guarantees it)
+	relaxed		FIFO_RELAXED: vsync, but a late frame goes out right away (tears) instead of waiting a whole interval
+	mailbox		no tearing, newest frame replaces the queued one, lowest latency without tearing
+	immediate	no vsync at all, for benchmarking
+anything missing falls back down its chain and ends at fifo.
+
+mailbox only pays off with a spare image to render into while one is queued and one is
+on screen, so it asks for minImageCount + 1 images.
+
+the pacer caps the frame rate (--pace-hz) and measures input-to-present latency: from the
+moment the frame samples input to vkQueuePresentKHR returning. that's the cpu side of it,
+what the display adds on top depends on the present mode and isn't visible to vulkan 1.0.
+the frame loop does all of its blocking before sampling input: the pacer's sleep first (so
+it doesn't show up as cpu frame time), then the frame fence and the acquire. time spent
+waiting on the gpu or the display then never ends up between the input and the image.
+*/
+
+#define PACER_WINDOW 1024 //latency samples kept for the percentiles
+
+typedef struct {
+	const char* name;
+	VkPresentModeKHR chain[3]; //most preferred first, fifo last
+} present_strategy;
+
+static const present_strategy present_strategies[] = {
+	{"fifo", {VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_KHR}},
+	{"relaxed", {VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_KHR}},
+	{"mailbox", {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_KHR}},
+	{"immediate", {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR}},
+};
+
+const char* presentModeName(VkPresentModeKHR mode)
+{
+	switch(mode)
+	{
+	case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+	case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+	case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo relaxed";
+	default: return "other";
+	}
+}
+
+//returns false (and picks fifo) for an unknown strategy name
+bool presentSelectMode(VkPhysicalDevice gpu, VkSurfaceKHR surface, const char* strategy, VkPresentModeKHR* mode)
+{
+	uint32_t count = 0;
+	VkResult res = vkGetPhysicalDeviceSurfacePresentModesKHR(gpu, surface, &count, nullptr);
+	assert(res == VK_SUCCESS);
+	std::vector<VkPresentModeKHR> modes(count);
+	res = vkGetPhysicalDeviceSurfacePresentModesKHR(gpu, surface, &count, modes.data());
+	assert(res == VK_SUCCESS);
+
+	printf("present modes:");
+	for(VkPresentModeKHR m : modes)
+		printf(" %s", presentModeName(m));
+	printf("\n");
+
+	*mode = VK_PRESENT_MODE_FIFO_KHR;
+	for(const present_strategy& s : present_strategies)
+	{
+		if(strcmp(s.name, strategy) != 0)
+			continue;
+		for(VkPresentModeKHR want : s.chain)
+		{
+			if(std::find(modes.begin(), modes.end(), want) != modes.end())
+			{
+				*mode = want;
+				break;
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+//mailbox wants one image more than the minimum, capped by the surface (0 = no max)
+uint32_t presentImageCount(const VkSurfaceCapabilitiesKHR& caps, VkPresentModeKHR mode)
+{
+	uint32_t count = caps.minImageCount;
+	if(mode == VK_PRESENT_MODE_MAILBOX_KHR)
+		count++;
+	if(caps.maxImageCount && count > caps.maxImageCount)
+		count = caps.maxImageCount;
+	return count;
+}
+
+
+typedef std::chrono::high_resolution_clock::time_point pacer_time;
+
+typedef struct {
+	double period_ms; //0 = uncapped
+	pacer_time next; //earliest start of the next frame
+	pacer_time input[FRAMES_IN_FLIGHT]; //when each frame in flight sampled its input
+
+	uint64_t frames;
+	double sleep_ms;
+	double latency_ms, latency_max_ms;
+	std::vector<float> window; //the last PACER_WINDOW latencies, ring
+} frame_pacer;
+
+
+void pacerInit(frame_pacer* p, double hz)
+{
+	p->period_ms = hz > 0.0 ? 1000.0 / hz : 0.0;
+	p->next = std::chrono::high_resolution_clock::now();
+	p->frames = 0;
+	p->sleep_ms = 0.0;
+	p->latency_ms = 0.0;
+	p->latency_max_ms = 0.0;
+	p->window.clear();
+	p->window.reserve(PACER_WINDOW);
+}
+
+//sleeps until the next frame is due, before frameBegin. the os sleep overshoots, so the last bit is spun
+void pacerWait(frame_pacer* p)
+{
+	if(p->period_ms <= 0.0)
+		return;
+	auto now = std::chrono::high_resolution_clock::now();
+	auto start = now;
+	auto coarse = p->next - std::chrono::microseconds(1500);
+	if(now < coarse)
+		std::this_thread::sleep_until(coarse);
+	while((now = std::chrono::high_resolution_clock::now()) < p->next)
+		std::this_thread::yield();
+	p->sleep_ms += std::chrono::duration<double, std::milli>(now - start).count();
+
+	//a frame that ran long pushes the schedule back instead of bursting to catch up
+	auto period = std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<double, std::milli>(p->period_ms));
+	p->next += period;
+	if(p->next < now)
+		p->next = now + period;
+}
+
+//right before the frame reads input, after all the waiting
+void pacerSampleInput(frame_pacer* p, uint32_t frame)
+{
+	p->input[frame] = std::chrono::high_resolution_clock::now();
+}
+
+//right after vkQueuePresentKHR (or the submit, headless)
+void pacerPresented(frame_pacer* p, uint32_t frame)
+{
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - p->input[frame]).count();
+	if(p->window.size() < PACER_WINDOW)
+		p->window.push_back((float)ms);
+	else
+		p->window[p->frames % PACER_WINDOW] = (float)ms;
+	p->frames++;
+	p->latency_ms += ms;
+	if(ms > p->latency_max_ms)
+		p->latency_max_ms = ms;
+}
+
+void pacerPrintStats(frame_pacer* p)
+{
+	if(!p->frames)
+		return;
+	std::vector<float> sorted = p->window;
+	std::sort(sorted.begin(), sorted.end());
+	printf("input to present: %.3f ms avg, p50 %.3f, p99 %.3f, max %.3f, pacing sleep %.3f ms/frame\n",
+		p->latency_ms / p->frames, sorted[sorted.size() / 2], sorted[sorted.size() * 99 / 100], p->latency_max_ms,
+		p->sleep_ms / p->frames);
+}
@@ -0,0 +1,615 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+#include "frame_loop.h"
+
+/*
+gpu/cpu profiler
+
+gpu scopes write a timestamp at their begin and end into the frame's command buffer, cpu scopes
+take the time on the cpu. both nest (a stack each), and every frame is implicitly the root of its
+gpu scopes. the top level gpu scopes also get a pipeline statistics query around them (vertices,
+primitives, shader invocations): those can't nest, a second query of the same type can't begin
+while one is active, so nested scopes only get times. a scope that begins inside a render pass has
+to end in the same subpass, one that begins outside has to end outside.
+
+nothing ever waits for a result. each frame in flight has its own range of queries, and they're
+read back when the slot comes around again in profilerBeginFrame, after frameBegin has waited on
+the slot's fence anyway: results show up FRAMES_IN_FLIGHT frames late, for free.
+
+timestamps count in ticks of timestampPeriod ns (VkPhysicalDeviceLimits) and only their low
+timestampValidBits bits mean anything. to put gpu scopes on the cpu timeline, one timestamp is
+written at init and the cpu time right before the submit and right after the fence says when it
+was taken, give or take half that window (printed). from there the two clocks are assumed to
+tick together, good enough for a capture of a few minutes; VK_EXT_calibrated_timestamps would do
+better, but it's not around on the drivers we target.
+
+results go two ways:
+	- a rolling table per scope (the last PROFILER_WINDOW frames): gpu/cpu avg, min, max, and the
+	  pipeline statistics for top level scopes
+	- chrome trace JSON (chrome://tracing, perfetto): cpu scopes on one track, gpu scopes on
+	  another, both in microseconds since the profiler started. capped at PROFILER_TRACE_MAX events
+
+scope names are pointers to strings that outlive the profiler (literals), they're compared by
+content and written to the trace as they are, so no quotes or backslashes in them. with the
+profiler off (enabled = false, no profilerInit) every call is a no-op, call sites stay unguarded.
+*/
+
+#define PROFILER_MAX_SCOPES 64 //gpu scopes per frame, the frame itself included
+#define PROFILER_WINDOW 256 //frames the rolling stats cover
+#define PROFILER_TRACE_MAX (1u << 20) //trace events kept
+#define PROFILER_STATS 6 //pipeline statistics per query, in the order of the flags below
+
+static const VkQueryPipelineStatisticFlags profiler_stat_flags =
+	VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+static const char* profiler_stat_names[PROFILER_STATS] = {"verts", "prims", "vs", "clipped", "fs", "cs"};
+
+typedef struct {
+	const char* name;
+	int32_t parent; //in the frame's scopes, -1 = top level
+	uint32_t depth; //0 for the frame and top level cpu scopes
+	bool gpu;
+	int32_t stats; //pipeline statistics query, -1 = none
+	uint64_t cpu_begin, cpu_end; //ns since init
+} profiler_scope;
+
+typedef struct {
+	std::vector<profiler_scope> scopes; //scopes[0] is the frame (gpu)
+	uint64_t number;
+	uint32_t stats_used;
+	bool pending; //recorded and submitted, not read back yet
+} profiler_frame;
+
+typedef struct {
+	float gpu_ms, cpu_ms;
+	uint64_t stats[PROFILER_STATS];
+} profiler_sample;
+
+//one row of the table: a scope name under a parent row
+typedef struct {
+	const char* name;
+	int32_t parent;
+	uint32_t depth;
+	bool gpu, has_stats;
+	std::vector<profiler_sample> window; //ring
+	uint64_t samples;
+	uint64_t last_frame; //frame the last sample came from, to count calls per frame
+	uint64_t frames;
+} profiler_entry;
+
+typedef struct {
+	const char* name;
+	uint64_t begin_ns, dur_ns;
+	uint64_t frame;
+	bool gpu, has_stats;
+	uint64_t stats[PROFILER_STATS];
+} profiler_event;
+
+typedef struct {
+	bool enabled; //set to false instead of calling profilerInit to turn it off
+	VkDevice device;
+	bool gpu; //the queue family has timestamps
+	bool pipeline_stats; //and the device the pipelineStatisticsQuery feature
+	VkQueryPool timestamps, statistics;
+	uint64_t mask;
+	double period_ns;
+
+	std::chrono::steady_clock::time_point start;
+	uint64_t calib_ticks, calib_ns; //the same moment on both clocks
+	uint64_t calib_error_ns;
+
+	profiler_frame frames[FRAMES_IN_FLIGHT];
+	uint32_t current;
+	std::vector<uint32_t> gpu_stack, cpu_stack; //open scopes, indices into the current frame's
+
+	std::vector<profiler_entry> entries;
+	std::vector<uint32_t> entry_of; //scratch: entry of each scope of the frame being resolved
+
+	bool trace;
+	std::vector<profiler_event> events;
+	uint64_t dropped_events, dropped_frames;
+} gpu_profiler;
+
+
+static uint64_t profilerNow(gpu_profiler* p)
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - p->start).count();
+}
+
+static VkQueryPool profilerQueries(VkDevice device, VkQueryType type, uint32_t count, VkQueryPipelineStatisticFlags stats)
+{
+	VkQueryPoolCreateInfo query_info = {};
+	query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	query_info.pNext = nullptr;
+	query_info.flags = 0;
+	query_info.queryType = type;
+	query_info.queryCount = count;
+	query_info.pipelineStatistics = stats;
+	VkQueryPool pool;
+	VkResult res = vkCreateQueryPool(device, &query_info, nullptr, &pool);
+	assert(res == VK_SUCCESS);
+	return pool;
+}
+
+//one timestamp on its own, cpu time taken around the submit
+static void profilerCalibrate(gpu_profiler* p, VkQueue queue, uint32_t queue_family)
+{
+	VkCommandPoolCreateInfo cmd_pool_info = {};
+	cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cmd_pool_info.pNext = nullptr;
+	cmd_pool_info.queueFamilyIndex = queue_family;
+	cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	VkCommandPool pool;
+	VkResult res = vkCreateCommandPool(p->device, &cmd_pool_info, nullptr, &pool);
+	assert(res == VK_SUCCESS);
+
+	VkCommandBufferAllocateInfo cmd_info = {};
+	cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cmd_info.pNext = nullptr;
+	cmd_info.commandPool = pool;
+	cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmd_info.commandBufferCount = 1;
+	VkCommandBuffer cmd;
+	res = vkAllocateCommandBuffers(p->device, &cmd_info, &cmd);
+	assert(res == VK_SUCCESS);
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.pNext = nullptr;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	begin_info.pInheritanceInfo = nullptr;
+	res = vkBeginCommandBuffer(cmd, &begin_info);
+	assert(res == VK_SUCCESS);
+	vkCmdResetQueryPool(cmd, p->timestamps, 0, 1);
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, p->timestamps, 0);
+	res = vkEndCommandBuffer(cmd);
+	assert(res == VK_SUCCESS);
+
+	VkFenceCreateInfo fence_info = {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_info.pNext = nullptr;
+	fence_info.flags = 0;
+	VkFence fence;
+	res = vkCreateFence(p->device, &fence_info, nullptr, &fence);
+	assert(res == VK_SUCCESS);
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = nullptr;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &cmd;
+	uint64_t before = profilerNow(p);
+	res = vkQueueSubmit(queue, 1, &submit_info, fence);
+	assert(res == VK_SUCCESS);
+	res = vkWaitForFences(p->device, 1, &fence, VK_TRUE, UINT64_MAX);
+	assert(res == VK_SUCCESS);
+	uint64_t after = profilerNow(p);
+
+	uint64_t ticks = 0;
+	res = vkGetQueryPoolResults(p->device, p->timestamps, 0, 1, sizeof(ticks), &ticks, sizeof(ticks), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+	assert(res == VK_SUCCESS);
+	p->calib_ticks = ticks & p->mask;
+	p->calib_ns = before + (after - before) / 2;
+	p->calib_error_ns = (after - before) / 2;
+
+	vkDestroyFence(p->device, fence, nullptr);
+	vkFreeCommandBuffers(p->device, pool, 1, &cmd);
+	vkDestroyCommandPool(p->device, pool, nullptr);
+}
+
+//queue/queue_family: where the profiled command buffers go. pipeline_stats: the device was created with pipelineStatisticsQuery
+void profilerInit(gpu_profiler* p, VkDevice device, const VkPhysicalDeviceProperties& props, uint32_t timestamp_bits, bool pipeline_stats,
+				  VkQueue queue, uint32_t queue_family, bool trace)
+{
+	p->enabled = true;
+	p->device = device;
+	p->start = std::chrono::steady_clock::now();
+	p->gpu = timestamp_bits != 0;
+	p->pipeline_stats = p->gpu && pipeline_stats;
+	p->mask = timestamp_bits >= 64 ? ~0ull : (1ull << timestamp_bits) - 1;
+	p->period_ns = props.limits.timestampPeriod;
+	p->timestamps = VK_NULL_HANDLE;
+	p->statistics = VK_NULL_HANDLE;
+	p->calib_ticks = 0;
+	p->calib_ns = 0;
+	p->calib_error_ns = 0;
+
+	if(p->gpu)
+	{
+		p->timestamps = profilerQueries(device, VK_QUERY_TYPE_TIMESTAMP, FRAMES_IN_FLIGHT * PROFILER_MAX_SCOPES * 2, 0);
+		profilerCalibrate(p, queue, queue_family);
+	}
+	if(p->pipeline_stats)
+		p->statistics = profilerQueries(device, VK_QUERY_TYPE_PIPELINE_STATISTICS, FRAMES_IN_FLIGHT * PROFILER_MAX_SCOPES, profiler_stat_flags);
+
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		p->frames[i].scopes.reserve(PROFILER_MAX_SCOPES * 2);
+		p->frames[i].pending = false;
+	}
+	p->current = 0;
+	p->gpu_stack.clear();
+	p->cpu_stack.clear();
+	p->entries.clear();
+	p->trace = trace;
+	p->events.clear();
+	p->dropped_events = 0;
+	p->dropped_frames = 0;
+
+	printf("profiler: %s, timestamp period %.3f ns, %u valid bits, cpu/gpu clocks matched to +-%.3f ms, pipeline statistics %s\n",
+		p->gpu ? "gpu and cpu" : "cpu only (no timestamps on this queue)", p->period_ns, timestamp_bits,
+		p->calib_error_ns / 1e6, p->pipeline_stats ? "on" : "off");
+}
+
+static uint32_t profilerEntry(gpu_profiler* p, const char* name, int32_t parent, uint32_t depth, bool gpu)
+{
+	for(uint32_t i = 0; i < p->entries.size(); i++)
+	{
+		const profiler_entry& e = p->entries[i];
+		if(e.parent == parent && e.gpu == gpu && strcmp(e.name, name) == 0)
+			return i;
+	}
+	profiler_entry e;
+	e.name = name;
+	e.parent = parent;
+	e.depth = depth;
+	e.gpu = gpu;
+	e.has_stats = false;
+	e.window.reserve(PROFILER_WINDOW);
+	e.samples = 0;
+	e.last_frame = UINT64_MAX;
+	e.frames = 0;
+	p->entries.push_back(e);
+	return (uint32_t)p->entries.size() - 1;
+}
+
+static void profilerEvent(gpu_profiler* p, const char* name, uint64_t begin_ns, uint64_t dur_ns, uint64_t frame, bool gpu, const uint64_t* stats)
+{
+	if(!p->trace)
+		return;
+	if(p->events.size() >= PROFILER_TRACE_MAX)
+	{
+		p->dropped_events++;
+		return;
+	}
+	profiler_event e;
+	e.name = name;
+	e.begin_ns = begin_ns;
+	e.dur_ns = dur_ns;
+	e.frame = frame;
+	e.gpu = gpu;
+	e.has_stats = stats != nullptr;
+	if(stats)
+		memcpy(e.stats, stats, sizeof(e.stats));
+	p->events.push_back(e);
+}
+
+//the slot's last frame: its fence has signaled, so every query in it is done
+static void profilerResolve(gpu_profiler* p, profiler_frame& f)
+{
+	f.pending = false;
+
+	uint64_t ticks[PROFILER_MAX_SCOPES * 2];
+	uint64_t stats[PROFILER_MAX_SCOPES * PROFILER_STATS];
+	uint32_t gpu_scopes = 0;
+	for(const profiler_scope& s : f.scopes)
+		gpu_scopes += s.gpu;
+	uint32_t slot = (uint32_t)(&f - p->frames);
+	if(p->gpu && gpu_scopes)
+	{
+		VkResult res = vkGetQueryPoolResults(p->device, p->timestamps, slot * PROFILER_MAX_SCOPES * 2, gpu_scopes * 2,
+											 sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if(res == VK_SUCCESS && f.stats_used)
+			res = vkGetQueryPoolResults(p->device, p->statistics, slot * PROFILER_MAX_SCOPES, f.stats_used,
+										sizeof(stats), stats, PROFILER_STATS * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if(res != VK_SUCCESS)
+		{
+			p->dropped_frames++;
+			return;
+		}
+	}
+
+	p->entry_of.resize(f.scopes.size());
+	uint32_t query = 0;
+	for(uint32_t i = 0; i < f.scopes.size(); i++)
+	{
+		const profiler_scope& s = f.scopes[i];
+		int32_t parent = s.parent >= 0 ? (int32_t)p->entry_of[s.parent] : -1;
+		uint32_t e_index = profilerEntry(p, s.name, parent, s.depth, s.gpu);
+		p->entry_of[i] = e_index;
+		profiler_entry& e = p->entries[e_index];
+
+		profiler_sample sample = {};
+		sample.cpu_ms = (float)((s.cpu_end - s.cpu_begin) / 1e6);
+		uint64_t begin_ns = s.cpu_begin, dur_ns = s.cpu_end - s.cpu_begin;
+		const uint64_t* scope_stats = nullptr;
+		if(s.gpu)
+		{
+			if(!p->gpu)
+				continue;
+			uint64_t begin = ticks[query * 2] & p->mask, end = ticks[query * 2 + 1] & p->mask;
+			query++;
+			uint64_t dur = end >= begin ? end - begin : end + p->mask + 1 - begin; //the counter wrapped
+			uint64_t since = (begin - p->calib_ticks) & p->mask;
+			begin_ns = p->calib_ns + (uint64_t)(since * p->period_ns);
+			dur_ns = (uint64_t)(dur * p->period_ns);
+			sample.gpu_ms = (float)(dur_ns / 1e6);
+			if(s.stats >= 0)
+			{
+				scope_stats = &stats[s.stats * PROFILER_STATS];
+				memcpy(sample.stats, scope_stats, sizeof(sample.stats));
+				e.has_stats = true;
+			}
+		}
+
+		if(e.window.size() < PROFILER_WINDOW)
+			e.window.push_back(sample);
+		else
+			e.window[e.samples % PROFILER_WINDOW] = sample;
+		e.samples++;
+		if(e.last_frame != f.number)
+		{
+			e.last_frame = f.number;
+			e.frames++;
+		}
+		profilerEvent(p, s.name, begin_ns, dur_ns, f.number, s.gpu, scope_stats);
+	}
+}
+
+//right after frameBegin, before anything else goes into cmd: reads back the slot's previous frame and resets its queries
+void profilerBeginFrame(gpu_profiler* p, VkCommandBuffer cmd, uint32_t slot, uint64_t frame_number)
+{
+	if(!p->enabled)
+		return;
+	profiler_frame& f = p->frames[slot];
+	if(f.pending)
+		profilerResolve(p, f);
+
+	p->current = slot;
+	f.number = frame_number;
+	f.scopes.clear();
+	f.stats_used = 0;
+	p->gpu_stack.clear();
+	p->cpu_stack.clear();
+	if(p->gpu)
+	{
+		vkCmdResetQueryPool(cmd, p->timestamps, slot * PROFILER_MAX_SCOPES * 2, PROFILER_MAX_SCOPES * 2);
+		if(p->pipeline_stats)
+			vkCmdResetQueryPool(cmd, p->statistics, slot * PROFILER_MAX_SCOPES, PROFILER_MAX_SCOPES);
+	}
+
+	//the frame is scope 0, the root of every gpu scope
+	profiler_scope s;
+	s.name = "frame";
+	s.parent = -1;
+	s.depth = 0;
+	s.gpu = true;
+	s.stats = -1;
+	s.cpu_begin = profilerNow(p);
+	s.cpu_end = s.cpu_begin;
+	f.scopes.push_back(s);
+	p->gpu_stack.push_back(0);
+	if(p->gpu)
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, p->timestamps, slot * PROFILER_MAX_SCOPES * 2);
+}
+
+//the gpu scopes get their queries in the order they begin, which is also the order they're stored in
+static uint32_t profilerGpuQuery(gpu_profiler* p, uint32_t scope)
+{
+	uint32_t query = 0;
+	const profiler_frame& f = p->frames[p->current];
+	for(uint32_t i = 0; i < scope; i++)
+		query += f.scopes[i].gpu;
+	return p->current * PROFILER_MAX_SCOPES * 2 + query * 2;
+}
+
+//returns the scope for profilerEnd, UINT32_MAX if the frame is out of scopes (then End ignores it).
+//statistics = false for scopes around vkCmdExecuteCommands: secondaries can't run while a query is active without inheritedQueries
+uint32_t profilerBegin(gpu_profiler* p, VkCommandBuffer cmd, const char* name, bool statistics = true)
+{
+	if(!p->enabled)
+		return UINT32_MAX;
+	profiler_frame& f = p->frames[p->current];
+	uint32_t gpu_scopes = 0;
+	for(const profiler_scope& s : f.scopes)
+		gpu_scopes += s.gpu;
+	if(gpu_scopes >= PROFILER_MAX_SCOPES)
+		return UINT32_MAX;
+
+	profiler_scope s;
+	s.name = name;
+	s.parent = (int32_t)p->gpu_stack.back();
+	s.depth = (uint32_t)p->gpu_stack.size();
+	s.gpu = true;
+	s.stats = -1;
+	s.cpu_begin = profilerNow(p);
+	s.cpu_end = s.cpu_begin;
+	uint32_t index = (uint32_t)f.scopes.size();
+	f.scopes.push_back(s);
+	p->gpu_stack.push_back(index);
+
+	if(p->gpu)
+	{
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, p->timestamps, profilerGpuQuery(p, index));
+		//one statistics query at a time, so only the frame's direct children get one
+		if(p->pipeline_stats && statistics && s.depth == 1)
+		{
+			f.scopes[index].stats = (int32_t)f.stats_used++;
+			vkCmdBeginQuery(cmd, p->statistics, p->current * PROFILER_MAX_SCOPES + f.scopes[index].stats, 0);
+		}
+	}
+	return index;
+}
+
+void profilerEnd(gpu_profiler* p, VkCommandBuffer cmd, uint32_t scope)
+{
+	if(scope == UINT32_MAX)
+		return;
+	profiler_frame& f = p->frames[p->current];
+	assert(!p->gpu_stack.empty() && p->gpu_stack.back() == scope); //scopes end in the reverse order they began
+	p->gpu_stack.pop_back();
+	profiler_scope& s = f.scopes[scope];
+	s.cpu_end = profilerNow(p);
+	if(p->gpu)
+	{
+		if(s.stats >= 0)
+			vkCmdEndQuery(cmd, p->statistics, p->current * PROFILER_MAX_SCOPES + s.stats);
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, p->timestamps, profilerGpuQuery(p, scope) + 1);
+	}
+}
+
+uint32_t profilerCpuBegin(gpu_profiler* p, const char* name)
+{
+	if(!p->enabled)
+		return UINT32_MAX;
+	profiler_frame& f = p->frames[p->current];
+	profiler_scope s;
+	s.name = name;
+	s.parent = p->cpu_stack.empty() ? -1 : (int32_t)p->cpu_stack.back();
+	s.depth = (uint32_t)p->cpu_stack.size();
+	s.gpu = false;
+	s.stats = -1;
+	s.cpu_begin = profilerNow(p);
+	s.cpu_end = s.cpu_begin;
+	uint32_t index = (uint32_t)f.scopes.size();
+	f.scopes.push_back(s);
+	p->cpu_stack.push_back(index);
+	return index;
+}
+
+void profilerCpuEnd(gpu_profiler* p, uint32_t scope)
+{
+	if(scope == UINT32_MAX)
+		return;
+	assert(!p->cpu_stack.empty() && p->cpu_stack.back() == scope);
+	p->cpu_stack.pop_back();
+	p->frames[p->current].scopes[scope].cpu_end = profilerNow(p);
+}
+
+//last thing before the command buffer ends
+void profilerEndFrame(gpu_profiler* p, VkCommandBuffer cmd)
+{
+	if(!p->enabled)
+		return;
+	assert(p->gpu_stack.size() == 1 && p->cpu_stack.empty());
+	profilerEnd(p, cmd, 0);
+	p->frames[p->current].pending = true;
+}
+
+//the last few frames are still out, reads them back. the device has to be idle
+void profilerFlush(gpu_profiler* p)
+{
+	if(!p->enabled)
+		return;
+	//oldest first, so the trace stays in order
+	for(uint32_t i = 1; i <= FRAMES_IN_FLIGHT; i++)
+	{
+		profiler_frame& f = p->frames[(p->current + i) % FRAMES_IN_FLIGHT];
+		if(f.pending)
+			profilerResolve(p, f);
+	}
+}
+
+static void profilerPrintEntry(gpu_profiler* p, uint32_t index)
+{
+	profiler_entry& e = p->entries[index];
+	if(e.window.empty())
+		return;
+
+	double sum = 0.0, lo = 1e30, hi = 0.0, cpu = 0.0;
+	double stats[PROFILER_STATS] = {};
+	for(const profiler_sample& s : e.window)
+	{
+		double ms = e.gpu ? s.gpu_ms : s.cpu_ms;
+		sum += ms;
+		lo = std::min(lo, ms);
+		hi = std::max(hi, ms);
+		cpu += s.cpu_ms;
+		for(uint32_t k = 0; k < PROFILER_STATS; k++)
+			stats[k] += (double)s.stats[k];
+	}
+	double n = (double)e.window.size();
+
+	char label[64];
+	snprintf(label, sizeof(label), "%*s%s", e.depth * 2, "", e.name);
+	printf("  %-24s %s %8.3f %8.3f %8.3f  %8.3f  %5.2f", label, e.gpu ? "gpu" : "cpu", sum / n, lo, hi, cpu / n,
+		e.frames ? (double)e.samples / e.frames : 0.0);
+	if(e.has_stats)
+	{
+		for(uint32_t k = 0; k < PROFILER_STATS; k++)
+			printf("  %s %.0f", profiler_stat_names[k], stats[k] / n);
+	}
+	printf("\n");
+
+	for(uint32_t i = 0; i < p->entries.size(); i++)
+	{
+		if(p->entries[i].parent == (int32_t)index)
+			profilerPrintEntry(p, i);
+	}
+}
+
+//the rolling table, children under their parents. times in ms, the cpu column is recording time for gpu scopes
+void profilerPrintStats(gpu_profiler* p)
+{
+	if(!p->enabled || p->entries.empty())
+		return;
+	printf("profiler, last %u frames:          avg      min      max   cpu avg  calls/frame\n", PROFILER_WINDOW);
+	for(uint32_t gpu = 0; gpu < 2; gpu++)
+	{
+		for(uint32_t i = 0; i < p->entries.size(); i++)
+		{
+			if(p->entries[i].parent == -1 && p->entries[i].gpu == (gpu == 1))
+				profilerPrintEntry(p, i);
+		}
+	}
+	if(p->dropped_frames || p->dropped_events)
+		printf("  dropped: %llu frames (results not ready), %llu trace events (over %u)\n",
+			(unsigned long long)p->dropped_frames, (unsigned long long)p->dropped_events, PROFILER_TRACE_MAX);
+}
+
+//chrome trace event format, complete ("X") events, flush first
+bool profilerWriteTrace(gpu_profiler* p, const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if(!file)
+		return false;
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"ph\":\"M\",\"pid\":1,\"tid\":1,\"name\":\"thread_name\",\"args\":{\"name\":\"cpu\"}},\n");
+	fprintf(file, "{\"ph\":\"M\",\"pid\":1,\"tid\":2,\"name\":\"thread_name\",\"args\":{\"name\":\"gpu\"}}");
+	for(const profiler_event& e : p->events)
+	{
+		fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"name\":\"%s\",\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu",
+			e.gpu ? 2 : 1, e.name, e.begin_ns / 1e3, e.dur_ns / 1e3, (unsigned long long)e.frame);
+		if(e.has_stats)
+		{
+			for(uint32_t k = 0; k < PROFILER_STATS; k++)
+				fprintf(file, ",\"%s\":%llu", profiler_stat_names[k], (unsigned long long)e.stats[k]);
+		}
+		fprintf(file, "}}");
+	}
+	fprintf(file, "\n]}\n");
+	return fclose(file) == 0;
+}
+
+void profilerDestroy(gpu_profiler* p)
+{
+	if(!p->enabled)
+		return;
+	if(p->timestamps != VK_NULL_HANDLE)
+		vkDestroyQueryPool(p->device, p->timestamps, nullptr);
+	if(p->statistics != VK_NULL_HANDLE)
+		vkDestroyQueryPool(p->device, p->statistics, nullptr);
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+/*
+queue families and timeline semaphores
+
+every family the device exposes gets looked at once and each role gets the most specialised
+one that can do the job:
+
+	graphics	GRAPHICS, one that can also present if there is one
+	present		can present to the surface, graphics' own family whenever it can
+	compute		COMPUTE without GRAPHICS (the async compute engine), graphics otherwise
+	transfer	TRANSFER without GRAPHICS or COMPUTE (the copy engine), compute otherwise
+
+(any graphics or compute family can do transfers even without the bit.) every distinct family
+gets one queue, roles that share a family share it. work on a dedicated family can run
+alongside the graphics queue, but EXCLUSIVE resources then have to be handed over between
+families explicitly (a release barrier on one queue, the matching acquire on the other, see
+async_compute.h).
+
+timeline semaphores (VK_KHR_timeline_semaphore, core in 1.2) carry a 64 bit counter instead of
+a signaled bit: submissions signal increasing values and waits are for "at least N", from the
+gpu or the cpu. one of them orders any number of submissions across queues, and nothing has to
+be reset or waited on exactly once the way binary semaphores do. this is a 1.0 app, so it's the
+extension: its functions come from vkGetDeviceProcAddr, and drivers without it get binary
+semaphores and fences instead.
+*/
+
+typedef struct {
+	std::vector<VkQueueFamilyProperties> props;
+	uint32_t graphics, present, compute, transfer; //family indices
+
+	VkQueue graphics_queue, present_queue, compute_queue, transfer_queue;
+
+	bool timeline; //VK_KHR_timeline_semaphore enabled on the device
+	PFN_vkWaitSemaphoresKHR waitSemaphores;
+	PFN_vkGetSemaphoreCounterValueKHR getSemaphoreCounterValue;
+} device_queues;
+
+
+//families from the device's profile (see device_profile.h). surface VK_NULL_HANDLE = headless, present is left as graphics.
+//false if there's no graphics family (or nothing presents)
+bool queuesFind(device_queues* q, VkPhysicalDevice gpu, VkSurfaceKHR surface, const std::vector<VkQueueFamilyProperties>& families)
+{
+	q->props = families;
+	uint32_t count = (uint32_t)families.size();
+
+	q->graphics = q->present = q->compute = q->transfer = UINT32_MAX;
+	q->graphics_queue = q->present_queue = q->compute_queue = q->transfer_queue = VK_NULL_HANDLE;
+	q->timeline = false;
+	q->waitSemaphores = nullptr;
+	q->getSemaphoreCounterValue = nullptr;
+
+	std::vector<VkBool32> presents(count, VK_FALSE);
+	if(surface != VK_NULL_HANDLE)
+	{
+		for(uint32_t i = 0; i < count; i++)
+			vkGetPhysicalDeviceSurfaceSupportKHR(gpu, i, surface, &presents[i]);
+	}
+
+	for(uint32_t i = 0; i < count; i++)
+	{
+		VkQueueFlags flags = q->props[i].queueFlags;
+		if(!q->props[i].queueCount)
+			continue;
+
+		if(flags & VK_QUEUE_GRAPHICS_BIT)
+		{
+			if(q->graphics == UINT32_MAX || (presents[i] && !presents[q->graphics]))
+				q->graphics = i;
+		}
+		else if((flags & VK_QUEUE_COMPUTE_BIT) && q->compute == UINT32_MAX)
+			q->compute = i;
+		else if((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_COMPUTE_BIT) && q->transfer == UINT32_MAX)
+			q->transfer = i;
+	}
+	if(q->graphics == UINT32_MAX)
+		return false;
+
+	if(surface == VK_NULL_HANDLE || presents[q->graphics])
+		q->present = q->graphics;
+	else
+	{
+		for(uint32_t i = 0; i < count && q->present == UINT32_MAX; i++)
+		{
+			if(presents[i])
+				q->present = i;
+		}
+		if(q->present == UINT32_MAX)
+			return false;
+	}
+
+	if(q->compute == UINT32_MAX)
+		q->compute = q->graphics;
+	if(q->transfer == UINT32_MAX)
+		q->transfer = q->compute;
+	return true;
+}
+
+//one queue per distinct family, priorities has to outlive vkCreateDevice
+void queuesCreateInfos(const device_queues* q, const float* priority, std::vector<VkDeviceQueueCreateInfo>& infos)
+{
+	uint32_t families[4] = {q->graphics, q->present, q->compute, q->transfer};
+	infos.clear();
+	for(uint32_t family : families)
+	{
+		bool seen = false;
+		for(const VkDeviceQueueCreateInfo& info : infos)
+			seen = seen || info.queueFamilyIndex == family;
+		if(seen)
+			continue;
+
+		VkDeviceQueueCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		info.pNext = nullptr;
+		info.flags = 0;
+		info.queueFamilyIndex = family;
+		info.queueCount = 1;
+		info.pQueuePriorities = priority;
+		infos.push_back(info);
+	}
+}
+
+//after vkCreateDevice. timeline = the extension and its feature were enabled
+void queuesInit(device_queues* q, VkDevice device, bool timeline)
+{
+	vkGetDeviceQueue(device, q->graphics, 0, &q->graphics_queue);
+	vkGetDeviceQueue(device, q->present, 0, &q->present_queue);
+	vkGetDeviceQueue(device, q->compute, 0, &q->compute_queue);
+	vkGetDeviceQueue(device, q->transfer, 0, &q->transfer_queue);
+
+	if(timeline)
+	{
+		q->waitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+		q->getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+	}
+	q->timeline = q->waitSemaphores && q->getSemaphoreCounterValue;
+}
+
+void queuesPrint(const device_queues* q)
+{
+	const char* names[4] = {"graphics", "present", "compute", "transfer"};
+	uint32_t families[4] = {q->graphics, q->present, q->compute, q->transfer};
+	printf("queues:");
+	for(uint32_t i = 0; i < 4; i++)
+	{
+		const VkQueueFamilyProperties& p = q->props[families[i]];
+		printf(" %s %u (%s%s%s, %u bit timestamps)%s", names[i], families[i],
+			p.queueFlags & VK_QUEUE_GRAPHICS_BIT ? "G" : "", p.queueFlags & VK_QUEUE_COMPUTE_BIT ? "C" : "",
+			p.queueFlags & VK_QUEUE_TRANSFER_BIT ? "T" : "", p.timestampValidBits, i < 3 ? "," : "\n");
+	}
+	printf("timeline semaphores: %s\n", q->timeline ? "yes" : "no, binary semaphores and fences");
+}
+
+VkSemaphore timelineCreate(VkDevice device, uint64_t initial)
+{
+	VkSemaphoreTypeCreateInfoKHR type_info = {};
+	type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+	type_info.pNext = nullptr;
+	type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+	type_info.initialValue = initial;
+
+	VkSemaphoreCreateInfo sem_info = {};
+	sem_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	sem_info.pNext = &type_info;
+	sem_info.flags = 0;
+	VkSemaphore sem;
+	VkResult res = vkCreateSemaphore(device, &sem_info, nullptr, &sem);
+	assert(res == VK_SUCCESS);
+	return sem;
+}
+
+//blocks until the counter reaches value
+void timelineWait(const device_queues* q, VkDevice device, VkSemaphore sem, uint64_t value)
+{
+	VkSemaphoreWaitInfoKHR wait_info = {};
+	wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+	wait_info.pNext = nullptr;
+	wait_info.flags = 0;
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores = &sem;
+	wait_info.pValues = &value;
+	VkResult res = q->waitSemaphores(device, &wait_info, UINT64_MAX);
+	assert(res == VK_SUCCESS);
+}
+
+uint64_t timelineValue(const device_queues* q, VkDevice device, VkSemaphore sem)
+{
+	uint64_t value = 0;
+	VkResult res = q->getSemaphoreCounterValue(device, sem, &value);
+	assert(res == VK_SUCCESS);
+	return value;
+}
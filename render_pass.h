@@ -0,0 +1,218 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+
+/*
+render passes from attachment lifetimes
+
+instead of picking load and store ops by hand, every attachment says where its contents come
+from and whether anything wants them after the pass, and the ops follow:
+	lifetime			load		store		usage
+	TRANSIENT			CLEAR		DONT_CARE	+ TRANSIENT_ATTACHMENT (depth: only the pass uses it)
+	OUTPUT				CLEAR		STORE		(the color image, presented or read back)
+	ACCUMULATE			LOAD		STORE		(drawn on top of an earlier pass)
+	CONSUMED			LOAD		DONT_CARE	(an earlier pass's result, last use)
+on a tile based gpu every LOAD is a read of the whole attachment from memory into tile memory
+at the start of the pass and every STORE a write back at the end; CLEAR and DONT_CARE are free.
+desktop gpus don't have the round trip but still skip the writes (and the decompression) for
+DONT_CARE. a TRANSIENT attachment also never needs memory outside the pass, which is what
+LAZILY_ALLOCATED memory is for (see depthAlloc in depth_format.h): tilers don't back it at all.
+
+the estimate of what that saves is load+store of every attachment compared to LOAD/STORE on
+everything, the old way to be safe. it's in bytes per frame at the framebuffer's size, there's
+no counter for the real traffic (and on desktop compression makes it smaller anyway).
+
+one subpass, colors first and depth last, dependencies as given.
+*/
+
+typedef enum {
+	ATTACHMENT_TRANSIENT,
+	ATTACHMENT_OUTPUT,
+	ATTACHMENT_ACCUMULATE,
+	ATTACHMENT_CONSUMED,
+	ATTACHMENT_LIFETIME_COUNT
+} attachment_lifetime;
+
+static const char* attachment_lifetimes[ATTACHMENT_LIFETIME_COUNT] = {"transient", "output", "accumulate", "consumed"};
+
+typedef struct {
+	VkFormat format;
+	attachment_lifetime lifetime;
+	VkImageLayout final_layout;
+	bool depth;
+	bool lazy; //ended up in LAZILY_ALLOCATED memory, only for the report
+} render_pass_attachment;
+
+typedef struct {
+	std::vector<render_pass_attachment> attachments;
+	std::vector<VkSubpassDependency> dependencies;
+} render_pass_desc;
+
+
+//nothing after the pass needs what's in it
+bool attachmentTransient(attachment_lifetime lifetime)
+{
+	return lifetime == ATTACHMENT_TRANSIENT;
+}
+
+static VkAttachmentLoadOp attachmentLoadOp(attachment_lifetime lifetime)
+{
+	return lifetime == ATTACHMENT_ACCUMULATE || lifetime == ATTACHMENT_CONSUMED ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+}
+
+static VkAttachmentStoreOp attachmentStoreOp(attachment_lifetime lifetime)
+{
+	return lifetime == ATTACHMENT_OUTPUT || lifetime == ATTACHMENT_ACCUMULATE ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+}
+
+//the usage an image needs to be this attachment
+VkImageUsageFlags attachmentUsage(attachment_lifetime lifetime, bool depth)
+{
+	VkImageUsageFlags usage = depth ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	if(attachmentTransient(lifetime))
+		usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	return usage;
+}
+
+//bytes per pixel of the formats attachments use, 4 for anything else
+uint32_t attachmentFormatBytes(VkFormat format)
+{
+	switch(format)
+	{
+	case VK_FORMAT_D16_UNORM: return 2;
+	case VK_FORMAT_D16_UNORM_S8_UINT: return 3;
+	case VK_FORMAT_D32_SFLOAT_S8_UINT: return 5;
+	case VK_FORMAT_R16G16B16A16_SFLOAT: return 8;
+	default: return 4;
+	}
+}
+
+static bool attachmentHasStencil(VkFormat format)
+{
+	return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT
+		|| format == VK_FORMAT_S8_UINT;
+}
+
+void renderPassInit(render_pass_desc* desc)
+{
+	desc->attachments.clear();
+	desc->dependencies.clear();
+}
+
+//returns the attachment index
+uint32_t renderPassAddColor(render_pass_desc* desc, VkFormat format, attachment_lifetime lifetime, VkImageLayout final_layout)
+{
+	render_pass_attachment a;
+	a.format = format;
+	a.lifetime = lifetime;
+	a.final_layout = final_layout;
+	a.depth = false;
+	a.lazy = false;
+	desc->attachments.push_back(a);
+	return (uint32_t)desc->attachments.size() - 1;
+}
+
+//one per pass
+uint32_t renderPassAddDepth(render_pass_desc* desc, VkFormat format, attachment_lifetime lifetime)
+{
+	for(const render_pass_attachment& a : desc->attachments)
+		assert(!a.depth);
+	render_pass_attachment a;
+	a.format = format;
+	a.lifetime = lifetime;
+	a.final_layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	a.depth = true;
+	a.lazy = false;
+	desc->attachments.push_back(a);
+	return (uint32_t)desc->attachments.size() - 1;
+}
+
+void renderPassAddDependency(render_pass_desc* desc, const VkSubpassDependency& dependency)
+{
+	desc->dependencies.push_back(dependency);
+}
+
+VkRenderPass renderPassCreate(render_pass_desc* desc, VkDevice device)
+{
+	std::vector<VkAttachmentDescription> attachments(desc->attachments.size());
+	std::vector<VkAttachmentReference> colors;
+	VkAttachmentReference depth_reference = {VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED};
+	for(uint32_t i = 0; i < desc->attachments.size(); i++)
+	{
+		const render_pass_attachment& a = desc->attachments[i];
+		bool loaded = attachmentLoadOp(a.lifetime) == VK_ATTACHMENT_LOAD_OP_LOAD;
+		bool stencil = a.depth && attachmentHasStencil(a.format);
+		VkImageLayout layout = a.depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		attachments[i].format = a.format;
+		attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[i].loadOp = attachmentLoadOp(a.lifetime);
+		attachments[i].storeOp = attachmentStoreOp(a.lifetime);
+		attachments[i].stencilLoadOp = stencil ? attachments[i].loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[i].stencilStoreOp = stencil ? attachments[i].storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		//contents that get loaded are expected in the layout the pass leaves them in
+		attachments[i].initialLayout = loaded ? a.final_layout : VK_IMAGE_LAYOUT_UNDEFINED;
+		attachments[i].finalLayout = a.final_layout;
+		attachments[i].flags = 0;
+
+		if(a.depth)
+			depth_reference = {i, layout};
+		else
+			colors.push_back({i, layout});
+	}
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.flags = 0;
+	subpass.inputAttachmentCount = 0;
+	subpass.pInputAttachments = nullptr;
+	subpass.colorAttachmentCount = colors.size();
+	subpass.pColorAttachments = colors.data();
+	subpass.pResolveAttachments = nullptr;
+	subpass.pDepthStencilAttachment = depth_reference.attachment != VK_ATTACHMENT_UNUSED ? &depth_reference : nullptr;
+	subpass.preserveAttachmentCount = 0;
+	subpass.pPreserveAttachments = nullptr;
+
+	VkRenderPassCreateInfo rp_info = {};
+	rp_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	rp_info.pNext = nullptr;
+	rp_info.attachmentCount = attachments.size();
+	rp_info.pAttachments = attachments.data();
+	rp_info.subpassCount = 1;
+	rp_info.pSubpasses = &subpass;
+	rp_info.dependencyCount = desc->dependencies.size();
+	rp_info.pDependencies = desc->dependencies.data();
+
+	VkRenderPass render_pass;
+	VkResult res = vkCreateRenderPass(device, &rp_info, nullptr, &render_pass);
+	assert(res == VK_SUCCESS);
+	return render_pass;
+}
+
+//what each attachment costs per frame at extent, and what the lifetimes save over LOAD/STORE everywhere
+void renderPassPrintStats(const render_pass_desc* desc, VkExtent2D extent)
+{
+	const double mb = 1024.0 * 1024.0;
+	double total = 0.0, naive = 0.0, lazy = 0.0;
+	printf("render pass, %ux%u:\n", extent.width, extent.height);
+	for(uint32_t i = 0; i < desc->attachments.size(); i++)
+	{
+		const render_pass_attachment& a = desc->attachments[i];
+		double size = (double)extent.width * extent.height * attachmentFormatBytes(a.format);
+		bool load = attachmentLoadOp(a.lifetime) == VK_ATTACHMENT_LOAD_OP_LOAD;
+		bool store = attachmentStoreOp(a.lifetime) == VK_ATTACHMENT_STORE_OP_STORE;
+		double bytes = (load ? size : 0.0) + (store ? size : 0.0);
+		total += bytes;
+		naive += 2.0 * size;
+		if(a.lazy)
+			lazy += size;
+		printf("    %u %-5s %-10s %s/%s, %.2f MB/frame%s\n", i, a.depth ? "depth" : "color", attachment_lifetimes[a.lifetime], load ? "load" : "clear",
+			store ? "store" : "dont care", bytes / mb, a.lazy ? ", lazily allocated" : attachmentTransient(a.lifetime) ? ", transient (no lazy memory)" : "");
+	}
+	printf("    %.2f MB/frame of attachment traffic, %.2f MB/frame saved (%.2f GB/s at 60 fps), %.2f MB not backed by memory\n", total / mb,
+		(naive - total) / mb, (naive - total) * 60.0 / (1024.0 * mb), lazy / mb);
+}
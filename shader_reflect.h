@@ -0,0 +1,575 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+#include <chrono>
+#include <string>
+
+#include "descriptors.h"
+
+/*
+shader reflection
+
+the shaders in shaders/ are compiled to SPIR-V at build time and tools/embed_spirv.cpp turns
+them into one generated header, shaders.h, with every module as a constexpr array next to what
+it reflected out of it:
+	static constexpr uint32_t mvp_vert_spv[] = {...};
+	static constexpr shader_blob mvp_vert = {"mvp.vert", mvp_vert_spv, sizeof(mvp_vert_spv), {stage, bindings, push range, spec ids}};
+so startup reads nothing off disk and parses nothing, the layouts come straight from the tables.
+
+the parser only looks at what a layout needs: the entry point's stage, every variable in the
+Uniform, UniformConstant, StorageBuffer and PushConstant storage classes, their DescriptorSet
+and Binding decorations, the type behind them (arrays give the descriptor count, runtime arrays
+a count of 0), the member offsets of the push constant block and which specialization constant
+ids there are (see pipeline_variants.h). it doesn't check the module is valid, the compiler did.
+
+shaderLayoutCreate merges the stages a pipeline uses and gets the set layouts from the layout
+cache (see descriptors.h), so a shader that declares the same set as something built by hand
+gets the same VkDescriptorSetLayout back. what reflection can't know comes in with the options:
+uniform buffers fed from a ring with dynamic offsets, sets with runtime arrays that need binding
+flags (the bindless table, see bindless.h), and push ranges shared by more stages than use them.
+*/
+
+#define SHADER_MAX_BINDINGS 16
+#define SHADER_MAX_SETS 4
+
+#ifndef SHADER_SPV_DIR
+#define SHADER_SPV_DIR "shaders" //CMakeLists.txt points this at where the build writes the .spv files
+#endif
+
+typedef struct {
+	uint32_t set, binding;
+	VkDescriptorType type;
+	uint32_t count; //0 for a runtime array
+	VkShaderStageFlags stages;
+} shader_binding;
+
+typedef struct {
+	VkShaderStageFlagBits stage;
+	uint32_t binding_count;
+	shader_binding bindings[SHADER_MAX_BINDINGS];
+	uint32_t push_offset, push_size; //size 0 without push constants
+	uint32_t spec_ids; //bit n: the module has a specialization constant with constant_id n (below 32)
+} shader_reflection;
+
+//what shaders.h has per module
+typedef struct {
+	const char* name;
+	const uint32_t* code;
+	size_t size; //bytes
+	shader_reflection reflection;
+} shader_blob;
+
+typedef struct {
+	bool dynamic_uniforms; //UNIFORM_BUFFER becomes UNIFORM_BUFFER_DYNAMIC
+	VkDescriptorSetLayout sets[SHADER_MAX_SETS]; //non-null: use this for the set instead of one from reflection
+	VkShaderStageFlags push_stages; //non-zero: the push range is visible to these stages
+} shader_layout_options;
+
+typedef struct {
+	uint32_t set_count;
+	VkDescriptorSetLayout sets[SHADER_MAX_SETS]; //owned by the layout cache or whoever passed them in
+	uint32_t push_count;
+	VkPushConstantRange push;
+	VkPipelineLayout layout;
+} shader_layout;
+
+
+#define SPIRV_MAGIC 0x07230203
+
+//opcodes, decorations and storage classes the parser cares about
+enum {
+	SPV_OP_ENTRY_POINT = 15,
+	SPV_OP_TYPE_INT = 21,
+	SPV_OP_TYPE_FLOAT = 22,
+	SPV_OP_TYPE_VECTOR = 23,
+	SPV_OP_TYPE_MATRIX = 24,
+	SPV_OP_TYPE_IMAGE = 25,
+	SPV_OP_TYPE_SAMPLER = 26,
+	SPV_OP_TYPE_SAMPLED_IMAGE = 27,
+	SPV_OP_TYPE_ARRAY = 28,
+	SPV_OP_TYPE_RUNTIME_ARRAY = 29,
+	SPV_OP_TYPE_STRUCT = 30,
+	SPV_OP_TYPE_POINTER = 32,
+	SPV_OP_CONSTANT = 43,
+	SPV_OP_SPEC_CONSTANT = 50,
+	SPV_OP_VARIABLE = 59,
+	SPV_OP_DECORATE = 71,
+	SPV_OP_MEMBER_DECORATE = 72,
+
+	SPV_DECORATION_SPEC_ID = 1,
+	SPV_DECORATION_BLOCK = 2,
+	SPV_DECORATION_BUFFER_BLOCK = 3,
+	SPV_DECORATION_ARRAY_STRIDE = 6,
+	SPV_DECORATION_MATRIX_STRIDE = 7,
+	SPV_DECORATION_BINDING = 33,
+	SPV_DECORATION_DESCRIPTOR_SET = 34,
+	SPV_DECORATION_OFFSET = 35,
+
+	SPV_STORAGE_UNIFORM_CONSTANT = 0,
+	SPV_STORAGE_UNIFORM = 2,
+	SPV_STORAGE_PUSH_CONSTANT = 9,
+	SPV_STORAGE_STORAGE_BUFFER = 12,
+
+	SPV_DIM_BUFFER = 5,
+	SPV_DIM_SUBPASS_DATA = 6,
+};
+
+typedef struct {
+	uint32_t op;
+	std::vector<uint32_t> operands; //everything after the result id, or after the type for OpVariable/OpConstant
+} spirv_type;
+
+typedef struct {
+	uint32_t set, binding;
+	uint32_t array_stride;
+	bool has_set, has_binding, block, buffer_block;
+	std::vector<uint32_t> offsets; //per member
+	std::vector<uint32_t> matrix_strides; //per member
+} spirv_decorations;
+
+static VkShaderStageFlagBits spirvStage(uint32_t model)
+{
+	switch(model)
+	{
+	case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+	case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+	case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+	case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+	case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+	case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+	default: return VK_SHADER_STAGE_ALL;
+	}
+}
+
+static void spirvMember(std::vector<uint32_t>* v, uint32_t member, uint32_t value)
+{
+	if(v->size() <= member)
+		v->resize(member + 1, 0);
+	(*v)[member] = value;
+}
+
+//bytes the type takes in a block, with the strides the decorations give it
+static uint32_t spirvTypeSize(std::unordered_map<uint32_t, spirv_type>& types, std::unordered_map<uint32_t, spirv_decorations>& decorations,
+							  uint32_t id, uint32_t matrix_stride)
+{
+	auto t = types.find(id);
+	if(t == types.end())
+		return 0;
+	const std::vector<uint32_t>& o = t->second.operands;
+	switch(t->second.op)
+	{
+	case SPV_OP_TYPE_INT:
+	case SPV_OP_TYPE_FLOAT:
+		return o[0] / 8;
+	case SPV_OP_TYPE_VECTOR:
+		return spirvTypeSize(types, decorations, o[0], 0) * o[1];
+	case SPV_OP_TYPE_MATRIX:
+		return (matrix_stride ? matrix_stride : spirvTypeSize(types, decorations, o[0], 0)) * o[1];
+	case SPV_OP_TYPE_ARRAY:
+	{
+		auto length = types.find(o[1]);
+		uint32_t count = length != types.end() ? length->second.operands[0] : 0;
+		uint32_t stride = decorations[id].array_stride;
+		return (stride ? stride : spirvTypeSize(types, decorations, o[0], matrix_stride)) * count;
+	}
+	case SPV_OP_TYPE_STRUCT:
+	{
+		const spirv_decorations& d = decorations[id];
+		uint32_t size = 0;
+		for(uint32_t m = 0; m < o.size(); m++)
+		{
+			uint32_t offset = m < d.offsets.size() ? d.offsets[m] : 0;
+			uint32_t stride = m < d.matrix_strides.size() ? d.matrix_strides[m] : 0;
+			size = std::max(size, offset + spirvTypeSize(types, decorations, o[m], stride));
+		}
+		return size;
+	}
+	default:
+		return 0;
+	}
+}
+
+//fills out from a SPIR-V module, false if it isn't one or has more than SHADER_MAX_BINDINGS bindings
+bool shaderReflect(const uint32_t* code, size_t size, shader_reflection* out)
+{
+	size_t words = size / sizeof(uint32_t);
+	if(words < 5 || code[0] != SPIRV_MAGIC)
+		return false;
+
+	out->stage = VK_SHADER_STAGE_ALL;
+	out->binding_count = 0;
+	out->push_offset = 0;
+	out->push_size = 0;
+	out->spec_ids = 0;
+
+	std::unordered_map<uint32_t, spirv_type> types;
+	std::unordered_map<uint32_t, spirv_decorations> decorations;
+	std::vector<std::pair<uint32_t, spirv_type>> variables; //id, {storage class, {pointer type}}
+
+	for(size_t i = 5; i < words;)
+	{
+		uint32_t count = code[i] >> 16;
+		uint32_t op = code[i] & 0xFFFF;
+		if(count == 0 || i + count > words)
+			return false;
+		const uint32_t* w = code + i + 1;
+		uint32_t n = count - 1;
+
+		switch(op)
+		{
+		case SPV_OP_ENTRY_POINT:
+			if(out->stage == VK_SHADER_STAGE_ALL) //the first one, there's one per module here
+				out->stage = spirvStage(w[0]);
+			break;
+		case SPV_OP_DECORATE:
+		{
+			spirv_decorations& d = decorations[w[0]];
+			if(w[1] == SPV_DECORATION_DESCRIPTOR_SET && n > 2)
+				d.set = w[2], d.has_set = true;
+			else if(w[1] == SPV_DECORATION_BINDING && n > 2)
+				d.binding = w[2], d.has_binding = true;
+			else if(w[1] == SPV_DECORATION_BLOCK)
+				d.block = true;
+			else if(w[1] == SPV_DECORATION_BUFFER_BLOCK)
+				d.buffer_block = true;
+			else if(w[1] == SPV_DECORATION_ARRAY_STRIDE && n > 2)
+				d.array_stride = w[2];
+			else if(w[1] == SPV_DECORATION_SPEC_ID && n > 2 && w[2] < 32)
+				out->spec_ids |= 1u << w[2];
+			break;
+		}
+		case SPV_OP_MEMBER_DECORATE:
+			if(w[2] == SPV_DECORATION_OFFSET && n > 3)
+				spirvMember(&decorations[w[0]].offsets, w[1], w[3]);
+			else if(w[2] == SPV_DECORATION_MATRIX_STRIDE && n > 3)
+				spirvMember(&decorations[w[0]].matrix_strides, w[1], w[3]);
+			break;
+		case SPV_OP_TYPE_INT:
+		case SPV_OP_TYPE_FLOAT:
+		case SPV_OP_TYPE_VECTOR:
+		case SPV_OP_TYPE_MATRIX:
+		case SPV_OP_TYPE_IMAGE:
+		case SPV_OP_TYPE_SAMPLER:
+		case SPV_OP_TYPE_SAMPLED_IMAGE:
+		case SPV_OP_TYPE_ARRAY:
+		case SPV_OP_TYPE_RUNTIME_ARRAY:
+		case SPV_OP_TYPE_STRUCT:
+		case SPV_OP_TYPE_POINTER:
+			types[w[0]] = {op, std::vector<uint32_t>(w + 1, w + n)};
+			break;
+		case SPV_OP_CONSTANT:
+		case SPV_OP_SPEC_CONSTANT: //array lengths, the spec constant's default is what the layout gets
+			if(n > 2)
+				types[w[1]] = {op, {w[2]}};
+			break;
+		case SPV_OP_VARIABLE:
+			if(n > 2)
+				variables.push_back({w[1], {w[2], {w[0]}}});
+			break;
+		}
+		i += count;
+	}
+
+	for(const auto& v : variables)
+	{
+		uint32_t storage = v.second.op;
+		if(storage != SPV_STORAGE_UNIFORM_CONSTANT && storage != SPV_STORAGE_UNIFORM && storage != SPV_STORAGE_PUSH_CONSTANT
+			&& storage != SPV_STORAGE_STORAGE_BUFFER)
+			continue;
+		auto pointer = types.find(v.second.operands[0]);
+		if(pointer == types.end() || pointer->second.op != SPV_OP_TYPE_POINTER)
+			continue;
+		uint32_t type = pointer->second.operands[1];
+
+		if(storage == SPV_STORAGE_PUSH_CONSTANT)
+		{
+			auto t = types.find(type);
+			if(t == types.end() || t->second.op != SPV_OP_TYPE_STRUCT)
+				continue;
+			const spirv_decorations& d = decorations[type];
+			uint32_t begin = UINT32_MAX;
+			for(uint32_t m = 0; m < t->second.operands.size(); m++)
+				begin = std::min(begin, m < d.offsets.size() ? d.offsets[m] : 0);
+			out->push_offset = begin == UINT32_MAX ? 0 : begin;
+			out->push_size = spirvTypeSize(types, decorations, type, 0) - out->push_offset;
+			continue;
+		}
+
+		//arrays of descriptors
+		uint32_t count = 1;
+		for(auto t = types.find(type); t != types.end();)
+		{
+			if(t->second.op == SPV_OP_TYPE_ARRAY)
+			{
+				auto length = types.find(t->second.operands[1]);
+				count *= length != types.end() ? length->second.operands[0] : 1;
+			}
+			else if(t->second.op == SPV_OP_TYPE_RUNTIME_ARRAY)
+				count = 0;
+			else
+				break;
+			type = t->second.operands[0];
+			t = types.find(type);
+		}
+
+		auto t = types.find(type);
+		if(t == types.end())
+			continue;
+		VkDescriptorType descriptor;
+		if(storage == SPV_STORAGE_STORAGE_BUFFER || (storage == SPV_STORAGE_UNIFORM && decorations[type].buffer_block))
+			descriptor = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		else if(storage == SPV_STORAGE_UNIFORM)
+			descriptor = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		else if(t->second.op == SPV_OP_TYPE_SAMPLER)
+			descriptor = VK_DESCRIPTOR_TYPE_SAMPLER;
+		else if(t->second.op == SPV_OP_TYPE_SAMPLED_IMAGE)
+			descriptor = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		else if(t->second.op == SPV_OP_TYPE_IMAGE)
+		{
+			//operands: sampled type, dim, depth, arrayed, ms, sampled (2 is storage), format
+			uint32_t dim = t->second.operands[1];
+			bool storage_image = t->second.operands[5] == 2;
+			if(dim == SPV_DIM_BUFFER)
+				descriptor = storage_image ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+			else if(dim == SPV_DIM_SUBPASS_DATA)
+				descriptor = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			else
+				descriptor = storage_image ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		}
+		else
+			continue;
+
+		const spirv_decorations& d = decorations[v.first];
+		if(!d.has_set || !d.has_binding)
+			continue;
+		if(out->binding_count == SHADER_MAX_BINDINGS)
+			return false;
+		shader_binding& b = out->bindings[out->binding_count++];
+		b.set = d.set;
+		b.binding = d.binding;
+		b.type = descriptor;
+		b.count = count;
+		b.stages = out->stage;
+	}
+
+	std::sort(out->bindings, out->bindings + out->binding_count, [](const shader_binding& a, const shader_binding& b) {
+		return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+	});
+	return out->stage != VK_SHADER_STAGE_ALL;
+}
+
+VkShaderModule shaderModuleCreate(VkDevice device, const uint32_t* code, size_t size)
+{
+	VkShaderModuleCreateInfo module_info = {};
+	module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	module_info.pNext = nullptr;
+	module_info.flags = 0;
+	module_info.codeSize = size;
+	module_info.pCode = code;
+
+	VkShaderModule module;
+	VkResult res = vkCreateShaderModule(device, &module_info, nullptr, &module);
+	assert(res == VK_SUCCESS);
+	return module;
+}
+
+//the pipeline layout for a pipeline made of these stages
+void shaderLayoutCreate(shader_layout* out, VkDevice device, descriptor_layout_cache* layouts, const shader_reflection* const* shaders,
+						uint32_t count, const shader_layout_options* options)
+{
+	//merge: a binding used by more than one stage is one binding visible to all of them
+	std::vector<shader_binding> merged;
+	uint32_t push_begin = UINT32_MAX, push_end = 0;
+	VkShaderStageFlags push_stages = 0;
+	for(uint32_t s = 0; s < count; s++)
+	{
+		const shader_reflection* r = shaders[s];
+		for(uint32_t i = 0; i < r->binding_count; i++)
+		{
+			const shader_binding& b = r->bindings[i];
+			assert(b.set < SHADER_MAX_SETS);
+			auto same = std::find_if(merged.begin(), merged.end(), [&](const shader_binding& m) { return m.set == b.set && m.binding == b.binding; });
+			if(same == merged.end())
+				merged.push_back(b);
+			else
+			{
+				assert(same->type == b.type && same->count == b.count);
+				same->stages |= b.stages;
+			}
+		}
+		if(r->push_size)
+		{
+			push_begin = std::min(push_begin, r->push_offset);
+			push_end = std::max(push_end, r->push_offset + r->push_size);
+			push_stages |= r->stage;
+		}
+	}
+
+	out->set_count = 0;
+	for(const shader_binding& b : merged)
+		out->set_count = std::max(out->set_count, b.set + 1);
+	for(uint32_t set = 0; set < SHADER_MAX_SETS; set++)
+	{
+		if(options && options->sets[set] != VK_NULL_HANDLE)
+			out->set_count = std::max(out->set_count, set + 1);
+	}
+
+	for(uint32_t set = 0; set < out->set_count; set++)
+	{
+		if(options && options->sets[set] != VK_NULL_HANDLE)
+		{
+			out->sets[set] = options->sets[set];
+			continue;
+		}
+		std::vector<VkDescriptorSetLayoutBinding> bindings;
+		for(const shader_binding& b : merged)
+		{
+			if(b.set != set)
+				continue;
+			assert(b.count != 0); //runtime arrays need binding flags, pass that set in the options
+			VkDescriptorSetLayoutBinding binding;
+			binding.binding = b.binding;
+			binding.descriptorType = options && options->dynamic_uniforms && b.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER
+				? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : b.type;
+			binding.descriptorCount = b.count;
+			binding.stageFlags = b.stages;
+			binding.pImmutableSamplers = nullptr;
+			bindings.push_back(binding);
+		}
+		//an unused set in between still needs a layout, an empty one
+		out->sets[set] = descriptorLayoutGet(layouts, bindings.data(), bindings.size());
+	}
+
+	out->push_count = push_end ? 1 : 0;
+	out->push.stageFlags = options && options->push_stages ? options->push_stages : push_stages;
+	out->push.offset = push_end ? push_begin : 0;
+	out->push.size = push_end ? push_end - push_begin : 0;
+	assert(!push_end || (out->push.stageFlags & push_stages) == push_stages);
+
+	VkPipelineLayoutCreateInfo layout_info = {};
+	layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_info.pNext = nullptr;
+	layout_info.flags = 0;
+	layout_info.setLayoutCount = out->set_count;
+	layout_info.pSetLayouts = out->sets;
+	layout_info.pushConstantRangeCount = out->push_count;
+	layout_info.pPushConstantRanges = out->push_count ? &out->push : nullptr;
+
+	VkResult res = vkCreatePipelineLayout(device, &layout_info, nullptr, &out->layout);
+	assert(res == VK_SUCCESS);
+}
+
+void shaderLayoutDestroy(shader_layout* l, VkDevice device)
+{
+	vkDestroyPipelineLayout(device, l->layout, nullptr);
+}
+
+static const char* shaderDescriptorName(VkDescriptorType type)
+{
+	switch(type)
+	{
+	case VK_DESCRIPTOR_TYPE_SAMPLER: return "sampler";
+	case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER: return "combined image sampler";
+	case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE: return "sampled image";
+	case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: return "storage image";
+	case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER: return "uniform texel buffer";
+	case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER: return "storage texel buffer";
+	case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER: return "uniform buffer";
+	case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER: return "storage buffer";
+	case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC: return "uniform buffer dynamic";
+	case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC: return "storage buffer dynamic";
+	case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT: return "input attachment";
+	default: return "?";
+	}
+}
+
+void shaderPrintReflection(const char* name, const shader_reflection* r)
+{
+	printf("%s: stage 0x%x, %u bindings, push constants %u+%u, specialization constants 0x%x\n", name, r->stage, r->binding_count,
+		r->push_offset, r->push_size, r->spec_ids);
+	for(uint32_t i = 0; i < r->binding_count; i++)
+	{
+		const shader_binding& b = r->bindings[i];
+		printf("    set %u binding %u: %s x%u%s\n", b.set, b.binding, shaderDescriptorName(b.type), b.count, b.count ? "" : " (runtime)");
+	}
+}
+
+
+//--bench-shaders: what embedding saves at startup. every module loaded the way it would be without
+//the build step, read from SHADER_SPV_DIR and reflected at runtime, against the embedded words and
+//tables. both end in the same shader modules. the first run is reported on its own since after it
+//the files are in the page cache, which a real startup can't count on.
+void shaderBenchmark(VkDevice device, const shader_blob* const* shaders, uint32_t count, uint32_t runs)
+{
+	typedef std::chrono::high_resolution_clock clock;
+	auto ms = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+
+	double embedded = 0.0, read = 0.0, reflect = 0.0, files = 0.0, first_embedded = 0.0, first_files = 0.0;
+	std::vector<VkShaderModule> modules(count);
+	for(uint32_t run = 0; run < runs; run++)
+	{
+		//the files first, so the first run is as cold as it gets here
+		double run_files = 0.0;
+		for(uint32_t i = 0; i < count; i++)
+		{
+			auto start = clock::now();
+			std::string path = std::string(SHADER_SPV_DIR) + "/" + shaders[i]->name + ".spv";
+			FILE* f = fopen(path.c_str(), "rb");
+			if(!f)
+			{
+				printf("shader bench: can't open %s, nothing to compare against\n", path.c_str());
+				for(uint32_t j = 0; j < i; j++)
+					vkDestroyShaderModule(device, modules[j], nullptr);
+				return;
+			}
+			fseek(f, 0, SEEK_END);
+			long size = ftell(f);
+			fseek(f, 0, SEEK_SET);
+			std::vector<uint32_t> code(size / sizeof(uint32_t));
+			size_t got = fread(code.data(), 1, code.size() * sizeof(uint32_t), f);
+			fclose(f);
+			auto loaded = clock::now();
+
+			shader_reflection r;
+			bool ok = shaderReflect(code.data(), got, &r);
+			assert(ok && r.binding_count == shaders[i]->reflection.binding_count);
+			auto reflected = clock::now();
+
+			modules[i] = shaderModuleCreate(device, code.data(), got);
+			auto end = clock::now();
+
+			read += ms(start, loaded);
+			reflect += ms(loaded, reflected);
+			run_files += ms(start, end);
+		}
+		for(uint32_t i = 0; i < count; i++)
+			vkDestroyShaderModule(device, modules[i], nullptr);
+
+		auto start = clock::now();
+		for(uint32_t i = 0; i < count; i++)
+		{
+			shader_reflection r = shaders[i]->reflection;
+			assert(r.stage != VK_SHADER_STAGE_ALL);
+			modules[i] = shaderModuleCreate(device, shaders[i]->code, shaders[i]->size);
+		}
+		double run_embedded = ms(start, clock::now());
+		for(uint32_t i = 0; i < count; i++)
+			vkDestroyShaderModule(device, modules[i], nullptr);
+
+		if(run == 0)
+			first_embedded = run_embedded, first_files = run_files;
+		embedded += run_embedded;
+		files += run_files;
+	}
+
+	printf("shader bench, %u modules, %u runs:\n", count, runs);
+	printf("    first run: embedded %.3f ms, from files %.3f ms, %.3f ms saved\n", first_embedded, first_files, first_files - first_embedded);
+	printf("    average:   embedded %.3f ms, from files %.3f ms (%.3f read, %.3f reflect), %.3f ms saved\n", embedded / runs, files / runs,
+		read / runs, reflect / runs, (files - embedded) / runs);
+}
@@ -0,0 +1,20 @@
+#version 450
+
+//the gpu cull's indirect draws (see gpu_cull.h): an instanced 36 index cube, the instance is a
+//slot in ids[] the cull filled, the model matrix is that object's
+
+layout(push_constant) uniform Push { mat4 view_proj; };
+
+struct Cmd { uint indexCount, instanceCount, firstIndex; int vertexOffset; uint firstInstance, pad[3]; };
+layout(set = 0, binding = 0) readonly buffer Models { mat4 models[]; };
+layout(set = 0, binding = 1) readonly buffer Draws { Cmd cmds[4]; uint ids[]; };
+
+layout(location = 0) out vec3 color;
+
+void main()
+{
+	//cube corner from the index: bit 0 is x, bit 1 y, bit 2 z
+	vec3 unit = vec3(gl_VertexIndex & 1, (gl_VertexIndex >> 1) & 1, (gl_VertexIndex >> 2) & 1);
+	gl_Position = view_proj * (models[ids[gl_InstanceIndex]] * vec4(unit - 0.5, 1.0));
+	color = unit;
+}
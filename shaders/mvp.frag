@@ -0,0 +1,25 @@
+#version 450
+
+//the features are specialization constants (see pipeline_variants.h), every pipeline variant
+//gets this compiled with the branches it doesn't take gone
+
+layout(constant_id = 0) const bool CHECKER = false;
+layout(constant_id = 1) const bool FOG = false;
+
+layout(location = 0) in vec3 color;
+
+layout(location = 0) out vec4 out_color;
+
+void main()
+{
+	vec3 c = color;
+	if(CHECKER)
+	{
+		ivec3 cell = ivec3(color * 4.0);
+		if(((cell.x + cell.y + cell.z) & 1) != 0)
+			c *= 0.5;
+	}
+	if(FOG)
+		c = mix(c, vec3(0.1, 0.1, 0.2), gl_FragCoord.z * gl_FragCoord.z);
+	out_color = vec4(c, 0.75); //only blended variants see the alpha
+}
@@ -0,0 +1,16 @@
+#version 450
+
+//one cube per draw, a 14 vertex triangle strip with the corners picked by the vertex index, the MVP
+//from the draw's slot in the uniform ring, picked with the dynamic offset (see uniform_ring.h)
+
+layout(set = 0, binding = 0) uniform MVP { mat4 mvp; };
+
+layout(location = 0) out vec3 color;
+
+void main()
+{
+	int bit = 1 << gl_VertexIndex;
+	vec3 unit = vec3((0x287A & bit) != 0, (0x02AF & bit) != 0, (0x31E3 & bit) != 0);
+	gl_Position = mvp * vec4(unit - 0.5, 1.0);
+	color = unit;
+}
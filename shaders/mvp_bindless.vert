@@ -0,0 +1,18 @@
+#version 450
+
+//mvp.vert for the bindless table (see bindless.h): the draw pushes which buffer holds the MVPs
+//and which element is its own, instead of binding the ring's set with an offset
+
+layout(set = 0, binding = 0) readonly buffer MVPs { mat4 mvps[]; } buffers[];
+
+layout(push_constant) uniform Draw { uint buffer_index; uint element; };
+
+layout(location = 0) out vec3 color;
+
+void main()
+{
+	int bit = 1 << gl_VertexIndex;
+	vec3 unit = vec3((0x287A & bit) != 0, (0x02AF & bit) != 0, (0x31E3 & bit) != 0);
+	gl_Position = buffers[buffer_index].mvps[element] * vec4(unit - 0.5, 1.0);
+	color = unit;
+}
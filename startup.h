@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+/*
+startup timing
+
+bring-up runs on two threads where it can: whatever doesn't need the window (layer
+enumeration, reading the pipeline cache and device profiles off disk) runs on a worker while
+the main thread creates the window, and physical device enumeration plus the capability
+queries (see device_profile.h) run on a worker while the main thread creates the surface and
+the debug messenger. SDL wants its window on the main thread, so that's the side that
+stays there.
+
+every step is a phase with a start and end on one clock, from whichever thread ran it. the
+report lists them in the order they started, and puts the sum of the phases next to the wall
+clock time: the difference is what the overlap saved.
+*/
+
+typedef struct {
+	const char* name;
+	double start_ms, end_ms;
+	bool worker; //not on the thread that called startupInit
+} startup_phase;
+
+typedef struct {
+	std::chrono::high_resolution_clock::time_point start;
+	std::thread::id main_thread;
+	std::mutex lock;
+	std::vector<startup_phase> phases;
+} startup_timer;
+
+
+void startupInit(startup_timer* t)
+{
+	t->start = std::chrono::high_resolution_clock::now();
+	t->main_thread = std::this_thread::get_id();
+	t->phases.clear();
+}
+
+static double startupNow(startup_timer* t)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t->start).count();
+}
+
+//from any thread, returns the phase for startupEnd
+size_t startupBegin(startup_timer* t, const char* name)
+{
+	startup_phase phase;
+	phase.name = name;
+	phase.start_ms = startupNow(t);
+	phase.end_ms = phase.start_ms;
+	phase.worker = std::this_thread::get_id() != t->main_thread;
+	std::lock_guard<std::mutex> guard(t->lock);
+	t->phases.push_back(phase);
+	return t->phases.size() - 1;
+}
+
+void startupEnd(startup_timer* t, size_t phase)
+{
+	double now = startupNow(t);
+	std::lock_guard<std::mutex> guard(t->lock);
+	t->phases[phase].end_ms = now;
+}
+
+//the workers have to be joined
+void startupPrint(startup_timer* t)
+{
+	double wall = startupNow(t);
+	double sum = 0.0;
+	printf("startup:\n");
+	for(const startup_phase& p : t->phases)
+	{
+		printf("    %-24s %-6s %8.3f -> %8.3f ms  %8.3f ms\n", p.name, p.worker ? "worker" : "main", p.start_ms, p.end_ms, p.end_ms - p.start_ms);
+		sum += p.end_ms - p.start_ms;
+	}
+
+	//time covered by at least one phase, what it would have taken one after the other is the sum
+	std::vector<startup_phase> sorted = t->phases;
+	std::sort(sorted.begin(), sorted.end(), [](const startup_phase& a, const startup_phase& b) { return a.start_ms < b.start_ms; });
+	double covered = 0.0, until = 0.0;
+	for(const startup_phase& p : sorted)
+	{
+		double from = std::max(p.start_ms, until);
+		if(p.end_ms > from)
+			covered += p.end_ms - from;
+		until = std::max(until, p.end_ms);
+	}
+	printf("    %.3f ms wall clock, %.3f ms of phases done in %.3f ms, %.3f ms saved by overlapping\n", wall, sum, covered, sum - covered);
+}
@@ -0,0 +1,388 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_vulkan.h>
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+
+#include "gpu_arena.h"
+#include "frame_loop.h"
+#include "deletion_queue.h"
+#include "offscreen.h"
+#include "present.h"
+#include "depth_format.h"
+
+/*
+swapchain and the targets that follow its size
+
+everything that depends on the window size lives here: the swapchain and its image views,
+the depth buffer and the framebuffers. headless, the color images come from offscreen.h
+instead and never change. the depth buffer's format, tiling, usage and memory are picked
+once, before the swapchain, by depth_format.h.
+
+on resize (SDL says so, or acquire/present report OUT_OF_DATE/SUBOPTIMAL) the whole set is
+rebuilt at the surface's new extent, with the old swapchain passed as oldSwapchain so the
+driver can hand resources over. the render pass only depends on the formats, so it stays.
+
+the old set can't be destroyed right away since frames in flight may still reference it,
+and vkDeviceWaitIdle would stall the whole pipeline for every resize step. it goes to the
+deletion queue instead (deletion_queue.h), tagged with the current frame.
+
+the resize hitch is the cpu time of the rebuild, there's no wait in it anymore.
+*/
+
+typedef struct {
+	VkImage image;
+	VkImageView view;
+} swap_chain_buffer;
+
+typedef struct {
+	VkDevice device;
+	VkPhysicalDevice gpu;
+	VkSurfaceKHR surface; //VK_NULL_HANDLE headless
+	SDL_Window* window;
+	uint32_t families[2]; //graphics, present. images are shared CONCURRENT when they differ
+
+	VkFormat format;
+	VkPresentModeKHR present_mode;
+	VkExtent2D extent;
+	VkSwapchainKHR swapchain;
+	std::vector<swap_chain_buffer> buffers;
+
+	depth_config depth_info;
+	VkImage depth;
+	gpu_allocation depth_mem;
+	VkImageView depth_view;
+	bool depth_lazy; //got LAZILY_ALLOCATED memory
+
+	VkRenderPass render_pass;
+	std::vector<VkFramebuffer> framebuffers;
+
+	uint32_t resizes;
+	double resize_ms, resize_max_ms;
+} swapchain;
+
+
+//the surface's extent, or the window's drawable size if the surface leaves it up to us
+static VkExtent2D swapchainSurfaceExtent(swapchain* sc, const VkSurfaceCapabilitiesKHR& caps)
+{
+	if(caps.currentExtent.width != 0xFFFFFFFF)
+		return caps.currentExtent;
+
+	int w, h;
+	SDL_Vulkan_GetDrawableSize(sc->window, &w, &h);
+	VkExtent2D extent = {(uint32_t)w, (uint32_t)h};
+	if(extent.width < caps.minImageExtent.width)
+		extent.width = caps.minImageExtent.width;
+	else if(extent.width > caps.maxImageExtent.width)
+		extent.width = caps.maxImageExtent.width;
+	if(extent.height < caps.minImageExtent.height)
+		extent.height = caps.minImageExtent.height;
+	else if(extent.height > caps.maxImageExtent.height)
+		extent.height = caps.maxImageExtent.height;
+	return extent;
+}
+
+static void swapchainCreateDepth(swapchain* sc, gpu_arena* arena)
+{
+	VkImageCreateInfo image_info = {};
+	image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	image_info.pNext = nullptr;
+	image_info.imageType = VK_IMAGE_TYPE_2D;
+	image_info.format = sc->depth_info.format;
+	image_info.extent.width = sc->extent.width;
+	image_info.extent.height = sc->extent.height;
+	image_info.extent.depth = 1;
+	image_info.mipLevels = 1;
+	image_info.arrayLayers = 1;
+	image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	image_info.tiling = sc->depth_info.tiling;
+	image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	image_info.usage = sc->depth_info.usage;
+	image_info.queueFamilyIndexCount = 0;
+	image_info.pQueueFamilyIndices = nullptr;
+	image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	image_info.flags = 0;
+	VkResult res = vkCreateImage(sc->device, &image_info, nullptr, &sc->depth);
+	assert(res == VK_SUCCESS);
+
+	bool ok = depthAlloc(arena, sc->depth, &sc->depth_info, &sc->depth_mem);
+	assert(ok);
+	uint32_t memory_type = arena->blocks[sc->depth_mem.block]->memory_type;
+	sc->depth_lazy = (arena->mem_props.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+
+	VkImageViewCreateInfo view_info = {};
+	view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_info.pNext = nullptr;
+	view_info.image = sc->depth;
+	view_info.format = sc->depth_info.format;
+	view_info.components.r = VK_COMPONENT_SWIZZLE_R;
+	view_info.components.g = VK_COMPONENT_SWIZZLE_G;
+	view_info.components.b = VK_COMPONENT_SWIZZLE_B;
+	view_info.components.a = VK_COMPONENT_SWIZZLE_A;
+	view_info.subresourceRange.aspectMask = sc->depth_info.aspect;
+	view_info.subresourceRange.baseMipLevel = 0;
+	view_info.subresourceRange.levelCount = 1;
+	view_info.subresourceRange.baseArrayLayer = 0;
+	view_info.subresourceRange.layerCount = 1;
+	view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_info.flags = 0;
+	res = vkCreateImageView(sc->device, &view_info, nullptr, &sc->depth_view);
+	assert(res == VK_SUCCESS);
+}
+
+static void swapchainCreateFramebuffers(swapchain* sc)
+{
+	sc->framebuffers.resize(sc->buffers.size());
+	for(uint32_t i = 0; i < sc->buffers.size(); i++)
+	{
+		VkImageView fb_attachments[2] = {sc->buffers[i].view, sc->depth_view};
+
+		VkFramebufferCreateInfo fb_info = {};
+		fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		fb_info.pNext = nullptr;
+		fb_info.renderPass = sc->render_pass;
+		fb_info.attachmentCount = 2;
+		fb_info.pAttachments = fb_attachments;
+		fb_info.width = sc->extent.width;
+		fb_info.height = sc->extent.height;
+		fb_info.layers = 1;
+
+		VkResult res = vkCreateFramebuffer(sc->device, &fb_info, nullptr, &sc->framebuffers[i]);
+		assert(res == VK_SUCCESS);
+	}
+}
+
+//swapchain + image views at the surface's current extent. false if there's nothing to create (minimized)
+static bool swapchainBuild(swapchain* sc, VkSwapchainKHR old)
+{
+	VkSurfaceCapabilitiesKHR caps;
+	VkResult res = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(sc->gpu, sc->surface, &caps);
+	assert(res == VK_SUCCESS);
+
+	VkExtent2D extent = swapchainSurfaceExtent(sc, caps);
+	if(extent.width == 0 || extent.height == 0)
+		return false;
+	sc->extent = extent;
+
+	VkSurfaceTransformFlagBitsKHR preTransform;
+	if(caps.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
+		preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+	else
+		preTransform = caps.currentTransform;
+
+	//find supported composite alpha mode- one is guarenteed to be sets
+	VkCompositeAlphaFlagBitsKHR compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+	VkCompositeAlphaFlagBitsKHR compositeAlphaFlags[4] = {
+		VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+		VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR,
+		VK_COMPOSITE_ALPHA_POST_MULTIPLIED_BIT_KHR,
+		VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR,
+	};
+	for(uint32_t i = 0; i < sizeof(compositeAlphaFlags) / sizeof(compositeAlphaFlags[0]); i++)
+	{
+		if(caps.supportedCompositeAlpha & compositeAlphaFlags[i])
+		{
+			compositeAlpha = compositeAlphaFlags[i];
+			break;
+		}
+	}
+
+	VkSwapchainCreateInfoKHR swapchain_ci = {};
+	swapchain_ci.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+	swapchain_ci.pNext = nullptr;
+	swapchain_ci.surface = sc->surface;
+	swapchain_ci.minImageCount = presentImageCount(caps, sc->present_mode);
+	swapchain_ci.imageFormat = sc->format;
+	swapchain_ci.imageExtent = extent;
+	swapchain_ci.preTransform = preTransform;
+	swapchain_ci.compositeAlpha = compositeAlpha;
+	swapchain_ci.imageArrayLayers = 1;
+	swapchain_ci.presentMode = sc->present_mode;
+	swapchain_ci.oldSwapchain = old;
+	swapchain_ci.clipped = VK_TRUE;
+	swapchain_ci.imageColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
+	swapchain_ci.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	if(sc->families[0] == sc->families[1])
+	{
+		swapchain_ci.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		swapchain_ci.queueFamilyIndexCount = 0;
+		swapchain_ci.pQueueFamilyIndices = nullptr;
+	}
+	else
+	{
+		//rare enough that ownership transfers for every image aren't worth it
+		swapchain_ci.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+		swapchain_ci.queueFamilyIndexCount = 2;
+		swapchain_ci.pQueueFamilyIndices = sc->families;
+	}
+	res = vkCreateSwapchainKHR(sc->device, &swapchain_ci, nullptr, &sc->swapchain);
+	assert(res == VK_SUCCESS);
+
+	uint32_t count;
+	res = vkGetSwapchainImagesKHR(sc->device, sc->swapchain, &count, nullptr);
+	assert(res == VK_SUCCESS);
+	std::vector<VkImage> images(count);
+	res = vkGetSwapchainImagesKHR(sc->device, sc->swapchain, &count, images.data());
+	assert(res == VK_SUCCESS);
+
+	sc->buffers.resize(count);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		sc->buffers[i].image = images[i];
+
+		VkImageViewCreateInfo color_image_view = {};
+		color_image_view.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		color_image_view.pNext = nullptr;
+		color_image_view.flags = 0;
+		color_image_view.image = images[i];
+		color_image_view.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		color_image_view.format = sc->format;
+		color_image_view.components.r = VK_COMPONENT_SWIZZLE_R;
+		color_image_view.components.g = VK_COMPONENT_SWIZZLE_G;
+		color_image_view.components.b = VK_COMPONENT_SWIZZLE_B;
+		color_image_view.components.a = VK_COMPONENT_SWIZZLE_A;
+		color_image_view.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		color_image_view.subresourceRange.baseMipLevel = 0;
+		color_image_view.subresourceRange.levelCount = 1;
+		color_image_view.subresourceRange.baseArrayLayer = 0;
+		color_image_view.subresourceRange.layerCount = 1;
+		res = vkCreateImageView(sc->device, &color_image_view, nullptr, &sc->buffers[i].view);
+		assert(res == VK_SUCCESS);
+	}
+	return true;
+}
+
+static void swapchainInitCommon(swapchain* sc, VkPhysicalDevice gpu, VkDevice device, const depth_config* depth)
+{
+	sc->device = device;
+	sc->gpu = gpu;
+	sc->surface = VK_NULL_HANDLE;
+	sc->window = nullptr;
+	sc->families[0] = sc->families[1] = 0;
+	sc->swapchain = VK_NULL_HANDLE;
+	sc->render_pass = VK_NULL_HANDLE;
+	sc->resizes = 0;
+	sc->resize_ms = 0.0;
+	sc->resize_max_ms = 0.0;
+	sc->depth_info = *depth;
+}
+
+//swapchain, views and depth. the framebuffers come once there's a render pass (swapchainSetRenderPass)
+void swapchainInit(swapchain* sc, gpu_arena* arena, VkPhysicalDevice gpu, VkDevice device, VkSurfaceKHR surface, SDL_Window* window,
+				   const char* present_strategy, uint32_t graphics_family, uint32_t present_family, const depth_config* depth)
+{
+	swapchainInitCommon(sc, gpu, device, depth);
+	sc->surface = surface;
+	sc->window = window;
+	sc->families[0] = graphics_family;
+	sc->families[1] = present_family;
+
+	//R8G8B8A8 if the surface has it, whatever comes first otherwise
+	uint32_t formatCount;
+	VkResult res = vkGetPhysicalDeviceSurfaceFormatsKHR(gpu, surface, &formatCount, nullptr);
+	assert(res == VK_SUCCESS && formatCount);
+	std::vector<VkSurfaceFormatKHR> surfFormats(formatCount);
+	res = vkGetPhysicalDeviceSurfaceFormatsKHR(gpu, surface, &formatCount, surfFormats.data());
+	assert(res == VK_SUCCESS);
+	sc->format = surfFormats[0].format;
+	for(uint32_t i = 0; i < formatCount; i++)
+	{
+		if(surfFormats[i].format == VK_FORMAT_R8G8B8A8_UNORM)
+			sc->format = VK_FORMAT_R8G8B8A8_UNORM;
+	}
+
+	//fifo unless asked otherwise, every strategy falls back to it (see present.h)
+	if(!presentSelectMode(gpu, surface, present_strategy, &sc->present_mode))
+		printf("unknown present strategy %s\n", present_strategy);
+	printf("present mode: %s\n", presentModeName(sc->present_mode));
+
+	bool ok = swapchainBuild(sc, VK_NULL_HANDLE);
+	assert(ok);
+	printf("w:%d h:%d\n", sc->extent.width, sc->extent.height);
+	swapchainCreateDepth(sc, arena);
+}
+
+//the frames in flight render into offscreen's images instead, these never get rebuilt
+void swapchainInitHeadless(swapchain* sc, gpu_arena* arena, VkPhysicalDevice gpu, VkDevice device, const offscreen* off, const depth_config* depth)
+{
+	swapchainInitCommon(sc, gpu, device, depth);
+	sc->format = OFFSCREEN_FORMAT;
+	sc->present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR; //unused, nothing is presented
+	sc->extent = off->extent;
+	sc->buffers.resize(FRAMES_IN_FLIGHT);
+	for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		sc->buffers[i].image = off->targets[i].image;
+		sc->buffers[i].view = off->targets[i].view;
+	}
+	swapchainCreateDepth(sc, arena);
+}
+
+void swapchainSetRenderPass(swapchain* sc, VkRenderPass render_pass)
+{
+	sc->render_pass = render_pass;
+	swapchainCreateFramebuffers(sc);
+}
+
+//rebuilds everything at the surface's current extent, the old set goes to deletions tagged with frame.
+//false (and nothing changes) while the surface has no area
+bool swapchainRecreate(swapchain* sc, gpu_arena* arena, deletion_queue* deletions, uint64_t frame)
+{
+	assert(sc->surface != VK_NULL_HANDLE);
+	auto start = std::chrono::high_resolution_clock::now();
+
+	VkSwapchainKHR old = sc->swapchain;
+	std::vector<swap_chain_buffer> old_buffers = sc->buffers;
+	if(!swapchainBuild(sc, old))
+		return false;
+
+	//dependents first
+	for(VkFramebuffer fb : sc->framebuffers)
+		deleteFramebuffer(deletions, frame, fb);
+	for(const swap_chain_buffer& b : old_buffers)
+		deleteImageView(deletions, frame, b.view);
+	deleteImageView(deletions, frame, sc->depth_view);
+	deleteImage(deletions, frame, sc->depth, &sc->depth_mem);
+	deleteSwapchain(deletions, frame, old);
+
+	swapchainCreateDepth(sc, arena);
+	swapchainCreateFramebuffers(sc);
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	sc->resizes++;
+	sc->resize_ms += ms;
+	if(ms > sc->resize_max_ms)
+		sc->resize_max_ms = ms;
+	printf("resized to %ux%u, %zu images, %.3f ms\n", sc->extent.width, sc->extent.height, sc->buffers.size(), ms);
+	return true;
+}
+
+void swapchainPrintStats(swapchain* sc)
+{
+	if(!sc->resizes)
+		return;
+	printf("resize: %u, hitch %.3f ms avg, %.3f ms max\n", sc->resizes, sc->resize_ms / sc->resizes, sc->resize_max_ms);
+}
+
+//the device has to be idle
+void swapchainDestroy(swapchain* sc, gpu_arena* arena)
+{
+	for(VkFramebuffer fb : sc->framebuffers)
+		vkDestroyFramebuffer(sc->device, fb, nullptr);
+	vkDestroyImageView(sc->device, sc->depth_view, nullptr);
+	vkDestroyImage(sc->device, sc->depth, nullptr);
+	arenaFree(arena, &sc->depth_mem);
+
+	//headless, the images and views are offscreen's
+	if(sc->swapchain != VK_NULL_HANDLE)
+	{
+		for(const swap_chain_buffer& b : sc->buffers)
+			vkDestroyImageView(sc->device, b.view, nullptr);
+		vkDestroySwapchainKHR(sc->device, sc->swapchain, nullptr);
+	}
+}
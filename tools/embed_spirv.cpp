@@ -0,0 +1,149 @@
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cctype>
+
+#include "shader_reflect.h"
+
+/*
+embed_spirv out.h a.vert.spv b.frag.spv ...
+
+the build step after glslangValidator (see CMakeLists.txt): reads every module, reflects it and
+writes one header with the words as constexpr arrays and the reflection as constexpr
+shader_blobs (see shader_reflect.h). a.vert.spv becomes a_vert_spv[] and a_vert.
+
+fails the build if a file can't be read or isn't SPIR-V.
+*/
+
+static bool readModule(const char* path, std::vector<uint32_t>* words)
+{
+	FILE* f = fopen(path, "rb");
+	if(!f)
+		return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	words->resize(size > 0 ? size / sizeof(uint32_t) : 0);
+	bool ok = size > 0 && size % sizeof(uint32_t) == 0 && fread(words->data(), 1, size, f) == (size_t)size;
+	fclose(f);
+	return ok;
+}
+
+//a.vert.spv -> a.vert
+static std::string shaderName(const char* path)
+{
+	std::string name = path;
+	size_t slash = name.find_last_of("/\\");
+	if(slash != std::string::npos)
+		name = name.substr(slash + 1);
+	if(name.size() > 4 && name.compare(name.size() - 4, 4, ".spv") == 0)
+		name.resize(name.size() - 4);
+	return name;
+}
+
+static std::string symbolName(const std::string& name)
+{
+	std::string symbol = name;
+	for(char& c : symbol)
+	{
+		if(!isalnum((unsigned char)c))
+			c = '_';
+	}
+	return symbol;
+}
+
+static const char* stageName(VkShaderStageFlagBits stage)
+{
+	switch(stage)
+	{
+	case VK_SHADER_STAGE_VERTEX_BIT: return "VK_SHADER_STAGE_VERTEX_BIT";
+	case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT: return "VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT";
+	case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT: return "VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT";
+	case VK_SHADER_STAGE_GEOMETRY_BIT: return "VK_SHADER_STAGE_GEOMETRY_BIT";
+	case VK_SHADER_STAGE_FRAGMENT_BIT: return "VK_SHADER_STAGE_FRAGMENT_BIT";
+	case VK_SHADER_STAGE_COMPUTE_BIT: return "VK_SHADER_STAGE_COMPUTE_BIT";
+	default: return "VK_SHADER_STAGE_ALL";
+	}
+}
+
+static const char* descriptorName(VkDescriptorType type)
+{
+	switch(type)
+	{
+	case VK_DESCRIPTOR_TYPE_SAMPLER: return "VK_DESCRIPTOR_TYPE_SAMPLER";
+	case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER: return "VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER";
+	case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE: return "VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE";
+	case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: return "VK_DESCRIPTOR_TYPE_STORAGE_IMAGE";
+	case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER: return "VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER";
+	case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER: return "VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER";
+	case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER: return "VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER";
+	case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER: return "VK_DESCRIPTOR_TYPE_STORAGE_BUFFER";
+	default: return "VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT";
+	}
+}
+
+int main(int argc, char const *argv[])
+{
+	if(argc < 3)
+	{
+		fprintf(stderr, "usage: %s out.h shader.spv...\n", argv[0]);
+		return 1;
+	}
+
+	std::string out = "#pragma once\n\n//generated by tools/embed_spirv.cpp from shaders/, don't edit\n\n#include \"shader_reflect.h\"\n";
+	std::string all;
+	for(int i = 2; i < argc; i++)
+	{
+		std::vector<uint32_t> words;
+		shader_reflection r;
+		if(!readModule(argv[i], &words))
+		{
+			fprintf(stderr, "embed_spirv: can't read %s\n", argv[i]);
+			return 1;
+		}
+		if(!shaderReflect(words.data(), words.size() * sizeof(uint32_t), &r))
+		{
+			fprintf(stderr, "embed_spirv: %s isn't a SPIR-V module this can reflect\n", argv[i]);
+			return 1;
+		}
+
+		std::string name = shaderName(argv[i]);
+		std::string symbol = symbolName(name);
+		char line[256];
+
+		out += "\nstatic constexpr uint32_t " + symbol + "_spv[] = {";
+		for(size_t w = 0; w < words.size(); w++)
+		{
+			snprintf(line, sizeof(line), "%s0x%08X,", w % 8 ? " " : "\n\t", words[w]);
+			out += line;
+		}
+		out += "\n};\n";
+
+		out += "static constexpr shader_blob " + symbol + " = {\"" + name + "\", " + symbol + "_spv, sizeof(" + symbol + "_spv), {" + stageName(r.stage) + ", ";
+		snprintf(line, sizeof(line), "%u, {", r.binding_count);
+		out += line;
+		for(uint32_t b = 0; b < r.binding_count; b++)
+		{
+			const shader_binding& s = r.bindings[b];
+			snprintf(line, sizeof(line), "%s{%u, %u, %s, %u, %s}", b ? ", " : "", s.set, s.binding, descriptorName(s.type), s.count, stageName(r.stage));
+			out += line;
+		}
+		snprintf(line, sizeof(line), "}, %u, %u, 0x%X}};\n", r.push_offset, r.push_size, r.spec_ids);
+		out += line;
+		all += (all.empty() ? "" : ", ") + std::string("&") + symbol;
+
+		shaderPrintReflection(name.c_str(), &r);
+	}
+	out += "\nstatic constexpr const shader_blob* embedded_shaders[] = {" + all + "};\n";
+
+	FILE* f = fopen(argv[1], "wb");
+	if(!f || fwrite(out.data(), 1, out.size(), f) != out.size())
+	{
+		fprintf(stderr, "embed_spirv: can't write %s\n", argv[1]);
+		return 1;
+	}
+	fclose(f);
+	return 0;
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <glm/mat4x4.hpp>
+
+#include "gpu_arena.h"
+#include "frame_loop.h"
+#include "mvp_batch.h"
+#include "descriptors.h"
+
+/*
+per-object uniform ring
+
+instead of a buffer + descriptor set per object there's one host visible buffer, split
+into a region per frame in flight, each region holding a slot per object:
+
+	| frame 0: slot 0 | slot 1 | ... | frame 1: slot 0 | slot 1 | ... |
+
+slots are padded out to minUniformBufferOffsetAlignment. draws bind one descriptor set
+(UNIFORM_BUFFER_DYNAMIC, range = one slot, see uniformRingDescriptor) and pick their slot with
+a dynamic offset in vkCmdBindDescriptorSets, so no descriptor updates per object. the layout
+comes from the layout cache and the set from the per frame pools (descriptors.h). bindless
+draws see each frame's region as its own storage buffer instead (uniformRingFrameOffset, and
+minStorageBufferOffsetAlignment pads the regions) and index its slots (uniformRingElement).
+
+a frame only writes its own region, and the frame fence (frame_loop.h) makes sure the
+gpu is done reading that region before we come back around to it.
+
+the memory is mapped write-combined on most hardware: write slots front to back, and
+never read them back. the MVPs are computed straight into the slots (mvp_batch.h).
+*/
+
+typedef struct {
+	VkDevice device;
+	VkBuffer buffer;
+	gpu_allocation mem;
+	uint8_t* mapped;
+	VkDeviceSize stride; //bytes per slot
+	VkDeviceSize frame_size; //bytes per frame region
+	uint32_t capacity; //slots per frame
+	bool coherent;
+
+	VkDeviceSize range; //the MVP in a slot, without the padding
+	VkDescriptorSetLayout set_layout; //owned by the layout cache
+
+	//cost of the last uniformRingWriteMVPs
+	uint32_t written;
+	double write_ms;
+} uniform_ring;
+
+
+void uniformRingInit(uniform_ring* ring, gpu_arena* arena, VkPhysicalDevice gpu, VkDevice device, uint32_t capacity, VkDeviceSize slot_size,
+					 descriptor_layout_cache* layouts)
+{
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(gpu, &props);
+	VkDeviceSize align = props.limits.minUniformBufferOffsetAlignment ? props.limits.minUniformBufferOffsetAlignment : 1;
+	VkDeviceSize frame_align = std::max(align, props.limits.minStorageBufferOffsetAlignment);
+
+	ring->device = device;
+	ring->capacity = capacity;
+	ring->stride = (slot_size + align - 1) / align * align;
+	ring->range = slot_size;
+	ring->frame_size = (ring->stride * capacity + frame_align - 1) / frame_align * frame_align;
+	ring->written = 0;
+	ring->write_ms = 0.0;
+	assert(ring->frame_size * FRAMES_IN_FLIGHT <= UINT32_MAX); //dynamic offsets are 32 bit
+
+	VkBufferCreateInfo buf_info = {};
+	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buf_info.pNext = nullptr;
+	buf_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT; //storage for bindless draws (bindless.h)
+	buf_info.size = ring->frame_size * FRAMES_IN_FLIGHT;
+	buf_info.queueFamilyIndexCount = 0;
+	buf_info.pQueueFamilyIndices = nullptr;
+	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	buf_info.flags = 0;
+	VkResult res = vkCreateBuffer(device, &buf_info, nullptr, &ring->buffer);
+	assert(res == VK_SUCCESS);
+
+	//prefer memory the gpu reads fast that we can still write (BAR/UMA), then plain host memory
+	ring->coherent = true;
+	if(!arenaAllocBuffer(arena, ring->buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &ring->mem)
+		&& !arenaAllocBuffer(arena, ring->buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &ring->mem))
+	{
+		ring->coherent = false;
+		bool ok = arenaAllocBuffer(arena, ring->buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &ring->mem);
+		assert(ok);
+	}
+	ring->mapped = (uint8_t*)ring->mem.mapped;
+
+	VkDescriptorSetLayoutBinding binding = {};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	binding.descriptorCount = 1;
+	binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	binding.pImmutableSamplers = nullptr;
+	ring->set_layout = descriptorLayoutGet(layouts, &binding, 1);
+}
+
+//what the draws' set holds, for descriptorsGet
+descriptor_write uniformRingDescriptor(const uniform_ring* ring)
+{
+	return descriptorBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, ring->buffer, 0, ring->range);
+}
+
+//dynamic offset of an object's slot for this frame
+uint32_t uniformRingOffset(const uniform_ring* ring, uint32_t frame, uint32_t object)
+{
+	return (uint32_t)(ring->frame_size * frame + ring->stride * object);
+}
+
+//where a frame's region starts, for a descriptor that covers just that region
+VkDeviceSize uniformRingFrameOffset(const uniform_ring* ring, uint32_t frame)
+{
+	return ring->frame_size * frame;
+}
+
+//an object's slot as an index into its frame's region read as an array of MVPs (bindless draws,
+//see bindless.h). exact, the stride is slot_size padded to a power of two alignment
+uint32_t uniformRingElement(const uniform_ring* ring, uint32_t object)
+{
+	assert(ring->stride % sizeof(glm::mat4) == 0);
+	return (uint32_t)(ring->stride * object / sizeof(glm::mat4));
+}
+
+void* uniformRingSlot(uniform_ring* ring, uint32_t frame, uint32_t object)
+{
+	return ring->mapped + uniformRingOffset(ring, frame, object);
+}
+
+//writes view_proj * model[objects[i]] into slot i of this frame's region for i in [0, count),
+//objects == nullptr writes model[i] instead
+void uniformRingWriteMVPs(uniform_ring* ring, uint32_t frame, const glm::mat4& view_proj, const object_transforms* models,
+						  const uint32_t* objects, uint32_t count)
+{
+	assert(count <= ring->capacity);
+	auto start = std::chrono::high_resolution_clock::now();
+
+	uint8_t* dst = (uint8_t*)uniformRingSlot(ring, frame, 0);
+	if(count && objects)
+		mvpBatchIndexed(view_proj, models, objects, count, dst, ring->stride);
+	else if(count)
+		mvpBatch(view_proj, models, 0, count, dst, ring->stride);
+
+	if(!ring->coherent && count)
+	{
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.pNext = nullptr;
+		range.memory = ring->mem.mem;
+		range.offset = 0;
+		range.size = VK_WHOLE_SIZE;
+		vkFlushMappedMemoryRanges(ring->device, 1, &range);
+	}
+
+	ring->written = count;
+	ring->write_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void uniformRingDestroy(uniform_ring* ring, gpu_arena* arena)
+{
+	vkDestroyBuffer(ring->device, ring->buffer, nullptr);
+	arenaFree(arena, &ring->mem);
+}
+
+
+//--bench-uniform: per object cost of computing and writing the MVPs into the ring
+void uniformRingBenchmark(gpu_arena* arena, VkPhysicalDevice gpu, VkDevice device, uint32_t count)
+{
+	descriptor_layout_cache layouts;
+	descriptorLayoutCacheInit(&layouts, device);
+	uniform_ring ring;
+	uniformRingInit(&ring, arena, gpu, device, count, sizeof(glm::mat4), &layouts);
+
+	object_transforms models;
+	transformsInit(&models, count);
+	for(uint32_t i = 0; i < count; i++)
+		transformsSet(&models, i, glm::mat4(1.0f));
+	glm::mat4 view_proj(1.0f);
+
+	const uint32_t iterations = 20;
+	double total = 0.0;
+	for(uint32_t i = 0; i < iterations; i++)
+	{
+		uniformRingWriteMVPs(&ring, i % FRAMES_IN_FLIGHT, view_proj, &models, nullptr, count);
+		total += ring.write_ms;
+	}
+	printf("uniform ring: %u objects, stride %llu bytes, %s kernel, write %.3f ms/frame (%.1f ns/object)\n",
+		count, (unsigned long long)ring.stride, mvpKernelName(), total / iterations, total * 1e6 / iterations / count);
+
+	uniformRingDestroy(&ring, arena);
+	descriptorLayoutCacheDestroy(&layouts);
+}
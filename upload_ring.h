@@ -0,0 +1,453 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+#include "gpu_arena.h"
+
+/*
+staging upload ring
+
+one big host visible buffer, mapped for its whole life. uploads get memcpy'd into it
+back to back and remembered as pending copies; uploadFlush() records all of them into a
+single command buffer (one vkCmdCopyBuffer per destination, however many regions) and
+submits it without waiting.
+
+every flush is a "batch" with its own fence and the ring position it ended at. ring
+space is handed back when a batch's fence has signaled, which we just poll, so normally
+nothing ever blocks. only if the ring is completely full do we wait on the oldest batch
+(counted in stalls, if that number goes up the ring is too small).
+
+the copies end with a barrier making the transfer writes visible to everything after
+it on the queue, so anything submitted after the flush can just use the data.
+
+positions are 64 bit running totals (never wrap), the actual offset is total % size.
+*/
+
+#define UPLOAD_RING_BATCHES 8
+
+typedef struct {
+	VkBuffer dst;
+	VkBufferCopy region;
+} upload_buffer_copy;
+
+typedef struct {
+	VkImage dst;
+	VkBufferImageCopy region;
+	VkImageLayout final_layout;
+} upload_image_copy;
+
+typedef struct {
+	VkCommandBuffer cmd;
+	VkFence fence;
+	uint64_t end; //ring position this batch wrote up to
+	bool in_flight;
+} upload_batch;
+
+typedef struct {
+	VkDevice device;
+	VkQueue queue;
+	VkBuffer buffer;
+	gpu_allocation mem;
+	uint8_t* mapped;
+	VkDeviceSize size;
+	VkDeviceSize align;
+	bool coherent;
+
+	uint64_t head; //next free byte
+	uint64_t tail; //oldest byte still in use by the gpu
+	uint64_t batch_start;
+
+	std::vector<upload_buffer_copy> buffer_copies;
+	std::vector<upload_image_copy> image_copies;
+
+	VkCommandPool pool;
+	upload_batch batches[UPLOAD_RING_BATCHES];
+	uint32_t next_batch;
+
+	uint64_t bytes;
+	uint64_t uploads;
+	uint64_t flushes;
+	uint64_t stalls;
+} upload_ring;
+
+
+void uploadInit(upload_ring* ring, gpu_arena* arena, VkPhysicalDevice gpu, VkDevice device, VkQueue queue, uint32_t queue_family, VkDeviceSize size)
+{
+	ring->device = device;
+	ring->queue = queue;
+	ring->size = size;
+	ring->head = ring->tail = ring->batch_start = 0;
+	ring->next_batch = 0;
+	ring->bytes = ring->uploads = ring->flushes = ring->stalls = 0;
+
+	//buffer->image copies want offsets aligned to the texel size and 4, 16 covers every format we use
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(gpu, &props);
+	ring->align = props.limits.optimalBufferCopyOffsetAlignment;
+	if(ring->align < 16)
+		ring->align = 16;
+
+	VkBufferCreateInfo buf_info = {};
+	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buf_info.pNext = nullptr;
+	buf_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	buf_info.size = size;
+	buf_info.queueFamilyIndexCount = 0;
+	buf_info.pQueueFamilyIndices = nullptr;
+	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	buf_info.flags = 0;
+	VkResult res = vkCreateBuffer(device, &buf_info, nullptr, &ring->buffer);
+	assert(res == VK_SUCCESS);
+
+	ring->coherent = arenaAllocBuffer(arena, ring->buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &ring->mem);
+	if(!ring->coherent)
+	{
+		bool ok = arenaAllocBuffer(arena, ring->buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &ring->mem);
+		assert(ok);
+	}
+	ring->mapped = (uint8_t*)ring->mem.mapped;
+	assert(ring->mapped);
+
+	VkCommandPoolCreateInfo cmd_pool_info = {};
+	cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cmd_pool_info.pNext = nullptr;
+	cmd_pool_info.queueFamilyIndex = queue_family;
+	cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	res = vkCreateCommandPool(device, &cmd_pool_info, nullptr, &ring->pool);
+	assert(res == VK_SUCCESS);
+
+	for(uint32_t i = 0; i < UPLOAD_RING_BATCHES; i++)
+	{
+		VkCommandBufferAllocateInfo cmd_info = {};
+		cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		cmd_info.pNext = nullptr;
+		cmd_info.commandPool = ring->pool;
+		cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		cmd_info.commandBufferCount = 1;
+		res = vkAllocateCommandBuffers(device, &cmd_info, &ring->batches[i].cmd);
+		assert(res == VK_SUCCESS);
+
+		VkFenceCreateInfo fence_info = {};
+		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fence_info.pNext = nullptr;
+		fence_info.flags = 0;
+		res = vkCreateFence(device, &fence_info, nullptr, &ring->batches[i].fence);
+		assert(res == VK_SUCCESS);
+		ring->batches[i].in_flight = false;
+		ring->batches[i].end = 0;
+	}
+}
+
+//hands back ring space of every batch that finished. wait = block on the oldest one if nothing has
+static void uploadReclaim(upload_ring* ring, bool wait)
+{
+	//batches retire in submission order, oldest is the one after the newest
+	for(uint32_t n = 0; n < UPLOAD_RING_BATCHES; n++)
+	{
+		upload_batch& b = ring->batches[(ring->next_batch + n) % UPLOAD_RING_BATCHES];
+		if(!b.in_flight)
+			continue;
+		VkResult res = vkGetFenceStatus(ring->device, b.fence);
+		if(res == VK_NOT_READY && wait)
+		{
+			ring->stalls++;
+			res = vkWaitForFences(ring->device, 1, &b.fence, VK_TRUE, UINT64_MAX);
+			wait = false;
+		}
+		if(res != VK_SUCCESS)
+			break;
+		b.in_flight = false;
+		ring->tail = b.end;
+	}
+}
+
+void uploadFlush(upload_ring* ring);
+
+//reserves size bytes of ring space, returns the offset in the ring buffer
+static VkDeviceSize uploadReserve(upload_ring* ring, VkDeviceSize size)
+{
+	assert(size <= ring->size);
+	for(;;)
+	{
+		uint64_t start = (ring->head + ring->align - 1) / ring->align * ring->align;
+		//can't straddle the end of the buffer, skip to the start
+		if(start % ring->size + size > ring->size)
+			start = (start / ring->size + 1) * ring->size;
+
+		if(start + size - ring->tail <= ring->size)
+		{
+			ring->head = start + size;
+			return start % ring->size;
+		}
+
+		//full. try what already finished, then our own pending copies, then wait
+		uploadReclaim(ring, false);
+		if(start + size - ring->tail <= ring->size)
+			continue;
+		if(ring->head != ring->batch_start)
+			uploadFlush(ring);
+		uploadReclaim(ring, true);
+
+		//everything's done but it still won't fit after the current position, start over at offset 0
+		if(ring->tail == ring->head)
+			ring->head = ring->tail = ring->batch_start = (ring->head / ring->size + 1) * ring->size;
+	}
+}
+
+void uploadBuffer(upload_ring* ring, VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size)
+{
+	VkDeviceSize offset = uploadReserve(ring, size);
+	memcpy(ring->mapped + offset, data, size);
+
+	upload_buffer_copy copy;
+	copy.dst = dst;
+	copy.region.srcOffset = offset;
+	copy.region.dstOffset = dst_offset;
+	copy.region.size = size;
+	ring->buffer_copies.push_back(copy);
+	ring->bytes += size;
+	ring->uploads++;
+}
+
+//whole mip 0 of a 2d color image, left in final_layout
+void uploadImage(upload_ring* ring, VkImage dst, VkExtent3D extent, const void* data, VkDeviceSize size, VkImageLayout final_layout)
+{
+	VkDeviceSize offset = uploadReserve(ring, size);
+	memcpy(ring->mapped + offset, data, size);
+
+	upload_image_copy copy;
+	copy.dst = dst;
+	copy.final_layout = final_layout;
+	copy.region.bufferOffset = offset;
+	copy.region.bufferRowLength = 0;
+	copy.region.bufferImageHeight = 0;
+	copy.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	copy.region.imageSubresource.mipLevel = 0;
+	copy.region.imageSubresource.baseArrayLayer = 0;
+	copy.region.imageSubresource.layerCount = 1;
+	copy.region.imageOffset = {0, 0, 0};
+	copy.region.imageExtent = extent;
+	ring->image_copies.push_back(copy);
+	ring->bytes += size;
+	ring->uploads++;
+}
+
+//submits everything uploaded since the last flush as one batch, doesn't wait for it
+void uploadFlush(upload_ring* ring)
+{
+	if(ring->buffer_copies.empty() && ring->image_copies.empty())
+		return;
+
+	upload_batch& b = ring->batches[ring->next_batch];
+	if(b.in_flight)
+	{
+		//every batch slot is busy, only happens with lots of tiny flushes
+		ring->stalls++;
+		vkWaitForFences(ring->device, 1, &b.fence, VK_TRUE, UINT64_MAX);
+		b.in_flight = false;
+		ring->tail = b.end;
+	}
+	VkResult res = vkResetFences(ring->device, 1, &b.fence);
+	assert(res == VK_SUCCESS);
+
+	if(!ring->coherent)
+	{
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.pNext = nullptr;
+		range.memory = ring->mem.mem;
+		range.offset = 0;
+		range.size = VK_WHOLE_SIZE;
+		vkFlushMappedMemoryRanges(ring->device, 1, &range);
+	}
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.pNext = nullptr;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	begin_info.pInheritanceInfo = nullptr;
+	res = vkBeginCommandBuffer(b.cmd, &begin_info);
+	assert(res == VK_SUCCESS);
+
+	//one copy command per destination buffer
+	std::stable_sort(ring->buffer_copies.begin(), ring->buffer_copies.end(),
+		[](const upload_buffer_copy& a, const upload_buffer_copy& b){ return a.dst < b.dst; });
+	std::vector<VkBufferCopy> regions;
+	for(size_t i = 0; i < ring->buffer_copies.size(); )
+	{
+		VkBuffer dst = ring->buffer_copies[i].dst;
+		regions.clear();
+		for(; i < ring->buffer_copies.size() && ring->buffer_copies[i].dst == dst; i++)
+			regions.push_back(ring->buffer_copies[i].region);
+		vkCmdCopyBuffer(b.cmd, ring->buffer, dst, (uint32_t)regions.size(), regions.data());
+	}
+
+	for(upload_image_copy& copy : ring->image_copies)
+	{
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.pNext = nullptr;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = copy.dst;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		vkCmdPipelineBarrier(b.cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		vkCmdCopyBufferToImage(b.cmd, ring->buffer, copy.dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy.region);
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = copy.final_layout;
+		vkCmdPipelineBarrier(b.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	//make the buffer writes visible to whatever comes later on this queue
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDEX_READ_BIT
+						  | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(b.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	res = vkEndCommandBuffer(b.cmd);
+	assert(res == VK_SUCCESS);
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = nullptr;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &b.cmd;
+	res = vkQueueSubmit(ring->queue, 1, &submit_info, b.fence);
+	assert(res == VK_SUCCESS);
+
+	b.in_flight = true;
+	b.end = ring->head;
+	ring->batch_start = ring->head;
+	ring->next_batch = (ring->next_batch + 1) % UPLOAD_RING_BATCHES;
+	ring->buffer_copies.clear();
+	ring->image_copies.clear();
+	ring->flushes++;
+
+	uploadReclaim(ring, false);
+}
+
+//blocks until every flushed batch is done
+void uploadWaitIdle(upload_ring* ring)
+{
+	for(uint32_t i = 0; i < UPLOAD_RING_BATCHES; i++)
+	{
+		upload_batch& b = ring->batches[i];
+		if(b.in_flight)
+			vkWaitForFences(ring->device, 1, &b.fence, VK_TRUE, UINT64_MAX);
+	}
+	uploadReclaim(ring, false);
+}
+
+void uploadDestroy(upload_ring* ring, gpu_arena* arena)
+{
+	uploadFlush(ring);
+	uploadWaitIdle(ring);
+	for(uint32_t i = 0; i < UPLOAD_RING_BATCHES; i++)
+		vkDestroyFence(ring->device, ring->batches[i].fence, nullptr);
+	vkDestroyCommandPool(ring->device, ring->pool, nullptr);
+	vkDestroyBuffer(ring->device, ring->buffer, nullptr);
+	arenaFree(arena, &ring->mem);
+}
+
+
+//--bench-upload: count uploads of size bytes, through the ring into a device local buffer vs
+//map/memcpy/unmap of a host visible buffer per upload
+void uploadBenchmark(gpu_arena* arena, VkPhysicalDevice gpu, VkDevice device, VkQueue queue, uint32_t queue_family, uint32_t count, uint32_t size)
+{
+	VkPhysicalDeviceMemoryProperties memProps;
+	vkGetPhysicalDeviceMemoryProperties(gpu, &memProps);
+
+	std::vector<uint8_t> src(size);
+	for(uint32_t i = 0; i < size; i++)
+		src[i] = (uint8_t)i;
+	VkDeviceSize total = (VkDeviceSize)count * size;
+
+	VkBufferCreateInfo buf_info = {};
+	buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buf_info.pNext = nullptr;
+	buf_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	buf_info.size = total;
+	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	//naive: its own host visible memory, mapped and unmapped around every write
+	VkBuffer naive_buf;
+	VkResult res = vkCreateBuffer(device, &buf_info, nullptr, &naive_buf);
+	assert(res == VK_SUCCESS);
+	VkMemoryRequirements reqs;
+	vkGetBufferMemoryRequirements(device, naive_buf, &reqs);
+	VkMemoryAllocateInfo mem_alloc = {};
+	mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	mem_alloc.allocationSize = reqs.size;
+	bool found = memType(memProps, reqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &mem_alloc.memoryTypeIndex);
+	assert(found);
+	VkDeviceMemory naive_mem;
+	res = vkAllocateMemory(device, &mem_alloc, nullptr, &naive_mem);
+	assert(res == VK_SUCCESS);
+	vkBindBufferMemory(device, naive_buf, naive_mem, 0);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for(uint32_t i = 0; i < count; i++)
+	{
+		void* ptr;
+		res = vkMapMemory(device, naive_mem, (VkDeviceSize)i * size, size, 0, &ptr);
+		assert(res == VK_SUCCESS);
+		memcpy(ptr, src.data(), size);
+		vkUnmapMemory(device, naive_mem);
+	}
+	double naive_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	vkDestroyBuffer(device, naive_buf, nullptr);
+	vkFreeMemory(device, naive_mem, nullptr);
+
+	//ring: device local destination, flushed every 1024 uploads
+	VkBuffer dst;
+	res = vkCreateBuffer(device, &buf_info, nullptr, &dst);
+	assert(res == VK_SUCCESS);
+	gpu_allocation dst_mem;
+	bool ok = arenaAllocBuffer(arena, dst, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &dst_mem);
+	assert(ok);
+
+	upload_ring ring;
+	uploadInit(&ring, arena, gpu, device, queue, queue_family, 16 * 1024 * 1024);
+	start = std::chrono::high_resolution_clock::now();
+	for(uint32_t i = 0; i < count; i++)
+	{
+		uploadBuffer(&ring, dst, (VkDeviceSize)i * size, src.data(), size);
+		if(i % 1024 == 1023)
+			uploadFlush(&ring);
+	}
+	uploadFlush(&ring);
+	double submit_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	uploadWaitIdle(&ring);
+	double ring_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	double mb = total / (1024.0 * 1024.0);
+	printf("upload %u x %u bytes: naive map/memcpy/unmap %.1f MB/s (%.3f ms)\n", count, size, mb / (naive_ms / 1000.0), naive_ms);
+	printf("upload %u x %u bytes: ring %.1f MB/s to device local (%.3f ms, %.3f ms cpu), %llu flushes, %llu stalls\n",
+		count, size, mb / (ring_ms / 1000.0), ring_ms, submit_ms, (unsigned long long)ring.flushes, (unsigned long long)ring.stalls);
+
+	uploadDestroy(&ring, arena);
+	vkDestroyBuffer(device, dst, nullptr);
+	arenaFree(arena, &dst_mem);
+}